@@ -145,6 +145,7 @@
 #endif
 
 #include <string.h>
+#include <stdlib.h>
 #include <inttypes.h>
 #include <gst/base/gsttypefindhelper.h>
 #include "gstdashdemux.h"
@@ -170,6 +171,7 @@ enum
   PROP_MAX_BUFFERING_TIME,
   PROP_BANDWIDTH_USAGE,
   PROP_MAX_BITRATE,
+  PROP_AVERAGE_SETUP_TIME,
   PROP_LAST
 };
 
@@ -229,9 +231,9 @@ static void gst_dash_demux_stream_free (GstDashDemuxStream * stream);
 static void gst_dash_demux_reset (GstDashDemux * demux, gboolean dispose);
 #ifndef GST_DISABLE_GST_DEBUG
 static GstClockTime gst_dash_demux_get_buffering_time (GstDashDemux * demux);
+#endif
 static GstClockTime gst_dash_demux_stream_get_buffering_time (GstDashDemuxStream
     * stream);
-#endif
 static GstCaps *gst_dash_demux_get_input_caps (GstDashDemux * demux,
     GstActiveStream * stream);
 static GstPad *gst_dash_demux_create_pad (GstDashDemux * demux);
@@ -304,6 +306,12 @@ gst_dash_demux_class_init (GstDashDemuxClass * klass)
           1000, G_MAXUINT, DEFAULT_MAX_BITRATE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_AVERAGE_SETUP_TIME,
+      g_param_spec_uint64 ("average-setup-time", "Average setup time",
+          "Average time to set up the source element of a fragment download "
+          "in nanoseconds",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_dash_demux_change_state);
 
@@ -399,6 +407,12 @@ gst_dash_demux_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_MAX_BITRATE:
       g_value_set_uint (value, demux->max_bitrate);
       break;
+    case PROP_AVERAGE_SETUP_TIME:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint64 (value, demux->n_fetched ?
+          demux->setup_time / demux->n_fetched : 0);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -492,7 +506,6 @@ gst_dash_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
       GstClockTime current_pos, target_pos;
       guint current_sequence, current_period;
       GstActiveStream *active_stream;
-      GstMediaSegment *chunk;
       GstStreamPeriod *period;
       GSList *iter;
       gboolean update;
@@ -579,30 +592,16 @@ gst_dash_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
         /* Update the current sequence on all streams */
         for (iter = demux->streams; iter; iter = g_slist_next (iter)) {
           GstDashDemuxStream *stream = iter->data;
-          gint seg_i;
 
           active_stream =
               gst_mpdparser_get_active_stream_by_index (demux->client,
               stream->index);
-          current_pos = 0;
-          current_sequence = 0;
-          for (seg_i = 0; seg_i < active_stream->segments->len; seg_i++) {
-            chunk = g_ptr_array_index (active_stream->segments, seg_i);
-            current_pos = chunk->start_time;
-            /* current_sequence = chunk->number; */
-            GST_DEBUG_OBJECT (demux, "current_pos:%" GST_TIME_FORMAT
-                " <= target_pos:%" GST_TIME_FORMAT " duration:%"
-                GST_TIME_FORMAT, GST_TIME_ARGS (current_pos),
-                GST_TIME_ARGS (target_pos), GST_TIME_ARGS (chunk->duration));
-            if (current_pos <= target_pos
-                && target_pos < current_pos + chunk->duration) {
-              GST_DEBUG_OBJECT (demux,
-                  "selecting sequence %d for stream %" GST_PTR_FORMAT,
-                  current_sequence, stream);
-              break;
-            }
-            current_sequence++;
-          }
+          current_sequence =
+              gst_mpd_client_get_segment_index_for_position (demux->client,
+              active_stream, target_pos);
+          GST_DEBUG_OBJECT (demux,
+              "selecting sequence %u for stream %" GST_PTR_FORMAT,
+              current_sequence, stream);
           gst_mpd_client_set_segment_index (active_stream, current_sequence);
         }
 
@@ -1426,6 +1425,11 @@ gst_dash_demux_reset (GstDashDemux * demux, gboolean dispose)
   gst_segment_init (&demux->segment, GST_FORMAT_TIME);
   demux->last_manifest_update = GST_CLOCK_TIME_NONE;
   demux->cancelled = FALSE;
+
+  GST_OBJECT_LOCK (demux);
+  demux->n_fetched = 0;
+  demux->setup_time = 0;
+  GST_OBJECT_UNLOCK (demux);
 }
 
 #ifndef GST_DISABLE_GST_DEBUG
@@ -1446,6 +1450,7 @@ gst_dash_demux_get_buffering_time (GstDashDemux * demux)
     buffer_time = 0;
   return buffer_time;
 }
+#endif
 
 static GstClockTime
 gst_dash_demux_stream_get_buffering_time (GstDashDemuxStream * stream)
@@ -1456,7 +1461,6 @@ gst_dash_demux_stream_get_buffering_time (GstDashDemuxStream * stream)
 
   return (GstClockTime) level.time;
 }
-#endif
 
 static gboolean
 gst_dash_demux_all_streams_have_data (GstDashDemux * demux)
@@ -1473,6 +1477,73 @@ gst_dash_demux_all_streams_have_data (GstDashDemux * demux)
   return TRUE;
 }
 
+/* Sets up @new_client from scratch and makes it the current client, trying
+ * to transfer the stream position status from the old one */
+static GstFlowReturn
+gst_dash_demux_replace_client (GstDashDemux * demux, GstMpdClient * new_client)
+{
+  const gchar *period_id;
+  guint period_idx;
+  GSList *iter;
+
+  period_id = gst_mpd_client_get_period_id (demux->client);
+  period_idx = gst_mpd_client_get_period_index (demux->client);
+
+  /* setup video, audio and subtitle streams, starting from current Period */
+  if (!gst_mpd_client_setup_media_presentation (new_client)) {
+    /* TODO */
+  }
+
+  if (period_idx) {
+    if (!gst_mpd_client_set_period_id (new_client, period_id)) {
+      GST_DEBUG_OBJECT (demux, "Error setting up the updated manifest file");
+      return GST_FLOW_EOS;
+    }
+  } else {
+    if (!gst_mpd_client_set_period_index (new_client, period_idx)) {
+      GST_DEBUG_OBJECT (demux, "Error setting up the updated manifest file");
+      return GST_FLOW_EOS;
+    }
+  }
+
+  if (!gst_dash_demux_setup_mpdparser_streams (demux, new_client)) {
+    GST_ERROR_OBJECT (demux, "Failed to setup streams on manifest update");
+    return GST_FLOW_ERROR;
+  }
+
+  /* update the streams to play from the next segment */
+  for (iter = demux->streams; iter; iter = g_slist_next (iter)) {
+    GstDashDemuxStream *demux_stream = iter->data;
+    GstActiveStream *new_stream;
+    GstClockTime ts;
+
+    new_stream =
+        gst_mpdparser_get_active_stream_by_index (new_client,
+        demux_stream->index);
+
+    if (!new_stream) {
+      GST_DEBUG_OBJECT (demux,
+          "Stream of index %d is missing from manifest update",
+          demux_stream->index);
+      return GST_FLOW_EOS;
+    }
+
+    if (gst_mpd_client_get_next_fragment_timestamp (demux->client,
+            demux_stream->index, &ts)) {
+      gst_mpd_client_stream_seek (new_client, new_stream, ts);
+    } else if (gst_mpd_client_get_last_fragment_timestamp (demux->client,
+            demux_stream->index, &ts)) {
+      /* try to set to the old timestamp + 1 */
+      gst_mpd_client_stream_seek (new_client, new_stream, ts + 1);
+    }
+  }
+
+  gst_mpd_client_free (demux->client);
+  demux->client = new_client;
+
+  return GST_FLOW_OK;
+}
+
 static GstFlowReturn
 gst_dash_demux_refresh_mpd (GstDashDemux * demux)
 {
@@ -1517,77 +1588,24 @@ gst_dash_demux_refresh_mpd (GstDashDemux * demux)
         gst_buffer_map (buffer, &mapinfo, GST_MAP_READ);
 
         if (gst_mpd_parse (new_client, (gchar *) mapinfo.data, mapinfo.size)) {
-          const gchar *period_id;
-          guint period_idx;
-          GSList *iter;
-
-          /* prepare the new manifest and try to transfer the stream position
-           * status from the old manifest client  */
+          GstFlowReturn ret;
 
           gst_buffer_unmap (buffer, &mapinfo);
           gst_buffer_unref (buffer);
 
           GST_DEBUG_OBJECT (demux, "Updating manifest");
 
-          period_id = gst_mpd_client_get_period_id (demux->client);
-          period_idx = gst_mpd_client_get_period_index (demux->client);
-
-          /* setup video, audio and subtitle streams, starting from current Period */
-          if (!gst_mpd_client_setup_media_presentation (new_client)) {
-            /* TODO */
-          }
-
-          if (period_idx) {
-            if (!gst_mpd_client_set_period_id (new_client, period_id)) {
-              GST_DEBUG_OBJECT (demux,
-                  "Error setting up the updated manifest file");
-              return GST_FLOW_EOS;
-            }
+          /* most updates only add segments or Periods, merge them into the
+           * current client and only set up everything again if that fails */
+          if (gst_mpd_client_merge_update (demux->client, new_client)) {
+            GST_DEBUG_OBJECT (demux, "Merged the manifest update");
+            gst_mpd_client_free (new_client);
           } else {
-            if (!gst_mpd_client_set_period_index (new_client, period_idx)) {
-              GST_DEBUG_OBJECT (demux,
-                  "Error setting up the updated manifest file");
-              return GST_FLOW_EOS;
-            }
-          }
-
-          if (!gst_dash_demux_setup_mpdparser_streams (demux, new_client)) {
-            GST_ERROR_OBJECT (demux, "Failed to setup streams on manifest "
-                "update");
-            return GST_FLOW_ERROR;
+            ret = gst_dash_demux_replace_client (demux, new_client);
+            if (ret != GST_FLOW_OK)
+              return ret;
           }
 
-          /* update the streams to play from the next segment */
-          for (iter = demux->streams; iter; iter = g_slist_next (iter)) {
-            GstDashDemuxStream *demux_stream = iter->data;
-            GstActiveStream *new_stream;
-            GstClockTime ts;
-
-            new_stream =
-                gst_mpdparser_get_active_stream_by_index (new_client,
-                demux_stream->index);
-
-            if (!new_stream) {
-              GST_DEBUG_OBJECT (demux,
-                  "Stream of index %d is missing from manifest update",
-                  demux_stream->index);
-              return GST_FLOW_EOS;
-            }
-
-            if (gst_mpd_client_get_next_fragment_timestamp (demux->client,
-                    demux_stream->index, &ts)) {
-              gst_mpd_client_stream_seek (new_client, new_stream, ts);
-            } else
-                if (gst_mpd_client_get_last_fragment_timestamp (demux->client,
-                    demux_stream->index, &ts)) {
-              /* try to set to the old timestamp + 1 */
-              gst_mpd_client_stream_seek (new_client, new_stream, ts + 1);
-            }
-          }
-
-          gst_mpd_client_free (demux->client);
-          demux->client = new_client;
-
           /* Send an updated duration message */
           duration =
               gst_mpd_client_get_media_presentation_duration (demux->client);
@@ -1794,6 +1812,56 @@ gst_dash_demux_resume_download_task (GstDashDemux * demux)
   gst_task_start (demux->download_task);
 }
 
+static gint
+_compare_bitrates (gconstpointer a, gconstpointer b)
+{
+  guint64 bitrate_a = *(const guint64 *) a;
+  guint64 bitrate_b = *(const guint64 *) b;
+
+  return bitrate_a < bitrate_b ? -1 : bitrate_a > bitrate_b;
+}
+
+/* Chooses among the bandwidths of the representations from the download
+ * rate and the amount of data queued for the stream */
+static guint64
+gst_dash_demux_stream_choose_bitrate (GstDashDemux * demux,
+    GstDashDemuxStream * stream, GstActiveStream * active_stream,
+    GList * rep_list)
+{
+  GstRepresentationNode *rep;
+  guint64 *bitrates, current_bitrate, bitrate;
+  guint n_bitrates = 0;
+  GList *iter;
+
+  bitrates = g_new (guint64, g_list_length (rep_list));
+  for (iter = rep_list; iter; iter = g_list_next (iter)) {
+    rep = iter->data;
+    if (rep)
+      bitrates[n_bitrates++] = rep->bandwidth;
+  }
+
+  if (n_bitrates == 0) {
+    g_free (bitrates);
+    return 0;
+  }
+
+  qsort (bitrates, n_bitrates, sizeof (guint64), _compare_bitrates);
+
+  current_bitrate = active_stream->cur_representation ?
+      active_stream->cur_representation->bandwidth : bitrates[0];
+
+  bitrate = gst_download_rate_choose_bitrate (&stream->dnl_rate, bitrates,
+      n_bitrates, current_bitrate,
+      gst_dash_demux_stream_get_buffering_time (stream),
+      demux->max_buffering_time,
+      gst_mpd_client_get_next_fragment_duration (demux->client,
+          active_stream), demux->bandwidth_usage);
+
+  g_free (bitrates);
+
+  return bitrate;
+}
+
 /* gst_dash_demux_select_representations:
  *
  * Select the most appropriate media representations based on current target 
@@ -1834,9 +1902,8 @@ gst_dash_demux_select_representations (GstDashDemux * demux)
     if (!rep_list)
       return FALSE;
 
-    bitrate =
-        gst_download_rate_get_current_rate (&stream->dnl_rate) *
-        demux->bandwidth_usage;
+    bitrate = gst_dash_demux_stream_choose_bitrate (demux, stream,
+        active_stream, rep_list);
     GST_DEBUG_OBJECT (demux, "Trying to change to bitrate: %" G_GUINT64_FORMAT,
         bitrate);
 
@@ -2172,6 +2239,11 @@ gst_dash_demux_get_next_fragment (GstDashDemux * demux,
         return FALSE;
       }
 
+      GST_OBJECT_LOCK (demux);
+      demux->n_fetched++;
+      demux->setup_time += download->download_setup_time;
+      GST_OBJECT_UNLOCK (demux);
+
       active_stream =
           gst_mpdparser_get_active_stream_by_index (demux->client, stream_idx);
       if (active_stream == NULL) {
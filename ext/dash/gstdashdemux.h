@@ -34,7 +34,7 @@
 #include <gst/base/gstadapter.h>
 #include <gst/base/gstdataqueue.h>
 #include "gstmpdparser.h"
-#include "gstdownloadrate.h"
+#include <gst/uridownloader/gstdownloadrate.h>
 #include <gst/uridownloader/gsturidownloader.h>
 
 G_BEGIN_DECLS
@@ -141,6 +141,10 @@ struct _GstDashDemux
 
   /* Manifest update */
   GstClockTime last_manifest_update;
+
+  /* Statistics, protected by the object lock */
+  guint64 n_fetched;
+  GstClockTime setup_time;      /* Total time spent setting up sources */
 };
 
 struct _GstDashDemuxClass
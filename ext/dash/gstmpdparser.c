@@ -132,7 +132,10 @@ static gchar *gst_mpdparser_build_URL_from_template (const gchar * url_template,
     const gchar * id, guint number, guint bandwidth, guint64 time);
 static gboolean gst_mpd_client_add_media_segment (GstActiveStream * stream,
     GstSegmentURLNode * url_node, guint number, guint64 start,
-    GstClockTime start_time, GstClockTime duration);
+    GstClockTime start_time, GstClockTime duration, guint64 scale_duration,
+    guint repeat);
+static GstMediaSegment *gst_mpd_client_find_media_segment (GstActiveStream *
+    stream, guint segment_idx, guint * repeat_idx);
 static const gchar *gst_mpdparser_mimetype_to_caps (const gchar * mimeType);
 static GstClockTime gst_mpd_client_get_segment_duration (GstMpdClient * client,
     GstActiveStream * stream);
@@ -1252,6 +1255,7 @@ gst_mpdparser_clone_s_node (GstSNode * pointer)
     clone = g_slice_new0 (GstSNode);
     if (clone) {
       clone->t = pointer->t;
+      clone->has_t = pointer->has_t;
       clone->d = pointer->d;
       clone->r = pointer->r;
     } else {
@@ -1275,7 +1279,8 @@ gst_mpdparser_parse_s_node (GQueue * queue, xmlNode * a_node)
   g_queue_push_tail (queue, new_s_node);
 
   GST_LOG ("attributes of S node:");
-  gst_mpdparser_get_xml_prop_unsigned_integer_64 (a_node, "t", 0,
+  new_s_node->has_t =
+      gst_mpdparser_get_xml_prop_unsigned_integer_64 (a_node, "t", 0,
       &new_s_node->t);
   gst_mpdparser_get_xml_prop_unsigned_integer_64 (a_node, "d", 0,
       &new_s_node->d);
@@ -2598,6 +2603,8 @@ gst_mpdparser_init_active_stream_segments (GstActiveStream * stream)
   g_assert (stream->segments == NULL);
   stream->segments = g_ptr_array_new ();
   g_ptr_array_set_free_func (stream->segments, (GDestroyNotify) gst_mpdparser_free_media_segment);
+  gst_segment_table_clear (&stream->segment_times);
+  gst_segment_table_clear (&stream->segment_numbers);
 }
 
 static void
@@ -2610,6 +2617,8 @@ gst_mpdparser_free_active_stream (GstActiveStream * active_stream)
     active_stream->queryURL = NULL;
     if (active_stream->segments)
       g_ptr_array_unref (active_stream->segments);
+    gst_segment_table_deinit (&active_stream->segment_times);
+    gst_segment_table_deinit (&active_stream->segment_numbers);
     g_slice_free (GstActiveStream, active_stream);
   }
 }
@@ -3012,16 +3021,24 @@ gst_mpdparser_get_chunk_by_index (GstMpdClient * client, guint indexStream,
 
   if (stream->segments) {
     GstMediaSegment *list_segment;
-    /* fixed list of segments */
-    if (indexChunk >= stream->segments->len)
+    guint repeat_idx;
+
+    /* fixed list of segments, possibly holding runs of segments of the
+     * same duration */
+    list_segment =
+        gst_mpd_client_find_media_segment (stream, indexChunk, &repeat_idx);
+    if (list_segment == NULL)
       return FALSE;
 
-    list_segment = g_ptr_array_index (stream->segments, indexChunk);
     segment->SegmentURL = list_segment->SegmentURL;
-    segment->number = list_segment->number;
-    segment->start = list_segment->start;
-    segment->start_time = list_segment->start_time;
+    segment->number = list_segment->number + repeat_idx;
+    segment->start =
+        list_segment->start + repeat_idx * list_segment->scale_duration;
+    segment->start_time =
+        list_segment->start_time + repeat_idx * list_segment->duration;
     segment->duration = list_segment->duration;
+    segment->scale_duration = list_segment->scale_duration;
+    segment->repeat = 0;
   } else {
     GstClockTime duration;
     g_return_val_if_fail (stream->cur_seg_template->MultSegBaseType->
@@ -3037,15 +3054,47 @@ gst_mpdparser_get_chunk_by_index (GstMpdClient * client, guint indexStream,
         + stream->cur_seg_template->MultSegBaseType->startNumber;
     segment->start_time = duration * indexChunk;
     segment->duration = duration;
+    segment->scale_duration = 0;
+    segment->repeat = 0;
     segment->SegmentURL = NULL;
   }
   return TRUE;
 }
 
+/* Returns the entry of the segment list of @stream holding the segment of
+ * index @segment_idx, and the position of that segment among the repeated
+ * segments of the entry in @repeat_idx */
+static GstMediaSegment *
+gst_mpd_client_find_media_segment (GstActiveStream * stream,
+    guint segment_idx, guint * repeat_idx)
+{
+  GstMediaSegment *first, *segment;
+  guint offset;
+  gint i;
+
+  if (stream->segments == NULL || stream->segments->len == 0)
+    return NULL;
+
+  first = g_ptr_array_index (stream->segments, 0);
+  i = gst_segment_table_lookup (&stream->segment_numbers,
+      (guint64) first->number + segment_idx);
+  if (i < 0)
+    return NULL;
+
+  segment = g_ptr_array_index (stream->segments, i);
+  offset = segment->number - first->number;
+  if (segment_idx > offset + segment->repeat)
+    return NULL;
+
+  *repeat_idx = segment_idx - offset;
+  return segment;
+}
+
 static gboolean
 gst_mpd_client_add_media_segment (GstActiveStream * stream,
     GstSegmentURLNode * url_node, guint number, guint64 start,
-    GstClockTime start_time, GstClockTime duration)
+    GstClockTime start_time, GstClockTime duration, guint64 scale_duration,
+    guint repeat)
 {
   GstMediaSegment *media_segment;
 
@@ -3062,8 +3111,12 @@ gst_mpd_client_add_media_segment (GstActiveStream * stream,
   media_segment->start = start;
   media_segment->start_time = start_time;
   media_segment->duration = duration;
+  media_segment->scale_duration = scale_duration;
+  media_segment->repeat = repeat;
 
   g_ptr_array_add (stream->segments, media_segment);
+  gst_segment_table_append (&stream->segment_times, start_time);
+  gst_segment_table_append (&stream->segment_numbers, number);
 
   return TRUE;
 }
@@ -3093,6 +3146,8 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
     g_ptr_array_unref (stream->segments);
     stream->segments = NULL;
   }
+  gst_segment_table_clear (&stream->segment_times);
+  gst_segment_table_clear (&stream->segment_numbers);
 
   stream_period = gst_mpdparser_get_stream_period (client);
   g_return_val_if_fail (stream_period != NULL, FALSE);
@@ -3129,7 +3184,7 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
       GST_DEBUG ("No useful SegmentList node for the current Representation");
       /* here we should have a single segment for each representation, whose URL is encoded in the baseURL element */
       if (!gst_mpd_client_add_media_segment (stream, NULL, 1, 0, PeriodStart,
-              PeriodEnd)) {
+              PeriodEnd, 0, 0)) {
         return FALSE;
       }
     } else {
@@ -3173,7 +3228,7 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
 
           for (j = 0; j <= S->r && SegmentURL != NULL; j++) {
             if (!gst_mpd_client_add_media_segment (stream, SegmentURL->data, i,
-                    start, start_time, duration)) {
+                    start, start_time, duration, S->d, 0)) {
               return FALSE;
             }
             i++;
@@ -3189,7 +3244,7 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
 
         while (SegmentURL) {
           if (!gst_mpd_client_add_media_segment (stream, SegmentURL->data, i, 0,
-                  start_time, duration)) {
+                  start_time, duration, 0, 0)) {
             return FALSE;
           }
           i++;
@@ -3212,7 +3267,8 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
 
       gst_mpdparser_init_active_stream_segments (stream);
       /* here we should have a single segment for each representation, whose URL is encoded in the baseURL element */
-      if (!gst_mpd_client_add_media_segment (stream, NULL, 1, 0, 0, PeriodEnd)) {
+      if (!gst_mpd_client_add_media_segment (stream, NULL, 1, 0, 0, PeriodEnd,
+              0, 0)) {
         return FALSE;
       }
     } else {
@@ -3231,7 +3287,7 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
         timeline = stream->cur_seg_template->MultSegBaseType->SegmentTimeline;
         gst_mpdparser_init_active_stream_segments (stream);
         for (list = g_queue_peek_head_link (&timeline->S); list; list = g_list_next (list)) {
-          guint j, timescale;
+          guint timescale;
 
           S = (GstSNode *) list->data;
           GST_LOG ("Processing S node: d=%" G_GUINT64_FORMAT " r=%u t=%"
@@ -3248,15 +3304,15 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
               start_time /= timescale;
           }
 
-          for (j = 0; j <= S->r; j++) {
-            if (!gst_mpd_client_add_media_segment (stream, NULL, i, start,
-                    start_time, duration)) {
-              return FALSE;
-            }
-            i++;
-            start += S->d;
-            start_time += duration;
+          /* the URLs all come from the template, keep the repeated segments
+           * as a single entry instead of expanding them */
+          if (!gst_mpd_client_add_media_segment (stream, NULL, i, start,
+                  start_time, duration, S->d, S->r)) {
+            return FALSE;
           }
+          i += S->r + 1;
+          start += S->d * (S->r + 1);
+          start_time += duration * (S->r + 1);
         }
       } else {
         /* NOP - The segment is created on demand with the template, no need
@@ -3270,13 +3326,29 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
       g_ptr_array_index (stream->segments, stream->segments->len - 1) : NULL;
 
   if (last_media_segment && GST_CLOCK_TIME_IS_VALID (PeriodEnd)) {
-    if (last_media_segment->start_time + last_media_segment->duration >
-        PeriodEnd) {
-      last_media_segment->duration = PeriodEnd - last_media_segment->start_time;
+    GstMediaSegment *last = last_media_segment;
+    GstClockTime last_start;
+
+    last_start = last->start_time + last->repeat * last->duration;
+    if (last_start + last->duration > PeriodEnd) {
+      if (last->repeat > 0) {
+        /* only the very last segment gets shortened, split it off */
+        last->repeat--;
+        if (!gst_mpd_client_add_media_segment (stream, last->SegmentURL,
+                last->number + last->repeat + 1,
+                last->start + (last->repeat + 1) * last->scale_duration,
+                last_start, last->duration, last->scale_duration, 0)) {
+          return FALSE;
+        }
+        last_media_segment =
+            g_ptr_array_index (stream->segments, stream->segments->len - 1);
+      }
+      last_media_segment->duration = PeriodEnd - last_start;
       GST_LOG ("Fixed duration of last segment: %" GST_TIME_FORMAT,
           GST_TIME_ARGS (last_media_segment->duration));
     }
-    GST_LOG ("Built a list of %d segments", last_media_segment->number);
+    GST_LOG ("Built a list of %u segments",
+        gst_mpd_client_get_segments_counts (stream));
   }
 
   g_free (stream->baseURL);
@@ -3530,10 +3602,28 @@ gst_mpd_client_stream_seek (GstMpdClient * client, GstActiveStream * stream,
 
   GST_MPD_CLIENT_LOCK (client);
   if (stream->segments) {
-    for (i = 0; i < stream->segments->len; i++, segment_idx++) {
+    GstMediaSegment *first = NULL;
+
+    if (stream->segments->len > 0)
+      first = g_ptr_array_index (stream->segments, 0);
+
+    /* start from the entry holding ts, the segment we want is the first of
+     * its repeated segments starting at or after ts, or the next entry */
+    i = MAX (gst_segment_table_lookup (&stream->segment_times, ts), 0);
+    for (; i < stream->segments->len; i++) {
       GstMediaSegment *segment = g_ptr_array_index (stream->segments, i);
+      guint k = 0;
+
+      segment_idx = segment->number - first->number;
       GST_DEBUG ("Looking at fragment sequence chunk %d", segment_idx);
-      if (segment->start_time >= ts) {
+      if (segment->start_time < ts) {
+        if (segment->duration == 0)
+          continue;
+        k = (ts - segment->start_time + segment->duration -
+            1) / segment->duration;
+      }
+      if (k <= segment->repeat) {
+        segment_idx += k;
         selectedChunk = segment;
         break;
       }
@@ -3562,6 +3652,270 @@ gst_mpd_client_stream_seek (GstMpdClient * client, GstActiveStream * stream,
   return TRUE;
 }
 
+/* Appends to @timeline the segments of @update that come after its last
+ * one, and drops the segments @update no longer lists at its start */
+static void
+gst_mpdparser_merge_segment_timeline (GstSegmentTimelineNode * timeline,
+    GstSegmentTimelineNode * update)
+{
+  GstSNode *S, *new_S;
+  GList *list;
+  guint64 t, end, update_start = 0;
+  guint k;
+
+  /* end of the known segments */
+  t = 0;
+  for (list = g_queue_peek_head_link (&timeline->S); list;
+      list = g_list_next (list)) {
+    S = (GstSNode *) list->data;
+    if (S->has_t)
+      t = S->t;
+    t += S->d * (S->r + 1);
+  }
+  end = t;
+
+  /* append the new ones, skipping the ones that are already known */
+  t = 0;
+  for (list = g_queue_peek_head_link (&update->S); list;
+      list = g_list_next (list)) {
+    S = (GstSNode *) list->data;
+    if (S->has_t)
+      t = S->t;
+    if (list == g_queue_peek_head_link (&update->S))
+      update_start = t;
+    if (S->d > 0 && t + S->d * (S->r + 1) > end) {
+      k = t >= end ? 0 : (end - t) / S->d;
+      new_S = g_slice_new0 (GstSNode);
+      new_S->t = t + k * S->d;
+      new_S->has_t = TRUE;
+      new_S->d = S->d;
+      new_S->r = S->r - k;
+      g_queue_push_tail (&timeline->S, new_S);
+    }
+    t += S->d * (S->r + 1);
+  }
+
+  /* drop the segments that went out of the window */
+  t = 0;
+  while ((S = g_queue_peek_head (&timeline->S)) != NULL) {
+    if (S->has_t)
+      t = S->t;
+    if (S->d == 0 || t >= update_start)
+      break;
+    if (t + S->d * (S->r + 1) > update_start) {
+      k = (update_start - t) / S->d;
+      S->t = t + k * S->d;
+      S->has_t = TRUE;
+      S->r -= k;
+      break;
+    }
+    t += S->d * (S->r + 1);
+    gst_mpdparser_free_s_node (g_queue_pop_head (&timeline->S));
+    new_S = g_queue_peek_head (&timeline->S);
+    if (new_S && !new_S->has_t) {
+      new_S->t = t;
+      new_S->has_t = TRUE;
+    }
+  }
+}
+
+/* Checks that @update can replace the segment information of @tmpl, and
+ * does it if @apply is TRUE */
+static gboolean
+gst_mpdparser_merge_segment_template (GstSegmentTemplateNode * tmpl,
+    GstSegmentTemplateNode * update, gboolean apply)
+{
+  GstMultSegmentBaseType *base, *update_base;
+
+  if (tmpl == NULL || update == NULL)
+    return tmpl == update;
+
+  if (g_strcmp0 (tmpl->media, update->media) != 0)
+    return FALSE;
+
+  base = tmpl->MultSegBaseType;
+  update_base = update->MultSegBaseType;
+  if (base == NULL || update_base == NULL)
+    return base == update_base;
+
+  if ((base->SegmentTimeline == NULL) != (update_base->SegmentTimeline == NULL)
+      || base->duration != update_base->duration)
+    return FALSE;
+
+  if ((base->SegBaseType == NULL) != (update_base->SegBaseType == NULL)
+      || (base->SegBaseType
+          && base->SegBaseType->timescale !=
+          update_base->SegBaseType->timescale))
+    return FALSE;
+
+  if (apply) {
+    base->startNumber = update_base->startNumber;
+    if (base->SegmentTimeline)
+      gst_mpdparser_merge_segment_timeline (base->SegmentTimeline,
+          update_base->SegmentTimeline);
+  }
+
+  return TRUE;
+}
+
+/* Checks that @update describes the same AdaptationSets and Representations
+ * as @period, and merges its segments into @period if @apply is TRUE.
+ * SegmentList nodes are not merged, their URLs would have to be matched one
+ * by one */
+static gboolean
+gst_mpdparser_merge_period (GstPeriodNode * period, GstPeriodNode * update,
+    gboolean apply)
+{
+  GList *list, *update_list, *rep_list, *update_rep_list;
+
+  if (g_strcmp0 (period->id, update->id) != 0
+      || period->start != update->start
+      || period->SegmentList || update->SegmentList
+      || g_list_length (period->AdaptationSets) !=
+      g_list_length (update->AdaptationSets))
+    return FALSE;
+
+  if (!gst_mpdparser_merge_segment_template (period->SegmentTemplate,
+          update->SegmentTemplate, apply))
+    return FALSE;
+
+  for (list = period->AdaptationSets, update_list = update->AdaptationSets;
+      list; list = g_list_next (list),
+      update_list = g_list_next (update_list)) {
+    GstAdaptationSetNode *adapt_set = list->data;
+    GstAdaptationSetNode *update_set = update_list->data;
+
+    if (adapt_set->id != update_set->id
+        || adapt_set->SegmentList || update_set->SegmentList
+        || g_list_length (adapt_set->Representations) !=
+        g_list_length (update_set->Representations))
+      return FALSE;
+
+    if (!gst_mpdparser_merge_segment_template (adapt_set->SegmentTemplate,
+            update_set->SegmentTemplate, apply))
+      return FALSE;
+
+    for (rep_list = adapt_set->Representations,
+        update_rep_list = update_set->Representations; rep_list;
+        rep_list = g_list_next (rep_list),
+        update_rep_list = g_list_next (update_rep_list)) {
+      GstRepresentationNode *rep = rep_list->data;
+      GstRepresentationNode *update_rep = update_rep_list->data;
+
+      if (g_strcmp0 (rep->id, update_rep->id) != 0
+          || rep->bandwidth != update_rep->bandwidth
+          || rep->SegmentList || update_rep->SegmentList)
+        return FALSE;
+
+      if (!gst_mpdparser_merge_segment_template (rep->SegmentTemplate,
+              update_rep->SegmentTemplate, apply))
+        return FALSE;
+    }
+  }
+
+  if (apply)
+    period->duration = update->duration;
+
+  return TRUE;
+}
+
+/* Checks that the Periods of @mpd are still the first ones of @update, and
+ * merges @update into @mpd if @apply is TRUE. The Periods @update adds are
+ * moved to @mpd */
+static gboolean
+gst_mpdparser_merge_periods (GstMPDNode * mpd, GstMPDNode * update,
+    gboolean apply)
+{
+  GList *list, *update_list;
+
+  for (list = mpd->Periods, update_list = update->Periods; list;
+      list = g_list_next (list), update_list = g_list_next (update_list)) {
+    if (update_list == NULL)
+      return FALSE;
+    if (!gst_mpdparser_merge_period (list->data, update_list->data, apply))
+      return FALSE;
+  }
+
+  if (apply && update_list) {
+    if (update_list->prev)
+      update_list->prev->next = NULL;
+    else
+      update->Periods = NULL;
+    update_list->prev = NULL;
+    mpd->Periods = g_list_concat (mpd->Periods, update_list);
+  }
+
+  return TRUE;
+}
+
+/* Merges the manifest update @update into @client, keeping the active
+ * streams and their position. Returns FALSE and leaves @client untouched if
+ * @update doesn't describe the same streams, in which case a new client has
+ * to be set up from @update. @update is left in an undefined state when this
+ * returns TRUE and must only be freed */
+gboolean
+gst_mpd_client_merge_update (GstMpdClient * client, GstMpdClient * update)
+{
+  GstMPDNode *mpd, *update_mpd;
+  GstDateTime *end_time;
+  GList *list;
+  guint stream_idx;
+
+  g_return_val_if_fail (client != NULL, FALSE);
+  g_return_val_if_fail (update != NULL, FALSE);
+
+  mpd = client->mpd_node;
+  update_mpd = update->mpd_node;
+  if (mpd == NULL || update_mpd == NULL || mpd->type != update_mpd->type)
+    return FALSE;
+
+  GST_MPD_CLIENT_LOCK (client);
+  /* check everything before changing anything */
+  if (!gst_mpdparser_merge_periods (mpd, update_mpd, FALSE)) {
+    GST_MPD_CLIENT_UNLOCK (client);
+    GST_DEBUG ("Manifest update doesn't match the current streams");
+    return FALSE;
+  }
+  gst_mpdparser_merge_periods (mpd, update_mpd, TRUE);
+
+  mpd->mediaPresentationDuration = update_mpd->mediaPresentationDuration;
+  mpd->minimumUpdatePeriod = update_mpd->minimumUpdatePeriod;
+  mpd->timeShiftBufferDepth = update_mpd->timeShiftBufferDepth;
+  mpd->suggestedPresentationDelay = update_mpd->suggestedPresentationDelay;
+  mpd->maxSegmentDuration = update_mpd->maxSegmentDuration;
+  end_time = mpd->availabilityEndTime;
+  mpd->availabilityEndTime = update_mpd->availabilityEndTime;
+  update_mpd->availabilityEndTime = end_time;
+  GST_MPD_CLIENT_UNLOCK (client);
+
+  if (!gst_mpd_client_setup_media_presentation (client))
+    GST_WARNING ("Failed to set up the updated Periods");
+
+  /* rebuild the segment lists and keep playing from the next segment */
+  for (list = client->active_streams, stream_idx = 0; list;
+      list = g_list_next (list), stream_idx++) {
+    GstActiveStream *stream = list->data;
+    GstClockTime ts = GST_CLOCK_TIME_NONE;
+
+    if (!gst_mpd_client_get_next_fragment_timestamp (client, stream_idx, &ts)
+        && gst_mpd_client_get_last_fragment_timestamp (client, stream_idx,
+            &ts))
+      ts += 1;
+
+    if (!gst_mpd_client_setup_representation (client, stream,
+            stream->cur_representation)) {
+      GST_WARNING ("Failed to set up the updated Representation %s",
+          stream->cur_representation->id);
+      continue;
+    }
+
+    if (GST_CLOCK_TIME_IS_VALID (ts))
+      gst_mpd_client_stream_seek (client, stream, ts);
+  }
+
+  return TRUE;
+}
+
 gint64
 gst_mpd_client_calculate_time_difference (const GstDateTime * t1,
     const GstDateTime * t2)
@@ -3929,8 +4283,10 @@ gst_mpd_client_get_next_fragment_duration (GstMpdClient * client,
   seg_idx = gst_mpd_client_get_segment_index (stream);
 
   if (stream->segments) {
-    if (seg_idx < stream->segments->len)
-      media_segment = g_ptr_array_index (stream->segments, seg_idx);
+    guint repeat_idx;
+
+    media_segment =
+        gst_mpd_client_find_media_segment (stream, seg_idx, &repeat_idx);
 
     return media_segment == NULL ? 0 : media_segment->duration;
   } else {
@@ -4089,13 +4445,53 @@ gst_mpd_client_get_segment_index (GstActiveStream * stream)
   return stream->segment_idx;
 }
 
+/* Returns the index of the segment of @stream playing at @ts, or the number
+ * of segments if there is none */
+guint
+gst_mpd_client_get_segment_index_for_position (GstMpdClient * client,
+    GstActiveStream * stream, GstClockTime ts)
+{
+  GstMediaSegment *first, *segment;
+  GstClockTime duration;
+  gint i;
+
+  g_return_val_if_fail (stream != NULL, 0);
+
+  if (stream->segments == NULL) {
+    duration = gst_mpd_client_get_segment_duration (client, stream);
+    if (!GST_CLOCK_TIME_IS_VALID (duration) || duration == 0)
+      return 0;
+    return ts / duration;
+  }
+
+  i = gst_segment_table_lookup (&stream->segment_times, ts);
+  if (i < 0)
+    return gst_mpd_client_get_segments_counts (stream);
+
+  first = g_ptr_array_index (stream->segments, 0);
+  segment = g_ptr_array_index (stream->segments, i);
+  if (segment->duration == 0 || ts >= segment->start_time +
+      (segment->repeat + 1) * segment->duration)
+    return gst_mpd_client_get_segments_counts (stream);
+
+  return segment->number - first->number +
+      (ts - segment->start_time) / segment->duration;
+}
+
 static guint
 gst_mpd_client_get_segments_counts (GstActiveStream * stream)
 {
   g_return_val_if_fail (stream != NULL, 0);
 
-  if (stream->segments)
-    return stream->segments->len;
+  if (stream->segments) {
+    GstMediaSegment *first, *last;
+
+    if (stream->segments->len == 0)
+      return 0;
+    first = g_ptr_array_index (stream->segments, 0);
+    last = g_ptr_array_index (stream->segments, stream->segments->len - 1);
+    return last->number - first->number + last->repeat + 1;
+  }
   g_return_val_if_fail (stream->cur_seg_template->MultSegBaseType->
       SegmentTimeline == NULL, 0);
   return 0;
@@ -28,6 +28,7 @@
 #define __GST_MPDPARSER_H__
 
 #include <gst/gst.h>
+#include <gst/uridownloader/gstsegmenttable.h>
 
 G_BEGIN_DECLS
 
@@ -123,6 +124,7 @@ struct _GstConditionalUintType
 struct _GstSNode
 {
   guint64 t;
+  gboolean has_t;                   /* t was set, it can be 0 */
   guint64 d;
   guint r;
 };
@@ -416,6 +418,8 @@ struct _GstMediaSegment
   guint64 start;                                /* segment start time in timescale units */
   GstClockTime start_time;                    /* segment start time */
   GstClockTime duration;                      /* segment duration */
+  guint64 scale_duration;                     /* segment duration in timescale units */
+  guint repeat;                               /* number of following segments with the same duration */
 };
 
 struct _GstMediaFragmentInfo
@@ -455,6 +459,8 @@ struct _GstActiveStream
   GstSegmentTemplateNode *cur_seg_template;   /* active segment template */
   guint segment_idx;                          /* index of next sequence chunk */
   GPtrArray *segments;                        /* array of GstMediaSegment */
+  GstSegmentTable segment_times;              /* start_time of each entry of segments */
+  GstSegmentTable segment_numbers;            /* number of each entry of segments */
 };
 
 struct _GstMpdClient
@@ -497,6 +503,7 @@ gboolean gst_mpd_client_seek_to_time (GstMpdClient * client, GDateTime * time);
 GstDateTime *gst_mpd_client_add_time_difference (GstDateTime * t1, gint64 usecs);
 gint gst_mpd_client_get_segment_index_at_time (GstMpdClient *client, GstActiveStream * stream, const GstDateTime *time);
 gint gst_mpd_client_check_time_position (GstMpdClient * client, GstActiveStream * stream, GstClockTime ts, gint64 * diff);
+gboolean gst_mpd_client_merge_update (GstMpdClient * client, GstMpdClient * update);
 
 /* Period selection */
 gboolean gst_mpd_client_set_period_index (GstMpdClient *client, guint period_idx);
@@ -525,6 +532,7 @@ guint gst_mpdparser_get_nb_adaptationSet (GstMpdClient *client);
 void gst_mpd_client_set_segment_index_for_all_streams (GstMpdClient * client, guint segment_idx);
 guint gst_mpd_client_get_segment_index (GstActiveStream * stream);
 void gst_mpd_client_set_segment_index (GstActiveStream * stream, guint segment_idx);
+guint gst_mpd_client_get_segment_index_for_position (GstMpdClient * client, GstActiveStream * stream, GstClockTime ts);
 
 /* Get audio/video stream parameters (mimeType, width, height, rate, number of channels) */
 const gchar *gst_mpd_client_get_stream_mimeType (GstActiveStream * stream);
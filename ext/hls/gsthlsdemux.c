@@ -47,8 +47,7 @@
 
 #include <string.h>
 #include <gst/glib-compat-private.h>
-#include <gnutls/gnutls.h>
-#include <gnutls/crypto.h>
+#include <gst/base/gsttypefindhelper.h>
 #include "gsthlsdemux.h"
 
 static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src_%u",
@@ -71,6 +70,16 @@ enum
   PROP_FRAGMENTS_CACHE,
   PROP_BITRATE_LIMIT,
   PROP_CONNECTION_SPEED,
+  PROP_PROGRESSIVE,
+  PROP_DOWNLOAD_WINDOW,
+  PROP_MAX_QUEUE_BYTES,
+  PROP_QUEUE_FRAGMENTS,
+  PROP_QUEUE_BYTES,
+  PROP_FRAGMENTS_FETCHED,
+  PROP_BYTES_FETCHED,
+  PROP_FETCH_FAILURES,
+  PROP_AVERAGE_FETCH_TIME,
+  PROP_AVERAGE_SETUP_TIME,
   PROP_LAST
 };
 
@@ -80,6 +89,11 @@ static const float update_interval_factor[] = { 1, 0.5, 1.5, 3 };
 #define DEFAULT_FAILED_COUNT 3
 #define DEFAULT_BITRATE_LIMIT 0.8
 #define DEFAULT_CONNECTION_SPEED    0
+#define DEFAULT_PROGRESSIVE         FALSE
+#define DEFAULT_DOWNLOAD_WINDOW     1
+#define DEFAULT_MAX_QUEUE_BYTES     0
+
+#define DOWNLOAD_RATE_HISTORY_MAX 3
 
 /* GObject */
 static void gst_hls_demux_set_property (GObject * object, guint prop_id,
@@ -110,9 +124,18 @@ static gboolean gst_hls_demux_schedule (GstHLSDemux * demux);
 static gboolean gst_hls_demux_switch_playlist (GstHLSDemux * demux);
 static gboolean gst_hls_demux_get_next_fragment (GstHLSDemux * demux,
     gboolean caching);
+static void gst_hls_demux_start_fetches (GstHLSDemux * demux);
+static void gst_hls_demux_start_fetches_locked (GstHLSDemux * demux);
+static void gst_hls_demux_fetch_func (GstHLSDemuxFetch * fetch,
+    GstHLSDemux * demux);
 static gboolean gst_hls_demux_update_playlist (GstHLSDemux * demux,
     gboolean update);
 static void gst_hls_demux_reset (GstHLSDemux * demux, gboolean dispose);
+static void gst_hls_demux_setup_fetches (GstHLSDemux * demux);
+static void gst_hls_demux_free_fetches (GstHLSDemux * demux);
+static void gst_hls_demux_cancel_downloads (GstHLSDemux * demux);
+static void gst_hls_demux_reset_downloads (GstHLSDemux * demux);
+static void gst_hls_demux_clear_queue (GstHLSDemux * demux);
 static gboolean gst_hls_demux_set_location (GstHLSDemux * demux,
     const gchar * uri);
 static gchar *gst_hls_src_buf_to_utf8_playlist (GstBuffer * buf);
@@ -142,7 +165,7 @@ gst_hls_demux_dispose (GObject * obj)
     if (GST_TASK_STATE (demux->updates_task) != GST_TASK_STOPPED) {
       GST_DEBUG_OBJECT (demux, "Leaving updates task");
       demux->cancelled = TRUE;
-      gst_uri_downloader_cancel (demux->downloader);
+      gst_hls_demux_cancel_downloads (demux);
       gst_task_stop (demux->updates_task);
       g_mutex_lock (&demux->updates_timed_lock);
       GST_TASK_SIGNAL (demux->updates_task);
@@ -157,14 +180,19 @@ gst_hls_demux_dispose (GObject * obj)
     demux->updates_task = NULL;
   }
 
+  gst_hls_demux_reset (demux, TRUE);
+
+  gst_hls_demux_free_fetches (demux);
+  g_cond_clear (&demux->fetch_cond);
+  g_mutex_clear (&demux->fetch_lock);
+
   if (demux->downloader != NULL) {
     g_object_unref (demux->downloader);
     demux->downloader = NULL;
   }
 
-  gst_hls_demux_reset (demux, TRUE);
-
   g_queue_free (demux->queue);
+  gst_download_rate_deinit (&demux->download_rate);
 
   G_OBJECT_CLASS (parent_class)->dispose (obj);
 }
@@ -201,6 +229,64 @@ gst_hls_demux_class_init (GstHLSDemuxClass * klass)
           0, G_MAXUINT / 1000, DEFAULT_CONNECTION_SPEED,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_PROGRESSIVE,
+      g_param_spec_boolean ("progressive", "Progressive",
+          "Push the data of fragments downstream while they are downloaded "
+          "instead of waiting for complete fragments",
+          DEFAULT_PROGRESSIVE,
+          G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+          G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DOWNLOAD_WINDOW,
+      g_param_spec_uint ("download-window", "Download window",
+          "Maximum number of fragments downloaded at the same time",
+          1, 32, DEFAULT_DOWNLOAD_WINDOW,
+          G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+          G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_QUEUE_BYTES,
+      g_param_spec_uint ("max-queue-bytes", "Max queue bytes",
+          "Maximum size of the downloaded fragments waiting to be pushed "
+          "(0 = unlimited)",
+          0, G_MAXUINT, DEFAULT_MAX_QUEUE_BYTES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUEUE_FRAGMENTS,
+      g_param_spec_uint ("queue-fragments", "Queue fragments",
+          "Number of downloaded fragments waiting to be pushed",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUEUE_BYTES,
+      g_param_spec_uint64 ("queue-bytes", "Queue bytes",
+          "Size of the downloaded fragments waiting to be pushed",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FRAGMENTS_FETCHED,
+      g_param_spec_uint64 ("fragments-fetched", "Fragments fetched",
+          "Number of fragments downloaded",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BYTES_FETCHED,
+      g_param_spec_uint64 ("bytes-fetched", "Bytes fetched",
+          "Number of bytes of fragments downloaded",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FETCH_FAILURES,
+      g_param_spec_uint ("fetch-failures", "Fetch failures",
+          "Number of fragments that could not be downloaded",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_AVERAGE_FETCH_TIME,
+      g_param_spec_uint64 ("average-fetch-time", "Average fetch time",
+          "Average time to download a fragment in nanoseconds",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_AVERAGE_SETUP_TIME,
+      g_param_spec_uint64 ("average-setup-time", "Average setup time",
+          "Average time to set up the source element of a fragment download "
+          "in nanoseconds",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   element_class->change_state = GST_DEBUG_FUNCPTR (gst_hls_demux_change_state);
 
   gst_element_class_add_pad_template (element_class,
@@ -240,8 +326,18 @@ gst_hls_demux_init (GstHLSDemux * demux)
   demux->fragments_cache = DEFAULT_FRAGMENTS_CACHE;
   demux->bitrate_limit = DEFAULT_BITRATE_LIMIT;
   demux->connection_speed = DEFAULT_CONNECTION_SPEED;
+  demux->progressive = DEFAULT_PROGRESSIVE;
+  demux->download_window = DEFAULT_DOWNLOAD_WINDOW;
+  demux->max_queue_bytes = DEFAULT_MAX_QUEUE_BYTES;
 
   demux->queue = g_queue_new ();
+  g_mutex_init (&demux->fetch_lock);
+  g_cond_init (&demux->fetch_cond);
+  gst_hls_demux_setup_fetches (demux);
+
+  gst_download_rate_init (&demux->download_rate);
+  gst_download_rate_set_max_length (&demux->download_rate,
+      DOWNLOAD_RATE_HISTORY_MAX);
 
   /* Updates task */
   g_rec_mutex_init (&demux->updates_lock);
@@ -276,6 +372,17 @@ gst_hls_demux_set_property (GObject * object, guint prop_id,
     case PROP_CONNECTION_SPEED:
       demux->connection_speed = g_value_get_uint (value) * 1000;
       break;
+    case PROP_PROGRESSIVE:
+      demux->progressive = g_value_get_boolean (value);
+      break;
+    case PROP_DOWNLOAD_WINDOW:
+      demux->download_window = g_value_get_uint (value);
+      break;
+    case PROP_MAX_QUEUE_BYTES:
+      GST_OBJECT_LOCK (demux);
+      demux->max_queue_bytes = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -298,6 +405,54 @@ gst_hls_demux_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_CONNECTION_SPEED:
       g_value_set_uint (value, demux->connection_speed / 1000);
       break;
+    case PROP_PROGRESSIVE:
+      g_value_set_boolean (value, demux->progressive);
+      break;
+    case PROP_DOWNLOAD_WINDOW:
+      g_value_set_uint (value, demux->download_window);
+      break;
+    case PROP_MAX_QUEUE_BYTES:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint (value, demux->max_queue_bytes);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_QUEUE_FRAGMENTS:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint (value, g_queue_get_length (demux->queue));
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_QUEUE_BYTES:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint64 (value, demux->queue_bytes);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_FRAGMENTS_FETCHED:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint64 (value, demux->n_fetched);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_BYTES_FETCHED:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint64 (value, demux->bytes_fetched);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_FETCH_FAILURES:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint (value, demux->n_fetch_failures);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_AVERAGE_FETCH_TIME:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint64 (value, demux->n_fetched ?
+          demux->fetch_time / demux->n_fetched : 0);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_AVERAGE_SETUP_TIME:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint64 (value, demux->n_fetched ?
+          demux->setup_time / demux->n_fetched : 0);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -312,8 +467,10 @@ gst_hls_demux_change_state (GstElement * element, GstStateChange transition)
 
   switch (transition) {
     case GST_STATE_CHANGE_READY_TO_PAUSED:
+      if (demux->n_fetches != demux->download_window)
+        gst_hls_demux_setup_fetches (demux);
       gst_hls_demux_reset (demux, FALSE);
-      gst_uri_downloader_reset (demux->downloader);
+      gst_hls_demux_reset_downloads (demux);
       break;
     default:
       break;
@@ -400,7 +557,7 @@ gst_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
 
       demux->cancelled = TRUE;
       gst_task_pause (demux->stream_task);
-      gst_uri_downloader_cancel (demux->downloader);
+      gst_hls_demux_cancel_downloads (demux);
       gst_task_stop (demux->updates_task);
       g_mutex_lock (&demux->updates_timed_lock);
       GST_TASK_SIGNAL (demux->updates_task);
@@ -413,11 +570,7 @@ gst_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
       g_rec_mutex_lock (&demux->stream_lock);
 
       demux->need_cache = TRUE;
-      while (!g_queue_is_empty (demux->queue)) {
-        GstFragment *fragment = g_queue_pop_head (demux->queue);
-        g_object_unref (fragment);
-      }
-      g_queue_clear (demux->queue);
+      gst_hls_demux_clear_queue (demux);
 
       GST_M3U8_CLIENT_LOCK (demux->client);
       GST_DEBUG_OBJECT (demux, "seeking to sequence %d", current_sequence);
@@ -434,7 +587,7 @@ gst_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
       }
 
       demux->cancelled = FALSE;
-      gst_uri_downloader_reset (demux->downloader);
+      gst_hls_demux_reset_downloads (demux);
       gst_task_start (demux->stream_task);
       g_rec_mutex_unlock (&demux->stream_lock);
 
@@ -601,7 +754,7 @@ gst_hls_demux_pause_tasks (GstHLSDemux * demux, gboolean caching)
 {
   if (GST_TASK_STATE (demux->updates_task) != GST_TASK_STOPPED) {
     demux->cancelled = TRUE;
-    gst_uri_downloader_cancel (demux->downloader);
+    gst_hls_demux_cancel_downloads (demux);
     gst_task_pause (demux->updates_task);
     if (!caching)
       g_mutex_lock (&demux->updates_timed_lock);
@@ -619,11 +772,11 @@ gst_hls_demux_pause_tasks (GstHLSDemux * demux, gboolean caching)
 static void
 gst_hls_demux_stop (GstHLSDemux * demux)
 {
-  gst_uri_downloader_cancel (demux->downloader);
+  gst_hls_demux_cancel_downloads (demux);
 
   if (GST_TASK_STATE (demux->updates_task) != GST_TASK_STOPPED) {
     demux->cancelled = TRUE;
-    gst_uri_downloader_cancel (demux->downloader);
+    gst_hls_demux_cancel_downloads (demux);
     gst_task_stop (demux->updates_task);
     g_mutex_lock (&demux->updates_timed_lock);
     GST_TASK_SIGNAL (demux->updates_task);
@@ -694,6 +847,23 @@ switch_pads (GstHLSDemux * demux, GstCaps * newcaps)
   }
 }
 
+static void
+gst_hls_demux_send_segment (GstHLSDemux * demux, GstClockTime start)
+{
+  GstSegment segment;
+
+  start += demux->position_shift;
+  /* And send a newsegment */
+  GST_DEBUG_OBJECT (demux, "Sending new-segment. segment start:%"
+      GST_TIME_FORMAT, GST_TIME_ARGS (start));
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  segment.start = start;
+  segment.time = start;
+  gst_pad_push_event (demux->srcpad, gst_event_new_segment (&segment));
+  demux->need_segment = FALSE;
+  demux->position_shift = 0;
+}
+
 static void
 gst_hls_demux_stream_loop (GstHLSDemux * demux)
 {
@@ -718,15 +888,30 @@ gst_hls_demux_stream_loop (GstHLSDemux * demux)
     GST_INFO_OBJECT (demux, "First fragments cached successfully");
   }
 
+  /* The fetches queue fragments and start this task with the fetch lock,
+   * so the task can't be paused after a fragment was queued */
+  g_mutex_lock (&demux->fetch_lock);
   if (g_queue_is_empty (demux->queue)) {
-    if (demux->end_of_playlist)
+    if (demux->end_of_playlist) {
+      g_mutex_unlock (&demux->fetch_lock);
       goto end_of_playlist;
+    }
 
-    goto pause_task;
+    GST_DEBUG_OBJECT (demux, "Pause task");
+    gst_task_pause (demux->stream_task);
+    g_mutex_unlock (&demux->fetch_lock);
+    return;
   }
 
+  GST_OBJECT_LOCK (demux);
   fragment = g_queue_pop_head (demux->queue);
   buf = gst_fragment_get_buffer (fragment);
+  demux->queue_bytes -= gst_buffer_get_size (buf);
+  GST_OBJECT_UNLOCK (demux);
+
+  /* Keep the download window full */
+  gst_hls_demux_start_fetches_locked (demux);
+  g_mutex_unlock (&demux->fetch_lock);
 
   /* Figure out if we need to create/switch pads */
   if (G_LIKELY (demux->srcpad))
@@ -742,21 +927,8 @@ gst_hls_demux_stream_loop (GstHLSDemux * demux)
     gst_caps_unref (srccaps);
   g_object_unref (fragment);
 
-  if (demux->need_segment) {
-    GstSegment segment;
-    GstClockTime start = GST_BUFFER_PTS (buf);
-
-    start += demux->position_shift;
-    /* And send a newsegment */
-    GST_DEBUG_OBJECT (demux, "Sending new-segment. segment start:%"
-        GST_TIME_FORMAT, GST_TIME_ARGS (start));
-    gst_segment_init (&segment, GST_FORMAT_TIME);
-    segment.start = start;
-    segment.time = start;
-    gst_pad_push_event (demux->srcpad, gst_event_new_segment (&segment));
-    demux->need_segment = FALSE;
-    demux->position_shift = 0;
-  }
+  if (demux->need_segment)
+    gst_hls_demux_send_segment (demux, GST_BUFFER_PTS (buf));
 
   GST_DEBUG_OBJECT (demux, "Pushing buffer %p", buf);
 
@@ -800,13 +972,6 @@ error_pushing:
     gst_hls_demux_pause_tasks (demux, FALSE);
     return;
   }
-
-pause_task:
-  {
-    GST_DEBUG_OBJECT (demux, "Pause task");
-    gst_task_pause (demux->stream_task);
-    return;
-  }
 }
 
 static void
@@ -836,17 +1001,157 @@ gst_hls_demux_reset (GstHLSDemux * demux, gboolean dispose)
     demux->client = gst_m3u8_client_new ("");
   }
 
+  gst_hls_demux_clear_queue (demux);
+
+  demux->position_shift = 0;
+  demux->need_segment = TRUE;
+  demux->fragment_start = FALSE;
+  demux->fragment_interrupted = FALSE;
+  demux->fragment_ret = GST_FLOW_OK;
+
+  g_free (demux->key_url);
+  demux->key_url = NULL;
+  if (demux->key_fragment) {
+    g_object_unref (demux->key_fragment);
+    demux->key_fragment = NULL;
+  }
+
+  demux->fetched_bytes = 0;
+  gst_download_rate_clear (&demux->download_rate);
+  GST_OBJECT_LOCK (demux);
+  demux->n_fetched = 0;
+  demux->bytes_fetched = 0;
+  demux->n_fetch_failures = 0;
+  demux->fetch_time = 0;
+  demux->setup_time = 0;
+  GST_OBJECT_UNLOCK (demux);
+
+  demux->have_group_id = FALSE;
+  demux->group_id = G_MAXUINT;
+}
+
+static void
+gst_hls_demux_setup_fetches (GstHLSDemux * demux)
+{
+  guint i;
+
+  gst_hls_demux_free_fetches (demux);
+
+  demux->n_fetches = demux->download_window;
+  demux->fetches = g_new0 (GstHLSDemuxFetch, demux->n_fetches);
+  for (i = 0; i < demux->n_fetches; i++) {
+    GstHLSDemuxFetch *fetch = &demux->fetches[i];
+
+    fetch->demux = demux;
+    fetch->downloader = gst_uri_downloader_new ();
+    fetch->decrypt_adapter = gst_adapter_new ();
+  }
+  demux->fetch_target = demux->n_fetches;
+
+  /* The threads are kept around between fragments */
+  demux->fetch_pool = g_thread_pool_new ((GFunc) gst_hls_demux_fetch_func,
+      demux, demux->n_fetches, FALSE, NULL);
+}
+
+static void
+gst_hls_demux_free_fetches (GstHLSDemux * demux)
+{
+  guint i;
+
+  if (demux->fetch_pool) {
+    g_thread_pool_free (demux->fetch_pool, TRUE, TRUE);
+    demux->fetch_pool = NULL;
+  }
+
+  for (i = 0; i < demux->n_fetches; i++) {
+    GstHLSDemuxFetch *fetch = &demux->fetches[i];
+
+    if (fetch->download)
+      g_object_unref (fetch->download);
+    g_object_unref (fetch->downloader);
+    g_object_unref (fetch->decrypt_adapter);
+    g_free (fetch->uri);
+    g_free (fetch->key);
+  }
+  g_free (demux->fetches);
+  demux->fetches = NULL;
+  demux->n_fetches = 0;
+  demux->n_busy = 0;
+}
+
+/* Must be called with the demuxer cancelled. Waits until the fetches
+ * dropped what they downloaded */
+static void
+gst_hls_demux_cancel_downloads (GstHLSDemux * demux)
+{
+  guint i;
+
+  gst_uri_downloader_cancel (demux->downloader);
+
+  g_mutex_lock (&demux->fetch_lock);
+  for (i = 0; i < demux->n_fetches; i++)
+    gst_uri_downloader_cancel (demux->fetches[i].downloader);
+  while (demux->n_busy > 0)
+    g_cond_wait (&demux->fetch_cond, &demux->fetch_lock);
+  g_mutex_unlock (&demux->fetch_lock);
+}
+
+static void
+gst_hls_demux_reset_downloads (GstHLSDemux * demux)
+{
+  guint i;
+
+  gst_uri_downloader_reset (demux->downloader);
+  for (i = 0; i < demux->n_fetches; i++)
+    gst_uri_downloader_reset (demux->fetches[i].downloader);
+
+  /* Start again from the current fragment of the playlist */
+  g_mutex_lock (&demux->fetch_lock);
+  demux->next_sequence = 0;
+  demux->queue_sequence = 0;
+  demux->fetch_end = FALSE;
+  demux->fetch_error = FALSE;
+  demux->end_of_playlist = FALSE;
+  demux->fetch_target = demux->n_fetches;
+  demux->fetched_bytes = 0;
+  demux->fetch_busy_time = 0;
+  g_mutex_unlock (&demux->fetch_lock);
+}
+
+static void
+gst_hls_demux_clear_queue (GstHLSDemux * demux)
+{
+  GST_OBJECT_LOCK (demux);
   while (!g_queue_is_empty (demux->queue)) {
     GstFragment *fragment = g_queue_pop_head (demux->queue);
     g_object_unref (fragment);
   }
   g_queue_clear (demux->queue);
+  demux->queue_bytes = 0;
+  GST_OBJECT_UNLOCK (demux);
+}
 
-  demux->position_shift = 0;
-  demux->need_segment = TRUE;
+/* Number of fragments that can be fetched at once without going over the
+ * size limit of the queue, estimated from the fragments fetched so far */
+static guint
+gst_hls_demux_queue_room (GstHLSDemux * demux, guint max)
+{
+  guint room = max;
 
-  demux->have_group_id = FALSE;
-  demux->group_id = G_MAXUINT;
+  GST_OBJECT_LOCK (demux);
+  if (demux->max_queue_bytes > 0) {
+    if (demux->queue_bytes >= demux->max_queue_bytes) {
+      room = 0;
+    } else if (demux->n_fetched > 0 && demux->bytes_fetched > 0) {
+      guint64 avg = demux->bytes_fetched / demux->n_fetched;
+      guint64 left = (demux->max_queue_bytes - demux->queue_bytes) / avg;
+
+      room = MIN (room, MAX (left, 1));
+    }
+  }
+  GST_OBJECT_UNLOCK (demux);
+
+  return room;
 }
 
 static gboolean
@@ -862,6 +1167,7 @@ gst_hls_demux_set_location (GstHLSDemux * demux, const gchar * uri)
 void
 gst_hls_demux_updates_loop (GstHLSDemux * demux)
 {
+
   /* Loop for the updates. It's started when the first fragments are cached and
    * schedules the next update of the playlist (for lives sources) and the next
    * update of fragments. When a new fragment is downloaded, it compares the
@@ -921,33 +1227,30 @@ gst_hls_demux_updates_loop (GstHLSDemux * demux)
     if (demux->cancelled)
       goto quit;
 
-    /* fetch the next fragment */
-    if (g_queue_is_empty (demux->queue)) {
-      GST_DEBUG_OBJECT (demux, "queue empty, get next fragment");
+    if (demux->progressive) {
+      /* the data is pushed as it arrives, fetch one fragment at a time */
       if (!gst_hls_demux_get_next_fragment (demux, FALSE)) {
-        if (demux->cancelled) {
-          goto quit;
-        } else if (!demux->end_of_playlist) {
-          demux->client->update_failed_count++;
-          if (demux->client->update_failed_count < DEFAULT_FAILED_COUNT) {
-            GST_WARNING_OBJECT (demux, "Could not fetch the next fragment");
-            continue;
-          } else {
-            GST_ELEMENT_ERROR (demux, RESOURCE, NOT_FOUND,
-                ("Could not fetch the next fragment"), (NULL));
-            goto error;
-          }
-        }
-      } else {
-        demux->client->update_failed_count = 0;
-
         if (demux->cancelled)
           goto quit;
-
-        /* try to switch to another bitrate if needed */
-        gst_hls_demux_switch_playlist (demux);
+        if (!demux->end_of_playlist) {
+          GST_ELEMENT_ERROR (demux, RESOURCE, NOT_FOUND,
+              ("Could not fetch the next fragment"), (NULL));
+          goto error;
+        }
+        continue;
       }
+    } else {
+      /* the fetches post the error themselves when a fragment failed */
+      if (demux->fetch_error)
+        goto error;
+      gst_hls_demux_start_fetches (demux);
     }
+
+    if (demux->cancelled)
+      goto quit;
+
+    /* try to switch to another bitrate if needed */
+    gst_hls_demux_switch_playlist (demux);
   }
 
 quit:
@@ -965,10 +1268,46 @@ error:
   }
 }
 
+/* Downloads fragments until @n_fragments of them are queued or the
+ * playlist is over */
+static gboolean
+gst_hls_demux_fill_queue (GstHLSDemux * demux, guint n_fragments)
+{
+  guint n_queued, n_posted = 0;
+  gboolean ret;
+
+  g_mutex_lock (&demux->fetch_lock);
+  demux->fetch_target = n_fragments;
+  gst_hls_demux_start_fetches_locked (demux);
+  while (!demux->cancelled && !demux->fetch_error && demux->n_busy > 0) {
+    GST_OBJECT_LOCK (demux);
+    n_queued = g_queue_get_length (demux->queue);
+    GST_OBJECT_UNLOCK (demux);
+    if (n_queued >= n_fragments)
+      break;
+
+    if (n_queued != n_posted) {
+      n_posted = n_queued;
+      g_mutex_unlock (&demux->fetch_lock);
+      gst_element_post_message (GST_ELEMENT (demux),
+          gst_message_new_buffering (GST_OBJECT (demux),
+              100 * n_queued / n_fragments));
+      g_mutex_lock (&demux->fetch_lock);
+      continue;
+    }
+    g_cond_wait (&demux->fetch_cond, &demux->fetch_lock);
+  }
+  ret = !demux->cancelled && !demux->fetch_error;
+  /* From now on, keep the download window full */
+  demux->fetch_target = demux->n_fetches;
+  g_mutex_unlock (&demux->fetch_lock);
+
+  return ret;
+}
+
 static gboolean
 gst_hls_demux_cache_fragments (GstHLSDemux * demux)
 {
-  gint i;
 
   /* If this playlist is a variant playlist, select the first one
    * and update it */
@@ -1005,24 +1344,27 @@ gst_hls_demux_cache_fragments (GstHLSDemux * demux)
           gst_message_new_duration_changed (GST_OBJECT (demux)));
   }
 
-  /* Cache the first fragments */
-  for (i = 0; i < demux->fragments_cache; i++) {
-    gst_element_post_message (GST_ELEMENT (demux),
-        gst_message_new_buffering (GST_OBJECT (demux),
-            100 * i / demux->fragments_cache));
-    g_get_current_time (&demux->next_update);
-    if (!gst_hls_demux_get_next_fragment (demux, TRUE)) {
-      if (demux->end_of_playlist)
-        break;
+  /* Cache the first fragments. In progressive mode the data is pushed as it
+   * arrives, so only start with the first one */
+  gst_element_post_message (GST_ELEMENT (demux),
+      gst_message_new_buffering (GST_OBJECT (demux), 0));
+  if (demux->progressive) {
+    if (!gst_hls_demux_get_next_fragment (demux, TRUE)
+        && !demux->end_of_playlist) {
       if (!demux->cancelled)
-        GST_ERROR_OBJECT (demux, "Error caching the first fragments");
+        GST_ERROR_OBJECT (demux, "Error caching the first fragment");
       return FALSE;
     }
-    /* make sure we stop caching fragments if something cancelled it */
-    if (demux->cancelled)
-      return FALSE;
-    gst_hls_demux_switch_playlist (demux);
+  } else if (!gst_hls_demux_fill_queue (demux, demux->fragments_cache)) {
+    if (!demux->cancelled)
+      GST_ERROR_OBJECT (demux, "Error caching the first fragments");
+    return FALSE;
   }
+  /* make sure we stop caching fragments if something cancelled it */
+  if (demux->cancelled)
+    return FALSE;
+  gst_hls_demux_switch_playlist (demux);
+
   gst_element_post_message (GST_ELEMENT (demux),
       gst_message_new_buffering (GST_OBJECT (demux), 100));
 
@@ -1124,12 +1466,14 @@ gst_hls_demux_change_playlist (GstHLSDemux * demux, guint max_bitrate)
   current_variant = gst_m3u8_client_get_playlist_for_bitrate (demux->client,
       max_bitrate);
 
+  GST_M3U8_CLIENT_LOCK (demux->client);
 retry_failover_protection:
   old_bandwidth = GST_M3U8 (previous_variant->data)->bandwidth;
   new_bandwidth = GST_M3U8 (current_variant->data)->bandwidth;
 
   /* Don't do anything else if the playlist is the same */
   if (new_bandwidth == old_bandwidth) {
+    GST_M3U8_CLIENT_UNLOCK (demux->client);
     return TRUE;
   }
 
@@ -1173,7 +1517,9 @@ retry_failover_protection:
   }
 
   /* Force typefinding since we might have changed media type */
+  g_mutex_lock (&demux->fetch_lock);
   demux->do_typefind = TRUE;
+  g_mutex_unlock (&demux->fetch_lock);
 
   return TRUE;
 }
@@ -1210,129 +1556,444 @@ gst_hls_demux_schedule (GstHLSDemux * demux)
 static gboolean
 gst_hls_demux_switch_playlist (GstHLSDemux * demux)
 {
-  GTimeVal now;
-  GstClockTime diff;
+  GstClockTime now, diff, target_duration;
   gsize size;
-  gint bitrate;
-  GstFragment *fragment;
-  GstBuffer *buffer;
+  guint64 *bitrates, current_bitrate, bitrate;
+  guint n_bitrates = 0, n_queued;
+  GList *walk;
+
+  /* Bytes downloaded over the time at least one fetch was running, so the
+   * fragments downloaded at the same time add up */
+  now = gst_util_get_timestamp ();
+  g_mutex_lock (&demux->fetch_lock);
+  size = demux->fetched_bytes;
+  diff = demux->fetch_busy_time;
+  if (demux->n_busy > 0) {
+    diff += now - demux->fetch_busy_start;
+    demux->fetch_busy_start = now;
+  }
+  demux->fetched_bytes = 0;
+  demux->fetch_busy_time = 0;
+  g_mutex_unlock (&demux->fetch_lock);
+
+  if (size == 0 || diff == 0)
+    return TRUE;
 
   GST_M3U8_CLIENT_LOCK (demux->client);
-  fragment = g_queue_peek_tail (demux->queue);
-  if (!demux->client->main->lists || !fragment) {
+  if (!demux->client->main->lists) {
     GST_M3U8_CLIENT_UNLOCK (demux->client);
     return TRUE;
   }
+
+  /* the variants are sorted by bandwidth */
+  bitrates = g_new (guint64, g_list_length (demux->client->main->lists));
+  for (walk = demux->client->main->lists; walk; walk = walk->next)
+    bitrates[n_bitrates++] = GST_M3U8 (walk->data)->bandwidth;
+  current_bitrate =
+      GST_M3U8 (demux->client->main->current_variant->data)->bandwidth;
   GST_M3U8_CLIENT_UNLOCK (demux->client);
 
-  /* compare the time when the fragment was downloaded with the time when it was
-   * scheduled */
-  g_get_current_time (&now);
-  diff = (GST_TIMEVAL_TO_TIME (now) - GST_TIMEVAL_TO_TIME (demux->next_update));
-  buffer = gst_fragment_get_buffer (fragment);
-  size = gst_buffer_get_size (buffer);
-  bitrate = (size * 8) / ((double) diff / GST_SECOND);
+  gst_download_rate_add_rate (&demux->download_rate, size, diff);
+
+  GST_DEBUG ("Downloaded %d bytes in %" GST_TIME_FORMAT ". Download rate is "
+      "now : %u", (guint) size, GST_TIME_ARGS (diff),
+      gst_download_rate_get_estimate (&demux->download_rate));
 
-  GST_DEBUG ("Downloaded %d bytes in %" GST_TIME_FORMAT ". Bitrate is : %d",
-      (guint) size, GST_TIME_ARGS (diff), bitrate);
+  /* The queue is what is buffered ahead of playback */
+  target_duration = gst_m3u8_client_get_target_duration (demux->client);
+  GST_OBJECT_LOCK (demux);
+  n_queued = g_queue_get_length (demux->queue);
+  GST_OBJECT_UNLOCK (demux);
 
-  gst_buffer_unref (buffer);
-  return gst_hls_demux_change_playlist (demux, bitrate * demux->bitrate_limit);
+  bitrate = gst_download_rate_choose_bitrate (&demux->download_rate,
+      bitrates, n_bitrates, current_bitrate, n_queued * target_duration,
+      MAX (demux->n_fetches, demux->fragments_cache) * target_duration,
+      target_duration, demux->bitrate_limit);
+  g_free (bitrates);
+
+  return gst_hls_demux_change_playlist (demux, bitrate);
 }
 
-static GstFragment *
-gst_hls_demux_decrypt_fragment (GstHLSDemux * demux,
-    GstFragment * encrypted_fragment, const gchar * key, const guint8 * iv)
+static GstBuffer *
+gst_hls_demux_get_key (GstHLSDemuxFetch * fetch)
 {
-  GstFragment *key_fragment, *ret = NULL;
-  GstBuffer *key_buffer, *encrypted_buffer, *decrypted_buffer;
-  GstMapInfo key_info, encrypted_info, decrypted_info;
-  gnutls_cipher_hd_t aes_ctx;
-  gnutls_datum_t key_d, iv_d;
-  gsize unpadded_size;
-
-  GST_INFO_OBJECT (demux, "Fetching key %s", key);
-  key_fragment = gst_uri_downloader_fetch_uri (demux->downloader, key);
-  if (key_fragment == NULL)
-    goto key_failed;
+  GstHLSDemux *demux = fetch->demux;
+  GstFragment *download;
+  GstBuffer *key_buffer = NULL;
+
+  /* Most playlists use the same key for many fragments, only fetch it
+   * when it changes */
+  g_mutex_lock (&demux->fetch_lock);
+  if (demux->key_url && strcmp (demux->key_url, fetch->key) == 0)
+    key_buffer = gst_fragment_get_buffer (demux->key_fragment);
+  g_mutex_unlock (&demux->fetch_lock);
+  if (key_buffer)
+    return key_buffer;
+
+  GST_INFO_OBJECT (demux, "Fetching key %s", fetch->key);
+  download = gst_uri_downloader_fetch_uri (fetch->downloader, fetch->key);
+  if (download == NULL)
+    return NULL;
+  key_buffer = gst_fragment_get_buffer (download);
+
+  g_mutex_lock (&demux->fetch_lock);
+  g_free (demux->key_url);
+  demux->key_url = g_strdup (fetch->key);
+  if (demux->key_fragment)
+    g_object_unref (demux->key_fragment);
+  demux->key_fragment = download;
+  g_mutex_unlock (&demux->fetch_lock);
+
+  return key_buffer;
+}
 
-  key_buffer = gst_fragment_get_buffer (key_fragment);
-  encrypted_buffer = gst_fragment_get_buffer (encrypted_fragment);
-  decrypted_buffer =
-      gst_buffer_new_allocate (NULL, gst_buffer_get_size (encrypted_buffer),
-      NULL);
+static gboolean
+gst_hls_demux_decrypt_start (GstHLSDemuxFetch * fetch, GstBuffer * key_buffer)
+{
+  GstMapInfo key_info;
+  gnutls_datum_t key_d, iv_d;
 
   gst_buffer_map (key_buffer, &key_info, GST_MAP_READ);
-  gst_buffer_map (encrypted_buffer, &encrypted_info, GST_MAP_READ);
-  gst_buffer_map (decrypted_buffer, &decrypted_info, GST_MAP_WRITE);
+  if (key_info.size < 16) {
+    GST_WARNING_OBJECT (fetch->demux, "Key is too short");
+    gst_buffer_unmap (key_buffer, &key_info);
+    return FALSE;
+  }
 
   key_d.data = key_info.data;
   key_d.size = 16;
-  iv_d.data = (unsigned char *) iv;
+  iv_d.data = fetch->iv;
   iv_d.size = 16;
-  gnutls_cipher_init (&aes_ctx, gnutls_cipher_get_id ("AES-128-CBC"), &key_d,
-      &iv_d);
-  gnutls_cipher_decrypt2 (aes_ctx, encrypted_info.data, encrypted_info.size,
-      decrypted_info.data, decrypted_info.size);
-  gnutls_cipher_deinit (aes_ctx);
+  gnutls_cipher_init (&fetch->aes_ctx, gnutls_cipher_get_id ("AES-128-CBC"),
+      &key_d, &iv_d);
+
+  gst_buffer_unmap (key_buffer, &key_info);
+
+  gst_adapter_clear (fetch->decrypt_adapter);
+  fetch->decrypting = TRUE;
+
+  return TRUE;
+}
+
+/* Decrypts the complete blocks received so far. Unless this is the end of
+ * the fragment, the last block is kept back as it may hold the padding */
+static GstBuffer *
+gst_hls_demux_decrypt_buffer (GstHLSDemuxFetch * fetch, GstBuffer * encrypted,
+    gboolean last)
+{
+  GstBuffer *in, *out;
+  GstMapInfo in_info, out_info;
+  gsize avail, size;
+
+  if (encrypted)
+    gst_adapter_push (fetch->decrypt_adapter, encrypted);
+
+  avail = gst_adapter_available (fetch->decrypt_adapter);
+  if (last)
+    size = avail - avail % 16;
+  else
+    size = avail > 16 ? ((avail - 1) / 16) * 16 : 0;
+
+  if (size == 0)
+    return NULL;
+
+  in = gst_adapter_take_buffer (fetch->decrypt_adapter, size);
+  out = gst_buffer_new_allocate (NULL, size, NULL);
+
+  gst_buffer_map (in, &in_info, GST_MAP_READ);
+  gst_buffer_map (out, &out_info, GST_MAP_WRITE);
+
+  /* The cipher keeps the CBC state between calls */
+  gnutls_cipher_decrypt2 (fetch->aes_ctx, in_info.data, size, out_info.data,
+      size);
 
   /* Handle pkcs7 unpadding here */
-  unpadded_size =
-      decrypted_info.size - decrypted_info.data[decrypted_info.size - 1];
+  if (last) {
+    guint8 padding = out_info.data[size - 1];
 
-  gst_buffer_unmap (decrypted_buffer, &decrypted_info);
-  gst_buffer_unmap (encrypted_buffer, &encrypted_info);
-  gst_buffer_unmap (key_buffer, &key_info);
+    if (padding > 0 && padding <= 16)
+      size -= padding;
+    else
+      GST_WARNING_OBJECT (fetch->demux, "Invalid padding %u", padding);
+  }
+
+  gst_buffer_unmap (out, &out_info);
+  gst_buffer_unmap (in, &in_info);
+  gst_buffer_unref (in);
 
-  gst_buffer_resize (decrypted_buffer, 0, unpadded_size);
+  if (last)
+    gst_buffer_resize (out, 0, size);
 
-  gst_buffer_unref (key_buffer);
-  gst_buffer_unref (encrypted_buffer);
-  g_object_unref (key_fragment);
+  return out;
+}
+
+/* Decrypts the data left at the end of the fragment */
+static GstBuffer *
+gst_hls_demux_decrypt_end (GstHLSDemuxFetch * fetch)
+{
+  GstBuffer *last;
+
+  last = gst_hls_demux_decrypt_buffer (fetch, NULL, TRUE);
+  gnutls_cipher_deinit (fetch->aes_ctx);
+  gst_adapter_clear (fetch->decrypt_adapter);
+  fetch->decrypting = FALSE;
+
+  return last;
+}
+
+/* Builds the whole decrypted fragment out of the data decrypted while it was
+ * downloaded and the last decrypted block */
+static GstFragment *
+gst_hls_demux_decrypted_fragment (GstFragment * download, GstBuffer * last)
+{
+  GstFragment *ret;
+  GstBuffer *buffer;
+
+  buffer = gst_fragment_get_buffer (download);
+  if (buffer && last)
+    buffer = gst_buffer_append (buffer, last);
+  else if (last)
+    buffer = last;
+  else if (buffer == NULL)
+    buffer = gst_buffer_new ();
 
   ret = gst_fragment_new ();
-  gst_fragment_add_buffer (ret, decrypted_buffer);
+  gst_fragment_add_buffer (ret, buffer);
+  ret->download_start_time = download->download_start_time;
+  ret->download_stop_time = download->download_stop_time;
+  ret->download_setup_time = download->download_setup_time;
   ret->completed = TRUE;
-key_failed:
-  g_object_unref (encrypted_fragment);
+  g_object_unref (download);
+
   return ret;
 }
 
+/* Pushes data of the fragment being downloaded in progressive mode. The
+ * first buffer of each fragment carries its timestamp, duration and
+ * discontinuity, as the single buffer of a fragment does otherwise, and
+ * decides whether the caps changed. The following buffers only continue
+ * the fragment and carry none of them */
+static GstFlowReturn
+gst_hls_demux_push_progressive (GstHLSDemux * demux, GstBuffer * buf)
+{
+  GstCaps *srccaps = NULL;
+
+  if (demux->fragment_ret != GST_FLOW_OK) {
+    gst_buffer_unref (buf);
+    return demux->fragment_ret;
+  }
+
+  /* Don't let through what the source set, like the DISCONT flag it puts
+   * on the first buffer of each download */
+  buf = gst_buffer_make_writable (buf);
+  GST_BUFFER_PTS (buf) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DTS (buf) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DURATION (buf) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_OFFSET (buf) = GST_BUFFER_OFFSET_NONE;
+  GST_BUFFER_OFFSET_END (buf) = GST_BUFFER_OFFSET_NONE;
+  GST_BUFFER_FLAG_UNSET (buf, GST_BUFFER_FLAG_DISCONT);
+
+  if (demux->fragment_start) {
+    demux->fragment_start = FALSE;
+    GST_BUFFER_PTS (buf) = demux->fragment_timestamp;
+    GST_BUFFER_DURATION (buf) = demux->fragment_duration;
+    if (demux->fragment_discont) {
+      GST_DEBUG_OBJECT (demux, "Marking fragment as discontinuous");
+      GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
+    }
+
+    /* We actually need to do this every time we switch bitrate */
+    if (G_UNLIKELY (demux->do_typefind)) {
+      GstCaps *caps = gst_type_find_helper_for_buffer (NULL, buf, NULL);
+
+      if (caps == NULL) {
+        GST_ELEMENT_ERROR (demux, STREAM, TYPE_NOT_FOUND,
+            ("Could not determine type of stream"), (NULL));
+        gst_buffer_unref (buf);
+        demux->fragment_ret = GST_FLOW_NOT_NEGOTIATED;
+        return demux->fragment_ret;
+      }
+      gst_caps_replace (&demux->input_caps, caps);
+      GST_INFO_OBJECT (demux, "Input source caps: %" GST_PTR_FORMAT,
+          demux->input_caps);
+      demux->do_typefind = FALSE;
+      gst_caps_unref (caps);
+    }
+
+    if (G_LIKELY (demux->srcpad))
+      srccaps = gst_pad_get_current_caps (demux->srcpad);
+    if (G_UNLIKELY (!srccaps
+            || !gst_caps_is_equal_fixed (demux->input_caps, srccaps)
+            || demux->need_segment)) {
+      switch_pads (demux, demux->input_caps);
+      demux->need_segment = TRUE;
+    }
+    if (G_LIKELY (srccaps))
+      gst_caps_unref (srccaps);
+
+    if (demux->need_segment)
+      gst_hls_demux_send_segment (demux, GST_BUFFER_PTS (buf));
+  }
+
+  GST_LOG_OBJECT (demux, "Pushing buffer %p", buf);
+  demux->fragment_ret = gst_pad_push (demux->srcpad, buf);
+
+  return demux->fragment_ret;
+}
+
+/* Called from the streaming thread of the downloader for every buffer of
+ * the fragment */
+static GstBuffer *
+gst_hls_demux_fragment_data (GstUriDownloader * downloader, GstBuffer * buffer,
+    gpointer user_data)
+{
+  GstHLSDemuxFetch *fetch = user_data;
+
+  fetch->bytes += gst_buffer_get_size (buffer);
+
+  if (fetch->decrypting) {
+    buffer = gst_hls_demux_decrypt_buffer (fetch, buffer, FALSE);
+    if (buffer == NULL)
+      return NULL;
+  }
+
+  if (fetch->demux->progressive) {
+    gst_hls_demux_push_progressive (fetch->demux, buffer);
+    return NULL;
+  }
+
+  return buffer;
+}
+
+/* Sets @fetch up for the next fragment of the playlist */
 static gboolean
-gst_hls_demux_get_next_fragment (GstHLSDemux * demux, gboolean caching)
+gst_hls_demux_fetch_prepare (GstHLSDemux * demux, GstHLSDemuxFetch * fetch)
 {
-  GstFragment *download;
-  const gchar *next_fragment_uri;
-  GstClockTime duration;
-  GstClockTime timestamp;
-  GstBuffer *buf;
-  gboolean discont;
+  const gchar *uri;
   const gchar *key = NULL;
   const guint8 *iv = NULL;
 
-  if (!gst_m3u8_client_get_next_fragment (demux->client, &discont,
-          &next_fragment_uri, &duration, &timestamp, &key, &iv)) {
-    GST_INFO_OBJECT (demux, "This playlist doesn't contain more fragments");
-    demux->end_of_playlist = TRUE;
-    gst_task_start (demux->stream_task);
+  if (!gst_m3u8_client_get_next_fragment (demux->client, &fetch->discont,
+          &uri, &fetch->duration, &fetch->timestamp, &key, &iv))
     return FALSE;
+
+  GST_INFO_OBJECT (demux, "Fetching next fragment %s", uri);
+  g_free (fetch->uri);
+  fetch->uri = g_strdup (uri);
+  g_free (fetch->key);
+  fetch->key = g_strdup (key);
+  if (key)
+    memcpy (fetch->iv, iv, sizeof (fetch->iv));
+  fetch->bytes = 0;
+  fetch->download = NULL;
+
+  return TRUE;
+}
+
+static gboolean
+gst_hls_demux_fetch_once (GstHLSDemuxFetch * fetch)
+{
+  GstHLSDemux *demux = fetch->demux;
+
+  fetch->bytes = 0;
+
+  /* Decrypt the data as it arrives instead of keeping the encrypted
+   * fragment around */
+  if (fetch->key) {
+    GstBuffer *key_buffer;
+    gboolean ok;
+
+    key_buffer = gst_hls_demux_get_key (fetch);
+    if (key_buffer == NULL)
+      return FALSE;
+    ok = gst_hls_demux_decrypt_start (fetch, key_buffer);
+    gst_buffer_unref (key_buffer);
+    if (!ok)
+      return FALSE;
   }
 
-  GST_INFO_OBJECT (demux, "Fetching next fragment %s", next_fragment_uri);
+  if (fetch->decrypting || demux->progressive) {
+    fetch->download = gst_uri_downloader_fetch_uri_full (fetch->downloader,
+        fetch->uri, 0, -1, gst_hls_demux_fragment_data, fetch);
+  } else {
+    fetch->download = gst_uri_downloader_fetch_uri (fetch->downloader,
+        fetch->uri);
+    /* Without a data callback nothing was counted while downloading */
+    if (fetch->download) {
+      GstBuffer *buffer = gst_fragment_get_buffer (fetch->download);
+
+      if (buffer) {
+        fetch->bytes = gst_buffer_get_size (buffer);
+        gst_buffer_unref (buffer);
+      }
+    }
+  }
 
-  download = gst_uri_downloader_fetch_uri (demux->downloader,
-      next_fragment_uri);
+  if (fetch->decrypting) {
+    GstBuffer *last = gst_hls_demux_decrypt_end (fetch);
 
-  if (download && key)
-    download = gst_hls_demux_decrypt_fragment (demux, download, key, iv);
+    if (fetch->download == NULL) {
+      if (last)
+        gst_buffer_unref (last);
+    } else if (demux->progressive) {
+      if (last)
+        gst_hls_demux_push_progressive (demux, last);
+    } else {
+      fetch->download = gst_hls_demux_decrypted_fragment (fetch->download,
+          last);
+    }
+  }
 
-  if (download == NULL)
-    goto error;
+  return fetch->download != NULL;
+}
+
+/* Downloads the fragment of @fetch, trying again when it fails. Failing to
+ * get the key or to set up the decryption fails the fragment too */
+static gboolean
+gst_hls_demux_fetch_run (GstHLSDemuxFetch * fetch)
+{
+  GstHLSDemux *demux = fetch->demux;
+  guint attempt;
+
+  for (attempt = 0; attempt < DEFAULT_FAILED_COUNT; attempt++) {
+    /* Data already pushed in progressive mode can't be taken back */
+    if (demux->cancelled || (demux->progressive && fetch->bytes > 0))
+      break;
+    if (attempt > 0)
+      GST_WARNING_OBJECT (demux, "Fetching %s again", fetch->uri);
+
+    if (gst_hls_demux_fetch_once (fetch)) {
+      GST_OBJECT_LOCK (demux);
+      demux->n_fetched++;
+      demux->bytes_fetched += fetch->bytes;
+      demux->fetch_time += fetch->download->download_stop_time -
+          fetch->download->download_start_time;
+      demux->setup_time += fetch->download->download_setup_time;
+      GST_OBJECT_UNLOCK (demux);
+      return TRUE;
+    }
+
+    GST_OBJECT_LOCK (demux);
+    if (!demux->cancelled)
+      demux->n_fetch_failures++;
+    GST_OBJECT_UNLOCK (demux);
+  }
+
+  return FALSE;
+}
+
+static gboolean
+gst_hls_demux_queue_fragment (GstHLSDemux * demux, GstHLSDemuxFetch * fetch)
+{
+  GstFragment *download = fetch->download;
+  GstBuffer *buf;
 
   buf = gst_fragment_get_buffer (download);
+  if (buf == NULL)
+    return FALSE;
 
-  GST_BUFFER_DURATION (buf) = duration;
-  GST_BUFFER_PTS (buf) = timestamp;
+  GST_BUFFER_DURATION (buf) = fetch->duration;
+  GST_BUFFER_PTS (buf) = fetch->timestamp;
 
   /* We actually need to do this every time we switch bitrate */
   if (G_UNLIKELY (demux->do_typefind)) {
@@ -1350,24 +2011,217 @@ gst_hls_demux_get_next_fragment (GstHLSDemux * demux, gboolean caching)
     gst_fragment_set_caps (download, demux->input_caps);
   }
 
-  if (discont) {
+  if (fetch->discont) {
     GST_DEBUG_OBJECT (demux, "Marking fragment as discontinuous");
     GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
   }
 
+  GST_DEBUG_OBJECT (demux, "Pushing fragment in queue");
+  GST_OBJECT_LOCK (demux);
+  g_queue_push_tail (demux->queue, download);
+  demux->queue_bytes += gst_buffer_get_size (buf);
+  GST_OBJECT_UNLOCK (demux);
+  fetch->download = NULL;
+
   /* The buffer ref is still kept inside the fragment download */
   gst_buffer_unref (buf);
 
-  GST_DEBUG_OBJECT (demux, "Pushing fragment in queue");
-  g_queue_push_tail (demux->queue, download);
-  if (!caching) {
-    GST_TASK_SIGNAL (demux->updates_task);
+  return TRUE;
+}
+
+static void
+gst_hls_demux_release_fetch_locked (GstHLSDemux * demux,
+    GstHLSDemuxFetch * fetch)
+{
+  if (fetch->download) {
+    g_object_unref (fetch->download);
+    fetch->download = NULL;
+  }
+  fetch->busy = FALSE;
+  if (--demux->n_busy == 0)
+    demux->fetch_busy_time +=
+        gst_util_get_timestamp () - demux->fetch_busy_start;
+}
+
+/* Starts downloading the next fragments while a fetch is free and the queue
+ * has room for them. Called with the fetch lock */
+static void
+gst_hls_demux_start_fetches_locked (GstHLSDemux * demux)
+{
+  GstHLSDemuxFetch *fetch;
+  guint i, n_queued, room;
+
+  if (demux->progressive)
+    return;
+
+  while (!demux->cancelled && !demux->fetch_error && !demux->fetch_end
+      && demux->n_busy < demux->n_fetches) {
+    GST_OBJECT_LOCK (demux);
+    n_queued = g_queue_get_length (demux->queue);
+    GST_OBJECT_UNLOCK (demux);
+    if (n_queued + demux->n_busy >= demux->fetch_target)
+      break;
+    room = gst_hls_demux_queue_room (demux, demux->fetch_target - n_queued);
+    if (room <= demux->n_busy)
+      break;
+
+    i = 0;
+    while (demux->fetches[i].busy)
+      i++;
+    fetch = &demux->fetches[i];
+    if (!gst_hls_demux_fetch_prepare (demux, fetch)) {
+      GST_INFO_OBJECT (demux, "This playlist doesn't contain more fragments");
+      demux->fetch_end = TRUE;
+      break;
+    }
+
+    fetch->busy = TRUE;
+    fetch->done = FALSE;
+    fetch->sequence = demux->next_sequence++;
+    if (demux->n_busy++ == 0)
+      demux->fetch_busy_start = gst_util_get_timestamp ();
+    g_thread_pool_push (demux->fetch_pool, fetch, NULL);
+  }
+
+  /* The playlist is over once the last fragment is queued */
+  if (demux->fetch_end && demux->n_busy == 0 && !demux->end_of_playlist
+      && !demux->cancelled) {
+    demux->end_of_playlist = TRUE;
     gst_task_start (demux->stream_task);
   }
-  return TRUE;
+}
 
-error:
+static void
+gst_hls_demux_start_fetches (GstHLSDemux * demux)
+{
+  g_mutex_lock (&demux->fetch_lock);
+  gst_hls_demux_start_fetches_locked (demux);
+  g_mutex_unlock (&demux->fetch_lock);
+}
+
+/* Queues the fragments downloaded so far in the order of the playlist and
+ * starts the next downloads. Called with the fetch lock */
+static void
+gst_hls_demux_queue_fetches_locked (GstHLSDemux * demux)
+{
+  gboolean drop = demux->cancelled || demux->fetch_error;
+  gboolean queued = FALSE, progress = TRUE;
+  guint i;
+
+  while (progress) {
+    progress = FALSE;
+    for (i = 0; i < demux->n_fetches; i++) {
+      GstHLSDemuxFetch *fetch = &demux->fetches[i];
+
+      if (!fetch->busy || !fetch->done)
+        continue;
+
+      if (drop) {
+        gst_hls_demux_release_fetch_locked (demux, fetch);
+      } else if (fetch->sequence == demux->queue_sequence) {
+        if (gst_hls_demux_queue_fragment (demux, fetch))
+          queued = TRUE;
+        demux->queue_sequence++;
+        gst_hls_demux_release_fetch_locked (demux, fetch);
+        progress = TRUE;
+      }
+    }
+  }
+
+  gst_hls_demux_start_fetches_locked (demux);
+  g_cond_broadcast (&demux->fetch_cond);
+
+  if (queued && !demux->need_cache && !demux->cancelled)
+    gst_task_start (demux->stream_task);
+}
+
+/* Runs in the fetch pool */
+static void
+gst_hls_demux_fetch_func (GstHLSDemuxFetch * fetch, GstHLSDemux * demux)
+{
+  gboolean ok;
+  gchar *failed = NULL;
+
+  ok = gst_hls_demux_fetch_run (fetch);
+
+  g_mutex_lock (&demux->fetch_lock);
+  fetch->done = TRUE;
+  if (ok) {
+    demux->fetched_bytes += fetch->bytes;
+  } else if (!demux->cancelled && !demux->fetch_error) {
+    failed = g_strdup (fetch->uri);
+    demux->fetch_error = TRUE;
+  }
+  gst_hls_demux_queue_fetches_locked (demux);
+  g_mutex_unlock (&demux->fetch_lock);
+
+  /* Posted once the fetch is released, in case the error stops the
+   * demuxer right away */
+  if (failed) {
+    GST_ELEMENT_ERROR (demux, RESOURCE, NOT_FOUND,
+        ("Could not fetch the next fragment"), ("%s", failed));
+    g_free (failed);
+  }
+}
+
+/* Downloads the next fragment in progressive mode, where its data is pushed
+ * while it arrives */
+static gboolean
+gst_hls_demux_get_next_fragment (GstHLSDemux * demux, gboolean caching)
+{
+  GstHLSDemuxFetch *fetch = &demux->fetches[0];
+  gboolean ok;
+
+  if (!gst_hls_demux_fetch_prepare (demux, fetch)) {
+    GST_INFO_OBJECT (demux, "This playlist doesn't contain more fragments");
+    demux->end_of_playlist = TRUE;
+    gst_task_start (demux->stream_task);
+    return FALSE;
+  }
+
+  /* The data after an interrupted fragment isn't continuous either */
+  demux->fragment_discont = fetch->discont || demux->fragment_interrupted;
+  demux->fragment_start = TRUE;
+  demux->fragment_timestamp = fetch->timestamp;
+  demux->fragment_duration = fetch->duration;
+  demux->fragment_ret = GST_FLOW_OK;
+
+  ok = gst_hls_demux_fetch_run (fetch);
+  /* Cancelled by a seek or failed, maybe after some of it was pushed */
+  demux->fragment_interrupted = !ok || demux->fragment_ret != GST_FLOW_OK;
+  if (ok) {
+    g_mutex_lock (&demux->fetch_lock);
+    demux->fetched_bytes += fetch->bytes;
+    demux->fetch_busy_time += fetch->download->download_stop_time -
+        fetch->download->download_start_time;
+    g_mutex_unlock (&demux->fetch_lock);
+    g_object_unref (fetch->download);
+    fetch->download = NULL;
+  }
+
+  if (demux->fragment_ret != GST_FLOW_OK)
+    goto error_pushing;
+
+  return ok && !demux->cancelled;
+
+error_pushing:
   {
+    GstFlowReturn ret = demux->fragment_ret;
+
+    if (ret == GST_FLOW_FLUSHING)
+      return FALSE;
+
+    if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS) {
+      GST_ELEMENT_ERROR (demux, STREAM, FAILED, (NULL),
+          ("stream stopped, reason %s", gst_flow_get_name (ret)));
+      if (demux->srcpad)
+        gst_pad_push_event (demux->srcpad, gst_event_new_eos ());
+    } else {
+      GST_DEBUG_OBJECT (demux, "stream stopped, reason %s",
+          gst_flow_get_name (ret));
+    }
+    /* The updates task holds its timed lock when not caching */
+    gst_hls_demux_pause_tasks (demux, !caching);
     return FALSE;
   }
 }
@@ -29,6 +29,9 @@
 #include "m3u8.h"
 #include "gstfragmented.h"
 #include <gst/uridownloader/gsturidownloader.h>
+#include <gst/uridownloader/gstdownloadrate.h>
+#include <gnutls/gnutls.h>
+#include <gnutls/crypto.h>
 
 G_BEGIN_DECLS
 #define GST_TYPE_HLS_DEMUX \
@@ -45,6 +48,35 @@ G_BEGIN_DECLS
   (G_TYPE_INSTANCE_GET_CLASS ((obj),GST_TYPE_HLS_DEMUX,GstHLSDemuxClass))
 typedef struct _GstHLSDemux GstHLSDemux;
 typedef struct _GstHLSDemuxClass GstHLSDemuxClass;
+typedef struct _GstHLSDemuxFetch GstHLSDemuxFetch;
+
+/* A fragment download, several of them can run at the same time */
+struct _GstHLSDemuxFetch
+{
+  GstHLSDemux *demux;
+  GstUriDownloader *downloader;
+
+  /* State, protected by the fetch lock of the demuxer */
+  gboolean busy;                /* Holds a fragment not queued yet */
+  gboolean done;                /* The download is over */
+  guint64 sequence;             /* Position of the fragment in the queue order */
+
+  /* Fragment to download */
+  gchar *uri;
+  gchar *key;                   /* URI of the key, NULL if not encrypted */
+  GstClockTime timestamp;
+  GstClockTime duration;
+  gboolean discont;
+
+  gsize bytes;                  /* Bytes received so far */
+  GstFragment *download;        /* The result */
+
+  /* Decryption */
+  gboolean decrypting;
+  gnutls_cipher_hd_t aes_ctx;
+  guint8 iv[16];
+  GstAdapter *decrypt_adapter;  /* Encrypted data not decrypted yet */
+};
 
 /**
  * GstHLSDemux:
@@ -74,6 +106,9 @@ struct _GstHLSDemux
   guint fragments_cache;        /* number of fragments needed to be cached to start playing */
   gfloat bitrate_limit;         /* limit of the available bitrate to use */
   guint connection_speed;       /* Network connection speed in kbps (0 = unknown) */
+  gboolean progressive;         /* Push fragments while they are downloaded */
+  guint download_window;        /* Maximum number of fragments fetched at once */
+  guint max_queue_bytes;        /* Limit of the queue size in bytes (0 = none) */
 
   /* Streaming task */
   GstTask *stream_task;
@@ -90,6 +125,44 @@ struct _GstHLSDemux
   /* Position in the stream */
   GstClockTime position_shift;
   gboolean need_segment;
+
+  /* Fragment downloads, run by a pool of threads and queued in playlist
+   * order as soon as they are over */
+  GstHLSDemuxFetch *fetches;
+  guint n_fetches;
+  GThreadPool *fetch_pool;
+  GMutex fetch_lock;
+  GCond fetch_cond;             /* Signalled when a download is over */
+  guint n_busy;                 /* Fetches holding a fragment */
+  guint fetch_target;           /* Fragments to keep queued or downloading */
+  guint64 next_sequence;        /* Sequence of the next fragment started */
+  guint64 queue_sequence;       /* Sequence of the next fragment to queue */
+  gboolean fetch_end;           /* The playlist has no more fragments */
+  gboolean fetch_error;         /* A fragment could not be downloaded */
+  gsize fetched_bytes;          /* Bytes received since the last rate check */
+  GstClockTime fetch_busy_time; /* Time with downloads running since then */
+  GstClockTime fetch_busy_start; /* When the downloads last became busy */
+  GstDownloadRate download_rate; /* Rates of the last downloads */
+
+  /* Fragment being pushed in progressive mode */
+  gboolean fragment_start;      /* Its first buffer wasn't pushed yet */
+  GstClockTime fragment_timestamp;
+  GstClockTime fragment_duration;
+  gboolean fragment_discont;
+  gboolean fragment_interrupted; /* It wasn't pushed completely */
+  GstFlowReturn fragment_ret;   /* Last flow return in progressive mode */
+
+  /* Decryption keys, protected by the fetch lock */
+  gchar *key_url;               /* URL of the last key fetched */
+  GstFragment *key_fragment;    /* The last key fetched */
+
+  /* Statistics, protected by the object lock */
+  guint64 queue_bytes;          /* Size of the fragments in the queue */
+  guint64 n_fetched;
+  guint64 bytes_fetched;
+  guint n_fetch_failures;
+  GstClockTime fetch_time;      /* Total time spent downloading fragments */
+  GstClockTime setup_time;      /* Total time spent setting up sources */
 };
 
 struct _GstHLSDemuxClass
@@ -1,55 +0,0 @@
-/* GStreamer
- * Copyright (C) 2012 Smart TV Alliance
- *  Author: Thiago Sousa Santos <thiago.sousa.santos@collabora.com>, Collabora Ltd.
- *
- * gstdownloadrate.h:
- *
- * This library is free software; you can redistribute it and/or
- * modify it under the terms of the GNU Library General Public
- * License as published by the Free Software Foundation; either
- * version 2 of the License, or (at your option) any later version.
- *
- * This library is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
- * Library General Public License for more details.
- *
- * You should have received a copy of the GNU Library General Public
- * License along with this library; if not, write to the
- * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
- * Boston, MA 02111-1307, USA.
- */
-
-#ifndef __GST_DOWNLOAD_RATE_H__
-#define __GST_DOWNLOAD_RATE_H__
-
-#include <glib-object.h>
-#include <gst/gst.h>
-
-G_BEGIN_DECLS
-
-typedef struct _GstDownloadRate GstDownloadRate;
-
-struct _GstDownloadRate
-{
-  GQueue queue;
-  GMutex mutex;
-
-  gint max_length;
-
-  guint64 total;
-};
-
-void gst_download_rate_init (GstDownloadRate * rate);
-void gst_download_rate_deinit (GstDownloadRate * rate);
-
-void gst_download_rate_set_max_length (GstDownloadRate * rate, gint max_length);
-gint gst_download_rate_get_max_length (GstDownloadRate * rate);
-
-void gst_download_rate_clear (GstDownloadRate * rate);
-void gst_download_rate_add_rate (GstDownloadRate * rate, guint bytes, guint64 time);
-
-guint gst_download_rate_get_current_rate (GstDownloadRate * rate);
-
-G_END_DECLS
-#endif /* __GST_DOWNLOAD_RATE_H__ */
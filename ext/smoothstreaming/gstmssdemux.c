@@ -93,6 +93,7 @@ enum
   PROP_CONNECTION_SPEED,
   PROP_MAX_QUEUE_SIZE_BUFFERS,
   PROP_BITRATE_LIMIT,
+  PROP_AVERAGE_SETUP_TIME,
   PROP_LAST
 };
 
@@ -182,6 +183,12 @@ gst_mss_demux_class_init (GstMssDemuxClass * klass)
           0, 1, DEFAULT_BITRATE_LIMIT,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_AVERAGE_SETUP_TIME,
+      g_param_spec_uint64 ("average-setup-time", "Average setup time",
+          "Average time to set up the source element of a fragment download "
+          "in nanoseconds",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_mss_demux_change_state);
 
@@ -342,6 +349,11 @@ gst_mss_demux_reset (GstMssDemux * mssdemux)
 
   mssdemux->have_group_id = FALSE;
   mssdemux->group_id = G_MAXUINT;
+
+  GST_OBJECT_LOCK (mssdemux);
+  mssdemux->n_fetched = 0;
+  mssdemux->setup_time = 0;
+  GST_OBJECT_UNLOCK (mssdemux);
 }
 
 static void
@@ -403,6 +415,12 @@ gst_mss_demux_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_BITRATE_LIMIT:
       g_value_set_float (value, mssdemux->bitrate_limit);
       break;
+    case PROP_AVERAGE_SETUP_TIME:
+      GST_OBJECT_LOCK (mssdemux);
+      g_value_set_uint64 (value, mssdemux->n_fetched ?
+          mssdemux->setup_time / mssdemux->n_fetched : 0);
+      GST_OBJECT_UNLOCK (mssdemux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -978,11 +996,32 @@ static void
 gst_mss_demux_reconfigure_stream (GstMssDemuxStream * stream)
 {
   GstMssDemux *mssdemux = stream->parent;
-  guint64 new_bitrate;
+  GstDataQueueSize level;
+  GstClockTime fragment_duration, buffer_max;
+  guint64 new_bitrate, *bitrates;
+  guint n_bitrates;
+
+  gst_data_queue_get_level (stream->dataqueue, &level);
+  fragment_duration =
+      gst_mss_stream_get_fragment_gst_duration (stream->manifest_stream);
+  if (GST_CLOCK_TIME_IS_VALID (fragment_duration))
+    buffer_max = mssdemux->data_queue_max_size * fragment_duration;
+  else
+    buffer_max = fragment_duration = 0;
+
+  bitrates = gst_mss_stream_get_bitrates (stream->manifest_stream,
+      &n_bitrates);
+  if (n_bitrates == 0) {
+    g_free (bitrates);
+    return;
+  }
+
+  new_bitrate = gst_download_rate_choose_bitrate (&stream->download_rate,
+      bitrates, n_bitrates,
+      gst_mss_stream_get_current_bitrate (stream->manifest_stream),
+      level.time, buffer_max, fragment_duration, mssdemux->bitrate_limit);
+  g_free (bitrates);
 
-  new_bitrate =
-      mssdemux->bitrate_limit *
-      gst_download_rate_get_current_rate (&stream->download_rate);
   if (mssdemux->connection_speed) {
     new_bitrate = MIN (mssdemux->connection_speed, new_bitrate);
   }
@@ -1031,7 +1070,11 @@ gst_mss_demux_stream_store_object (GstMssDemuxStream * stream,
   item = g_slice_new (GstDataQueueItem);
   item->object = (GstMiniObject *) obj;
 
-  item->duration = 0;           /* we don't care */
+  /* used to know how much is buffered when choosing bitrates */
+  if (GST_IS_BUFFER (obj) && GST_BUFFER_DURATION_IS_VALID (obj))
+    item->duration = GST_BUFFER_DURATION (obj);
+  else
+    item->duration = 0;
   item->size = 0;
   item->visible = TRUE;
 
@@ -1103,6 +1146,11 @@ gst_mss_demux_stream_download_fragment (GstMssDemuxStream * stream,
     return GST_FLOW_ERROR;
   }
 
+  GST_OBJECT_LOCK (mssdemux);
+  mssdemux->n_fetched++;
+  mssdemux->setup_time += fragment->download_setup_time;
+  GST_OBJECT_UNLOCK (mssdemux);
+
   _buffer = gst_fragment_get_buffer (fragment);
   _buffer = gst_buffer_make_writable (_buffer);
   GST_BUFFER_TIMESTAMP (_buffer) =
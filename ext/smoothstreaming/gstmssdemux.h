@@ -28,7 +28,7 @@
 #include <gst/base/gstdataqueue.h>
 #include "gstmssmanifest.h"
 #include <gst/uridownloader/gsturidownloader.h>
-#include "gstdownloadrate.h"
+#include <gst/uridownloader/gstdownloadrate.h>
 
 G_BEGIN_DECLS
 
@@ -112,6 +112,10 @@ struct _GstMssDemux {
   guint64 connection_speed; /* in bps */
   guint data_queue_max_size;
   gfloat bitrate_limit;
+
+  /* statistics, protected by the object lock */
+  guint64 n_fetched;
+  GstClockTime setup_time; /* total time spent setting up sources */
 };
 
 struct _GstMssDemuxClass {
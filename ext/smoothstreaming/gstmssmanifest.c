@@ -29,6 +29,7 @@
 
 /* for parsing h264 codec data */
 #include <gst/codecparsers/gsth264parser.h>
+#include <gst/uridownloader/gstsegmenttable.h>
 
 #include "gstmssmanifest.h"
 
@@ -70,12 +71,13 @@ struct _GstMssStream
   gboolean active;              /* if the stream is currently being used */
   gint selectedQualityIndex;
 
-  GList *fragments;
+  GPtrArray *fragments;         /* array of GstMssStreamFragment */
+  GstSegmentTable fragment_times;       /* time of each fragment */
   GList *qualities;
 
   gchar *url;
 
-  GList *current_fragment;
+  guint current_fragment;       /* fragments->len when the stream is over */
   GList *current_quality;
 
   /* TODO move this to somewhere static */
@@ -146,6 +148,7 @@ _gst_mss_stream_init (GstMssStream * stream, xmlNodePtr node)
   guint64 fragment_time_accum = 0;
 
   stream->xmlnode = node;
+  stream->fragments = g_ptr_array_new_with_free_func (g_free);
 
   /* get the base url path generator */
   stream->url = (gchar *) xmlGetProp (node, (xmlChar *) MSS_PROP_URL);
@@ -195,8 +198,8 @@ _gst_mss_stream_init (GstMssStream * stream, xmlNodePtr node)
         previous_fragment = fragment;
       }
 
-      /* we reverse it later */
-      stream->fragments = g_list_prepend (stream->fragments, fragment);
+      g_ptr_array_add (stream->fragments, fragment);
+      gst_segment_table_append (&stream->fragment_times, fragment->time);
     } else if (node_has_type (iter, MSS_NODE_STREAM_QUALITY)) {
       GstMssStreamQuality *quality = gst_mss_stream_quality_new (iter);
       stream->qualities = g_list_prepend (stream->qualities, quality);
@@ -205,13 +208,11 @@ _gst_mss_stream_init (GstMssStream * stream, xmlNodePtr node)
     }
   }
 
-  stream->fragments = g_list_reverse (stream->fragments);
-
   /* order them from smaller to bigger based on bitrates */
   stream->qualities =
       g_list_sort (stream->qualities, (GCompareFunc) compare_bitrate);
 
-  stream->current_fragment = stream->fragments;
+  stream->current_fragment = 0;
   stream->current_quality = stream->qualities;
 
   stream->regex_bitrate = g_regex_new ("\\{[Bb]itrate\\}", 0, 0, NULL);
@@ -261,7 +262,8 @@ gst_mss_manifest_new (GstBuffer * data)
 static void
 gst_mss_stream_free (GstMssStream * stream)
 {
-  g_list_free_full (stream->fragments, g_free);
+  g_ptr_array_unref (stream->fragments);
+  gst_segment_table_deinit (&stream->fragment_times);
   g_list_free_full (stream->qualities,
       (GDestroyNotify) gst_mss_stream_quality_free);
   xmlFree (stream->url);
@@ -756,6 +758,15 @@ gst_mss_stream_get_caps (GstMssStream * stream)
   return caps;
 }
 
+static GstMssStreamFragment *
+gst_mss_stream_get_current_fragment (GstMssStream * stream)
+{
+  if (stream->current_fragment >= stream->fragments->len)
+    return NULL;
+
+  return g_ptr_array_index (stream->fragments, stream->current_fragment);
+}
+
 GstFlowReturn
 gst_mss_stream_get_fragment_url (GstMssStream * stream, gchar ** url)
 {
@@ -766,11 +777,10 @@ gst_mss_stream_get_fragment_url (GstMssStream * stream, gchar ** url)
 
   g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
 
-  if (stream->current_fragment == NULL) /* stream is over */
+  fragment = gst_mss_stream_get_current_fragment (stream);
+  if (fragment == NULL)         /* stream is over */
     return GST_FLOW_EOS;
 
-  fragment = stream->current_fragment->data;
-
   start_time_str = g_strdup_printf ("%" G_GUINT64_FORMAT, fragment->time);
 
   tmp = g_regex_replace_literal (stream->regex_bitrate, stream->url,
@@ -796,11 +806,10 @@ gst_mss_stream_get_fragment_gst_timestamp (GstMssStream * stream)
 
   g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
 
-  if (!stream->current_fragment)
+  fragment = gst_mss_stream_get_current_fragment (stream);
+  if (!fragment)
     return GST_CLOCK_TIME_NONE;
 
-  fragment = stream->current_fragment->data;
-
   time = fragment->time;
   timescale = gst_mss_stream_get_timescale (stream);
   return (GstClockTime) gst_util_uint64_scale_round (time, GST_SECOND,
@@ -816,11 +825,10 @@ gst_mss_stream_get_fragment_gst_duration (GstMssStream * stream)
 
   g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
 
-  if (!stream->current_fragment)
+  fragment = gst_mss_stream_get_current_fragment (stream);
+  if (!fragment)
     return GST_CLOCK_TIME_NONE;
 
-  fragment = stream->current_fragment->data;
-
   dur = fragment->duration;
   timescale = gst_mss_stream_get_timescale (stream);
   return (GstClockTime) gst_util_uint64_scale_round (dur, GST_SECOND,
@@ -832,11 +840,11 @@ gst_mss_stream_advance_fragment (GstMssStream * stream)
 {
   g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
 
-  if (stream->current_fragment == NULL)
+  if (stream->current_fragment >= stream->fragments->len)
     return GST_FLOW_EOS;
 
-  stream->current_fragment = g_list_next (stream->current_fragment);
-  if (stream->current_fragment == NULL)
+  stream->current_fragment++;
+  if (stream->current_fragment >= stream->fragments->len)
     return GST_FLOW_EOS;
   return GST_FLOW_OK;
 }
@@ -881,30 +889,24 @@ gst_mss_manifest_seek (GstMssManifest * manifest, guint64 time)
 gboolean
 gst_mss_stream_seek (GstMssStream * stream, guint64 time)
 {
-  GList *iter;
+  GstMssStreamFragment *fragment;
   guint64 timescale;
+  gint idx;
+
+  if (stream->fragments->len == 0)
+    return TRUE;
 
   timescale = gst_mss_stream_get_timescale (stream);
   time = gst_util_uint64_scale_round (time, timescale, GST_SECOND);
 
-  for (iter = stream->fragments; iter; iter = g_list_next (iter)) {
-    GList *next = g_list_next (iter);
-    if (next) {
-      GstMssStreamFragment *fragment = next->data;
+  /* last fragment starting at or before time, or the first one */
+  idx = MAX (gst_segment_table_lookup (&stream->fragment_times, time), 0);
+  stream->current_fragment = idx;
 
-      if (fragment->time > time) {
-        stream->current_fragment = iter;
-        break;
-      }
-    } else {
-      GstMssStreamFragment *fragment = iter->data;
-      if (fragment->time + fragment->duration > time) {
-        stream->current_fragment = iter;
-      } else {
-        stream->current_fragment = NULL;        /* EOS */
-      }
-      break;
-    }
+  if (idx == stream->fragments->len - 1) {
+    fragment = g_ptr_array_index (stream->fragments, idx);
+    if (fragment->time + fragment->duration <= time)
+      stream->current_fragment = stream->fragments->len;        /* EOS */
   }
 
   return TRUE;
@@ -939,19 +941,22 @@ static void
 gst_mss_stream_reload_fragments (GstMssStream * stream, xmlNodePtr streamIndex)
 {
   xmlNodePtr iter;
-  GList *new_fragments = NULL;
+  GPtrArray *new_fragments;
+  GstSegmentTable new_fragment_times;
   GstMssStreamFragment *previous_fragment = NULL;
   GstMssStreamFragment *current_fragment =
-      stream->current_fragment ? stream->current_fragment->data : NULL;
+      gst_mss_stream_get_current_fragment (stream);
   guint64 current_time = gst_mss_stream_get_fragment_gst_timestamp (stream);
   guint fragment_number = 0;
   guint64 fragment_time_accum = 0;
 
-  if (!current_fragment && stream->fragments) {
-    current_fragment = g_list_last (stream->fragments)->data;
-  } else if (g_list_previous (stream->current_fragment)) {
+  if (!current_fragment && stream->fragments->len) {
+    current_fragment =
+        g_ptr_array_index (stream->fragments, stream->fragments->len - 1);
+  } else if (current_fragment && stream->current_fragment > 0) {
     /* rewind one as this is the next to be pushed */
-    current_fragment = g_list_previous (stream->current_fragment)->data;
+    current_fragment =
+        g_ptr_array_index (stream->fragments, stream->current_fragment - 1);
   } else {
     current_fragment = NULL;
   }
@@ -962,6 +967,9 @@ gst_mss_stream_reload_fragments (GstMssStream * stream, xmlNodePtr streamIndex)
     fragment_time_accum = current_fragment->time;
   }
 
+  new_fragments = g_ptr_array_new_with_free_func (g_free);
+  gst_segment_table_init (&new_fragment_times);
+
   for (iter = streamIndex->children; iter; iter = iter->next) {
     if (node_has_type (iter, MSS_NODE_STREAM_FRAGMENT)) {
       gchar *duration_str;
@@ -1006,7 +1014,8 @@ gst_mss_stream_reload_fragments (GstMssStream * stream, xmlNodePtr streamIndex)
       }
 
       if (fragment->time > current_time) {
-        new_fragments = g_list_append (new_fragments, fragment);
+        g_ptr_array_add (new_fragments, fragment);
+        gst_segment_table_append (&new_fragment_times, fragment->time);
       } else {
         previous_fragment = NULL;
         g_free (fragment);
@@ -1018,10 +1027,15 @@ gst_mss_stream_reload_fragments (GstMssStream * stream, xmlNodePtr streamIndex)
   }
 
   /* store the new fragments list */
-  if (new_fragments) {
-    g_list_free_full (stream->fragments, g_free);
+  if (new_fragments->len) {
+    g_ptr_array_unref (stream->fragments);
+    gst_segment_table_deinit (&stream->fragment_times);
     stream->fragments = new_fragments;
-    stream->current_fragment = new_fragments;
+    stream->fragment_times = new_fragment_times;
+    stream->current_fragment = 0;
+  } else {
+    g_ptr_array_unref (new_fragments);
+    gst_segment_table_deinit (&new_fragment_times);
   }
 }
 
@@ -1088,7 +1102,7 @@ gst_mss_stream_select_bitrate (GstMssStream * stream, guint64 bitrate)
     next = g_list_next (iter);
     if (next) {
       next_q = next->data;
-      if (next_q->bitrate < bitrate) {
+      if (next_q->bitrate <= bitrate) {
         iter = next;
         q = iter->data;
       } else {
@@ -1105,6 +1119,25 @@ gst_mss_stream_select_bitrate (GstMssStream * stream, guint64 bitrate)
   return TRUE;
 }
 
+/* Returns the bitrates of the qualities of the stream, increasing */
+guint64 *
+gst_mss_stream_get_bitrates (GstMssStream * stream, guint * n_bitrates)
+{
+  guint64 *bitrates;
+  GList *iter;
+  guint i = 0;
+
+  bitrates = g_new (guint64, g_list_length (stream->qualities));
+  for (iter = stream->qualities; iter; iter = g_list_next (iter)) {
+    GstMssStreamQuality *q = iter->data;
+
+    bitrates[i++] = q->bitrate;
+  }
+  *n_bitrates = i;
+
+  return bitrates;
+}
+
 guint64
 gst_mss_stream_get_current_bitrate (GstMssStream * stream)
 {
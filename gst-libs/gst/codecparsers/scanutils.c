@@ -0,0 +1,74 @@
+/* GStreamer
+ *
+ * scanutils.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "scanutils.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Returns the offset of the first 0x000001 start code prefix in @data that
+ * is followed by at least one more byte, or -1 if there is none */
+gint
+scan_for_start_codes (const guint8 * data, guint size)
+{
+  guint i = 0;
+
+  if (G_UNLIKELY (size < 4))
+    return -1;
+
+#ifdef __SSE2__
+  {
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i one = _mm_set1_epi8 (1);
+    __m128i b0, b1, b2;
+    gint mask;
+
+    /* check 16 positions at once, the last one needs 3 bytes after it */
+    for (; i + 19 <= size; i += 16) {
+      b2 = _mm_loadu_si128 ((const __m128i *) (data + i + 2));
+      mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (b2, one));
+      if (G_LIKELY (mask == 0))
+        continue;
+
+      b0 = _mm_loadu_si128 ((const __m128i *) (data + i));
+      b1 = _mm_loadu_si128 ((const __m128i *) (data + i + 1));
+      mask &= _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (b0, zero),
+              _mm_cmpeq_epi8 (b1, zero)));
+      if (mask != 0)
+        return i + g_bit_nth_lsf (mask, -1);
+    }
+  }
+#endif
+
+  /* skip as many bytes as the byte at i + 2 allows */
+  while (i <= size - 4) {
+    if (data[i + 2] > 1)
+      i += 3;
+    else if (data[i + 1])
+      i += 2;
+    else if (data[i] || data[i + 2] != 1)
+      i++;
+    else
+      return i;
+  }
+
+  return -1;
+}
@@ -0,0 +1,309 @@
+/* GStreamer
+ * Copyright (C) 2011 Andoni Morales Alastruey <ylatuya@gmail.com>
+ * Copyright (C) 2012 Smart TV Alliance
+ *  Author: Louis-Francis Ratté-Boulianne <lfrb@collabora.com>, Collabora Ltd.
+ *
+ * gstdownloadrate.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <math.h>
+#include <glib.h>
+#include "gstdownloadrate.h"
+
+/* Half-lives of the moving averages, in seconds of download time. The fast
+ * one follows drops quickly, the slow one ignores short peaks */
+#define FAST_EWMA_HALF_LIFE 2.0
+#define SLOW_EWMA_HALF_LIFE 5.0
+
+/* BOLA parameter weighting the utility of a bitrate against the risk of
+ * rebuffering */
+#define BOLA_GAMMA_P 5.0
+
+static void
+_gst_download_rate_check_remove_rates (GstDownloadRate * rate)
+{
+  if (rate->max_length == 0)
+    return;
+
+  while (g_queue_get_length (&rate->queue) > rate->max_length) {
+    guint bitrate = GPOINTER_TO_UINT (g_queue_pop_head (&rate->queue));
+
+    rate->total -= bitrate;
+  }
+}
+
+void
+gst_download_rate_init (GstDownloadRate * rate)
+{
+  g_queue_init (&rate->queue);
+  g_mutex_init (&rate->mutex);
+  rate->total = 0;
+  rate->max_length = 0;
+  rate->fast_ewma = 0;
+  rate->slow_ewma = 0;
+  rate->ewma_weight = 0;
+}
+
+void
+gst_download_rate_deinit (GstDownloadRate * rate)
+{
+  gst_download_rate_clear (rate);
+  g_mutex_clear (&rate->mutex);
+}
+
+void
+gst_download_rate_set_max_length (GstDownloadRate * rate, gint max_length)
+{
+  g_mutex_lock (&rate->mutex);
+  rate->max_length = max_length;
+  _gst_download_rate_check_remove_rates (rate);
+  g_mutex_unlock (&rate->mutex);
+}
+
+gint
+gst_download_rate_get_max_length (GstDownloadRate * rate)
+{
+  guint ret;
+  g_mutex_lock (&rate->mutex);
+  ret = rate->max_length;
+  g_mutex_unlock (&rate->mutex);
+
+  return ret;
+}
+
+void
+gst_download_rate_clear (GstDownloadRate * rate)
+{
+  g_mutex_lock (&rate->mutex);
+  g_queue_clear (&rate->queue);
+  rate->total = 0;
+  rate->fast_ewma = 0;
+  rate->slow_ewma = 0;
+  rate->ewma_weight = 0;
+  g_mutex_unlock (&rate->mutex);
+}
+
+static void
+_gst_download_rate_update_ewma (gdouble * ewma, gdouble half_life,
+    gdouble weight, gdouble sample)
+{
+  gdouble alpha = pow (0.5, weight / half_life);
+
+  *ewma = sample * (1 - alpha) + alpha * *ewma;
+}
+
+/* The averages start from 0, remove the weight of that initial value */
+static gdouble
+_gst_download_rate_get_ewma (GstDownloadRate * rate, gdouble ewma,
+    gdouble half_life)
+{
+  return ewma / (1 - pow (0.5, rate->ewma_weight / half_life));
+}
+
+void
+gst_download_rate_add_rate (GstDownloadRate * rate, guint bytes, guint64 time)
+{
+  guint64 bitrate;
+  gdouble weight;
+
+  if (time == 0)
+    return;
+
+  g_mutex_lock (&rate->mutex);
+
+  /* convert from bytes / nanoseconds to bits per second */
+  bitrate = G_GUINT64_CONSTANT (8000000000) * bytes / time;
+  bitrate = MIN (bitrate, G_MAXUINT - 1);
+
+  g_queue_push_tail (&rate->queue, GUINT_TO_POINTER ((guint) bitrate));
+  rate->total += bitrate;
+
+  weight = (gdouble) time / GST_SECOND;
+  _gst_download_rate_update_ewma (&rate->fast_ewma, FAST_EWMA_HALF_LIFE,
+      weight, bitrate);
+  _gst_download_rate_update_ewma (&rate->slow_ewma, SLOW_EWMA_HALF_LIFE,
+      weight, bitrate);
+  rate->ewma_weight += weight;
+
+  _gst_download_rate_check_remove_rates (rate);
+  g_mutex_unlock (&rate->mutex);
+}
+
+guint
+gst_download_rate_get_current_rate (GstDownloadRate * rate)
+{
+  guint ret;
+  g_mutex_lock (&rate->mutex);
+  if (g_queue_get_length (&rate->queue))
+    ret = rate->total / g_queue_get_length (&rate->queue);
+  else
+    ret = G_MAXUINT;
+  g_mutex_unlock (&rate->mutex);
+
+  return ret;
+}
+
+/* Harmonic mean of the rates in the history, less sensitive than the
+ * arithmetic mean to a single fast download */
+guint
+gst_download_rate_get_harmonic_rate (GstDownloadRate * rate)
+{
+  GList *walk;
+  gdouble sum = 0;
+  guint ret;
+
+  g_mutex_lock (&rate->mutex);
+  for (walk = rate->queue.head; walk; walk = walk->next)
+    sum += 1.0 / MAX (GPOINTER_TO_UINT (walk->data), 1);
+
+  if (g_queue_get_length (&rate->queue))
+    ret = g_queue_get_length (&rate->queue) / sum;
+  else
+    ret = G_MAXUINT;
+  g_mutex_unlock (&rate->mutex);
+
+  return ret;
+}
+
+/* The lowest of the fast and slow moving averages: drops are followed
+ * quickly while increases need to last before being trusted */
+guint
+gst_download_rate_get_ewma_rate (GstDownloadRate * rate)
+{
+  gdouble fast, slow;
+  guint ret;
+
+  g_mutex_lock (&rate->mutex);
+  if (rate->ewma_weight > 0) {
+    fast = _gst_download_rate_get_ewma (rate, rate->fast_ewma,
+        FAST_EWMA_HALF_LIFE);
+    slow = _gst_download_rate_get_ewma (rate, rate->slow_ewma,
+        SLOW_EWMA_HALF_LIFE);
+    ret = MIN (fast, slow);
+  } else {
+    ret = G_MAXUINT;
+  }
+  g_mutex_unlock (&rate->mutex);
+
+  return ret;
+}
+
+/* Conservative throughput estimate, used to choose bitrates */
+guint
+gst_download_rate_get_estimate (GstDownloadRate * rate)
+{
+  return MIN (gst_download_rate_get_ewma_rate (rate),
+      gst_download_rate_get_harmonic_rate (rate));
+}
+
+/**
+ * gst_download_rate_choose_bitrate:
+ * @rate: the #GstDownloadRate of the stream
+ * @bitrates: (array length=n_bitrates): available bitrates, increasing
+ * @n_bitrates: number of @bitrates
+ * @current_bitrate: bitrate being downloaded
+ * @buffer_level: duration of the data downloaded but not played yet, or
+ *     #GST_CLOCK_TIME_NONE if unknown
+ * @buffer_max: maximum duration of data that can be buffered, 0 if unknown
+ * @fragment_duration: duration of a fragment, 0 if unknown
+ * @safety: fraction of the estimated throughput that can be used
+ *
+ * Chooses the bitrate to download next. The bitrate goes up as soon as the
+ * estimated throughput allows it with the @safety margin, but only goes
+ * down when the current bitrate can't be sustained anymore, to avoid
+ * oscillating. Once the buffer is half full, the buffer level is used like
+ * BOLA does: the bitrate can go one step into the safety margin, and is
+ * kept above the throughput while the buffer level justifies it.
+ *
+ * Returns: one of @bitrates, or @current_bitrate if nothing was downloaded
+ * yet
+ */
+guint64
+gst_download_rate_choose_bitrate (GstDownloadRate * rate,
+    const guint64 * bitrates, guint n_bitrates, guint64 current_bitrate,
+    GstClockTime buffer_level, GstClockTime buffer_max,
+    GstClockTime fragment_duration, gdouble safety)
+{
+  guint estimate;
+  guint i, throughput_idx = 0, current_idx = 0, bola_idx = 0;
+  gdouble q, q_max, v, min_bitrate, score, best_score;
+  gboolean use_buffer;
+
+  g_return_val_if_fail (n_bitrates > 0, current_bitrate);
+
+  estimate = gst_download_rate_get_estimate (rate);
+  if (estimate == G_MAXUINT)
+    return current_bitrate;
+
+  for (i = 0; i < n_bitrates; i++) {
+    if (bitrates[i] <= estimate * safety)
+      throughput_idx = i;
+    if (bitrates[i] <= current_bitrate)
+      current_idx = i;
+  }
+
+  use_buffer = GST_CLOCK_TIME_IS_VALID (buffer_level) && fragment_duration > 0
+      && buffer_max >= 2 * fragment_duration && buffer_level >= buffer_max / 2;
+
+  if (use_buffer) {
+    /* BOLA: maximize (V * (utility + gamma_p) - Q) / bitrate, with the
+     * utility being the log of the bitrate and Q the buffer level in
+     * fragments */
+    q = (gdouble) buffer_level / fragment_duration;
+    q_max = (gdouble) buffer_max / fragment_duration;
+    min_bitrate = MAX (bitrates[0], 1);
+    v = (q_max - 1) / (log (bitrates[n_bitrates - 1] / min_bitrate) +
+        BOLA_GAMMA_P);
+
+    best_score = -G_MAXDOUBLE;
+    for (i = 0; i < n_bitrates; i++) {
+      gdouble bitrate = MAX (bitrates[i], 1);
+
+      score = (v * (log (bitrate / min_bitrate) + BOLA_GAMMA_P) - q) /
+          bitrate;
+      if (score > best_score) {
+        best_score = score;
+        bola_idx = i;
+      }
+    }
+  }
+
+  if (throughput_idx > current_idx)
+    return bitrates[throughput_idx];
+
+  /* With enough buffer, BOLA can take the safety margin to go one step
+   * higher, as long as the throughput covers it */
+  if (use_buffer && bola_idx > current_idx
+      && bitrates[current_idx + 1] <= estimate)
+    return bitrates[current_idx + 1];
+
+  if (throughput_idx == current_idx)
+    return bitrates[current_idx];
+
+  /* The current bitrate isn't sustainable anymore with the safety margin.
+   * Keep it while the throughput still covers it, or while the buffer is
+   * full enough for BOLA to choose it, otherwise go down to what both
+   * allow */
+  if (bitrates[current_idx] <= estimate)
+    return bitrates[current_idx];
+
+  if (use_buffer)
+    return bitrates[MIN (current_idx, MAX (bola_idx, throughput_idx))];
+
+  return bitrates[throughput_idx];
+}
@@ -38,6 +38,12 @@ struct _GstDownloadRate
   gint max_length;
 
   guint64 total;
+
+  /* Moving averages of the rate in bits per second, weighted by the
+   * download time of each sample */
+  gdouble fast_ewma;
+  gdouble slow_ewma;
+  gdouble ewma_weight;          /* Total download time in seconds */
 };
 
 void gst_download_rate_init (GstDownloadRate * rate);
@@ -50,6 +56,14 @@ void gst_download_rate_clear (GstDownloadRate * rate);
 void gst_download_rate_add_rate (GstDownloadRate * rate, guint bytes, guint64 time);
 
 guint gst_download_rate_get_current_rate (GstDownloadRate * rate);
+guint gst_download_rate_get_harmonic_rate (GstDownloadRate * rate);
+guint gst_download_rate_get_ewma_rate (GstDownloadRate * rate);
+guint gst_download_rate_get_estimate (GstDownloadRate * rate);
+
+guint64 gst_download_rate_choose_bitrate (GstDownloadRate * rate,
+    const guint64 * bitrates, guint n_bitrates, guint64 current_bitrate,
+    GstClockTime buffer_level, GstClockTime buffer_max,
+    GstClockTime fragment_duration, gdouble safety);
 
 G_END_DECLS
 #endif /* __GST_DOWNLOAD_RATE_H__ */
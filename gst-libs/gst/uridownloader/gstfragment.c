@@ -161,6 +161,7 @@ gst_fragment_init (GstFragment * fragment)
   g_mutex_init (&fragment->priv->lock);
   priv->buffer = NULL;
   fragment->download_start_time = gst_util_get_timestamp ();
+  fragment->download_setup_time = 0;
   fragment->start_time = 0;
   fragment->stop_time = 0;
   fragment->index = 0;
@@ -209,7 +210,7 @@ gst_fragment_get_buffer (GstFragment * fragment)
 {
   g_return_val_if_fail (fragment != NULL, NULL);
 
-  if (!fragment->completed)
+  if (!fragment->completed || fragment->priv->buffer == NULL)
     return NULL;
 
   gst_buffer_ref (fragment->priv->buffer);
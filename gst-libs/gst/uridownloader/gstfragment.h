@@ -45,6 +45,7 @@ struct _GstFragment
   gboolean completed;           /* Whether the fragment is complete or not */
   guint64 download_start_time;  /* Epoch time when the download started */
   guint64 download_stop_time;   /* Epoch time when the download finished */
+  guint64 download_setup_time;  /* Time spent setting up the source */
   guint64 start_time;           /* Start time of the fragment */
   guint64 stop_time;            /* Stop time of the fragment */
   gboolean index;               /* Index of the fragment */
@@ -0,0 +1,103 @@
+/* GStreamer
+ *
+ * gstsegmenttable.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <glib.h>
+#include "gstsegmenttable.h"
+
+void
+gst_segment_table_init (GstSegmentTable * table)
+{
+  table->starts = NULL;
+}
+
+void
+gst_segment_table_deinit (GstSegmentTable * table)
+{
+  if (table->starts) {
+    g_array_free (table->starts, TRUE);
+    table->starts = NULL;
+  }
+}
+
+void
+gst_segment_table_clear (GstSegmentTable * table)
+{
+  if (table->starts)
+    g_array_set_size (table->starts, 0);
+}
+
+/* A @start smaller than the start of the last segment is raised to it, so
+ * that the table keeps one entry per segment of the caller */
+void
+gst_segment_table_append (GstSegmentTable * table, guint64 start)
+{
+  guint64 last;
+
+  if (table->starts == NULL)
+    table->starts = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+  if (table->starts->len > 0) {
+    last = g_array_index (table->starts, guint64, table->starts->len - 1);
+    start = MAX (start, last);
+  }
+
+  g_array_append_val (table->starts, start);
+}
+
+guint
+gst_segment_table_get_length (GstSegmentTable * table)
+{
+  return table->starts ? table->starts->len : 0;
+}
+
+guint64
+gst_segment_table_get_start (GstSegmentTable * table, guint idx)
+{
+  g_return_val_if_fail (idx < gst_segment_table_get_length (table), 0);
+
+  return g_array_index (table->starts, guint64, idx);
+}
+
+/* Returns the index of the last segment starting at or before @position,
+ * or -1 if there is none */
+gint
+gst_segment_table_lookup (GstSegmentTable * table, guint64 position)
+{
+  const guint64 *starts;
+  guint low, high, mid;
+
+  if (table->starts == NULL)
+    return -1;
+
+  starts = (const guint64 *) table->starts->data;
+  low = 0;
+  high = table->starts->len;
+
+  /* find the first segment starting after position */
+  while (low < high) {
+    mid = low + (high - low) / 2;
+    if (starts[mid] <= position)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return (gint) low - 1;
+}
@@ -0,0 +1,50 @@
+/* GStreamer
+ *
+ * gstsegmenttable.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_SEGMENT_TABLE_H__
+#define __GST_SEGMENT_TABLE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstSegmentTable GstSegmentTable;
+
+/* Start positions of the segments of a stream, in increasing order, to
+ * find the segment holding a position without walking all of them. A
+ * zero-filled table is a valid empty table */
+struct _GstSegmentTable
+{
+  GArray *starts;               /* guint64 */
+};
+
+void gst_segment_table_init (GstSegmentTable * table);
+void gst_segment_table_deinit (GstSegmentTable * table);
+
+void gst_segment_table_clear (GstSegmentTable * table);
+void gst_segment_table_append (GstSegmentTable * table, guint64 start);
+
+guint gst_segment_table_get_length (GstSegmentTable * table);
+guint64 gst_segment_table_get_start (GstSegmentTable * table, guint idx);
+
+gint gst_segment_table_lookup (GstSegmentTable * table, guint64 position);
+
+G_END_DECLS
+#endif /* __GST_SEGMENT_TABLE_H__ */
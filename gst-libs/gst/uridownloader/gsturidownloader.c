@@ -19,6 +19,7 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <string.h>
 #include <glib.h>
 #include "gstfragment.h"
 #include "gsturidownloader.h"
@@ -35,11 +36,16 @@ struct _GstUriDownloaderPrivate
 {
   /* Fragments fetcher */
   GstElement *urisrc;
+  gchar *urisrc_uri;            /* URI urisrc was last set to */
+  gboolean started;             /* urisrc kept running after a download */
+  guint64 received;             /* bytes received for the current download */
   GstBus *bus;
   GstPad *pad;
   GTimeVal *timeout;
   GstFragment *download;
   GMutex download_lock;         /* used to restrict to one download only */
+  GstUriDownloaderDataFunc data_func;
+  gpointer data_func_user_data;
 
   GCond cond;
   gboolean cancelled;
@@ -54,6 +60,7 @@ static gboolean gst_uri_downloader_sink_event (GstPad * pad, GstObject * parent,
     GstEvent * event);
 static GstBusSyncReply gst_uri_downloader_bus_handler (GstBus * bus,
     GstMessage * message, gpointer data);
+static void gst_uri_downloader_destroy_src (GstUriDownloader * downloader);
 
 static GstStaticPadTemplate sinkpadtemplate = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
@@ -109,10 +116,7 @@ gst_uri_downloader_dispose (GObject * object)
 {
   GstUriDownloader *downloader = GST_URI_DOWNLOADER (object);
 
-  if (downloader->priv->urisrc != NULL) {
-    gst_object_unref (downloader->priv->urisrc);
-    downloader->priv->urisrc = NULL;
-  }
+  gst_uri_downloader_destroy_src (downloader);
 
   if (downloader->priv->bus != NULL) {
     gst_object_unref (downloader->priv->bus);
@@ -239,6 +243,26 @@ gst_uri_downloader_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
 
   GST_LOG_OBJECT (downloader, "The uri fetcher received a new buffer "
       "of size %" G_GSIZE_FORMAT, gst_buffer_get_size (buf));
+  downloader->priv->received += gst_buffer_get_size (buf);
+
+  if (downloader->priv->data_func) {
+    GstUriDownloaderDataFunc func = downloader->priv->data_func;
+    gpointer user_data = downloader->priv->data_func_user_data;
+
+    /* The function may block, don't prevent cancelling meanwhile */
+    GST_OBJECT_UNLOCK (downloader);
+    buf = func (downloader, buf, user_data);
+    if (buf == NULL)
+      goto done;
+
+    GST_OBJECT_LOCK (downloader);
+    if (downloader->priv->download == NULL) {
+      GST_OBJECT_UNLOCK (downloader);
+      gst_buffer_unref (buf);
+      goto done;
+    }
+  }
+
   if (!gst_fragment_add_buffer (downloader->priv->download, buf))
     GST_WARNING_OBJECT (downloader, "Could not add buffer to fragment");
   GST_OBJECT_UNLOCK (downloader);
@@ -251,7 +275,7 @@ done:
 
 /* Must be called with mutex locked. */
 static void
-gst_uri_downloader_stop (GstUriDownloader * downloader)
+gst_uri_downloader_destroy_src (GstUriDownloader * downloader)
 {
   GstPad *pad;
   GstElement *urisrc;
@@ -259,9 +283,6 @@ gst_uri_downloader_stop (GstUriDownloader * downloader)
   if (!downloader->priv->urisrc)
     return;
 
-  GST_DEBUG_OBJECT (downloader, "Stopping source element %s",
-      GST_ELEMENT_NAME (downloader->priv->urisrc));
-
   /* remove the bus' sync handler */
   gst_bus_set_sync_handler (downloader->priv->bus, NULL, NULL, NULL);
   /* unlink the source element from the internal pad */
@@ -272,8 +293,11 @@ gst_uri_downloader_stop (GstUriDownloader * downloader)
   }
   urisrc = downloader->priv->urisrc;
   downloader->priv->urisrc = NULL;
+  downloader->priv->started = FALSE;
+  g_free (downloader->priv->urisrc_uri);
+  downloader->priv->urisrc_uri = NULL;
 
-  GST_DEBUG_OBJECT (downloader, "Stopping source element %s",
+  GST_DEBUG_OBJECT (downloader, "Destroying source element %s",
       GST_ELEMENT_NAME (urisrc));
 
   /* set the element state to NULL */
@@ -284,6 +308,28 @@ gst_uri_downloader_stop (GstUriDownloader * downloader)
   gst_object_unref (urisrc);
 }
 
+/* Must be called with mutex locked. After a successful download the source
+ * element is left running, so that the next fetch from the same origin can
+ * restart it with a seek. Stopping it would make HTTP sources close their
+ * session, and with it the connection the next fetch could reuse */
+static void
+gst_uri_downloader_stop (GstUriDownloader * downloader, gboolean keep)
+{
+  if (!downloader->priv->urisrc)
+    return;
+
+  if (!keep) {
+    gst_uri_downloader_destroy_src (downloader);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (downloader, "Keeping source element %s running",
+      GST_ELEMENT_NAME (downloader->priv->urisrc));
+
+  gst_bus_set_flushing (downloader->priv->bus, TRUE);
+  downloader->priv->started = TRUE;
+}
+
 void
 gst_uri_downloader_reset (GstUriDownloader * downloader)
 {
@@ -317,14 +363,16 @@ gst_uri_downloader_cancel (GstUriDownloader * downloader)
   GST_OBJECT_UNLOCK (downloader);
 }
 
+/* Also used to restart a source element left running by the previous
+ * download, which always needs the seek to start the new request */
 static gboolean
 gst_uri_downloader_set_range (GstUriDownloader * downloader,
-    gint64 range_start, gint64 range_end)
+    gint64 range_start, gint64 range_end, gboolean restart)
 {
   g_return_val_if_fail (range_start >= 0, FALSE);
   g_return_val_if_fail (range_end >= -1, FALSE);
 
-  if (range_start || (range_end >= 0)) {
+  if (restart || range_start || (range_end >= 0)) {
     GstEvent *seek;
 
     seek = gst_event_new_seek (1.0, GST_FORMAT_BYTES, GST_SEEK_FLAG_FLUSH,
@@ -335,6 +383,66 @@ gst_uri_downloader_set_range (GstUriDownloader * downloader,
   return TRUE;
 }
 
+/* Returns the scheme and authority of @uri, which a source element can keep
+ * a connection to */
+static gchar *
+gst_uri_downloader_get_origin (const gchar * uri)
+{
+  const gchar *start, *end;
+
+  start = strstr (uri, "://");
+  if (start == NULL)
+    return NULL;
+
+  end = strpbrk (start + 3, "/?#");
+  if (end == NULL)
+    end = uri + strlen (uri);
+
+  return g_ascii_strdown (uri, end - uri);
+}
+
+static gboolean
+gst_uri_downloader_same_origin (const gchar * uri, const gchar * other)
+{
+  gchar *origin, *other_origin;
+  gboolean ret;
+
+  origin = gst_uri_downloader_get_origin (uri);
+  other_origin = gst_uri_downloader_get_origin (other);
+  ret = origin && other_origin && strcmp (origin, other_origin) == 0;
+  g_free (origin);
+  g_free (other_origin);
+
+  return ret;
+}
+
+/* Must be called with mutex locked. Most sources only accept a new URI
+ * when they are stopped, only stop a running one if it refuses it */
+static gboolean
+gst_uri_downloader_set_src_uri (GstUriDownloader * downloader,
+    const gchar * uri)
+{
+  GstURIHandler *handler = GST_URI_HANDLER (downloader->priv->urisrc);
+  GError *err = NULL;
+
+  if (gst_uri_handler_set_uri (handler, uri, &err))
+    return TRUE;
+
+  if (downloader->priv->started) {
+    g_clear_error (&err);
+    downloader->priv->started = FALSE;
+    if (gst_element_set_state (downloader->priv->urisrc,
+            GST_STATE_READY) != GST_STATE_CHANGE_FAILURE
+        && gst_uri_handler_set_uri (handler, uri, &err))
+      return TRUE;
+  }
+
+  GST_DEBUG_OBJECT (downloader, "Failed to re-use source element: %s",
+      err ? err->message : "state change failed");
+  g_clear_error (&err);
+  return FALSE;
+}
+
 static gboolean
 gst_uri_downloader_set_uri (GstUriDownloader * downloader, const gchar * uri)
 {
@@ -343,25 +451,55 @@ gst_uri_downloader_set_uri (GstUriDownloader * downloader, const gchar * uri)
   if (!gst_uri_is_valid (uri))
     return FALSE;
 
-  g_assert (downloader->priv->urisrc == NULL);
+  if (downloader->priv->urisrc) {
+    if (strcmp (downloader->priv->urisrc_uri, uri) == 0) {
+      /* back-to-back fetches of the same URI, usually ranges of it */
+      GST_DEBUG_OBJECT (downloader, "Re-using source element for the same URI");
+      goto setup_bus;
+    }
+
+    if (!gst_uri_downloader_same_origin (downloader->priv->urisrc_uri, uri)) {
+      GST_DEBUG_OBJECT (downloader, "Can't re-use source element for %s", uri);
+      gst_uri_downloader_destroy_src (downloader);
+    } else if (!gst_uri_downloader_set_src_uri (downloader, uri)) {
+      gst_uri_downloader_destroy_src (downloader);
+    } else {
+      GST_DEBUG_OBJECT (downloader, "Re-using source element for the URI:%s",
+          uri);
+      g_free (downloader->priv->urisrc_uri);
+      downloader->priv->urisrc_uri = g_strdup (uri);
+      goto setup_bus;
+    }
+  }
 
   GST_DEBUG_OBJECT (downloader, "Creating source element for the URI:%s", uri);
   downloader->priv->urisrc =
       gst_element_make_from_uri (GST_URI_SRC, uri, NULL, NULL);
   if (!downloader->priv->urisrc)
     return FALSE;
+  downloader->priv->urisrc_uri = g_strdup (uri);
+
+  /* ask HTTP sources to keep their connection open for the next fetches */
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (downloader->
+              priv->urisrc), "keep-alive"))
+    g_object_set (downloader->priv->urisrc, "keep-alive", TRUE, NULL);
 
-  /* add a sync handler for the bus messages to detect errors in the download */
   gst_element_set_bus (GST_ELEMENT (downloader->priv->urisrc),
       downloader->priv->bus);
-  gst_bus_set_sync_handler (downloader->priv->bus,
-      gst_uri_downloader_bus_handler, downloader, NULL);
 
   pad = gst_element_get_static_pad (downloader->priv->urisrc, "src");
-  if (!pad)
+  if (!pad) {
+    gst_uri_downloader_destroy_src (downloader);
     return FALSE;
+  }
   gst_pad_link (pad, downloader->priv->pad);
   gst_object_unref (pad);
+
+setup_bus:
+  /* add a sync handler for the bus messages to detect errors in the download,
+   * it removes itself when it gets one */
+  gst_bus_set_sync_handler (downloader->priv->bus,
+      gst_uri_downloader_bus_handler, downloader, NULL);
   return TRUE;
 }
 
@@ -378,18 +516,66 @@ gst_uri_downloader_fetch_uri (GstUriDownloader * downloader, const gchar * uri)
  * @range_start: the starting byte index
  * @range_end: the final byte index, use -1 for unspecified
  *
+ * The source element of a successful download is kept for the next fetch
+ * from the same origin, so that fetching several ranges of a URI or
+ * consecutive fragments from the same server doesn't need to create a new
+ * element, and can reuse its connection.
+ *
  * Returns the downloaded #GstFragment
  */
 GstFragment *
 gst_uri_downloader_fetch_uri_with_range (GstUriDownloader * downloader,
     const gchar * uri, gint64 range_start, gint64 range_end)
+{
+  return gst_uri_downloader_fetch_uri_full (downloader, uri, range_start,
+      range_end, NULL, NULL);
+}
+
+/**
+ * gst_uri_downloader_fetch_uri_full:
+ * @downloader: the #GstUriDownloader
+ * @uri: the uri
+ * @range_start: the starting byte index
+ * @range_end: the final byte index, use -1 for unspecified
+ * @func: (allow-none): function called for every buffer as it is received
+ * @user_data: user data for @func
+ *
+ * Like gst_uri_downloader_fetch_uri_with_range(), but gives the data to
+ * @func as it arrives, so that it can be processed before the whole URI is
+ * downloaded. Only the buffers returned by @func are kept in the fragment.
+ *
+ * Returns the downloaded #GstFragment
+ */
+/* Must be called with mutex locked. A source element left running by the
+ * previous download can only be restarted with a seek if it is seekable */
+static gboolean
+gst_uri_downloader_src_seekable (GstUriDownloader * downloader)
+{
+  GstQuery *query;
+  gboolean seekable = FALSE;
+
+  query = gst_query_new_seeking (GST_FORMAT_BYTES);
+  if (gst_element_query (downloader->priv->urisrc, query))
+    gst_query_parse_seeking (query, NULL, &seekable, NULL, NULL);
+  gst_query_unref (query);
+
+  return seekable;
+}
+
+GstFragment *
+gst_uri_downloader_fetch_uri_full (GstUriDownloader * downloader,
+    const gchar * uri, gint64 range_start, gint64 range_end,
+    GstUriDownloaderDataFunc func, gpointer user_data)
 {
   GstStateChangeReturn ret;
   GstFragment *download = NULL;
+  guint64 setup_start;
+  gboolean same_uri, restart;
 
   GST_DEBUG_OBJECT (downloader, "Fetching URI %s", uri);
 
   g_mutex_lock (&downloader->priv->download_lock);
+  setup_start = gst_util_get_timestamp ();
 
   GST_OBJECT_LOCK (downloader);
   if (downloader->priv->cancelled) {
@@ -397,40 +583,66 @@ gst_uri_downloader_fetch_uri_with_range (GstUriDownloader * downloader,
     goto quit;
   }
 
+  same_uri = downloader->priv->urisrc_uri &&
+      strcmp (downloader->priv->urisrc_uri, uri) == 0;
   if (!gst_uri_downloader_set_uri (downloader, uri)) {
     GST_WARNING_OBJECT (downloader, "Failed to set URI");
     goto quit;
   }
 
+  /* Sources only know the size of a new URI once they requested it, a
+   * range starting after the end of the previous one would end right
+   * away. Start the source again in that case */
+  restart = downloader->priv->started && (same_uri || range_start == 0)
+      && gst_uri_downloader_src_seekable (downloader);
+
   gst_bus_set_flushing (downloader->priv->bus, FALSE);
   downloader->priv->download = gst_fragment_new ();
-  GST_OBJECT_UNLOCK (downloader);
-  ret = gst_element_set_state (downloader->priv->urisrc, GST_STATE_READY);
-  GST_OBJECT_LOCK (downloader);
-  if (ret == GST_STATE_CHANGE_FAILURE || downloader->priv->download == NULL) {
-    GST_WARNING_OBJECT (downloader, "Failed to set src to READY");
-    goto quit;
-  }
+  downloader->priv->received = 0;
+  downloader->priv->data_func = func;
+  downloader->priv->data_func_user_data = user_data;
 
-  /* might have been cancelled because of failures in state change */
-  if (downloader->priv->cancelled) {
-    goto quit;
-  }
+  if (restart) {
+    GST_DEBUG_OBJECT (downloader, "Restarting the running source element");
+    GST_OBJECT_UNLOCK (downloader);
+    restart = gst_uri_downloader_set_range (downloader, range_start,
+        range_end, TRUE);
+    GST_OBJECT_LOCK (downloader);
+    if (!restart) {
+      GST_WARNING_OBJECT (downloader, "Failed to restart the source element");
+      goto quit;
+    }
+  } else {
+    downloader->priv->started = FALSE;
+    GST_OBJECT_UNLOCK (downloader);
+    ret = gst_element_set_state (downloader->priv->urisrc, GST_STATE_READY);
+    GST_OBJECT_LOCK (downloader);
+    if (ret == GST_STATE_CHANGE_FAILURE || downloader->priv->download == NULL) {
+      GST_WARNING_OBJECT (downloader, "Failed to set src to READY");
+      goto quit;
+    }
 
-  if (!gst_uri_downloader_set_range (downloader, range_start, range_end)) {
-    GST_WARNING_OBJECT (downloader, "Failed to set range");
-    goto quit;
-  }
+    /* might have been cancelled because of failures in state change */
+    if (downloader->priv->cancelled) {
+      goto quit;
+    }
 
-  GST_OBJECT_UNLOCK (downloader);
-  ret = gst_element_set_state (downloader->priv->urisrc, GST_STATE_PLAYING);
-  GST_OBJECT_LOCK (downloader);
-  if (ret == GST_STATE_CHANGE_FAILURE) {
-    if (downloader->priv->download) {
-      g_object_unref (downloader->priv->download);
-      downloader->priv->download = NULL;
+    if (!gst_uri_downloader_set_range (downloader, range_start, range_end,
+            FALSE)) {
+      GST_WARNING_OBJECT (downloader, "Failed to set range");
+      goto quit;
+    }
+
+    GST_OBJECT_UNLOCK (downloader);
+    ret = gst_element_set_state (downloader->priv->urisrc, GST_STATE_PLAYING);
+    GST_OBJECT_LOCK (downloader);
+    if (ret == GST_STATE_CHANGE_FAILURE) {
+      if (downloader->priv->download) {
+        g_object_unref (downloader->priv->download);
+        downloader->priv->download = NULL;
+      }
+      goto quit;
     }
-    goto quit;
   }
 
   /* might have been cancelled because of failures in state change */
@@ -438,13 +650,24 @@ gst_uri_downloader_fetch_uri_with_range (GstUriDownloader * downloader,
     goto quit;
   }
 
+  if (downloader->priv->download) {
+    downloader->priv->download->download_setup_time =
+        gst_util_get_timestamp () - setup_start;
+    GST_LOG_OBJECT (downloader, "Source element set up in %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (downloader->priv->download->download_setup_time));
+  }
+
   /* wait until:
    *   - the download succeed (EOS in the src pad)
    *   - the download failed (Error message on the fetcher bus)
    *   - the download was canceled
+   * The source runs while the lock is released above, so this can already
+   * have happened
    */
   GST_DEBUG_OBJECT (downloader, "Waiting to fetch the URI %s", uri);
-  g_cond_wait (&downloader->priv->cond, GST_OBJECT_GET_LOCK (downloader));
+  while (downloader->priv->download && !downloader->priv->download->completed
+      && !downloader->priv->cancelled)
+    g_cond_wait (&downloader->priv->cond, GST_OBJECT_GET_LOCK (downloader));
 
   if (downloader->priv->cancelled) {
     if (downloader->priv->download) {
@@ -464,7 +687,12 @@ gst_uri_downloader_fetch_uri_with_range (GstUriDownloader * downloader,
 
 quit:
   {
-    gst_uri_downloader_stop (downloader);
+    /* only keep a source element that just worked. One that received
+     * nothing could still have the size of an older URI */
+    gst_uri_downloader_stop (downloader, download != NULL
+        && downloader->priv->received > 0);
+    downloader->priv->data_func = NULL;
+    downloader->priv->data_func_user_data = NULL;
     GST_OBJECT_UNLOCK (downloader);
     g_mutex_unlock (&downloader->priv->download_lock);
     return download;
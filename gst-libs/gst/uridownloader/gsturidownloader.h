@@ -53,11 +53,26 @@ struct _GstUriDownloaderClass
   gpointer _gst_reserved[GST_PADDING];
 };
 
+/**
+ * GstUriDownloaderDataFunc:
+ * @downloader: the #GstUriDownloader
+ * @buffer: (transfer full): a buffer just received
+ * @user_data: user data passed to gst_uri_downloader_fetch_uri_full()
+ *
+ * Called from the streaming thread of the source element for every
+ * buffer received, while the download is running.
+ *
+ * Returns: (transfer full): the buffer to add to the fragment, or %NULL
+ */
+typedef GstBuffer * (*GstUriDownloaderDataFunc) (GstUriDownloader * downloader,
+    GstBuffer * buffer, gpointer user_data);
+
 GType gst_uri_downloader_get_type (void);
 
 GstUriDownloader * gst_uri_downloader_new (void);
 GstFragment * gst_uri_downloader_fetch_uri (GstUriDownloader * downloader, const gchar * uri);
 GstFragment * gst_uri_downloader_fetch_uri_with_range (GstUriDownloader * downloader, const gchar * uri, gint64 range_start, gint64 range_end);
+GstFragment * gst_uri_downloader_fetch_uri_full (GstUriDownloader * downloader, const gchar * uri, gint64 range_start, gint64 range_end, GstUriDownloaderDataFunc func, gpointer user_data);
 void gst_uri_downloader_reset (GstUriDownloader *downloader);
 void gst_uri_downloader_cancel (GstUriDownloader *downloader);
 void gst_uri_downloader_free (GstUriDownloader *downloader);
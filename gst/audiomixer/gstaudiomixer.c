@@ -30,6 +30,12 @@
  * The audiomixer currently mixes all data received on the sinkpads as soon as
  * possible without trying to synchronize the streams.
  *
+ * If upstream is live, each output block is mixed at the latest when its
+ * last sample is due according to the clock and the upstream latency, so a
+ * stalled input does not hold back the others: inputs without data by then
+ * are mixed as silence, and their data that arrives later is clipped to the
+ * current output position or dropped. This adds one block to the latency.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -85,6 +91,34 @@ struct _GstAudioMixerCollect
 #define VOLUME_UNITY_INT32           134217728  /* internal int for unity 2^(32-5) */
 #define VOLUME_UNITY_INT32_BIT_SHIFT 27
 
+/* All the pads are mixed into the output one tile of at most this many
+ * samples at a time, so that the tile stays in the cache while the inputs
+ * are added to it */
+#define MIX_TILE_SAMPLES 1024
+
+/* Integer formats follow volume ramps in steps of this many frames */
+#define RAMP_STEP_FRAMES 32
+
+/* A range of output frames that one thread mixes all jobs into */
+typedef struct
+{
+  guint8 *out;
+  guint start;
+  guint end;
+} GstAudioMixerSlice;
+
+/* An input buffer region to mix into the current output buffer */
+typedef struct
+{
+  GstBuffer *buffer;
+  GstMapInfo map;
+  guint in_offset;              /* offset of the first byte to mix in map */
+  guint out_start;              /* first output frame to mix into */
+  guint n_frames;
+  gdouble volume_start;         /* volume of the first frame */
+  gdouble volume_end;           /* volume the ramp reaches after n_frames */
+} GstAudioMixerJob;
+
 enum
 {
   PROP_PAD_0,
@@ -123,9 +157,6 @@ gst_audiomixer_pad_set_property (GObject * object, guint prop_id,
     case PROP_PAD_VOLUME:
       GST_OBJECT_LOCK (pad);
       pad->volume = g_value_get_double (value);
-      pad->volume_i8 = pad->volume * VOLUME_UNITY_INT8;
-      pad->volume_i16 = pad->volume * VOLUME_UNITY_INT16;
-      pad->volume_i32 = pad->volume * VOLUME_UNITY_INT32;
       GST_OBJECT_UNLOCK (pad);
       break;
     case PROP_PAD_MUTE:
@@ -161,12 +192,14 @@ static void
 gst_audiomixer_pad_init (GstAudioMixerPad * pad)
 {
   pad->volume = DEFAULT_PAD_VOLUME;
+  pad->mixed_volume = -1.0;
   pad->mute = DEFAULT_PAD_MUTE;
 }
 
 #define DEFAULT_ALIGNMENT_THRESHOLD   (40 * GST_MSECOND)
 #define DEFAULT_DISCONT_WAIT (1 * GST_SECOND)
 #define DEFAULT_BLOCKSIZE (1024)
+#define DEFAULT_THREADS (1)
 
 enum
 {
@@ -174,7 +207,8 @@ enum
   PROP_FILTER_CAPS,
   PROP_ALIGNMENT_THRESHOLD,
   PROP_DISCONT_WAIT,
-  PROP_BLOCKSIZE
+  PROP_BLOCKSIZE,
+  PROP_THREADS
 };
 
 /* elementfactory information */
@@ -212,6 +246,7 @@ G_DEFINE_TYPE_WITH_CODE (GstAudioMixer, gst_audiomixer, GST_TYPE_ELEMENT,
         gst_audiomixer_child_proxy_init));
 
 static void gst_audiomixer_dispose (GObject * object);
+static void gst_audiomixer_finalize (GObject * object);
 static void gst_audiomixer_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_audiomixer_get_property (GObject * object, guint prop_id,
@@ -228,6 +263,8 @@ static gboolean gst_audiomixer_src_event (GstPad * pad, GstObject * parent,
 static gboolean gst_audiomixer_sink_event (GstCollectPads * pads,
     GstCollectData * pad, GstEvent * event, gpointer user_data);
 
+static void gst_audiomixer_timeout_loop (GstAudioMixer * audiomixer);
+
 static GstPad *gst_audiomixer_request_new_pad (GstElement * element,
     GstPadTemplate * temp, const gchar * unused, const GstCaps * caps);
 static void gst_audiomixer_release_pad (GstElement * element, GstPad * pad);
@@ -362,6 +399,42 @@ gst_audiomixer_sink_query (GstCollectPads * pads, GstCollectData * pad,
   return res;
 }
 
+/* Publishes the deadline of the current output block to the timeout task,
+ * must be called with the object lock */
+static void
+gst_audiomixer_update_deadline_unlocked (GstAudioMixer * audiomixer)
+{
+  GstClockTime deadline = GST_CLOCK_TIME_NONE;
+  gint rate = GST_AUDIO_INFO_RATE (&audiomixer->info);
+
+  if (audiomixer->live && rate > 0 && audiomixer->segment.rate > 0.0) {
+    GstClockTime end;
+
+    end = gst_util_uint64_scale (audiomixer->offset + audiomixer->blocksize,
+        GST_SECOND, rate);
+    deadline = gst_segment_to_running_time (&audiomixer->segment,
+        GST_FORMAT_TIME, end);
+    if (GST_CLOCK_TIME_IS_VALID (deadline))
+      deadline += audiomixer->latency;
+  }
+
+  if (deadline != audiomixer->deadline) {
+    audiomixer->deadline = deadline;
+    if (audiomixer->timeout_id)
+      gst_clock_id_unschedule (audiomixer->timeout_id);
+  }
+  audiomixer->deadline_pending = GST_CLOCK_TIME_IS_VALID (deadline);
+  g_cond_signal (&audiomixer->timeout_cond);
+}
+
+static void
+gst_audiomixer_update_deadline (GstAudioMixer * audiomixer)
+{
+  GST_OBJECT_LOCK (audiomixer);
+  gst_audiomixer_update_deadline_unlocked (audiomixer);
+  GST_OBJECT_UNLOCK (audiomixer);
+}
+
 /* the first caps we receive on any of the sinkpads will define the caps for all
  * the other sinkpads because we can only mix streams with the same caps.
  */
@@ -373,6 +446,7 @@ gst_audiomixer_setcaps (GstAudioMixer * audiomixer, GstPad * pad,
   GstAudioInfo info;
   GstStructure *s;
   gint channels;
+  gboolean live;
 
   caps = gst_caps_copy (orig_caps);
 
@@ -409,9 +483,16 @@ gst_audiomixer_setcaps (GstAudioMixer * audiomixer, GstPad * pad,
 
   memcpy (&audiomixer->info, &info, sizeof (info));
   audiomixer->send_caps = TRUE;
+  live = audiomixer->live;
+  gst_audiomixer_update_deadline_unlocked (audiomixer);
   GST_OBJECT_UNLOCK (audiomixer);
   /* send caps event later, after stream-start event */
 
+  /* our latency depends on the rate in live mode */
+  if (live)
+    gst_element_post_message (GST_ELEMENT_CAST (audiomixer),
+        gst_message_new_latency (GST_OBJECT_CAST (audiomixer)));
+
   GST_INFO_OBJECT (pad, "handle caps change to %" GST_PTR_FORMAT, caps);
 
   gst_caps_unref (caps);
@@ -514,8 +595,10 @@ gst_audiomixer_query_duration (GstAudioMixer * audiomixer, GstQuery * query)
   return res;
 }
 
+/* Asks the peers of all sink pads for their latency and combines them */
 static gboolean
-gst_audiomixer_query_latency (GstAudioMixer * audiomixer, GstQuery * query)
+gst_audiomixer_peer_latency (GstAudioMixer * audiomixer, gboolean * live_out,
+    GstClockTime * min_out, GstClockTime * max_out)
 {
   GstClockTime min, max;
   gboolean live;
@@ -588,8 +671,64 @@ gst_audiomixer_query_latency (GstAudioMixer * audiomixer, GstQuery * query)
   g_value_unset (&item);
   gst_iterator_free (it);
 
+  *live_out = live;
+  *min_out = min;
+  *max_out = max;
+
+  return res;
+}
+
+/* Stores the upstream latency without waiting for a latency query from
+ * downstream. An async sink only sends one once it prerolled, so a live
+ * input that doesn't deliver data at startup would block the mix forever */
+static void
+gst_audiomixer_update_latency (GstAudioMixer * audiomixer)
+{
+  GstClockTime min, max;
+  gboolean live;
+
+  if (!gst_audiomixer_peer_latency (audiomixer, &live, &min, &max))
+    return;
+
+  GST_DEBUG_OBJECT (audiomixer, "Upstream latency: live %s, min %"
+      GST_TIME_FORMAT, (live ? "yes" : "no"), GST_TIME_ARGS (min));
+
+  GST_OBJECT_LOCK (audiomixer);
+  audiomixer->live = live;
+  audiomixer->latency = min;
+  gst_audiomixer_update_deadline_unlocked (audiomixer);
+  GST_OBJECT_UNLOCK (audiomixer);
+}
+
+static gboolean
+gst_audiomixer_query_latency (GstAudioMixer * audiomixer, GstQuery * query)
+{
+  GstClockTime min, max;
+  gboolean live;
+  gboolean res;
+
+  res = gst_audiomixer_peer_latency (audiomixer, &live, &min, &max);
+
   if (res) {
+    gint rate;
+
     /* store the results */
+    GST_OBJECT_LOCK (audiomixer);
+    audiomixer->live = live;
+    audiomixer->latency = min;
+    rate = GST_AUDIO_INFO_RATE (&audiomixer->info);
+    if (live && rate > 0) {
+      GstClockTime block;
+
+      /* a block is mixed once its last sample is due */
+      block = gst_util_uint64_scale (audiomixer->blocksize, GST_SECOND, rate);
+      min += block;
+      if (max != GST_CLOCK_TIME_NONE)
+        max += block;
+    }
+    gst_audiomixer_update_deadline_unlocked (audiomixer);
+    GST_OBJECT_UNLOCK (audiomixer);
+
     GST_DEBUG_OBJECT (audiomixer, "Calculated total latency: live %s, min %"
         GST_TIME_FORMAT ", max %" GST_TIME_FORMAT,
         (live ? "yes" : "no"), GST_TIME_ARGS (min), GST_TIME_ARGS (max));
@@ -982,6 +1121,7 @@ gst_audiomixer_class_init (GstAudioMixerClass * klass)
   gobject_class->set_property = gst_audiomixer_set_property;
   gobject_class->get_property = gst_audiomixer_get_property;
   gobject_class->dispose = gst_audiomixer_dispose;
+  gobject_class->finalize = gst_audiomixer_finalize;
 
   g_object_class_install_property (gobject_class, PROP_FILTER_CAPS,
       g_param_spec_boxed ("caps", "Target caps",
@@ -1008,6 +1148,12 @@ gst_audiomixer_class_init (GstAudioMixerClass * klass)
           G_MAXUINT, DEFAULT_BLOCKSIZE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_THREADS,
+      g_param_spec_uint ("threads", "Threads",
+          "Number of threads to mix with (0 = one per processor)", 0,
+          G_MAXINT, DEFAULT_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&gst_audiomixer_src_template));
   gst_element_class_add_pad_template (gstelement_class,
@@ -1049,6 +1195,18 @@ gst_audiomixer_init (GstAudioMixer * audiomixer)
   audiomixer->alignment_threshold = DEFAULT_ALIGNMENT_THRESHOLD;
   audiomixer->discont_wait = DEFAULT_DISCONT_WAIT;
   audiomixer->blocksize = DEFAULT_BLOCKSIZE;
+  audiomixer->mix_jobs = g_array_new (FALSE, FALSE, sizeof (GstAudioMixerJob));
+  audiomixer->threads = DEFAULT_THREADS;
+  g_mutex_init (&audiomixer->mix_lock);
+  g_cond_init (&audiomixer->mix_cond);
+  audiomixer->deadline = GST_CLOCK_TIME_NONE;
+
+  g_rec_mutex_init (&audiomixer->timeout_lock);
+  g_cond_init (&audiomixer->timeout_cond);
+  audiomixer->timeout_task =
+      gst_task_new ((GstTaskFunction) gst_audiomixer_timeout_loop, audiomixer,
+      NULL);
+  gst_task_set_lock (audiomixer->timeout_task, &audiomixer->timeout_lock);
 
   /* keep track of the sinkpads requested */
   audiomixer->collect = gst_collect_pads_new ();
@@ -1074,6 +1232,21 @@ gst_audiomixer_dispose (GObject * object)
   gst_caps_replace (&audiomixer->filter_caps, NULL);
   gst_caps_replace (&audiomixer->current_caps, NULL);
 
+  if (audiomixer->mix_jobs) {
+    g_array_free (audiomixer->mix_jobs, TRUE);
+    audiomixer->mix_jobs = NULL;
+  }
+
+  if (audiomixer->mix_pool) {
+    g_thread_pool_free (audiomixer->mix_pool, FALSE, TRUE);
+    audiomixer->mix_pool = NULL;
+  }
+
+  if (audiomixer->timeout_task) {
+    gst_object_unref (audiomixer->timeout_task);
+    audiomixer->timeout_task = NULL;
+  }
+
   if (audiomixer->pending_events) {
     g_list_foreach (audiomixer->pending_events, (GFunc) gst_event_unref, NULL);
     g_list_free (audiomixer->pending_events);
@@ -1083,6 +1256,19 @@ gst_audiomixer_dispose (GObject * object)
   G_OBJECT_CLASS (parent_class)->dispose (object);
 }
 
+static void
+gst_audiomixer_finalize (GObject * object)
+{
+  GstAudioMixer *audiomixer = GST_AUDIO_MIXER (object);
+
+  g_rec_mutex_clear (&audiomixer->timeout_lock);
+  g_cond_clear (&audiomixer->timeout_cond);
+  g_mutex_clear (&audiomixer->mix_lock);
+  g_cond_clear (&audiomixer->mix_cond);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
 static void
 gst_audiomixer_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
@@ -1120,6 +1306,11 @@ gst_audiomixer_set_property (GObject * object, guint prop_id,
     case PROP_BLOCKSIZE:
       audiomixer->blocksize = g_value_get_uint (value);
       break;
+    case PROP_THREADS:
+      GST_OBJECT_LOCK (audiomixer);
+      audiomixer->threads = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (audiomixer);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1147,6 +1338,11 @@ gst_audiomixer_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_BLOCKSIZE:
       g_value_set_uint (value, audiomixer->blocksize);
       break;
+    case PROP_THREADS:
+      GST_OBJECT_LOCK (audiomixer);
+      g_value_set_uint (value, audiomixer->threads);
+      GST_OBJECT_UNLOCK (audiomixer);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1243,6 +1439,10 @@ gst_audiomixer_do_clip (GstCollectPads * pads, GstCollectData * data,
   GstAudioMixer *audiomixer = GST_AUDIO_MIXER (user_data);
   gint rate, bpf;
 
+  if (g_atomic_int_compare_and_exchange (&audiomixer->latency_pending, TRUE,
+          FALSE))
+    gst_audiomixer_update_latency (audiomixer);
+
   rate = GST_AUDIO_INFO_RATE (&audiomixer->info);
   bpf = GST_AUDIO_INFO_BPF (&audiomixer->info);
 
@@ -1324,12 +1524,19 @@ gst_audio_mixer_fill_buffer (GstAudioMixer * audiomixer, GstCollectPads * pads,
   }
 
   if (discont) {
+    GstAudioMixerPad *pad = GST_AUDIO_MIXER_PAD (collect_data->pad);
+
     /* Have discont, need resync */
     if (adata->next_offset != -1)
       GST_INFO_OBJECT (collect_data->pad, "Have discont. Expected %"
           G_GUINT64_FORMAT ", got %" G_GUINT64_FORMAT,
           adata->next_offset, start_offset);
     adata->output_offset = -1;
+
+    /* no point in ramping from the volume of unrelated samples */
+    GST_OBJECT_LOCK (pad);
+    pad->mixed_volume = -1.0;
+    GST_OBJECT_UNLOCK (pad);
   } else {
     audiomixer->discont_time = GST_CLOCK_TIME_NONE;
   }
@@ -1402,16 +1609,18 @@ gst_audio_mixer_fill_buffer (GstAudioMixer * audiomixer, GstCollectPads * pads,
   return TRUE;
 }
 
+/* Queues the part of the current input buffer of @adata that overlaps the
+ * output buffer, it is mixed together with all the other pads by
+ * gst_audio_mixer_mix_jobs() */
 static void
-gst_audio_mixer_mix_buffer (GstAudioMixer * audiomixer, GstCollectPads * pads,
-    GstCollectData * collect_data, GstAudioMixerCollect * adata,
-    GstMapInfo * outmap)
+gst_audio_mixer_queue_mix (GstAudioMixer * audiomixer, GstCollectPads * pads,
+    GstCollectData * collect_data, GstAudioMixerCollect * adata)
 {
   GstAudioMixerPad *pad = GST_AUDIO_MIXER_PAD (adata->collect.pad);
+  GstAudioMixerJob job;
   guint overlap;
   guint out_start;
   GstBuffer *inbuf;
-  GstMapInfo inmap;
   gint bpf;
 
   bpf = GST_AUDIO_INFO_BPF (&audiomixer->info);
@@ -1432,8 +1641,11 @@ gst_audio_mixer_mix_buffer (GstAudioMixer * audiomixer, GstCollectPads * pads,
   g_assert (inbuf != NULL && inbuf == adata->buffer);
 
   GST_OBJECT_LOCK (pad);
-  if (pad->mute || pad->volume < G_MINDOUBLE) {
+  /* A pad whose volume just dropped to 0 still ramps down to it */
+  if (pad->mute || (pad->volume < G_MINDOUBLE
+          && pad->mixed_volume < G_MINDOUBLE)) {
     GST_DEBUG_OBJECT (pad, "Skipping muted pad");
+    pad->mixed_volume = pad->mute ? -1.0 : 0.0;
     gst_buffer_unref (inbuf);
     adata->position += adata->size;
     adata->output_offset += adata->size / bpf;
@@ -1459,117 +1671,499 @@ gst_audio_mixer_mix_buffer (GstAudioMixer * audiomixer, GstCollectPads * pads,
     return;
   }
 
-  gst_buffer_map (inbuf, &inmap, GST_MAP_READ);
   GST_LOG_OBJECT (pad, "mixing %u bytes at offset %u from offset %u",
       overlap * bpf, out_start * bpf, adata->position);
-  /* further buffers, need to add them */
-  if (pad->volume == 1.0) {
-    switch (audiomixer->info.finfo->format) {
+
+  /* The job keeps the reference we got from peeking, the buffer stays
+   * mapped until everything is mixed */
+  job.buffer = inbuf;
+  gst_buffer_map (inbuf, &job.map, GST_MAP_READ);
+  job.in_offset = adata->position;
+  job.out_start = out_start;
+  job.n_frames = overlap;
+  /* Ramp from the volume of the previous sample to the current one, so that
+   * volume changes don't click */
+  job.volume_start = pad->mixed_volume >= 0.0 ? pad->mixed_volume :
+      pad->volume;
+  job.volume_end = pad->volume;
+  pad->mixed_volume = pad->volume;
+  g_array_append_val (audiomixer->mix_jobs, job);
+
+  adata->position += overlap * bpf;
+  adata->output_offset += overlap;
+
+  if (adata->position == adata->size) {
+    /* Buffer done, drop it */
+    gst_buffer_replace (&adata->buffer, NULL);
+    gst_buffer_unref (gst_collect_pads_pop (pads, collect_data));
+    GST_DEBUG_OBJECT (pad, "Finished mixing buffer, waiting for next");
+  }
+
+  GST_OBJECT_UNLOCK (pad);
+}
+
+/* Adds @n_samples samples from @in scaled by @volume to @out */
+static void
+gst_audio_mixer_add (GstAudioFormat format, guint8 * out, const guint8 * in,
+    gint n_samples, gdouble volume)
+{
+  if (volume == 1.0) {
+    switch (format) {
       case GST_AUDIO_FORMAT_U8:
-        audiomixer_orc_add_u8 ((gpointer) (outmap->data + out_start * bpf),
-            (gpointer) (inmap.data + adata->position),
-            overlap * audiomixer->info.channels);
+        audiomixer_orc_add_u8 ((gpointer) out, (gpointer) in, n_samples);
         break;
       case GST_AUDIO_FORMAT_S8:
-        audiomixer_orc_add_s8 ((gpointer) (outmap->data + out_start * bpf),
-            (gpointer) (inmap.data + adata->position),
-            overlap * audiomixer->info.channels);
+        audiomixer_orc_add_s8 ((gpointer) out, (gpointer) in, n_samples);
         break;
       case GST_AUDIO_FORMAT_U16:
-        audiomixer_orc_add_u16 ((gpointer) (outmap->data + out_start * bpf),
-            (gpointer) (inmap.data + adata->position),
-            overlap * audiomixer->info.channels);
+        audiomixer_orc_add_u16 ((gpointer) out, (gpointer) in, n_samples);
         break;
       case GST_AUDIO_FORMAT_S16:
-        audiomixer_orc_add_s16 ((gpointer) (outmap->data + out_start * bpf),
-            (gpointer) (inmap.data + adata->position),
-            overlap * audiomixer->info.channels);
+        audiomixer_orc_add_s16 ((gpointer) out, (gpointer) in, n_samples);
         break;
       case GST_AUDIO_FORMAT_U32:
-        audiomixer_orc_add_u32 ((gpointer) (outmap->data + out_start * bpf),
-            (gpointer) (inmap.data + adata->position),
-            overlap * audiomixer->info.channels);
+        audiomixer_orc_add_u32 ((gpointer) out, (gpointer) in, n_samples);
         break;
       case GST_AUDIO_FORMAT_S32:
-        audiomixer_orc_add_s32 ((gpointer) (outmap->data + out_start * bpf),
-            (gpointer) (inmap.data + adata->position),
-            overlap * audiomixer->info.channels);
+        audiomixer_orc_add_s32 ((gpointer) out, (gpointer) in, n_samples);
         break;
       case GST_AUDIO_FORMAT_F32:
-        audiomixer_orc_add_f32 ((gpointer) (outmap->data + out_start * bpf),
-            (gpointer) (inmap.data + adata->position),
-            overlap * audiomixer->info.channels);
+        audiomixer_orc_add_f32 ((gpointer) out, (gpointer) in, n_samples);
         break;
       case GST_AUDIO_FORMAT_F64:
-        audiomixer_orc_add_f64 ((gpointer) (outmap->data + out_start * bpf),
-            (gpointer) (inmap.data + adata->position),
-            overlap * audiomixer->info.channels);
+        audiomixer_orc_add_f64 ((gpointer) out, (gpointer) in, n_samples);
         break;
       default:
         g_assert_not_reached ();
         break;
     }
   } else {
-    switch (audiomixer->info.finfo->format) {
+    switch (format) {
       case GST_AUDIO_FORMAT_U8:
-        audiomixer_orc_add_volume_u8 ((gpointer) (outmap->data +
-                out_start * bpf), (gpointer) (inmap.data + adata->position),
-            pad->volume_i8, overlap * audiomixer->info.channels);
+        audiomixer_orc_add_volume_u8 ((gpointer) out, (gpointer) in,
+            volume * VOLUME_UNITY_INT8, n_samples);
         break;
       case GST_AUDIO_FORMAT_S8:
-        audiomixer_orc_add_volume_s8 ((gpointer) (outmap->data +
-                out_start * bpf), (gpointer) (inmap.data + adata->position),
-            pad->volume_i8, overlap * audiomixer->info.channels);
+        audiomixer_orc_add_volume_s8 ((gpointer) out, (gpointer) in,
+            volume * VOLUME_UNITY_INT8, n_samples);
         break;
       case GST_AUDIO_FORMAT_U16:
-        audiomixer_orc_add_volume_u16 ((gpointer) (outmap->data +
-                out_start * bpf), (gpointer) (inmap.data + adata->position),
-            pad->volume_i16, overlap * audiomixer->info.channels);
+        audiomixer_orc_add_volume_u16 ((gpointer) out, (gpointer) in,
+            volume * VOLUME_UNITY_INT16, n_samples);
         break;
       case GST_AUDIO_FORMAT_S16:
-        audiomixer_orc_add_volume_s16 ((gpointer) (outmap->data +
-                out_start * bpf), (gpointer) (inmap.data + adata->position),
-            pad->volume_i16, overlap * audiomixer->info.channels);
+        audiomixer_orc_add_volume_s16 ((gpointer) out, (gpointer) in,
+            volume * VOLUME_UNITY_INT16, n_samples);
         break;
       case GST_AUDIO_FORMAT_U32:
-        audiomixer_orc_add_volume_u32 ((gpointer) (outmap->data +
-                out_start * bpf), (gpointer) (inmap.data + adata->position),
-            pad->volume_i32, overlap * audiomixer->info.channels);
+        audiomixer_orc_add_volume_u32 ((gpointer) out, (gpointer) in,
+            volume * VOLUME_UNITY_INT32, n_samples);
         break;
       case GST_AUDIO_FORMAT_S32:
-        audiomixer_orc_add_volume_s32 ((gpointer) (outmap->data +
-                out_start * bpf), (gpointer) (inmap.data + adata->position),
-            pad->volume_i32, overlap * audiomixer->info.channels);
+        audiomixer_orc_add_volume_s32 ((gpointer) out, (gpointer) in,
+            volume * VOLUME_UNITY_INT32, n_samples);
         break;
       case GST_AUDIO_FORMAT_F32:
-        audiomixer_orc_add_volume_f32 ((gpointer) (outmap->data +
-                out_start * bpf), (gpointer) (inmap.data + adata->position),
-            pad->volume, overlap * audiomixer->info.channels);
+        audiomixer_orc_add_volume_f32 ((gpointer) out, (gpointer) in,
+            volume, n_samples);
         break;
       case GST_AUDIO_FORMAT_F64:
-        audiomixer_orc_add_volume_f64 ((gpointer) (outmap->data +
-                out_start * bpf), (gpointer) (inmap.data + adata->position),
-            pad->volume, overlap * audiomixer->info.channels);
+        audiomixer_orc_add_volume_f64 ((gpointer) out, (gpointer) in,
+            volume, n_samples);
         break;
       default:
         g_assert_not_reached ();
         break;
     }
   }
-  gst_buffer_unmap (inbuf, &inmap);
-  gst_buffer_unref (inbuf);
+}
 
-  adata->position += overlap * bpf;
-  adata->output_offset += overlap;
+/* Gain of frame @frame of @job */
+static inline gdouble
+gst_audio_mixer_job_gain (const GstAudioMixerJob * job, guint frame)
+{
+  return job->volume_start + (job->volume_end - job->volume_start) *
+      frame / job->n_frames;
+}
 
-  if (adata->position == adata->size) {
-    /* Buffer done, drop it */
-    gst_buffer_replace (&adata->buffer, NULL);
-    gst_buffer_unref (gst_collect_pads_pop (pads, collect_data));
-    GST_DEBUG_OBJECT (pad, "Finished mixing buffer, waiting for next");
+/* Mixes all jobs into frames [@start, @end) of the output in one pass over
+ * the tile. The loops are kept simple so that the compiler can vectorise
+ * them, the gains of a ramp are computed once per frame */
+#define MAKE_FLOAT_MIX_TILE(type, ctype) \
+static void \
+gst_audio_mixer_mix_tile_##type (GstAudioMixerJob * jobs, guint n_jobs, \
+    gint channels, guint8 * out, guint start, guint end) \
+{ \
+  ctype gains[MIX_TILE_SAMPLES]; \
+  guint i, j, f, c, n; \
+  \
+  for (j = 0; j < n_jobs; j++) { \
+    GstAudioMixerJob *job = &jobs[j]; \
+    const ctype *in; \
+    ctype *a; \
+    guint first, last; \
+    \
+    first = MAX (start, job->out_start); \
+    last = MIN (end, job->out_start + job->n_frames); \
+    if (first >= last) \
+      continue; \
+    \
+    a = (ctype *) out + first * channels; \
+    in = (const ctype *) (job->map.data + job->in_offset) + \
+        (first - job->out_start) * channels; \
+    n = (last - first) * channels; \
+    \
+    if (job->volume_start == job->volume_end) { \
+      ctype g = job->volume_end; \
+      \
+      for (i = 0; i < n; i++) \
+        a[i] += in[i] * g; \
+    } else if (n <= MIX_TILE_SAMPLES) { \
+      for (f = first, i = 0; f < last; f++) { \
+        ctype g = gst_audio_mixer_job_gain (job, f - job->out_start); \
+        \
+        for (c = 0; c < channels; c++) \
+          gains[i++] = g; \
+      } \
+      for (i = 0; i < n; i++) \
+        a[i] += in[i] * gains[i]; \
+    } else { \
+      /* more channels than fit in a tile */ \
+      for (f = first, i = 0; f < last; f++) { \
+        ctype g = gst_audio_mixer_job_gain (job, f - job->out_start); \
+        \
+        for (c = 0; c < channels; c++, i++) \
+          a[i] += in[i] * g; \
+      } \
+    } \
+  } \
+}
+
+MAKE_FLOAT_MIX_TILE (F32, gfloat)
+MAKE_FLOAT_MIX_TILE (F64, gdouble)
+
+/* Integer formats saturate in the ORC kernels, we use them per job and
+ * follow ramps in steps of RAMP_STEP_FRAMES frames */
+static void
+gst_audio_mixer_mix_tile_int (GstAudioFormat format, gint bpf, gint channels,
+    GstAudioMixerJob * jobs, guint n_jobs, guint8 * out, guint start,
+    guint end)
+{
+  guint j, f, step;
+
+  for (j = 0; j < n_jobs; j++) {
+    GstAudioMixerJob *job = &jobs[j];
+    const guint8 *in;
+    guint first, last;
+
+    first = MAX (start, job->out_start);
+    last = MIN (end, job->out_start + job->n_frames);
+    if (first >= last)
+      continue;
+
+    in = job->map.data + job->in_offset + (first - job->out_start) * bpf;
+
+    if (job->volume_start == job->volume_end) {
+      gst_audio_mixer_add (format, out + first * bpf, in,
+          (last - first) * channels, job->volume_end);
+      continue;
+    }
+
+    for (f = first; f < last; f += step) {
+      step = MIN (RAMP_STEP_FRAMES, last - f);
+      gst_audio_mixer_add (format, out + f * bpf, in, step * channels,
+          gst_audio_mixer_job_gain (job, f - job->out_start + step / 2));
+      in += step * bpf;
+    }
   }
+}
 
-  GST_OBJECT_UNLOCK (pad);
+/* Mixes all the queued jobs into output frames [@start, @end), tile by
+ * tile. Tiles start at multiples of the tile size from @start, so how
+ * the frames are split over threads does not change the result */
+static void
+gst_audio_mixer_mix_range (GstAudioMixer * audiomixer, guint8 * out,
+    guint start, guint end)
+{
+  GstAudioMixerJob *jobs;
+  GstAudioFormat format;
+  guint n_jobs, tile, tile_end;
+  gint bpf, channels;
+
+  jobs = (GstAudioMixerJob *) audiomixer->mix_jobs->data;
+  n_jobs = audiomixer->mix_jobs->len;
+  format = GST_AUDIO_INFO_FORMAT (&audiomixer->info);
+  bpf = GST_AUDIO_INFO_BPF (&audiomixer->info);
+  channels = GST_AUDIO_INFO_CHANNELS (&audiomixer->info);
+
+  tile = MAX (1, MIX_TILE_SAMPLES / channels);
+  for (; start < end; start = tile_end) {
+    tile_end = MIN (end, start + tile);
+
+    switch (format) {
+      case GST_AUDIO_FORMAT_F32:
+        gst_audio_mixer_mix_tile_F32 (jobs, n_jobs, channels, out, start,
+            tile_end);
+        break;
+      case GST_AUDIO_FORMAT_F64:
+        gst_audio_mixer_mix_tile_F64 (jobs, n_jobs, channels, out, start,
+            tile_end);
+        break;
+      default:
+        gst_audio_mixer_mix_tile_int (format, bpf, channels, jobs, n_jobs,
+            out, start, tile_end);
+        break;
+    }
+  }
+}
+
+/* Runs in the worker threads */
+static void
+gst_audio_mixer_mix_slice (GstAudioMixerSlice * slice,
+    GstAudioMixer * audiomixer)
+{
+  gst_audio_mixer_mix_range (audiomixer, slice->out, slice->start,
+      slice->end);
+
+  g_mutex_lock (&audiomixer->mix_lock);
+  if (--audiomixer->mix_pending == 0)
+    g_cond_signal (&audiomixer->mix_cond);
+  g_mutex_unlock (&audiomixer->mix_lock);
+}
+
+/* Returns the number of threads to mix with, making sure there are enough
+ * workers for them */
+static guint
+gst_audio_mixer_get_mix_threads (GstAudioMixer * audiomixer)
+{
+  GError *err = NULL;
+  guint threads;
+
+  GST_OBJECT_LOCK (audiomixer);
+  threads = audiomixer->threads;
+  GST_OBJECT_UNLOCK (audiomixer);
+
+  if (threads == 0) {
+#if GLIB_CHECK_VERSION (2, 36, 0)
+    threads = g_get_num_processors ();
+#else
+    threads = 1;
+#endif
+  }
+
+  if (threads <= 1)
+    return 1;
+
+  if (audiomixer->mix_pool
+      && g_thread_pool_get_max_threads (audiomixer->mix_pool) ==
+      (gint) threads - 1)
+    return threads;
+
+  if (audiomixer->mix_pool)
+    g_thread_pool_free (audiomixer->mix_pool, FALSE, TRUE);
+
+  audiomixer->mix_pool =
+      g_thread_pool_new ((GFunc) gst_audio_mixer_mix_slice, audiomixer,
+      threads - 1, TRUE, &err);
+  if (audiomixer->mix_pool == NULL) {
+    GST_WARNING_OBJECT (audiomixer, "Failed to start %u mixing threads: %s",
+        threads - 1, err->message);
+    g_clear_error (&err);
+    return 1;
+  }
+
+  GST_DEBUG_OBJECT (audiomixer, "Mixing with %u threads", threads);
+
+  return threads;
+}
+
+/* Mixes all the queued jobs into @outmap, then releases their buffers. With
+ * several threads, each one mixes all jobs into its own range of tiles */
+static void
+gst_audio_mixer_mix_jobs (GstAudioMixer * audiomixer, GstMapInfo * outmap)
+{
+  GstAudioMixerJob *jobs;
+  GstAudioMixerSlice *slices;
+  guint n_jobs, start, end, tile, n_tiles, n_slices, per_slice, threads;
+  guint i, j;
+  gint channels;
+
+  n_jobs = audiomixer->mix_jobs->len;
+  if (n_jobs == 0)
+    return;
+
+  jobs = (GstAudioMixerJob *) audiomixer->mix_jobs->data;
+
+  start = G_MAXUINT;
+  end = 0;
+  for (j = 0; j < n_jobs; j++) {
+    start = MIN (start, jobs[j].out_start);
+    end = MAX (end, jobs[j].out_start + jobs[j].n_frames);
+  }
+
+  GST_LOG_OBJECT (audiomixer, "mixing %u buffers into frames %u to %u",
+      n_jobs, start, end);
+
+  channels = GST_AUDIO_INFO_CHANNELS (&audiomixer->info);
+  tile = MAX (1, MIX_TILE_SAMPLES / channels);
+  n_tiles = (end - start + tile - 1) / tile;
+  threads = gst_audio_mixer_get_mix_threads (audiomixer);
+
+  if (threads > 1 && n_tiles > 1) {
+    per_slice = (n_tiles + MIN (threads, n_tiles) - 1) / MIN (threads, n_tiles);
+    n_slices = (n_tiles + per_slice - 1) / per_slice;
+    slices = g_newa (GstAudioMixerSlice, n_slices);
+    for (i = 0; i < n_slices; i++) {
+      slices[i].out = outmap->data;
+      slices[i].start = start + i * per_slice * tile;
+      slices[i].end = MIN (end, slices[i].start + per_slice * tile);
+    }
+
+    audiomixer->mix_pending = n_slices - 1;
+    for (i = 1; i < n_slices; i++)
+      g_thread_pool_push (audiomixer->mix_pool, &slices[i], NULL);
+
+    gst_audio_mixer_mix_range (audiomixer, slices[0].out, slices[0].start,
+        slices[0].end);
+
+    g_mutex_lock (&audiomixer->mix_lock);
+    while (audiomixer->mix_pending > 0)
+      g_cond_wait (&audiomixer->mix_cond, &audiomixer->mix_lock);
+    g_mutex_unlock (&audiomixer->mix_lock);
+  } else {
+    gst_audio_mixer_mix_range (audiomixer, outmap->data, start, end);
+  }
+
+  for (j = 0; j < n_jobs; j++) {
+    gst_buffer_unmap (jobs[j].buffer, &jobs[j].map);
+    gst_buffer_unref (jobs[j].buffer);
+  }
+  g_array_set_size (audiomixer->mix_jobs, 0);
+}
+
+/* Lets the mix go on without the pads that have no data at the deadline
+ * of the current output block */
+static void
+gst_audiomixer_timeout_loop (GstAudioMixer * audiomixer)
+{
+  GstClock *clock;
+  GstClockID id;
+  GstClockTime deadline;
+  GstClockReturn res;
+  GSList *l;
+
+  GST_OBJECT_LOCK (audiomixer);
+  while (!audiomixer->timeout_flushing && !audiomixer->deadline_pending)
+    g_cond_wait (&audiomixer->timeout_cond, GST_OBJECT_GET_LOCK (audiomixer));
+
+  clock = GST_ELEMENT_CLOCK (audiomixer);
+  if (audiomixer->timeout_flushing || clock == NULL) {
+    audiomixer->deadline_pending = FALSE;
+    GST_OBJECT_UNLOCK (audiomixer);
+    return;
+  }
+
+  deadline = audiomixer->deadline;
+  audiomixer->deadline_pending = FALSE;
+  clock = gst_object_ref (clock);
+  id = gst_clock_new_single_shot_id (clock,
+      GST_ELEMENT_CAST (audiomixer)->base_time + deadline);
+  audiomixer->timeout_id = id;
+  GST_OBJECT_UNLOCK (audiomixer);
+
+  GST_LOG_OBJECT (audiomixer, "waiting for deadline %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (deadline));
+  res = gst_clock_id_wait (id, NULL);
+
+  GST_OBJECT_LOCK (audiomixer);
+  audiomixer->timeout_id = NULL;
+  GST_OBJECT_UNLOCK (audiomixer);
+  gst_clock_id_unref (id);
+  gst_object_unref (clock);
+
+  /* deadline changed or flushing */
+  if (res == GST_CLOCK_UNSCHEDULED)
+    return;
+
+  /* If we're mixing already, the current block moves on and gets a new
+   * deadline anyway */
+  if (!g_rec_mutex_trylock (GST_COLLECT_PADS_GET_STREAM_LOCK
+          (audiomixer->collect)))
+    return;
+
+  GST_OBJECT_LOCK (audiomixer);
+  if (audiomixer->deadline != deadline) {
+    GST_OBJECT_UNLOCK (audiomixer);
+    GST_COLLECT_PADS_STREAM_UNLOCK (audiomixer->collect);
+    return;
+  }
+  GST_OBJECT_UNLOCK (audiomixer);
+
+  for (l = audiomixer->collect->data; l; l = l->next) {
+    GstCollectData *collect_data = l->data;
+
+    if (collect_data->buffer == NULL
+        && !GST_COLLECT_PADS_STATE_IS_SET (collect_data,
+            GST_COLLECT_PADS_STATE_EOS)
+        && GST_COLLECT_PADS_STATE_IS_SET (collect_data,
+            GST_COLLECT_PADS_STATE_WAITING)) {
+      GST_INFO_OBJECT (collect_data->pad, "No data at deadline %"
+          GST_TIME_FORMAT ", mixing without it", GST_TIME_ARGS (deadline));
+      /* resync once data comes again */
+      ((GstAudioMixerCollect *) collect_data)->output_offset = -1;
+      gst_collect_pads_set_waiting (audiomixer->collect, collect_data, FALSE);
+    }
+  }
+  GST_COLLECT_PADS_STREAM_UNLOCK (audiomixer->collect);
+}
+
+/* Pads that missed the previous deadline only don't hold back the mix if
+ * the deadline of the current block passed too. Returns FALSE if a pad
+ * has to be waited for again */
+static gboolean
+gst_audiomixer_check_late_pads (GstAudioMixer * audiomixer,
+    GstCollectPads * pads)
+{
+  GstClock *clock = NULL;
+  GstClockTime deadline, base_time;
+  gboolean passed = FALSE, ready = TRUE;
+  GSList *l;
+
+  GST_OBJECT_LOCK (audiomixer);
+  if (!audiomixer->live) {
+    GST_OBJECT_UNLOCK (audiomixer);
+    return TRUE;
+  }
+  deadline = audiomixer->deadline;
+  base_time = GST_ELEMENT_CAST (audiomixer)->base_time;
+  if (GST_ELEMENT_CLOCK (audiomixer))
+    clock = gst_object_ref (GST_ELEMENT_CLOCK (audiomixer));
+  GST_OBJECT_UNLOCK (audiomixer);
+
+  if (clock) {
+    passed = GST_CLOCK_TIME_IS_VALID (deadline)
+        && gst_clock_get_time (clock) >= base_time + deadline;
+    gst_object_unref (clock);
+  }
+
+  for (l = pads->data; l; l = l->next) {
+    GstCollectData *collect_data = l->data;
+
+    if (GST_COLLECT_PADS_STATE_IS_SET (collect_data,
+            GST_COLLECT_PADS_STATE_WAITING))
+      continue;
+
+    if (collect_data->buffer) {
+      GST_INFO_OBJECT (collect_data->pad, "Late pad has data again");
+      gst_collect_pads_set_waiting (pads, collect_data, TRUE);
+    } else if (!passed && !GST_COLLECT_PADS_STATE_IS_SET (collect_data,
+            GST_COLLECT_PADS_STATE_EOS)) {
+      gst_collect_pads_set_waiting (pads, collect_data, TRUE);
+      ready = FALSE;
+    }
+  }
+
+  return ready;
 }
 
 static GstFlowReturn
@@ -1711,6 +2305,12 @@ gst_audiomixer_collected (GstCollectPads * pads, gpointer user_data)
     audiomixer->pending_events = NULL;
   }
 
+  if (!gst_audiomixer_check_late_pads (audiomixer, pads)) {
+    GST_DEBUG_OBJECT (audiomixer, "Waiting for late pads until the deadline");
+    gst_audiomixer_update_deadline (audiomixer);
+    return GST_FLOW_OK;
+  }
+
   /* for the next timestamp, use the sample counter, which will
    * never accumulate rounding errors */
 
@@ -1750,8 +2350,13 @@ gst_audiomixer_collected (GstCollectPads * pads, gpointer user_data)
     adata = (GstAudioMixerCollect *) collect_data;
 
     inbuf = gst_collect_pads_peek (pads, collect_data);
-    if (!inbuf)
+    if (!inbuf) {
+      /* A late pad in live mode, mixed as silence */
+      if (!GST_COLLECT_PADS_STATE_IS_SET (collect_data,
+              GST_COLLECT_PADS_STATE_EOS))
+        is_eos = FALSE;
       continue;
+    }
 
     /* New buffer? */
     if (!adata->buffer || adata->buffer != inbuf) {
@@ -1778,8 +2383,7 @@ gst_audiomixer_collected (GstCollectPads * pads, gpointer user_data)
         && adata->output_offset <
         audiomixer->offset + audiomixer->blocksize && adata->buffer) {
       GST_LOG_OBJECT (collect_data->pad, "Mixing buffer for current offset");
-      gst_audio_mixer_mix_buffer (audiomixer, pads, collect_data, adata,
-          &outmap);
+      gst_audio_mixer_queue_mix (audiomixer, pads, collect_data, adata);
       if (adata->output_offset >= next_offset) {
         GST_DEBUG_OBJECT (collect_data->pad,
             "Pad is after current offset: %" G_GUINT64_FORMAT " >= %"
@@ -1790,12 +2394,14 @@ gst_audiomixer_collected (GstCollectPads * pads, gpointer user_data)
     }
   }
 
+  gst_audio_mixer_mix_jobs (audiomixer, &outmap);
   gst_buffer_unmap (outbuf, &outmap);
 
   if (dropped) {
     /* We dropped a buffer, retry */
     GST_DEBUG_OBJECT (audiomixer,
         "A pad dropped a buffer, wait for the next one");
+    gst_audiomixer_update_deadline (audiomixer);
     return GST_FLOW_OK;
   }
 
@@ -1803,6 +2409,7 @@ gst_audiomixer_collected (GstCollectPads * pads, gpointer user_data)
     /* Get more buffers */
     GST_DEBUG_OBJECT (audiomixer,
         "We're not done yet for the current offset," " waiting for more data");
+    gst_audiomixer_update_deadline (audiomixer);
     return GST_FLOW_OK;
   }
 
@@ -1859,6 +2466,7 @@ gst_audiomixer_collected (GstCollectPads * pads, gpointer user_data)
 
   audiomixer->offset = next_offset;
   audiomixer->segment.position = next_timestamp;
+  gst_audiomixer_update_deadline (audiomixer);
 
   /* send it out */
   GST_LOG_OBJECT (audiomixer,
@@ -1913,8 +2521,30 @@ gst_audiomixer_change_state (GstElement * element, GstStateChange transition)
       gst_segment_init (&audiomixer->segment, GST_FORMAT_TIME);
       gst_collect_pads_start (audiomixer->collect);
       audiomixer->discont_time = GST_CLOCK_TIME_NONE;
+      GST_OBJECT_LOCK (audiomixer);
+      audiomixer->live = FALSE;
+      audiomixer->latency = 0;
+      audiomixer->deadline = GST_CLOCK_TIME_NONE;
+      audiomixer->deadline_pending = FALSE;
+      GST_OBJECT_UNLOCK (audiomixer);
+      g_atomic_int_set (&audiomixer->latency_pending, TRUE);
       break;
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+      gst_audiomixer_update_latency (audiomixer);
+      GST_OBJECT_LOCK (audiomixer);
+      audiomixer->timeout_flushing = FALSE;
+      GST_OBJECT_UNLOCK (audiomixer);
+      gst_task_start (audiomixer->timeout_task);
+      break;
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      gst_task_stop (audiomixer->timeout_task);
+      GST_OBJECT_LOCK (audiomixer);
+      audiomixer->timeout_flushing = TRUE;
+      if (audiomixer->timeout_id)
+        gst_clock_id_unschedule (audiomixer->timeout_id);
+      g_cond_signal (&audiomixer->timeout_cond);
+      GST_OBJECT_UNLOCK (audiomixer);
+      gst_task_join (audiomixer->timeout_task);
       break;
     case GST_STATE_CHANGE_PAUSED_TO_READY:
       /* need to unblock the collectpads before calling the
@@ -84,6 +84,37 @@ struct _GstAudioMixer {
   /* Size in samples that is output per buffer */
   guint blocksize;
 
+  /* Input buffers to mix into the current output buffer */
+  GArray *mix_jobs;
+
+  /* Number of threads mixing, 0 for one per processor */
+  guint threads;
+  /* Workers mixing next to the streaming thread */
+  GThreadPool *mix_pool;
+  GMutex mix_lock;
+  GCond mix_cond;
+  guint mix_pending;
+
+  /* Live mode: if upstream is live, the current output block is mixed when
+   * its deadline passes, even if some pads have no data yet. Protected by
+   * the object lock */
+  gboolean live;
+  /* Upstream latency from the last latency query */
+  GstClockTime latency;
+  /* Whether upstream still has to be asked for its latency on the first
+   * buffer, accessed atomically */
+  volatile gint latency_pending;
+  /* Running time at which the current output block is due */
+  GstClockTime deadline;
+  gboolean deadline_pending;
+  gboolean timeout_flushing;
+  GstClockID timeout_id;
+
+  /* Waits for the deadlines and stops waiting for late pads */
+  GstTask *timeout_task;
+  GRecMutex timeout_lock;
+  GCond timeout_cond;
+
   /* Pending inline events */
   GList *pending_events;
   
@@ -108,9 +139,9 @@ struct _GstAudioMixerPad {
   GstPad parent;
 
   gdouble volume;
-  gint volume_i32;
-  gint volume_i16;
-  gint volume_i8;
+  /* Volume the last mixed sample was scaled with, or -1 if the next
+   * buffer starts without ramping from it */
+  gdouble mixed_volume;
   gboolean mute;
 };
 
@@ -63,6 +63,8 @@ static void gst_inter_audio_sink_get_times (GstBaseSink * sink,
     GstBuffer * buffer, GstClockTime * start, GstClockTime * end);
 static gboolean gst_inter_audio_sink_start (GstBaseSink * sink);
 static gboolean gst_inter_audio_sink_stop (GstBaseSink * sink);
+static gboolean gst_inter_audio_sink_query (GstBaseSink * sink,
+    GstQuery * query);
 static GstFlowReturn gst_inter_audio_sink_render (GstBaseSink * sink,
     GstBuffer * buffer);
 
@@ -113,6 +115,7 @@ gst_inter_audio_sink_class_init (GstInterAudioSinkClass * klass)
       GST_DEBUG_FUNCPTR (gst_inter_audio_sink_get_times);
   base_sink_class->start = GST_DEBUG_FUNCPTR (gst_inter_audio_sink_start);
   base_sink_class->stop = GST_DEBUG_FUNCPTR (gst_inter_audio_sink_stop);
+  base_sink_class->query = GST_DEBUG_FUNCPTR (gst_inter_audio_sink_query);
   base_sink_class->render = GST_DEBUG_FUNCPTR (gst_inter_audio_sink_render);
 
   g_object_class_install_property (gobject_class, PROP_CHANNEL,
@@ -201,7 +204,8 @@ gst_inter_audio_sink_start (GstBaseSink * sink)
 
   GST_DEBUG ("start");
 
-  interaudiosink->surface = gst_inter_surface_get (interaudiosink->channel);
+  interaudiosink->surface = gst_inter_surface_get (interaudiosink->channel,
+      GST_INTER_SURFACE_PRODUCER);
 
   return TRUE;
 }
@@ -217,12 +221,22 @@ gst_inter_audio_sink_stop (GstBaseSink * sink)
   gst_adapter_clear (interaudiosink->surface->audio_adapter);
   g_mutex_unlock (&interaudiosink->surface->mutex);
 
-  gst_inter_surface_unref (interaudiosink->surface);
+  gst_inter_surface_unref (interaudiosink->surface, GST_INTER_SURFACE_PRODUCER);
   interaudiosink->surface = NULL;
 
   return TRUE;
 }
 
+static gboolean
+gst_inter_audio_sink_query (GstBaseSink * sink, GstQuery * query)
+{
+  if (gst_inter_surface_query_channels (query))
+    return TRUE;
+
+  return GST_BASE_SINK_CLASS (gst_inter_audio_sink_parent_class)->query (sink,
+      query);
+}
+
 static GstFlowReturn
 gst_inter_audio_sink_render (GstBaseSink * sink, GstBuffer * buffer)
 {
@@ -242,6 +256,7 @@ gst_inter_audio_sink_render (GstBaseSink * sink, GstBuffer * buffer)
   }
   gst_adapter_push (interaudiosink->surface->audio_adapter,
       gst_buffer_ref (buffer));
+  gst_inter_surface_add_buffer_stats (interaudiosink->surface, buffer);
   g_mutex_unlock (&interaudiosink->surface->mutex);
 
   return GST_FLOW_OK;
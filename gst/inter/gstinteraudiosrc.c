@@ -217,7 +217,8 @@ gst_inter_audio_src_start (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (interaudiosrc, "start");
 
-  interaudiosrc->surface = gst_inter_surface_get (interaudiosrc->channel);
+  interaudiosrc->surface = gst_inter_surface_get (interaudiosrc->channel,
+      GST_INTER_SURFACE_CONSUMER);
 
   return TRUE;
 }
@@ -229,7 +230,7 @@ gst_inter_audio_src_stop (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (interaudiosrc, "stop");
 
-  gst_inter_surface_unref (interaudiosrc->surface);
+  gst_inter_surface_unref (interaudiosrc->surface, GST_INTER_SURFACE_CONSUMER);
   interaudiosrc->surface = NULL;
   interaudiosrc->finfo = NULL;
 
@@ -339,6 +340,9 @@ gst_inter_audio_src_query (GstBaseSrc * src, GstQuery * query)
 
   GST_DEBUG_OBJECT (src, "query");
 
+  if (gst_inter_surface_query_channels (query))
+    return TRUE;
+
   switch (GST_QUERY_TYPE (query)) {
     case GST_QUERY_LATENCY:{
       GstClockTime min_latency, max_latency;
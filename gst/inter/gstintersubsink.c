@@ -58,6 +58,8 @@ static void gst_inter_sub_sink_get_times (GstBaseSink * sink,
     GstBuffer * buffer, GstClockTime * start, GstClockTime * end);
 static gboolean gst_inter_sub_sink_start (GstBaseSink * sink);
 static gboolean gst_inter_sub_sink_stop (GstBaseSink * sink);
+static gboolean gst_inter_sub_sink_query (GstBaseSink * sink,
+    GstQuery * query);
 static GstFlowReturn
 gst_inter_sub_sink_render (GstBaseSink * sink, GstBuffer * buffer);
 
@@ -105,6 +107,7 @@ gst_inter_sub_sink_class_init (GstInterSubSinkClass * klass)
   base_sink_class->get_times = GST_DEBUG_FUNCPTR (gst_inter_sub_sink_get_times);
   base_sink_class->start = GST_DEBUG_FUNCPTR (gst_inter_sub_sink_start);
   base_sink_class->stop = GST_DEBUG_FUNCPTR (gst_inter_sub_sink_stop);
+  base_sink_class->query = GST_DEBUG_FUNCPTR (gst_inter_sub_sink_query);
   base_sink_class->render = GST_DEBUG_FUNCPTR (gst_inter_sub_sink_render);
 
   g_object_class_install_property (gobject_class, PROP_CHANNEL,
@@ -184,7 +187,8 @@ gst_inter_sub_sink_start (GstBaseSink * sink)
 {
   GstInterSubSink *intersubsink = GST_INTER_SUB_SINK (sink);
 
-  intersubsink->surface = gst_inter_surface_get (intersubsink->channel);
+  intersubsink->surface = gst_inter_surface_get (intersubsink->channel,
+      GST_INTER_SURFACE_PRODUCER);
 
   return TRUE;
 }
@@ -201,12 +205,22 @@ gst_inter_sub_sink_stop (GstBaseSink * sink)
   intersubsink->surface->sub_buffer = NULL;
   g_mutex_unlock (&intersubsink->surface->mutex);
 
-  gst_inter_surface_unref (intersubsink->surface);
+  gst_inter_surface_unref (intersubsink->surface, GST_INTER_SURFACE_PRODUCER);
   intersubsink->surface = NULL;
 
   return TRUE;
 }
 
+static gboolean
+gst_inter_sub_sink_query (GstBaseSink * sink, GstQuery * query)
+{
+  if (gst_inter_surface_query_channels (query))
+    return TRUE;
+
+  return GST_BASE_SINK_CLASS (gst_inter_sub_sink_parent_class)->query (sink,
+      query);
+}
+
 static GstFlowReturn
 gst_inter_sub_sink_render (GstBaseSink * sink, GstBuffer * buffer)
 {
@@ -218,6 +232,7 @@ gst_inter_sub_sink_render (GstBaseSink * sink, GstBuffer * buffer)
   }
   intersubsink->surface->sub_buffer = gst_buffer_ref (buffer);
   //intersubsink->surface->sub_buffer_count = 0;
+  gst_inter_surface_add_buffer_stats (intersubsink->surface, buffer);
   g_mutex_unlock (&intersubsink->surface->mutex);
 
   return GST_FLOW_OK;
@@ -57,6 +57,8 @@ static void gst_inter_sub_src_get_property (GObject * object,
 
 static gboolean gst_inter_sub_src_start (GstBaseSrc * src);
 static gboolean gst_inter_sub_src_stop (GstBaseSrc * src);
+static gboolean gst_inter_sub_src_query (GstBaseSrc * src,
+    GstQuery * query);
 static void
 gst_inter_sub_src_get_times (GstBaseSrc * src, GstBuffer * buffer,
     GstClockTime * start, GstClockTime * end);
@@ -107,6 +109,7 @@ gst_inter_sub_src_class_init (GstInterSubSrcClass * klass)
   gobject_class->get_property = gst_inter_sub_src_get_property;
   base_src_class->start = GST_DEBUG_FUNCPTR (gst_inter_sub_src_start);
   base_src_class->stop = GST_DEBUG_FUNCPTR (gst_inter_sub_src_stop);
+  base_src_class->query = GST_DEBUG_FUNCPTR (gst_inter_sub_src_query);
   base_src_class->get_times = GST_DEBUG_FUNCPTR (gst_inter_sub_src_get_times);
   base_src_class->create = GST_DEBUG_FUNCPTR (gst_inter_sub_src_create);
 
@@ -170,7 +173,8 @@ gst_inter_sub_src_start (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (intersubsrc, "start");
 
-  intersubsrc->surface = gst_inter_surface_get (intersubsrc->channel);
+  intersubsrc->surface = gst_inter_surface_get (intersubsrc->channel,
+      GST_INTER_SURFACE_CONSUMER);
 
   return TRUE;
 }
@@ -182,12 +186,22 @@ gst_inter_sub_src_stop (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (intersubsrc, "stop");
 
-  gst_inter_surface_unref (intersubsrc->surface);
+  gst_inter_surface_unref (intersubsrc->surface, GST_INTER_SURFACE_CONSUMER);
   intersubsrc->surface = NULL;
 
   return TRUE;
 }
 
+static gboolean
+gst_inter_sub_src_query (GstBaseSrc * src, GstQuery * query)
+{
+  if (gst_inter_surface_query_channels (query))
+    return TRUE;
+
+  return GST_BASE_SRC_CLASS (gst_inter_sub_src_parent_class)->query (src,
+      query);
+}
+
 static void
 gst_inter_sub_src_get_times (GstBaseSrc * src, GstBuffer * buffer,
     GstClockTime * start, GstClockTime * end)
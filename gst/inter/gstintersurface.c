@@ -21,43 +21,277 @@
 #include "config.h"
 #endif
 
-#include <string.h>
-
 #include "gstintersurface.h"
 
-static GList *list;
+/* name -> GstInterSurface */
+static GHashTable *surfaces;
 static GMutex mutex;
 
 
 GstInterSurface *
-gst_inter_surface_get (const char *name)
+gst_inter_surface_get (const char *name, GstInterSurfaceRole role)
 {
-  GList *g;
   GstInterSurface *surface;
 
   g_mutex_lock (&mutex);
 
-  for (g = list; g; g = g_list_next (g)) {
-    surface = (GstInterSurface *) g->data;
-    if (strcmp (name, surface->name) == 0) {
-      g_mutex_unlock (&mutex);
-      return surface;
-    }
-  }
+  if (!surfaces)
+    surfaces = g_hash_table_new (g_str_hash, g_str_equal);
+
+  surface = g_hash_table_lookup (surfaces, name);
+  if (!surface) {
+    surface = g_malloc0 (sizeof (GstInterSurface));
+    surface->name = g_strdup (name);
+    g_mutex_init (&surface->mutex);
+    surface->audio_adapter = gst_adapter_new ();
+    surface->creation_time = g_get_monotonic_time ();
 
-  surface = g_malloc0 (sizeof (GstInterSurface));
-  surface->name = g_strdup (name);
-  g_mutex_init (&surface->mutex);
-  surface->audio_adapter = gst_adapter_new ();
+    g_hash_table_insert (surfaces, surface->name, surface);
+  }
 
-  list = g_list_append (list, surface);
+  if (role == GST_INTER_SURFACE_PRODUCER)
+    surface->n_producers++;
+  else
+    surface->n_consumers++;
   g_mutex_unlock (&mutex);
 
   return surface;
 }
 
+/* The surface is freed once all the elements using it are gone */
+void
+gst_inter_surface_unref (GstInterSurface * surface, GstInterSurfaceRole role)
+{
+  g_mutex_lock (&mutex);
+  if (role == GST_INTER_SURFACE_PRODUCER)
+    surface->n_producers--;
+  else
+    surface->n_consumers--;
+
+  if (surface->n_producers > 0 || surface->n_consumers > 0) {
+    g_mutex_unlock (&mutex);
+    return;
+  }
+
+  g_hash_table_remove (surfaces, surface->name);
+  g_mutex_unlock (&mutex);
+
+  g_assert (surface->video_queues == NULL);
+
+  if (surface->video_buffer)
+    gst_buffer_unref (surface->video_buffer);
+  if (surface->sub_buffer)
+    gst_buffer_unref (surface->sub_buffer);
+  g_object_unref (surface->audio_adapter);
+  g_mutex_clear (&surface->mutex);
+  g_free (surface->name);
+  g_free (surface);
+}
+
+/* Accounts for a buffer sent by a producer, with the surface lock */
+void
+gst_inter_surface_add_buffer_stats (GstInterSurface * surface,
+    GstBuffer * buffer)
+{
+  surface->n_buffers++;
+  surface->n_bytes += gst_buffer_get_size (buffer);
+}
+
+static GstStructure *
+gst_inter_surface_get_stats (GstInterSurface * surface, gint64 now)
+{
+  GstStructure *s;
+  guint64 n_buffers, n_bytes;
+  gint64 elapsed;
+
+  g_mutex_lock (&surface->mutex);
+  n_buffers = surface->n_buffers;
+  n_bytes = surface->n_bytes;
+  g_mutex_unlock (&surface->mutex);
+
+  elapsed = MAX (now - surface->creation_time, 1);
+
+  s = gst_structure_new ("channel",
+      "name", G_TYPE_STRING, surface->name,
+      "producers", G_TYPE_UINT, surface->n_producers,
+      "consumers", G_TYPE_UINT, surface->n_consumers,
+      "buffers", G_TYPE_UINT64, n_buffers,
+      "bytes", G_TYPE_UINT64, n_bytes,
+      "byte-rate", G_TYPE_UINT64,
+      gst_util_uint64_scale (n_bytes, G_USEC_PER_SEC, elapsed), NULL);
+
+  return s;
+}
+
+/**
+ * gst_inter_surface_query_channels:
+ * @query: a #GstQuery
+ *
+ * Answers the custom query with a #GST_INTER_CHANNELS_QUERY structure,
+ * which the inter elements support to list all the channels of the
+ * process. The structure gets a "channels" array with one "channel"
+ * structure per channel, giving its "name", the number of "producers"
+ * and "consumers" elements using it, the number of "buffers" and "bytes"
+ * sent through it, and the average "byte-rate" (in bytes per second)
+ * since it was created.
+ *
+ * Returns: %TRUE if @query was the channels query
+ */
+gboolean
+gst_inter_surface_query_channels (GstQuery * query)
+{
+  const GstStructure *readonly;
+  GstStructure *structure;
+  GValue channels = G_VALUE_INIT;
+  GValue channel = G_VALUE_INIT;
+  GHashTableIter iter;
+  gpointer value;
+  gint64 now;
+
+  if (GST_QUERY_TYPE (query) != GST_QUERY_CUSTOM)
+    return FALSE;
+
+  /* only make the query writable if it is ours */
+  readonly = gst_query_get_structure (query);
+  if (!readonly
+      || !gst_structure_has_name (readonly, GST_INTER_CHANNELS_QUERY))
+    return FALSE;
+
+  structure = gst_query_writable_structure (query);
+
+  g_value_init (&channels, GST_TYPE_ARRAY);
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&mutex);
+  if (surfaces) {
+    g_hash_table_iter_init (&iter, surfaces);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+      g_value_init (&channel, GST_TYPE_STRUCTURE);
+      g_value_take_boxed (&channel,
+          gst_inter_surface_get_stats ((GstInterSurface *) value, now));
+      gst_value_array_append_value (&channels, &channel);
+      g_value_unset (&channel);
+    }
+  }
+  g_mutex_unlock (&mutex);
+
+  gst_structure_take_value (structure, "channels", &channels);
+
+  return TRUE;
+}
+
+/* Called by the sink for every frame, the buffer is kept for the srcs not
+ * in queue mode and queued for the others */
+void
+gst_inter_surface_push_video (GstInterSurface * surface, GstBuffer * buffer)
+{
+  GList *g;
+
+  g_mutex_lock (&surface->mutex);
+  if (surface->video_buffer) {
+    gst_buffer_unref (surface->video_buffer);
+  }
+  surface->video_buffer = gst_buffer_ref (buffer);
+  surface->video_buffer_count = 0;
+  gst_inter_surface_add_buffer_stats (surface, buffer);
+
+  for (g = surface->video_queues; g; g = g_list_next (g))
+    gst_inter_surface_queue_push ((GstInterSurfaceQueue *) g->data, buffer);
+  g_mutex_unlock (&surface->mutex);
+}
+
+void
+gst_inter_surface_add_video_queue (GstInterSurface * surface,
+    GstInterSurfaceQueue * queue)
+{
+  g_mutex_lock (&surface->mutex);
+  surface->video_queues = g_list_prepend (surface->video_queues, queue);
+  g_mutex_unlock (&surface->mutex);
+}
+
+/* Once this returns, the sink doesn't touch @queue anymore */
+void
+gst_inter_surface_remove_video_queue (GstInterSurface * surface,
+    GstInterSurfaceQueue * queue)
+{
+  g_mutex_lock (&surface->mutex);
+  surface->video_queues = g_list_remove (surface->video_queues, queue);
+  g_mutex_unlock (&surface->mutex);
+}
+
+GstInterSurfaceQueue *
+gst_inter_surface_queue_new (guint size)
+{
+  GstInterSurfaceQueue *queue;
+  guint n_slots;
+
+  g_return_val_if_fail (size > 0, NULL);
+
+  /* a power of two, so that the indices can wrap around */
+  n_slots = 1 << g_bit_storage (size - 1);
+
+  queue = g_new0 (GstInterSurfaceQueue, 1);
+  queue->size = size;
+  queue->mask = n_slots - 1;
+  queue->buffers = g_new0 (GstBuffer *, n_slots);
+  queue->times = g_new0 (gint64, n_slots);
+
+  return queue;
+}
+
 void
-gst_inter_surface_unref (GstInterSurface * surface)
+gst_inter_surface_queue_free (GstInterSurfaceQueue * queue)
 {
+  GstBuffer *buffer;
+
+  while ((buffer = gst_inter_surface_queue_pop (queue, NULL)))
+    gst_buffer_unref (buffer);
+
+  g_free (queue->buffers);
+  g_free (queue->times);
+  g_free (queue);
+}
+
+/* Only called from the sink thread. Returns FALSE if the frame was dropped
+ * because the queue is full. */
+gboolean
+gst_inter_surface_queue_push (GstInterSurfaceQueue * queue, GstBuffer * buffer)
+{
+  guint write_index = g_atomic_int_get (&queue->write_index);
+  guint read_index = g_atomic_int_get (&queue->read_index);
+
+  if (write_index - read_index >= queue->size) {
+    g_atomic_int_inc (&queue->dropped);
+    return FALSE;
+  }
+
+  queue->buffers[write_index & queue->mask] = gst_buffer_ref (buffer);
+  queue->times[write_index & queue->mask] = g_get_monotonic_time ();
+
+  /* publishes the slot */
+  g_atomic_int_set (&queue->write_index, write_index + 1);
+
+  return TRUE;
+}
+
+/* Only called from the src thread. Returns the oldest frame, or NULL if
+ * the queue is empty. */
+GstBuffer *
+gst_inter_surface_queue_pop (GstInterSurfaceQueue * queue, gint64 * queued_time)
+{
+  guint read_index = g_atomic_int_get (&queue->read_index);
+  GstBuffer *buffer;
+
+  if (read_index == (guint) g_atomic_int_get (&queue->write_index))
+    return NULL;
+
+  buffer = queue->buffers[read_index & queue->mask];
+  queue->buffers[read_index & queue->mask] = NULL;
+  if (queued_time)
+    *queued_time = queue->times[read_index & queue->mask];
+
+  /* gives the slot back to the sink */
+  g_atomic_int_set (&queue->read_index, read_index + 1);
 
+  return buffer;
 }
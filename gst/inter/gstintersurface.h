@@ -25,7 +25,34 @@
 
 G_BEGIN_DECLS
 
+/* Name of the structure of the custom query listing the channels */
+#define GST_INTER_CHANNELS_QUERY "GstInterChannels"
+
 typedef struct _GstInterSurface GstInterSurface;
+typedef struct _GstInterSurfaceQueue GstInterSurfaceQueue;
+
+typedef enum
+{
+  GST_INTER_SURFACE_PRODUCER,
+  GST_INTER_SURFACE_CONSUMER
+} GstInterSurfaceRole;
+
+/* Bounded queue of video frames from the sink to one src. Only the sink
+ * writes write_index and only the src writes read_index, so neither side
+ * needs a lock. */
+struct _GstInterSurfaceQueue
+{
+  guint size;
+  guint mask;
+  GstBuffer **buffers;
+  gint64 *times;
+
+  volatile gint write_index;
+  volatile gint read_index;
+
+  /* frames dropped by the sink because the queue was full */
+  volatile gint dropped;
+};
 
 struct _GstInterSurface
 {
@@ -48,11 +75,41 @@ struct _GstInterSurface
   GstBuffer *video_buffer;
   GstBuffer *sub_buffer;
   GstAdapter *audio_adapter;
+
+  /* GstInterSurfaceQueue of the srcs in queue mode */
+  GList *video_queues;
+
+  /* protected by the registry lock */
+  guint n_producers;
+  guint n_consumers;
+
+  /* statistics */
+  gint64 creation_time;
+  guint64 n_buffers;
+  guint64 n_bytes;
 };
 
 
-GstInterSurface * gst_inter_surface_get (const char *name);
-void gst_inter_surface_unref (GstInterSurface *surface);
+GstInterSurface * gst_inter_surface_get (const char *name,
+    GstInterSurfaceRole role);
+void gst_inter_surface_unref (GstInterSurface *surface,
+    GstInterSurfaceRole role);
+void gst_inter_surface_add_buffer_stats (GstInterSurface *surface,
+    GstBuffer *buffer);
+gboolean gst_inter_surface_query_channels (GstQuery *query);
+
+void gst_inter_surface_push_video (GstInterSurface *surface, GstBuffer *buffer);
+void gst_inter_surface_add_video_queue (GstInterSurface *surface,
+    GstInterSurfaceQueue *queue);
+void gst_inter_surface_remove_video_queue (GstInterSurface *surface,
+    GstInterSurfaceQueue *queue);
+
+GstInterSurfaceQueue * gst_inter_surface_queue_new (guint size);
+void gst_inter_surface_queue_free (GstInterSurfaceQueue *queue);
+gboolean gst_inter_surface_queue_push (GstInterSurfaceQueue *queue,
+    GstBuffer *buffer);
+GstBuffer * gst_inter_surface_queue_pop (GstInterSurfaceQueue *queue,
+    gint64 *queued_time);
 
 
 G_END_DECLS
@@ -23,6 +23,11 @@
  * in connection with an intervideosrc element in a different pipeline,
  * similar to interaudiosink and interaudiosrc.
  *
+ * All the inter elements answer a custom query with a "GstInterChannels"
+ * structure by adding to it a "channels" array. The array lists every
+ * channel in the process, with its number of producers and consumers and
+ * the buffers, bytes and average byte rate sent through it.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -61,6 +66,8 @@ static void gst_inter_video_sink_get_times (GstBaseSink * sink,
     GstBuffer * buffer, GstClockTime * start, GstClockTime * end);
 static gboolean gst_inter_video_sink_start (GstBaseSink * sink);
 static gboolean gst_inter_video_sink_stop (GstBaseSink * sink);
+static gboolean gst_inter_video_sink_query (GstBaseSink * sink,
+    GstQuery * query);
 static GstFlowReturn gst_inter_video_sink_render (GstBaseSink * sink,
     GstBuffer * buffer);
 
@@ -110,6 +117,7 @@ gst_inter_video_sink_class_init (GstInterVideoSinkClass * klass)
       GST_DEBUG_FUNCPTR (gst_inter_video_sink_get_times);
   base_sink_class->start = GST_DEBUG_FUNCPTR (gst_inter_video_sink_start);
   base_sink_class->stop = GST_DEBUG_FUNCPTR (gst_inter_video_sink_stop);
+  base_sink_class->query = GST_DEBUG_FUNCPTR (gst_inter_video_sink_query);
   base_sink_class->render = GST_DEBUG_FUNCPTR (gst_inter_video_sink_render);
 
   g_object_class_install_property (gobject_class, PROP_CHANNEL,
@@ -196,7 +204,8 @@ gst_inter_video_sink_start (GstBaseSink * sink)
 {
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
 
-  intervideosink->surface = gst_inter_surface_get (intervideosink->channel);
+  intervideosink->surface = gst_inter_surface_get (intervideosink->channel,
+      GST_INTER_SURFACE_PRODUCER);
 
   return TRUE;
 }
@@ -213,24 +222,28 @@ gst_inter_video_sink_stop (GstBaseSink * sink)
   intervideosink->surface->video_buffer = NULL;
   g_mutex_unlock (&intervideosink->surface->mutex);
 
-  gst_inter_surface_unref (intervideosink->surface);
+  gst_inter_surface_unref (intervideosink->surface, GST_INTER_SURFACE_PRODUCER);
   intervideosink->surface = NULL;
 
   return TRUE;
 }
 
+static gboolean
+gst_inter_video_sink_query (GstBaseSink * sink, GstQuery * query)
+{
+  if (gst_inter_surface_query_channels (query))
+    return TRUE;
+
+  return GST_BASE_SINK_CLASS (gst_inter_video_sink_parent_class)->query (sink,
+      query);
+}
+
 static GstFlowReturn
 gst_inter_video_sink_render (GstBaseSink * sink, GstBuffer * buffer)
 {
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
 
-  g_mutex_lock (&intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = gst_buffer_ref (buffer);
-  intervideosink->surface->video_buffer_count = 0;
-  g_mutex_unlock (&intervideosink->surface->mutex);
+  gst_inter_surface_push_video (intervideosink->surface, buffer);
 
   return GST_FLOW_OK;
 }
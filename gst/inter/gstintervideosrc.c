@@ -23,6 +23,15 @@
  * in connection with a intervideosink element in a different pipeline,
  * similar to interaudiosink and interaudiosrc.
  *
+ * By default, it outputs the latest frame rendered by the intervideosink.
+ * With #GstInterVideoSrc:queue-size set, the sink queues every frame for
+ * this source instead, and the source takes them from the queue without
+ * locking. The #GstInterVideoSrc:dropped, #GstInterVideoSrc:duplicated,
+ * #GstInterVideoSrc:average-latency and #GstInterVideoSrc:max-latency
+ * properties tell how well the two pipelines keep up with each other.
+ * Several sources can read the same channel, they all get the same
+ * buffers.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -59,6 +68,8 @@ static void gst_inter_video_src_finalize (GObject * object);
 static gboolean gst_inter_video_src_set_caps (GstBaseSrc * src, GstCaps * caps);
 static gboolean gst_inter_video_src_start (GstBaseSrc * src);
 static gboolean gst_inter_video_src_stop (GstBaseSrc * src);
+static gboolean gst_inter_video_src_query (GstBaseSrc * src,
+    GstQuery * query);
 static void
 gst_inter_video_src_get_times (GstBaseSrc * src, GstBuffer * buffer,
     GstClockTime * start, GstClockTime * end);
@@ -70,9 +81,19 @@ static GstCaps *gst_inter_video_src_fixate (GstBaseSrc * src, GstCaps * caps);
 enum
 {
   PROP_0,
-  PROP_CHANNEL
+  PROP_CHANNEL,
+  PROP_QUEUE_SIZE,
+  PROP_DROPPED,
+  PROP_DUPLICATED,
+  PROP_AVERAGE_LATENCY,
+  PROP_MAX_LATENCY
 };
 
+#define DEFAULT_QUEUE_SIZE 0
+
+/* number of times the last frame is repeated before sending black */
+#define MAX_REPEAT 30
+
 /* pad templates */
 
 static GstStaticPadTemplate gst_inter_video_src_src_template =
@@ -112,6 +133,7 @@ gst_inter_video_src_class_init (GstInterVideoSrcClass * klass)
   base_src_class->set_caps = GST_DEBUG_FUNCPTR (gst_inter_video_src_set_caps);
   base_src_class->start = GST_DEBUG_FUNCPTR (gst_inter_video_src_start);
   base_src_class->stop = GST_DEBUG_FUNCPTR (gst_inter_video_src_stop);
+  base_src_class->query = GST_DEBUG_FUNCPTR (gst_inter_video_src_query);
   base_src_class->get_times = GST_DEBUG_FUNCPTR (gst_inter_video_src_get_times);
   base_src_class->create = GST_DEBUG_FUNCPTR (gst_inter_video_src_create);
   base_src_class->fixate = GST_DEBUG_FUNCPTR (gst_inter_video_src_fixate);
@@ -121,6 +143,31 @@ gst_inter_video_src_class_init (GstInterVideoSrcClass * klass)
           "Channel name to match inter src and sink elements",
           "default", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_QUEUE_SIZE,
+      g_param_spec_uint ("queue-size", "Queue size",
+          "Number of frames queued from the sink (0 = only use the latest "
+          "frame)", 0, 1024, DEFAULT_QUEUE_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DROPPED,
+      g_param_spec_uint64 ("dropped", "Dropped",
+          "Number of frames dropped because the queue was full",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DUPLICATED,
+      g_param_spec_uint64 ("duplicated", "Duplicated",
+          "Number of frames repeated because the queue was empty",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_AVERAGE_LATENCY,
+      g_param_spec_uint64 ("average-latency", "Average latency",
+          "Average time frames spent in the queue (in ns)",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_LATENCY,
+      g_param_spec_uint64 ("max-latency", "Maximum latency",
+          "Maximum time a frame spent in the queue (in ns)",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -130,6 +177,7 @@ gst_inter_video_src_init (GstInterVideoSrc * intervideosrc)
   gst_base_src_set_live (GST_BASE_SRC (intervideosrc), TRUE);
 
   intervideosrc->channel = g_strdup ("default");
+  intervideosrc->queue_size = DEFAULT_QUEUE_SIZE;
 }
 
 void
@@ -143,6 +191,9 @@ gst_inter_video_src_set_property (GObject * object, guint property_id,
       g_free (intervideosrc->channel);
       intervideosrc->channel = g_value_dup_string (value);
       break;
+    case PROP_QUEUE_SIZE:
+      intervideosrc->queue_size = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -159,6 +210,31 @@ gst_inter_video_src_get_property (GObject * object, guint property_id,
     case PROP_CHANNEL:
       g_value_set_string (value, intervideosrc->channel);
       break;
+    case PROP_QUEUE_SIZE:
+      g_value_set_uint (value, intervideosrc->queue_size);
+      break;
+    case PROP_DROPPED:
+      GST_OBJECT_LOCK (intervideosrc);
+      g_value_set_uint64 (value, intervideosrc->queue ?
+          (guint) g_atomic_int_get (&intervideosrc->queue->dropped) : 0);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
+    case PROP_DUPLICATED:
+      GST_OBJECT_LOCK (intervideosrc);
+      g_value_set_uint64 (value, intervideosrc->duplicated);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
+    case PROP_AVERAGE_LATENCY:
+      GST_OBJECT_LOCK (intervideosrc);
+      g_value_set_uint64 (value, intervideosrc->n_queued ?
+          intervideosrc->total_latency / intervideosrc->n_queued : 0);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
+    case PROP_MAX_LATENCY:
+      GST_OBJECT_LOCK (intervideosrc);
+      g_value_set_uint64 (value, intervideosrc->max_latency);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -199,7 +275,22 @@ gst_inter_video_src_start (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (intervideosrc, "start");
 
-  intervideosrc->surface = gst_inter_surface_get (intervideosrc->channel);
+  intervideosrc->surface = gst_inter_surface_get (intervideosrc->channel,
+      GST_INTER_SURFACE_CONSUMER);
+
+  GST_OBJECT_LOCK (intervideosrc);
+  intervideosrc->duplicated = 0;
+  intervideosrc->n_queued = 0;
+  intervideosrc->total_latency = 0;
+  intervideosrc->max_latency = 0;
+  if (intervideosrc->queue_size > 0)
+    intervideosrc->queue =
+        gst_inter_surface_queue_new (intervideosrc->queue_size);
+  GST_OBJECT_UNLOCK (intervideosrc);
+
+  if (intervideosrc->queue)
+    gst_inter_surface_add_video_queue (intervideosrc->surface,
+        intervideosrc->queue);
 
   return TRUE;
 }
@@ -211,12 +302,33 @@ gst_inter_video_src_stop (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (intervideosrc, "stop");
 
-  gst_inter_surface_unref (intervideosrc->surface);
+  if (intervideosrc->queue) {
+    GstInterSurfaceQueue *queue = intervideosrc->queue;
+
+    gst_inter_surface_remove_video_queue (intervideosrc->surface, queue);
+    GST_OBJECT_LOCK (intervideosrc);
+    intervideosrc->queue = NULL;
+    GST_OBJECT_UNLOCK (intervideosrc);
+    gst_inter_surface_queue_free (queue);
+  }
+  gst_buffer_replace (&intervideosrc->last_buffer, NULL);
+
+  gst_inter_surface_unref (intervideosrc->surface, GST_INTER_SURFACE_CONSUMER);
   intervideosrc->surface = NULL;
 
   return TRUE;
 }
 
+static gboolean
+gst_inter_video_src_query (GstBaseSrc * src, GstQuery * query)
+{
+  if (gst_inter_surface_query_channels (query))
+    return TRUE;
+
+  return GST_BASE_SRC_CLASS (gst_inter_video_src_parent_class)->query (src,
+      query);
+}
+
 static void
 gst_inter_video_src_get_times (GstBaseSrc * src, GstBuffer * buffer,
     GstClockTime * start, GstClockTime * end)
@@ -254,16 +366,44 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
 
   buffer = NULL;
 
-  g_mutex_lock (&intervideosrc->surface->mutex);
-  if (intervideosrc->surface->video_buffer) {
-    buffer = gst_buffer_ref (intervideosrc->surface->video_buffer);
-    intervideosrc->surface->video_buffer_count++;
-    if (intervideosrc->surface->video_buffer_count >= 30) {
-      gst_buffer_unref (intervideosrc->surface->video_buffer);
-      intervideosrc->surface->video_buffer = NULL;
+  if (intervideosrc->queue) {
+    gint64 queued_time;
+
+    /* doesn't touch the surface lock */
+    buffer = gst_inter_surface_queue_pop (intervideosrc->queue, &queued_time);
+    if (buffer) {
+      guint64 latency =
+          (g_get_monotonic_time () - queued_time) * GST_USECOND;
+
+      gst_buffer_replace (&intervideosrc->last_buffer, buffer);
+      intervideosrc->last_buffer_count = 0;
+
+      GST_OBJECT_LOCK (intervideosrc);
+      intervideosrc->n_queued++;
+      intervideosrc->total_latency += latency;
+      intervideosrc->max_latency = MAX (intervideosrc->max_latency, latency);
+      GST_OBJECT_UNLOCK (intervideosrc);
+    } else if (intervideosrc->last_buffer
+        && intervideosrc->last_buffer_count < MAX_REPEAT) {
+      buffer = gst_buffer_ref (intervideosrc->last_buffer);
+      intervideosrc->last_buffer_count++;
+
+      GST_OBJECT_LOCK (intervideosrc);
+      intervideosrc->duplicated++;
+      GST_OBJECT_UNLOCK (intervideosrc);
+    }
+  } else {
+    g_mutex_lock (&intervideosrc->surface->mutex);
+    if (intervideosrc->surface->video_buffer) {
+      buffer = gst_buffer_ref (intervideosrc->surface->video_buffer);
+      intervideosrc->surface->video_buffer_count++;
+      if (intervideosrc->surface->video_buffer_count >= MAX_REPEAT) {
+        gst_buffer_unref (intervideosrc->surface->video_buffer);
+        intervideosrc->surface->video_buffer = NULL;
+      }
     }
+    g_mutex_unlock (&intervideosrc->surface->mutex);
   }
-  g_mutex_unlock (&intervideosrc->surface->mutex);
 
   if (buffer == NULL) {
     GstMapInfo map;
@@ -45,6 +45,18 @@ struct _GstInterVideoSrc
 
   GstVideoInfo info;
   int n_frames;
+
+  /* queue mode */
+  guint queue_size;
+  GstInterSurfaceQueue *queue;
+  GstBuffer *last_buffer;
+  int last_buffer_count;
+
+  /* statistics, protected by the object lock */
+  guint64 duplicated;
+  guint64 n_queued;
+  guint64 total_latency;
+  guint64 max_latency;
 };
 
 struct _GstInterVideoSrcClass
@@ -213,6 +213,8 @@ mpegts_base_reset (MpegTSBase * base)
 
   if (klass->reset)
     klass->reset (base);
+
+  base->pid_dispatch_dirty = TRUE;
 }
 
 static void
@@ -234,6 +236,7 @@ mpegts_base_init (MpegTSBase * base)
   base->parse_private_sections = FALSE;
   base->is_pes = g_new0 (guint8, 1024);
   base->known_psi = g_new0 (guint8, 1024);
+  base->pid_dispatch = g_new0 (guint8, 0x2000);
   base->program_size = sizeof (MpegTSBaseProgram);
   base->stream_size = sizeof (MpegTSBaseStream);
 
@@ -253,6 +256,7 @@ mpegts_base_dispose (GObject * object)
     base->disposed = TRUE;
     g_free (base->known_psi);
     g_free (base->is_pes);
+    g_free (base->pid_dispatch);
   }
 
   if (G_OBJECT_CLASS (parent_class)->dispose)
@@ -365,6 +369,7 @@ mpegts_base_add_program (MpegTSBase * base,
         pmt_pid);
   }
   MPEGTS_BIT_SET (base->known_psi, pmt_pid);
+  base->pid_dispatch_dirty = TRUE;
 
   g_hash_table_insert (base->programs,
       GINT_TO_POINTER (program_number), program);
@@ -576,6 +581,7 @@ mpegts_base_deactivate_program (MpegTSBase * base, MpegTSBaseProgram * program)
   GST_DEBUG_OBJECT (base, "Deactivating PMT");
 
   program->active = FALSE;
+  base->pid_dispatch_dirty = TRUE;
 
   if (program->pmt) {
     for (i = 0; i < program->pmt->streams->len; ++i) {
@@ -711,6 +717,7 @@ mpegts_base_activate_program (MpegTSBase * base, MpegTSBaseProgram * program,
    * streams above, no new stream will be created */
   mpegts_base_program_add_stream (base, program, pmt->pcr_pid, -1, NULL);
   MPEGTS_BIT_SET (base->is_pes, pmt->pcr_pid);
+  base->pid_dispatch_dirty = TRUE;
 
   program->active = TRUE;
   program->initial_program = initial_program;
@@ -746,6 +753,7 @@ mpegts_base_apply_pat (MpegTSBase * base, GstMpegTsSection * section)
 
   old_pat = base->pat;
   base->pat = pat;
+  base->pid_dispatch_dirty = TRUE;
 
   GST_LOG ("Activating new Program Association Table");
   /* activate the new table */
@@ -1081,21 +1089,62 @@ query_upstream_latency (MpegTSBase * base)
   base->queried_latency = TRUE;
 }
 
+static void
+mpegts_base_update_pid_dispatch (MpegTSBase * base)
+{
+  guint16 pid;
+
+  GST_DEBUG_OBJECT (base, "Updating PID dispatch table");
+
+  for (pid = 0; pid < 0x2000; pid++) {
+    if (MPEGTS_BIT_IS_SET (base->is_pes, pid))
+      base->pid_dispatch[pid] = MPEGTS_BASE_PID_PES;
+    else if (MPEGTS_BIT_IS_SET (base->known_psi, pid))
+      base->pid_dispatch[pid] = MPEGTS_BASE_PID_PSI;
+    else
+      base->pid_dispatch[pid] = MPEGTS_BASE_PID_DROP;
+  }
+
+  base->pid_dispatch_dirty = FALSE;
+}
+
+static GstFlowReturn
+mpegts_base_handle_psi_packet (MpegTSBase * base,
+    MpegTSPacketizerPacket * packet)
+{
+  MpegTSBaseClass *klass = GST_MPEGTS_BASE_GET_CLASS (base);
+  GstFlowReturn res = GST_FLOW_OK;
+  GList *others, *tmp;
+  GstMpegTsSection *section;
+
+  section = mpegts_packetizer_push_section (base->packetizer, packet, &others);
+  if (section)
+    mpegts_base_handle_psi (base, section);
+  if (G_UNLIKELY (others)) {
+    for (tmp = others; tmp; tmp = tmp->next)
+      mpegts_base_handle_psi (base, (GstMpegTsSection *) tmp->data);
+    g_list_free (others);
+  }
+
+  /* we need to push section packet downstream */
+  if (base->push_section)
+    res = klass->push (base, packet, section);
+
+  return res;
+}
+
 static GstFlowReturn
 mpegts_base_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
 {
   GstFlowReturn res = GST_FLOW_OK;
   MpegTSBase *base;
   MpegTSPacketizerPacketReturn pret;
-  MpegTSPacketizer2 *packetizer;
   MpegTSPacketizerPacket packet;
   MpegTSBaseClass *klass;
 
   base = GST_MPEGTS_BASE (parent);
   klass = GST_MPEGTS_BASE_GET_CLASS (base);
 
-  packetizer = base->packetizer;
-
   if (G_UNLIKELY (base->queried_latency == FALSE)) {
     query_upstream_latency (base);
   }
@@ -1118,32 +1167,25 @@ mpegts_base_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
       goto next;
     }
 
-    /* If it's a known PES, push it */
-    if (MPEGTS_BIT_IS_SET (base->is_pes, packet.pid)) {
-      /* push the packet downstream */
-      if (base->push_data)
-        res = klass->push (base, &packet, NULL);
-    } else if (packet.payload
-        && MPEGTS_BIT_IS_SET (base->known_psi, packet.pid)) {
-      /* base PSI data */
-      GList *others, *tmp;
-      GstMpegTsSection *section;
-
-      section = mpegts_packetizer_push_section (packetizer, &packet, &others);
-      if (section)
-        mpegts_base_handle_psi (base, section);
-      if (G_UNLIKELY (others)) {
-        for (tmp = others; tmp; tmp = tmp->next)
-          mpegts_base_handle_psi (base, (GstMpegTsSection *) tmp->data);
-        g_list_free (others);
-      }
-
-      /* we need to push section packet downstream */
-      if (base->push_section)
-        res = klass->push (base, &packet, section);
+    if (G_UNLIKELY (base->pid_dispatch_dirty))
+      mpegts_base_update_pid_dispatch (base);
 
-    } else if (packet.payload && packet.pid != 0x1fff)
-      GST_LOG ("PID 0x%04x Saw packet on a pid we don't handle", packet.pid);
+    switch (base->pid_dispatch[packet.pid]) {
+      case MPEGTS_BASE_PID_PES:
+        /* If it's a known PES, push it downstream */
+        if (base->push_data)
+          res = klass->push (base, &packet, NULL);
+        break;
+      case MPEGTS_BASE_PID_PSI:
+        if (G_LIKELY (packet.payload))
+          res = mpegts_base_handle_psi_packet (base, &packet);
+        break;
+      default:
+        if (packet.payload && packet.pid != 0x1fff)
+          GST_LOG ("PID 0x%04x Saw packet on a pid we don't handle",
+              packet.pid);
+        break;
+    }
 
   next:
     mpegts_packetizer_clear_packet (base->packetizer, &packet);
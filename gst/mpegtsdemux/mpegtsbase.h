@@ -92,6 +92,13 @@ struct _MpegTSBaseProgram
   gboolean initial_program;
 };
 
+/* What to do with packets of a given PID, see MpegTSBase.pid_dispatch */
+typedef enum {
+  MPEGTS_BASE_PID_DROP = 0,	/* Not a PID we handle */
+  MPEGTS_BASE_PID_PES,		/* PES data, pushed to the subclass */
+  MPEGTS_BASE_PID_PSI		/* Section data, parsed and pushed */
+} MpegTSBasePIDDispatch;
+
 typedef enum {
   /* PULL MODE */
   BASE_MODE_SCANNING,		/* Looking for PAT/PMT */
@@ -128,6 +135,13 @@ struct _MpegTSBase {
   guint8 *known_psi;
   guint8 *is_pes;
 
+  /* MpegTSBasePIDDispatch for each of the 0x2000 PIDs. Derived from
+   * known_psi/is_pes, and only recalculated when those changed (i.e. when
+   * a PAT/PMT was applied) so that incoming packets can be dispatched with
+   * a single lookup */
+  guint8 *pid_dispatch;
+  gboolean pid_dispatch_dirty;
+
   gboolean disposed;
 
   /* size of the MpegTSBaseProgram structure, can be overridden
@@ -36,6 +36,14 @@
 #include "mpegtspacketizer.h"
 #include "gstmpegdesc.h"
 
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SYNC_SCAN_SIMD 1
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_SYNC_SCAN_SIMD 1
+#endif
+
 GST_DEBUG_CATEGORY_STATIC (mpegts_packetizer_debug);
 #define GST_CAT_DEFAULT mpegts_packetizer_debug
 
@@ -52,6 +60,7 @@ static GstClockTime calculate_skew (MpegTSPCR * pcr, guint64 pcrtime,
 static void _close_current_group (MpegTSPCR * pcrtable);
 static void record_pcr (MpegTSPacketizer2 * packetizer, MpegTSPCR * pcrtable,
     guint64 pcr, guint64 offset);
+static void mpegts_packetizer_clear_input (MpegTSPacketizer2 * packetizer);
 
 #define CONTINUITY_UNSET 255
 #define VERSION_NUMBER_UNSET 255
@@ -236,6 +245,11 @@ mpegts_packetizer_init (MpegTSPacketizer2 * packetizer)
   packetizer->map_offset = 0;
   packetizer->need_sync = FALSE;
 
+  g_queue_init (&packetizer->input_buffers);
+  packetizer->input_skip = 0;
+  packetizer->map_buffer = NULL;
+  packetizer->map_buffer_offset = 0;
+
   memset (packetizer->pcrtablelut, 0xff, 0x2000);
   memset (packetizer->observations, 0x0, sizeof (packetizer->observations));
   packetizer->lastobsid = 0;
@@ -264,6 +278,7 @@ mpegts_packetizer_dispose (GObject * object)
 
     gst_adapter_clear (packetizer->adapter);
     g_object_unref (packetizer->adapter);
+    mpegts_packetizer_clear_input (packetizer);
     packetizer->disposed = TRUE;
     packetizer->offset = 0;
     packetizer->empty = TRUE;
@@ -536,6 +551,7 @@ mpegts_packetizer_clear (MpegTSPacketizer2 * packetizer)
   }
 
   gst_adapter_clear (packetizer->adapter);
+  mpegts_packetizer_clear_input (packetizer);
   packetizer->offset = 0;
   packetizer->empty = TRUE;
   packetizer->need_sync = FALSE;
@@ -567,6 +583,7 @@ mpegts_packetizer_flush (MpegTSPacketizer2 * packetizer, gboolean hard)
     }
   }
   gst_adapter_clear (packetizer->adapter);
+  mpegts_packetizer_clear_input (packetizer);
 
   packetizer->offset = 0;
   packetizer->empty = TRUE;
@@ -623,29 +640,67 @@ mpegts_packetizer_push (MpegTSPacketizer2 * packetizer, GstBuffer * buffer)
   GST_DEBUG ("Pushing %" G_GSIZE_FORMAT " byte from offset %"
       G_GUINT64_FORMAT, gst_buffer_get_size (buffer),
       GST_BUFFER_OFFSET (buffer));
+  /* The adapter discards empty buffers, so must we */
+  if (gst_buffer_get_size (buffer) > 0)
+    g_queue_push_tail (&packetizer->input_buffers, gst_buffer_ref (buffer));
   gst_adapter_push (packetizer->adapter, buffer);
   /* If buffer timestamp is valid, store it */
   if (GST_CLOCK_TIME_IS_VALID (GST_BUFFER_TIMESTAMP (buffer)))
     packetizer->last_in_time = GST_BUFFER_TIMESTAMP (buffer);
 }
 
+static void
+mpegts_packetizer_clear_input (MpegTSPacketizer2 * packetizer)
+{
+  GstBuffer *buffer;
+
+  while ((buffer = g_queue_pop_head (&packetizer->input_buffers)))
+    gst_buffer_unref (buffer);
+  packetizer->input_skip = 0;
+  packetizer->map_buffer = NULL;
+  packetizer->map_buffer_offset = 0;
+}
+
+/* Keep input_buffers in sync with what was flushed from the adapter */
+static void
+mpegts_packetizer_flush_input (MpegTSPacketizer2 * packetizer, gsize size)
+{
+  GstBuffer *head;
+  gsize remaining;
+
+  while (size > 0 && (head = g_queue_peek_head (&packetizer->input_buffers))) {
+    remaining = gst_buffer_get_size (head) - packetizer->input_skip;
+    if (size < remaining) {
+      packetizer->input_skip += size;
+      return;
+    }
+    size -= remaining;
+    gst_buffer_unref (g_queue_pop_head (&packetizer->input_buffers));
+    packetizer->input_skip = 0;
+  }
+}
+
 static void
 mpegts_packetizer_flush_bytes (MpegTSPacketizer2 * packetizer, gsize size)
 {
   if (size > 0) {
     GST_LOG ("flushing %" G_GSIZE_FORMAT " bytes from adapter", size);
     gst_adapter_flush (packetizer->adapter, size);
+    mpegts_packetizer_flush_input (packetizer, size);
   }
 
   packetizer->map_data = NULL;
   packetizer->map_size = 0;
   packetizer->map_offset = 0;
+  packetizer->map_buffer = NULL;
+  packetizer->map_buffer_offset = 0;
 }
 
 static gboolean
 mpegts_packetizer_map (MpegTSPacketizer2 * packetizer, gsize size)
 {
-  gsize available;
+  GstBuffer *head;
+  gsize available, map_size;
 
   if (packetizer->map_size - packetizer->map_offset >= size)
     return TRUE;
@@ -656,19 +711,92 @@ mpegts_packetizer_map (MpegTSPacketizer2 * packetizer, gsize size)
   if (available < size)
     return FALSE;
 
+  map_size = available;
+
+  /* When mapping single packets, avoid making the adapter merge all
+   * pending input buffers. Map the rest of the first input buffer, so
+   * payloads can be referenced from it, or only assemble the one packet
+   * straddling two input buffers */
+  if (size <= MPEGTS_MAX_PACKETSIZE) {
+    head = g_queue_peek_head (&packetizer->input_buffers);
+    if (head && gst_buffer_get_size (head) - packetizer->input_skip >= size) {
+      map_size = gst_buffer_get_size (head) - packetizer->input_skip;
+      packetizer->map_buffer = head;
+      packetizer->map_buffer_offset = packetizer->input_skip;
+    } else {
+      map_size = size;
+    }
+  }
+
   packetizer->map_data =
-      (guint8 *) gst_adapter_map (packetizer->adapter, available);
-  if (!packetizer->map_data)
+      (guint8 *) gst_adapter_map (packetizer->adapter, map_size);
+  if (!packetizer->map_data) {
+    packetizer->map_buffer = NULL;
     return FALSE;
+  }
 
-  packetizer->map_size = available;
+  packetizer->map_size = map_size;
   packetizer->map_offset = 0;
 
-  GST_LOG ("mapped %" G_GSIZE_FORMAT " bytes from adapter", available);
+  GST_LOG ("mapped %" G_GSIZE_FORMAT " bytes from adapter", map_size);
 
   return TRUE;
 }
 
+/* Scanning for sync needs to look at all available data and not just at
+ * what was mapped for the previous packet */
+static inline void
+mpegts_packetizer_unmap_partial (MpegTSPacketizer2 * packetizer)
+{
+  if (packetizer->map_data
+      && packetizer->map_size < gst_adapter_available (packetizer->adapter))
+    mpegts_packetizer_flush_bytes (packetizer, packetizer->map_offset);
+}
+
+#ifdef HAVE_SYNC_SCAN_SIMD
+/* Number of candidate offsets checked at once */
+#define SYNC_SCAN_WIDTH 16
+
+/* Returns a bitmask of the offsets i in [0, SYNC_SCAN_WIDTH) for which
+ * data[i + k * stride] is a sync byte for every k in [0, count) */
+static inline guint
+sync_scan_mask (const guint8 * data, gsize stride, guint count)
+{
+  guint k;
+#if defined (__SSE2__)
+  const __m128i sync = _mm_set1_epi8 (PACKET_SYNC_BYTE);
+  __m128i res;
+
+  res = _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) data), sync);
+  for (k = 1; k < count; k++)
+    res = _mm_and_si128 (res,
+        _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) (data +
+                    k * stride)), sync));
+
+  return _mm_movemask_epi8 (res);
+#else
+  static const guint8 bits[16] = {
+    1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+  };
+  const uint8x16_t sync = vdupq_n_u8 (PACKET_SYNC_BYTE);
+  uint8x16_t res;
+  uint8x8_t sum;
+
+  res = vceqq_u8 (vld1q_u8 (data), sync);
+  for (k = 1; k < count; k++)
+    res = vandq_u8 (res, vceqq_u8 (vld1q_u8 (data + k * stride), sync));
+
+  /* There is no movemask on NEON, fold the lanes into two bytes */
+  res = vandq_u8 (res, vld1q_u8 (bits));
+  sum = vpadd_u8 (vget_low_u8 (res), vget_high_u8 (res));
+  sum = vpadd_u8 (sum, sum);
+  sum = vpadd_u8 (sum, sum);
+
+  return vget_lane_u8 (sum, 0) | (vget_lane_u8 (sum, 1) << 8);
+#endif
+}
+#endif
+
 static gboolean
 mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
 {
@@ -682,13 +810,31 @@ mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
     MPEGTS_ATSC_PACKETSIZE
   };
 
+  mpegts_packetizer_unmap_partial (packetizer);
   if (!mpegts_packetizer_map (packetizer, 4 * MPEGTS_MAX_PACKETSIZE))
     return FALSE;
 
   size = packetizer->map_size - packetizer->map_offset;
   data = packetizer->map_data + packetizer->map_offset;
 
-  for (i = 0; i + 3 * MPEGTS_MAX_PACKETSIZE < size; i++) {
+  i = 0;
+#ifdef HAVE_SYNC_SCAN_SIMD
+  /* Look for the first candidate offset for any packet size, the loop
+   * below then figures out which size it was */
+  for (; i + SYNC_SCAN_WIDTH - 1 + 3 * MPEGTS_MAX_PACKETSIZE < size;
+      i += SYNC_SCAN_WIDTH) {
+    guint mask = 0;
+
+    for (j = 0; j < G_N_ELEMENTS (psizes); j++)
+      mask |= sync_scan_mask (data + i, psizes[j], 4);
+    if (mask) {
+      i += g_bit_nth_lsf (mask, -1);
+      break;
+    }
+  }
+#endif
+
+  for (; i + 3 * MPEGTS_MAX_PACKETSIZE < size; i++) {
     /* find a sync byte */
     if (data[i] != PACKET_SYNC_BYTE)
       continue;
@@ -735,6 +881,7 @@ mpegts_packetizer_sync (MpegTSPacketizer2 * packetizer)
 
   packet_size = packetizer->packet_size;
 
+  mpegts_packetizer_unmap_partial (packetizer);
   if (!mpegts_packetizer_map (packetizer, 3 * packet_size))
     return FALSE;
 
@@ -746,7 +893,20 @@ mpegts_packetizer_sync (MpegTSPacketizer2 * packetizer)
   else
     sync_offset = 0;
 
-  for (i = sync_offset; i + 2 * packet_size < size; i++) {
+  i = sync_offset;
+#ifdef HAVE_SYNC_SCAN_SIMD
+  for (; i + SYNC_SCAN_WIDTH - 1 + 2 * packet_size < size;
+      i += SYNC_SCAN_WIDTH) {
+    guint mask = sync_scan_mask (data + i, packet_size, 3);
+
+    if (mask) {
+      i += g_bit_nth_lsf (mask, -1);
+      break;
+    }
+  }
+#endif
+
+  for (; i + 2 * packet_size < size; i++) {
     if (data[i] == PACKET_SYNC_BYTE &&
         data[i + packet_size] == PACKET_SYNC_BYTE &&
         data[i + 2 * packet_size] == PACKET_SYNC_BYTE) {
@@ -842,6 +1002,25 @@ mpegts_packetizer_clear_packet (MpegTSPacketizer2 * packetizer,
   }
 }
 
+/* Returns the input buffer (not ref'ed) containing @data, which must point
+ * within the current packet, and sets @offset to the position of @data
+ * in that buffer. Returns NULL if the current packet was assembled from
+ * several input buffers. */
+GstBuffer *
+mpegts_packetizer_get_backing_buffer (MpegTSPacketizer2 * packetizer,
+    const guint8 * data, gsize * offset)
+{
+  if (packetizer->map_buffer == NULL)
+    return NULL;
+
+  g_return_val_if_fail (data >= packetizer->map_data &&
+      data < packetizer->map_data + packetizer->map_size, NULL);
+
+  *offset = packetizer->map_buffer_offset + (data - packetizer->map_data);
+
+  return packetizer->map_buffer;
+}
+
 gboolean
 mpegts_packetizer_has_packets (MpegTSPacketizer2 * packetizer)
 {
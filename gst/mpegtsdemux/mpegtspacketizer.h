@@ -267,6 +267,16 @@ struct _MpegTSPacketizer2 {
   gsize map_size;
   gboolean need_sync;
 
+  /* The buffers currently in the adapter, and the amount of bytes
+   * already flushed from the first one */
+  GQueue   input_buffers;
+  gsize    input_skip;
+
+  /* The input buffer backing map_data and the offset of map_data in it.
+   * NULL if map_data was assembled from several input buffers */
+  GstBuffer *map_buffer;
+  gsize      map_buffer_offset;
+
   /* Reference offset */
   guint64 refoffset;
 
@@ -347,6 +357,8 @@ G_GNUC_INTERNAL void mpegts_packetizer_clear_packet (MpegTSPacketizer2 *packetiz
 				     MpegTSPacketizerPacket *packet);
 G_GNUC_INTERNAL void mpegts_packetizer_remove_stream(MpegTSPacketizer2 *packetizer,
   gint16 pid);
+G_GNUC_INTERNAL GstBuffer *mpegts_packetizer_get_backing_buffer (MpegTSPacketizer2 *packetizer,
+  const guint8 *data, gsize *offset);
 
 G_GNUC_INTERNAL GstMpegTsSection *mpegts_packetizer_push_section (MpegTSPacketizer2 *packetzer,
 								  MpegTSPacketizerPacket *packet, GList **remaining);
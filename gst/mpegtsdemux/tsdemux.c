@@ -61,6 +61,20 @@
  */
 #define SEEK_TIMESTAMP_OFFSET (500 * GST_MSECOND)
 
+/* Maximum distance between a seek target and a keyframe of the index for
+ * the keyframe to be used. Further away, the target lies in a region that
+ * wasn't played yet and the PCR based estimation is used instead */
+#define INDEX_MAX_DISTANCE (10 * GST_SECOND)
+
+/* Index sidecar file layout (all values big endian):
+ * magic (8 bytes), version (32 bits), PID (16 bits), reserved (16 bits),
+ * upstream size (64 bits), number of entries (32 bits),
+ * followed by the entries: time (64 bits), offset (64 bits) */
+#define INDEX_FILE_MAGIC "GstTSIdx"
+#define INDEX_FILE_VERSION 1
+#define INDEX_FILE_HEADER_SIZE 28
+#define INDEX_FILE_ENTRY_SIZE 16
+
 #define SEGMENT_FORMAT "[format:%s, rate:%f, start:%"			\
   GST_TIME_FORMAT", stop:%"GST_TIME_FORMAT", time:%"GST_TIME_FORMAT	\
   ", base:%"GST_TIME_FORMAT", position:%"GST_TIME_FORMAT		\
@@ -102,11 +116,28 @@ typedef struct
 {
   /* The fully reconstructed buffer */
   GstBuffer *buffer;
+  /* The list owning buffer, if the PES was split over several buffers */
+  GstBufferList *list;
 
   /* Raw PTS/DTS (in 90kHz units) */
   guint64 pts, dts;
 } PendingBuffer;
 
+/* Piece of PES payload, referencing the input buffer it was received in */
+typedef struct
+{
+  GstBuffer *buffer;
+  gsize offset;
+  guint size;
+} PESSlice;
+
+/* Keyframe index entry */
+typedef struct
+{
+  GstClockTime ts;
+  guint64 offset;
+} TSDemuxIndexEntry;
+
 typedef struct _TSDemuxStream TSDemuxStream;
 
 struct _TSDemuxStream
@@ -118,6 +149,13 @@ struct _TSDemuxStream
   /* Whether the pad was added or not */
   gboolean active;
 
+  /* Whether the pad is a video pad */
+  gboolean is_video;
+
+  /* Offset of the packet starting the current PES if it had the
+   * random_access_indicator set, else -1 */
+  guint64 rap_offset;
+
   /* TRUE if we are waiting for a valid timestamp */
   gboolean pending_ts;
 
@@ -127,16 +165,14 @@ struct _TSDemuxStream
   /* Output data */
   PendingPacketState state;
 
-  /* Data being reconstructed (allocated) */
-  guint8 *data;
+  /* Data being reconstructed (array of PESSlice) */
+  GArray *slices;
 
   /* Size of data being reconstructed (if known, else 0) */
   guint expected_size;
 
-  /* Amount of bytes in current ->data */
+  /* Amount of bytes in current ->slices */
   guint current_size;
-  /* Size of ->data */
-  guint allocated_size;
 
   /* Current PTS/DTS for this stream (in running time) */
   GstClockTime pts;
@@ -226,6 +262,7 @@ enum
   ARG_0,
   PROP_PROGRAM_NUMBER,
   PROP_EMIT_STATS,
+  PROP_INDEX_LOCATION,
   /* FILL ME */
 };
 
@@ -256,6 +293,9 @@ static void gst_ts_demux_flush_streams (GstTSDemux * tsdemux);
 static GstFlowReturn
 gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream);
 static void gst_ts_demux_stream_flush (TSDemuxStream * stream);
+static void pes_slice_clear (PESSlice * slice);
+static void gst_ts_demux_finalize (GObject * object);
+static void gst_ts_demux_save_index (GstTSDemux * demux);
 
 static gboolean push_event (MpegTSBase * base, GstEvent * event);
 
@@ -285,6 +325,7 @@ gst_ts_demux_class_init (GstTSDemuxClass * klass)
   gobject_class = G_OBJECT_CLASS (klass);
   gobject_class->set_property = gst_ts_demux_set_property;
   gobject_class->get_property = gst_ts_demux_get_property;
+  gobject_class->finalize = gst_ts_demux_finalize;
 
   g_object_class_install_property (gobject_class, PROP_PROGRAM_NUMBER,
       g_param_spec_int ("program-number", "Program number",
@@ -296,6 +337,12 @@ gst_ts_demux_class_init (GstTSDemuxClass * klass)
           "Emit messages for every pcr/opcr/pts/dts", FALSE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_INDEX_LOCATION,
+      g_param_spec_string ("index-location", "Index location",
+          "File to load the keyframe index from and save it to, allowing "
+          "later seeks to go straight to the right keyframe (NULL = none)",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   element_class = GST_ELEMENT_CLASS (klass);
   gst_element_class_add_pad_template (element_class,
       gst_static_pad_template_get (&video_template));
@@ -346,6 +393,15 @@ gst_ts_demux_reset (MpegTSBase * base)
 
   demux->have_group_id = FALSE;
   demux->group_id = G_MAXUINT;
+
+  if (demux->index) {
+    gst_ts_demux_save_index (demux);
+    g_array_set_size (demux->index, 0);
+  }
+  demux->index_pid = G_MAXUINT16;
+  demux->index_upstream_size = -1;
+  demux->index_dirty = FALSE;
+  demux->index_loaded = FALSE;
 }
 
 static void
@@ -360,9 +416,21 @@ gst_ts_demux_init (GstTSDemux * demux)
 
   demux->requested_program_number = -1;
   demux->program_number = -1;
+  demux->index = g_array_new (FALSE, FALSE, sizeof (TSDemuxIndexEntry));
   gst_ts_demux_reset (base);
 }
 
+static void
+gst_ts_demux_finalize (GObject * object)
+{
+  GstTSDemux *demux = GST_TS_DEMUX (object);
+
+  g_array_free (demux->index, TRUE);
+  g_free (demux->index_location);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
 
 static void
 gst_ts_demux_set_property (GObject * object, guint prop_id,
@@ -379,6 +447,12 @@ gst_ts_demux_set_property (GObject * object, guint prop_id,
     case PROP_EMIT_STATS:
       demux->emit_statistics = g_value_get_boolean (value);
       break;
+    case PROP_INDEX_LOCATION:
+      GST_OBJECT_LOCK (demux);
+      g_free (demux->index_location);
+      demux->index_location = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -397,6 +471,11 @@ gst_ts_demux_get_property (GObject * object, guint prop_id,
     case PROP_EMIT_STATS:
       g_value_set_boolean (value, demux->emit_statistics);
       break;
+    case PROP_INDEX_LOCATION:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_string (value, demux->index_location);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -512,6 +591,236 @@ gst_ts_demux_srcpad_query (GstPad * pad, GstObject * parent, GstQuery * query)
 
 }
 
+/* Returns the number of index entries with a time lower or equal to @ts */
+static guint
+gst_ts_demux_index_upper_bound (GstTSDemux * demux, GstClockTime ts)
+{
+  guint lo = 0, hi = demux->index->len, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (g_array_index (demux->index, TSDemuxIndexEntry, mid).ts <= ts)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+static void
+gst_ts_demux_index_insert (GstTSDemux * demux, GstClockTime ts,
+    guint64 offset)
+{
+  TSDemuxIndexEntry entry, *prev;
+  guint idx;
+
+  idx = gst_ts_demux_index_upper_bound (demux, ts);
+  if (idx > 0) {
+    prev = &g_array_index (demux->index, TSDemuxIndexEntry, idx - 1);
+    /* Already known */
+    if (prev->ts == ts || prev->offset == offset)
+      return;
+  }
+
+  GST_LOG_OBJECT (demux, "Adding keyframe %" GST_TIME_FORMAT " at offset %"
+      G_GUINT64_FORMAT, GST_TIME_ARGS (ts), offset);
+
+  entry.ts = ts;
+  entry.offset = offset;
+  g_array_insert_val (demux->index, idx, entry);
+  demux->index_dirty = TRUE;
+}
+
+static void
+gst_ts_demux_add_index_entry (GstTSDemux * demux, TSDemuxStream * stream,
+    GstClockTime ts, guint64 offset)
+{
+  MpegTSBase *base = (MpegTSBase *) demux;
+  gint64 size;
+
+  /* Offsets are only meaningful if we're driving the upstream reads */
+  if (base->mode == BASE_MODE_PUSHING)
+    return;
+
+  if (G_UNLIKELY (demux->index_pid == G_MAXUINT16)) {
+    GST_DEBUG_OBJECT (demux, "Indexing keyframes of PID 0x%04x",
+        stream->stream.pid);
+    demux->index_pid = stream->stream.pid;
+    if (gst_pad_peer_query_duration (base->sinkpad, GST_FORMAT_BYTES, &size))
+      demux->index_upstream_size = size;
+  } else if (demux->index_pid != stream->stream.pid) {
+    return;
+  }
+
+  gst_ts_demux_index_insert (demux, ts, offset);
+}
+
+/* Finds the keyframe to seek to for @ts, according to the KEY_UNIT/SNAP
+ * seek @flags. Returns NULL if the index doesn't cover @ts */
+static const TSDemuxIndexEntry *
+gst_ts_demux_index_lookup (GstTSDemux * demux, GstClockTime ts,
+    GstSeekFlags flags)
+{
+  const TSDemuxIndexEntry *before = NULL, *after = NULL;
+  guint idx;
+
+  idx = gst_ts_demux_index_upper_bound (demux, ts);
+  if (idx > 0) {
+    before = &g_array_index (demux->index, TSDemuxIndexEntry, idx - 1);
+    if (ts - before->ts > INDEX_MAX_DISTANCE)
+      before = NULL;
+  }
+
+  /* A keyframe right at @ts is what all the flags ask for */
+  if (before && before->ts == ts)
+    return before;
+
+  if (idx < demux->index->len) {
+    after = &g_array_index (demux->index, TSDemuxIndexEntry, idx);
+    if (after->ts - ts > INDEX_MAX_DISTANCE)
+      after = NULL;
+  }
+
+  /* Without KEY_UNIT, we need to start decoding from the previous keyframe */
+  if (!(flags & GST_SEEK_FLAG_KEY_UNIT))
+    return before;
+
+  if ((flags & GST_SEEK_FLAG_SNAP_NEAREST) == GST_SEEK_FLAG_SNAP_NEAREST) {
+    if (before && after)
+      return (ts - before->ts <= after->ts - ts) ? before : after;
+    return before ? before : after;
+  }
+
+  if (flags & GST_SEEK_FLAG_SNAP_AFTER)
+    return after;
+
+  return before;
+}
+
+static void
+gst_ts_demux_load_index (GstTSDemux * demux)
+{
+  MpegTSBase *base = (MpegTSBase *) demux;
+  GError *err = NULL;
+  gchar *location, *contents = NULL;
+  const guint8 *data;
+  gsize size;
+  guint64 upstream_size;
+  gint64 current_size;
+  guint16 pid;
+  guint32 i, n_entries;
+
+  demux->index_loaded = TRUE;
+
+  GST_OBJECT_LOCK (demux);
+  location = g_strdup (demux->index_location);
+  GST_OBJECT_UNLOCK (demux);
+
+  if (location == NULL)
+    return;
+
+  if (!g_file_get_contents (location, &contents, &size, &err)) {
+    GST_DEBUG_OBJECT (demux, "No index loaded from %s: %s", location,
+        err->message);
+    g_error_free (err);
+    goto done;
+  }
+
+  data = (const guint8 *) contents;
+  if (size < INDEX_FILE_HEADER_SIZE
+      || memcmp (data, INDEX_FILE_MAGIC, 8) != 0
+      || GST_READ_UINT32_BE (data + 8) != INDEX_FILE_VERSION)
+    goto invalid;
+
+  pid = GST_READ_UINT16_BE (data + 12);
+  upstream_size = GST_READ_UINT64_BE (data + 16);
+  n_entries = GST_READ_UINT32_BE (data + 24);
+  if (n_entries > (size - INDEX_FILE_HEADER_SIZE) / INDEX_FILE_ENTRY_SIZE
+      || size != INDEX_FILE_HEADER_SIZE +
+      (gsize) n_entries * INDEX_FILE_ENTRY_SIZE)
+    goto invalid;
+
+  /* The index is only valid for the file it was created from */
+  if (!gst_pad_peer_query_duration (base->sinkpad, GST_FORMAT_BYTES,
+          &current_size) || current_size != upstream_size) {
+    GST_INFO_OBJECT (demux, "Index in %s is for another file", location);
+    goto done;
+  }
+
+  if (demux->index_pid != G_MAXUINT16 && demux->index_pid != pid) {
+    GST_INFO_OBJECT (demux, "Index in %s is for another PID", location);
+    goto done;
+  }
+
+  demux->index_pid = pid;
+  demux->index_upstream_size = upstream_size;
+  data += INDEX_FILE_HEADER_SIZE;
+  for (i = 0; i < n_entries; i++, data += INDEX_FILE_ENTRY_SIZE)
+    gst_ts_demux_index_insert (demux, GST_READ_UINT64_BE (data),
+        GST_READ_UINT64_BE (data + 8));
+  demux->index_dirty = FALSE;
+
+  GST_INFO_OBJECT (demux, "Loaded %u keyframes from %s", n_entries, location);
+
+done:
+  g_free (contents);
+  g_free (location);
+  return;
+
+invalid:
+  GST_WARNING_OBJECT (demux, "Invalid index file %s", location);
+  goto done;
+}
+
+static void
+gst_ts_demux_save_index (GstTSDemux * demux)
+{
+  GError *err = NULL;
+  TSDemuxIndexEntry *entry;
+  gchar *location;
+  guint8 *data, *p;
+  gsize size;
+  guint i;
+
+  if (!demux->index_dirty || demux->index->len == 0)
+    return;
+
+  GST_OBJECT_LOCK (demux);
+  location = g_strdup (demux->index_location);
+  GST_OBJECT_UNLOCK (demux);
+
+  if (location == NULL)
+    return;
+
+  size = INDEX_FILE_HEADER_SIZE + demux->index->len * INDEX_FILE_ENTRY_SIZE;
+  data = p = g_malloc0 (size);
+  memcpy (p, INDEX_FILE_MAGIC, 8);
+  GST_WRITE_UINT32_BE (p + 8, INDEX_FILE_VERSION);
+  GST_WRITE_UINT16_BE (p + 12, demux->index_pid);
+  GST_WRITE_UINT64_BE (p + 16, demux->index_upstream_size);
+  GST_WRITE_UINT32_BE (p + 24, demux->index->len);
+  p += INDEX_FILE_HEADER_SIZE;
+  for (i = 0; i < demux->index->len; i++, p += INDEX_FILE_ENTRY_SIZE) {
+    entry = &g_array_index (demux->index, TSDemuxIndexEntry, i);
+    GST_WRITE_UINT64_BE (p, entry->ts);
+    GST_WRITE_UINT64_BE (p + 8, entry->offset);
+  }
+
+  if (!g_file_set_contents (location, (const gchar *) data, size, &err)) {
+    GST_WARNING_OBJECT (demux, "Could not save index to %s: %s", location,
+        err->message);
+    g_error_free (err);
+  } else {
+    GST_INFO_OBJECT (demux, "Saved %u keyframes to %s", demux->index->len,
+        location);
+    demux->index_dirty = FALSE;
+  }
+
+  g_free (data);
+  g_free (location);
+}
+
 static GstFlowReturn
 gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
 {
@@ -525,6 +834,7 @@ gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
   GstSegment seeksegment;
   gboolean update;
   guint64 start_offset;
+  const TSDemuxIndexEntry *keyframe;
 
   gst_event_parse_seek (event, &rate, &format, &flags, &start_type, &start,
       &stop_type, &stop);
@@ -558,10 +868,22 @@ gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
   GST_DEBUG ("seeksegment after set_seek " SEGMENT_FORMAT,
       SEGMENT_ARGS (seeksegment));
 
-  /* Convert start/stop to offset */
-  start_offset =
-      mpegts_packetizer_ts_to_offset (base->packetizer, MAX (0,
-          start - SEEK_TIMESTAMP_OFFSET), demux->program->pcr_pid);
+  if (G_UNLIKELY (!demux->index_loaded))
+    gst_ts_demux_load_index (demux);
+
+  keyframe = gst_ts_demux_index_lookup (demux, MAX (0, start), flags);
+  if (keyframe) {
+    /* We know exactly where to go */
+    GST_DEBUG_OBJECT (demux, "Seeking to keyframe %" GST_TIME_FORMAT
+        " at offset %" G_GUINT64_FORMAT, GST_TIME_ARGS (keyframe->ts),
+        keyframe->offset);
+    start_offset = keyframe->offset;
+  } else {
+    /* Convert start/stop to offset */
+    start_offset =
+        mpegts_packetizer_ts_to_offset (base->packetizer, MAX (0,
+            start - SEEK_TIMESTAMP_OFFSET), demux->program->pcr_pid);
+  }
 
   if (G_UNLIKELY (start_offset == -1)) {
     GST_WARNING ("Couldn't convert start position to an offset");
@@ -1038,6 +1360,7 @@ done:
     GST_LOG ("stream:%p creating pad with name %s and caps %" GST_PTR_FORMAT,
         stream, name, caps);
     pad = gst_pad_new_from_template (template, name);
+    stream->is_video = g_str_has_prefix (name, "video_");
     gst_pad_set_active (pad, TRUE);
     gst_pad_use_fixed_caps (pad);
     stream_id =
@@ -1100,6 +1423,11 @@ gst_ts_demux_stream_added (MpegTSBase * base, MpegTSBaseStream * bstream,
     stream->pending_ts = TRUE;
     stream->first_dts = GST_CLOCK_TIME_NONE;
     stream->continuity_counter = CONTINUITY_UNSET;
+    stream->rap_offset = -1;
+  }
+  if (!stream->slices) {
+    stream->slices = g_array_new (FALSE, FALSE, sizeof (PESSlice));
+    g_array_set_clear_func (stream->slices, (GDestroyNotify) pes_slice_clear);
   }
   stream->flow_return = GST_FLOW_OK;
 }
@@ -1125,6 +1453,10 @@ gst_ts_demux_stream_removed (MpegTSBase * base, MpegTSBaseStream * bstream)
     stream->pad = NULL;
   }
   gst_ts_demux_stream_flush (stream);
+  if (stream->slices) {
+    g_array_free (stream->slices, TRUE);
+    stream->slices = NULL;
+  }
   stream->flow_return = GST_FLOW_NOT_LINKED;
 }
 
@@ -1163,12 +1495,10 @@ gst_ts_demux_stream_flush (TSDemuxStream * stream)
 {
   GST_DEBUG ("flushing stream %p", stream);
 
-  if (stream->data)
-    g_free (stream->data);
-  stream->data = NULL;
+  if (stream->slices)
+    g_array_set_size (stream->slices, 0);
   stream->state = PENDING_PACKET_EMPTY;
   stream->expected_size = 0;
-  stream->allocated_size = 0;
   stream->current_size = 0;
   stream->need_newsegment = TRUE;
   stream->pts = GST_CLOCK_TIME_NONE;
@@ -1418,6 +1748,98 @@ check_pending_buffers (GstTSDemux * demux, TSDemuxStream * stream)
   return TRUE;
 }
 
+static void
+pes_slice_clear (PESSlice * slice)
+{
+  gst_buffer_unref (slice->buffer);
+}
+
+/* Reference @size bytes of payload at @data from the input buffer they
+ * belong to, instead of copying them */
+static inline void
+gst_ts_demux_stream_add_slice (GstTSDemux * demux, TSDemuxStream * stream,
+    guint8 * data, guint size)
+{
+  PESSlice slice;
+  GstBuffer *buffer;
+
+  if (G_UNLIKELY (size == 0))
+    return;
+
+  buffer = mpegts_packetizer_get_backing_buffer (MPEG_TS_BASE_PACKETIZER
+      (demux), data, &slice.offset);
+  if (G_LIKELY (buffer)) {
+    slice.buffer = gst_buffer_ref (buffer);
+  } else {
+    /* Packet was assembled from several input buffers, keep a copy */
+    slice.buffer = gst_buffer_new_wrapped (g_memdup (data, size), size);
+    slice.offset = 0;
+  }
+  slice.size = size;
+
+  g_array_append_val (stream->slices, slice);
+  stream->current_size += size;
+}
+
+/* Create the output buffer from the pending slices. Small PES packets
+ * keep referencing the input memory (downstream only pays for a merge
+ * if it needs contiguous data). Video PES packets with more slices than
+ * a GstBuffer can hold memories are split over a buffer list, the first
+ * buffer of which is returned and carries the timestamps. Other streams
+ * can go to elements expecting a whole PES per buffer, so they are
+ * copied once into a buffer of the exact size */
+static GstBuffer *
+gst_ts_demux_stream_take_buffer (TSDemuxStream * stream,
+    GstBufferList ** list)
+{
+  GstBuffer *buffer = NULL, *first = NULL;
+  PESSlice *slice;
+  guint i;
+
+  *list = NULL;
+
+  if (stream->slices->len <= GST_BUFFER_MEM_MAX) {
+    buffer = gst_buffer_new ();
+    for (i = 0; i < stream->slices->len; i++) {
+      slice = &g_array_index (stream->slices, PESSlice, i);
+      gst_buffer_copy_into (buffer, slice->buffer, GST_BUFFER_COPY_MEMORY,
+          slice->offset, slice->size);
+    }
+  } else if (stream->is_video) {
+    *list = gst_buffer_list_new_sized ((stream->slices->len +
+            GST_BUFFER_MEM_MAX - 1) / GST_BUFFER_MEM_MAX);
+    for (i = 0; i < stream->slices->len; i++) {
+      if (i % GST_BUFFER_MEM_MAX == 0) {
+        buffer = gst_buffer_new ();
+        gst_buffer_list_add (*list, buffer);
+        if (first == NULL)
+          first = buffer;
+      }
+      slice = &g_array_index (stream->slices, PESSlice, i);
+      gst_buffer_copy_into (buffer, slice->buffer, GST_BUFFER_COPY_MEMORY,
+          slice->offset, slice->size);
+    }
+    buffer = first;
+  } else {
+    GstMapInfo map;
+    guint8 *dest;
+
+    buffer = gst_buffer_new_allocate (NULL, stream->current_size, NULL);
+    gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+    dest = map.data;
+    for (i = 0; i < stream->slices->len; i++) {
+      slice = &g_array_index (stream->slices, PESSlice, i);
+      gst_buffer_extract (slice->buffer, slice->offset, dest, slice->size);
+      dest += slice->size;
+    }
+    gst_buffer_unmap (buffer, &map);
+  }
+
+  g_array_set_size (stream->slices, 0);
+
+  return buffer;
+}
+
 static void
 gst_ts_demux_parse_pes_header (GstTSDemux * demux, TSDemuxStream * stream,
     guint8 * data, guint32 length, guint64 bufferoffset)
@@ -1438,6 +1860,10 @@ gst_ts_demux_parse_pes_header (GstTSDemux * demux, TSDemuxStream * stream,
 
   gst_ts_demux_record_dts (demux, stream, header.DTS, bufferoffset);
   gst_ts_demux_record_pts (demux, stream, header.PTS, bufferoffset);
+  if (stream->is_video && stream->rap_offset != -1
+      && GST_CLOCK_TIME_IS_VALID (stream->pts))
+    gst_ts_demux_add_index_entry (demux, stream, stream->pts,
+        stream->rap_offset);
   if (G_UNLIKELY (stream->pending_ts &&
           (stream->pts != GST_CLOCK_TIME_NONE
               || stream->dts != GST_CLOCK_TIME_NONE))) {
@@ -1470,16 +1896,8 @@ gst_ts_demux_parse_pes_header (GstTSDemux * demux, TSDemuxStream * stream,
   data += header.header_size;
   length -= header.header_size;
 
-  /* Create the output buffer */
-  if (stream->expected_size)
-    stream->allocated_size = MAX (stream->expected_size, length);
-  else
-    stream->allocated_size = MAX (8192, length);
-
-  g_assert (stream->data == NULL);
-  stream->data = g_malloc (stream->allocated_size);
-  memcpy (stream->data, data, length);
-  stream->current_size = length;
+  g_assert (stream->current_size == 0);
+  gst_ts_demux_stream_add_slice (demux, stream, data, length);
 
   stream->state = PENDING_PACKET_BUFFER;
 
@@ -1534,6 +1952,13 @@ gst_ts_demux_queue_data (GstTSDemux * demux, TSDemuxStream * stream,
     {
       GST_LOG ("HEADER: Parsing PES header");
 
+      /* Remember whether this PES starts at a random access point */
+      if (FLAGS_HAS_AFC (packet->scram_afc_cc) &&
+          (packet->afc_flags & MPEGTS_AFC_RANDOM_ACCES_FLAGS))
+        stream->rap_offset = packet->offset;
+      else
+        stream->rap_offset = -1;
+
       /* parse the header */
       gst_ts_demux_parse_pes_header (demux, stream, data, size, packet->offset);
       break;
@@ -1541,23 +1966,15 @@ gst_ts_demux_queue_data (GstTSDemux * demux, TSDemuxStream * stream,
     case PENDING_PACKET_BUFFER:
     {
       GST_LOG ("BUFFER: appending data");
-      if (G_UNLIKELY (stream->current_size + size > stream->allocated_size)) {
-        GST_LOG ("resizing buffer");
-        do {
-          stream->allocated_size *= 2;
-        } while (stream->current_size + size > stream->allocated_size);
-        stream->data = g_realloc (stream->data, stream->allocated_size);
-      }
-      memcpy (stream->data + stream->current_size, data, size);
-      stream->current_size += size;
+      gst_ts_demux_stream_add_slice (demux, stream, data, size);
       break;
     }
     case PENDING_PACKET_DISCONT:
     {
       GST_LOG ("DISCONT: not storing/pushing");
-      if (G_UNLIKELY (stream->data)) {
-        g_free (stream->data);
-        stream->data = NULL;
+      if (G_UNLIKELY (stream->slices->len)) {
+        g_array_set_size (stream->slices, 0);
+        stream->current_size = 0;
       }
       stream->continuity_counter = CONTINUITY_UNSET;
       break;
@@ -1671,13 +2088,14 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
   MpegTSBaseStream *bs = (MpegTSBaseStream *) stream;
 #endif
   GstBuffer *buffer = NULL;
+  GstBufferList *list;
 
   GST_DEBUG_OBJECT (stream->pad,
       "stream:%p, pid:0x%04x stream_type:%d state:%d", stream, bs->pid,
       bs->stream_type, stream->state);
 
-  if (G_UNLIKELY (stream->data == NULL)) {
-    GST_LOG ("stream->data == NULL");
+  if (G_UNLIKELY (stream->slices->len == 0)) {
+    GST_LOG ("no pending data");
     goto beach;
   }
 
@@ -1693,16 +2111,16 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
 
   if (G_UNLIKELY (demux->program == NULL)) {
     GST_LOG_OBJECT (demux, "No program");
-    g_free (stream->data);
     goto beach;
   }
 
-  buffer = gst_buffer_new_wrapped (stream->data, stream->current_size);
+  buffer = gst_ts_demux_stream_take_buffer (stream, &list);
 
   if (G_UNLIKELY (stream->pending_ts && !check_pending_buffers (demux, stream))) {
     PendingBuffer *pend;
     pend = g_slice_new0 (PendingBuffer);
     pend->buffer = buffer;
+    pend->list = list;
     pend->pts = stream->raw_pts;
     pend->dts = stream->raw_dts;
     stream->pending = g_list_append (stream->pending, pend);
@@ -1727,7 +2145,10 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
           GST_TIME_FORMAT, GST_TIME_ARGS (GST_BUFFER_PTS (pend->buffer)),
           GST_TIME_ARGS (GST_BUFFER_DTS (pend->buffer)));
 
-      res = gst_pad_push (stream->pad, pend->buffer);
+      if (pend->list)
+        res = gst_pad_push_list (stream->pad, pend->list);
+      else
+        res = gst_pad_push (stream->pad, pend->buffer);
       g_slice_free (PendingBuffer, pend);
     }
     g_list_free (stream->pending);
@@ -1746,7 +2167,10 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
       GST_TIME_ARGS (GST_BUFFER_PTS (buffer)),
       GST_TIME_ARGS (GST_BUFFER_DTS (buffer)));
 
-  res = gst_pad_push (stream->pad, buffer);
+  if (list)
+    res = gst_pad_push_list (stream->pad, list);
+  else
+    res = gst_pad_push (stream->pad, buffer);
   GST_DEBUG_OBJECT (stream->pad, "Returned %s", gst_flow_get_name (res));
   res = tsdemux_combine_flows (demux, stream, res);
   GST_DEBUG_OBJECT (stream->pad, "combined %s", gst_flow_get_name (res));
@@ -1755,7 +2179,7 @@ beach:
   /* Reset everything */
   GST_LOG ("Resetting to EMPTY, returning %s", gst_flow_get_name (res));
   stream->state = PENDING_PACKET_EMPTY;
-  stream->data = NULL;
+  g_array_set_size (stream->slices, 0);
   stream->expected_size = 0;
   stream->current_size = 0;
 
@@ -79,6 +79,19 @@ struct _GstTSDemux
 
   /* Pending seek rate (default 1.0) */
   gdouble rate;
+
+  /* Keyframe index (TSDemuxIndexEntry sorted by time), built from the
+   * random access points of index_pid while playing */
+  GArray *index;
+  guint16 index_pid;
+  /* Upstream size the index applies to */
+  guint64 index_upstream_size;
+  /* TRUE if the index has entries not saved to index_location yet */
+  gboolean index_dirty;
+  /* TRUE once we tried loading index_location */
+  gboolean index_loaded;
+  /* Sidecar file to load/save the index from/to (protected by OBJECT_LOCK) */
+  gchar *index_location;
 };
 
 struct _GstTSDemuxClass
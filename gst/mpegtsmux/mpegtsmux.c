@@ -110,11 +110,14 @@ enum
   ARG_M2TS_MODE,
   ARG_PAT_INTERVAL,
   ARG_PMT_INTERVAL,
-  ARG_ALIGNMENT
+  ARG_ALIGNMENT,
+  ARG_BITRATE,
+  ARG_PCR_INTERVAL
 };
 
 #define MPEGTSMUX_DEFAULT_ALIGNMENT    -1
 #define MPEGTSMUX_DEFAULT_M2TS         FALSE
+#define MPEGTSMUX_DEFAULT_BITRATE      0
 
 static GstStaticPadTemplate mpegtsmux_sink_factory =
     GST_STATIC_PAD_TEMPLATE ("sink_%d",
@@ -277,6 +280,19 @@ mpegtsmux_class_init (MpegTsMuxClass * klass)
           "(-1 = auto, 0 = all available packets)",
           -1, G_MAXINT, MPEGTSMUX_DEFAULT_ALIGNMENT,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_BITRATE,
+      g_param_spec_uint64 ("bitrate", "Bitrate",
+          "Constant output bitrate in bits per second, stuffed with null "
+          "packets (0 = variable bitrate)",
+          0, G_MAXUINT64, MPEGTSMUX_DEFAULT_BITRATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_PCR_INTERVAL,
+      g_param_spec_uint ("pcr-interval", "PCR interval",
+          "Set the interval (in ticks of the 90kHz clock) for writing out the PCR",
+          1, G_MAXUINT, TSMUX_DEFAULT_PCR_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -312,6 +328,8 @@ mpegtsmux_init (MpegTsMux * mux)
   mux->pmt_interval = TSMUX_DEFAULT_PMT_INTERVAL;
   mux->prog_map = NULL;
   mux->alignment = MPEGTSMUX_DEFAULT_ALIGNMENT;
+  mux->bitrate = MPEGTSMUX_DEFAULT_BITRATE;
+  mux->pcr_interval = TSMUX_DEFAULT_PCR_INTERVAL;
 
   /* initial state */
   mpegtsmux_reset (mux, TRUE);
@@ -349,6 +367,64 @@ mpegtsmux_pad_reset (MpegTsPadData * pad_data)
 
 }
 
+/* Buffers of both pools are released once pushed and consumed, so a few of
+ * them are enough to get going */
+#define MPEGTSMUX_POOL_MIN_BUFFERS 4
+
+static GstBufferPool *
+mpegtsmux_new_pool (MpegTsMux * mux, guint size)
+{
+  GstBufferPool *pool;
+  GstStructure *config;
+
+  GST_DEBUG_OBJECT (mux, "creating pool of %u bytes buffers", size);
+
+  pool = gst_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, NULL, size,
+      MPEGTSMUX_POOL_MIN_BUFFERS, 0);
+  if (!gst_buffer_pool_set_config (pool, config) ||
+      !gst_buffer_pool_set_active (pool, TRUE)) {
+    GST_WARNING_OBJECT (mux, "failed to activate pool");
+    gst_object_unref (pool);
+    return NULL;
+  }
+
+  return pool;
+}
+
+static void
+mpegtsmux_free_pool (GstBufferPool ** pool)
+{
+  if (*pool) {
+    gst_buffer_pool_set_active (*pool, FALSE);
+    gst_object_unref (*pool);
+    *pool = NULL;
+  }
+}
+
+/* Gets a buffer of @size bytes from @pool, (re)creating it as needed.
+ * Falls back to a plain allocation if the pool doesn't work out */
+static GstBuffer *
+mpegtsmux_acquire_buffer (MpegTsMux * mux, GstBufferPool ** pool,
+    guint pool_size, guint size)
+{
+  GstBuffer *buf = NULL;
+
+  if (G_UNLIKELY (*pool == NULL))
+    *pool = mpegtsmux_new_pool (mux, pool_size);
+
+  if (G_UNLIKELY (*pool == NULL ||
+          gst_buffer_pool_acquire_buffer (*pool, &buf, NULL) != GST_FLOW_OK))
+    return gst_buffer_new_and_alloc (size);
+
+  /* buffers may come back from downstream resized or flagged */
+  gst_buffer_set_size (buf, size);
+  GST_BUFFER_FLAG_UNSET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  return buf;
+}
+
 static void
 mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
 {
@@ -398,6 +474,10 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
   gst_event_replace (&mux->force_key_unit_event, NULL);
   gst_buffer_replace (&mux->out_buffer, NULL);
 
+  mpegtsmux_free_pool (&mux->packet_pool);
+  mpegtsmux_free_pool (&mux->out_pool);
+  mux->out_pool_size = 0;
+
   GST_COLLECT_PADS_STREAM_LOCK (mux->collect);
   for (walk = mux->collect->data; walk != NULL; walk = g_slist_next (walk))
     mpegtsmux_pad_reset ((MpegTsPadData *) walk->data);
@@ -407,6 +487,8 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
     mux->tsmux = tsmux_new ();
     tsmux_set_write_func (mux->tsmux, new_packet_cb, mux);
     tsmux_set_alloc_func (mux->tsmux, alloc_packet_cb, mux);
+    tsmux_set_bitrate (mux->tsmux, mux->bitrate);
+    tsmux_set_pcr_interval (mux->tsmux, mux->pcr_interval);
   }
 }
 
@@ -479,6 +561,16 @@ gst_mpegtsmux_set_property (GObject * object, guint prop_id,
     case ARG_ALIGNMENT:
       mux->alignment = g_value_get_int (value);
       break;
+    case ARG_BITRATE:
+      mux->bitrate = g_value_get_uint64 (value);
+      if (mux->tsmux)
+        tsmux_set_bitrate (mux->tsmux, mux->bitrate);
+      break;
+    case ARG_PCR_INTERVAL:
+      mux->pcr_interval = g_value_get_uint (value);
+      if (mux->tsmux)
+        tsmux_set_pcr_interval (mux->tsmux, mux->pcr_interval);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -507,6 +599,12 @@ gst_mpegtsmux_get_property (GObject * object, guint prop_id,
     case ARG_ALIGNMENT:
       g_value_set_int (value, mux->alignment);
       break;
+    case ARG_BITRATE:
+      g_value_set_uint64 (value, mux->bitrate);
+      break;
+    case ARG_PCR_INTERVAL:
+      g_value_set_uint (value, mux->pcr_interval);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1349,6 +1447,7 @@ mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
   GstBuffer *buf;
   GstFlowReturn ret = GST_FLOW_OK;
   GstClockTime ts;
+  GstMapInfo map;
 
   if (mux->m2ts_mode) {
     packet_size = M2TS_PACKET_LENGTH;
@@ -1363,33 +1462,56 @@ mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
   av = gst_adapter_available (mux->out_adapter);
   GST_LOG_OBJECT (mux, "align %d, av %d", align, av);
 
-  if (!align)
-    align = av;
-  else
-    align *= packet_size;
+  if (!align) {
+    /* no alignment, push all we have in one go */
+    if (av) {
+      GST_LOG_OBJECT (mux, "pushing %d bytes", av);
+      ts = gst_adapter_prev_pts (mux->out_adapter, NULL);
+      buf = gst_adapter_take_buffer (mux->out_adapter, av);
+      GST_BUFFER_PTS (buf) = ts;
+      ret = gst_pad_push (mux->srcpad, buf);
+    }
+    return ret;
+  }
+
+  align *= packet_size;
+  if (G_UNLIKELY (mux->out_pool_size != align)) {
+    mpegtsmux_free_pool (&mux->out_pool);
+    mux->out_pool_size = align;
+  }
 
   /* FIXME: what about DTS here? */
   GST_LOG_OBJECT (mux, "aligning to %d bytes", align);
-  if (G_LIKELY ((align <= av) && av)) {
+  if (G_LIKELY (align <= av)) {
+    GstBufferList *list;
+
+    /* copy the packets into pooled chunks of @align bytes, each of them
+     * being pushed as a separate buffer of a single list */
     GST_LOG_OBJECT (mux, "pushing %d aligned bytes", av - (av % align));
-    ts = gst_adapter_prev_pts (mux->out_adapter, NULL);
-    buf = gst_adapter_take_buffer (mux->out_adapter, av - (av % align));
-    g_assert (buf);
-    GST_BUFFER_PTS (buf) = ts;
+    list = gst_buffer_list_new_sized (av / align);
+    while (av >= align) {
+      buf = mpegtsmux_acquire_buffer (mux, &mux->out_pool, align, align);
+      ts = gst_adapter_prev_pts (mux->out_adapter, NULL);
+      gst_buffer_map (buf, &map, GST_MAP_WRITE);
+      gst_adapter_copy (mux->out_adapter, map.data, 0, align);
+      gst_buffer_unmap (buf, &map);
+      gst_adapter_flush (mux->out_adapter, align);
+      GST_BUFFER_PTS (buf) = ts;
+      gst_buffer_list_add (list, buf);
+      av -= align;
+    }
 
-    ret = gst_pad_push (mux->srcpad, buf);
-    av = av % align;
+    ret = gst_pad_push_list (mux->srcpad, list);
   }
 
   if (av && force) {
     guint8 *data;
     guint32 header;
     gint dummy;
-    GstMapInfo map;
 
     GST_LOG_OBJECT (mux, "handling %d leftover bytes", av);
-    buf = gst_buffer_new_and_alloc (align);
-    gst_buffer_map (buf, &map, GST_MAP_READ);
+    buf = mpegtsmux_acquire_buffer (mux, &mux->out_pool, align, align);
+    gst_buffer_map (buf, &map, GST_MAP_WRITE);
     data = map.data;
     ts = gst_adapter_prev_pts (mux->out_adapter, NULL);
 
@@ -1600,16 +1722,11 @@ static void
 alloc_packet_cb (GstBuffer ** _buf, void *user_data)
 {
   MpegTsMux *mux = (MpegTsMux *) user_data;
-  GstBuffer *buf;
-  gint offset = 0;
-
-  if (mux->m2ts_mode == TRUE)
-    offset = 4;
-
-  buf = gst_buffer_new_and_alloc (NORMAL_TS_PACKET_LENGTH + offset);
-  gst_buffer_set_size (buf, NORMAL_TS_PACKET_LENGTH);
 
-  *_buf = buf;
+  /* room is always left for the m2ts prefix so the pool never needs to be
+   * recreated when switching modes */
+  *_buf = mpegtsmux_acquire_buffer (mux, &mux->packet_pool,
+      M2TS_PACKET_LENGTH, NORMAL_TS_PACKET_LENGTH);
 }
 
 static void
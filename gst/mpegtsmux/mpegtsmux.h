@@ -140,6 +140,8 @@ struct MpegTsMux {
   guint pat_interval;
   guint pmt_interval;
   gint alignment;
+  guint64 bitrate;
+  guint pcr_interval;
 
   /* state */
   gboolean first;
@@ -164,6 +166,12 @@ struct MpegTsMux {
   GstAdapter *out_adapter;
   GstBuffer *out_buffer;
 
+  /* pool of packet buffers handed to tsmux */
+  GstBufferPool *packet_pool;
+  /* pool of aligned output chunks, and their size */
+  GstBufferPool *out_pool;
+  guint out_pool_size;
+
 #if 0
   /* SPN/PTS index handling */
   GstIndex *element_index;
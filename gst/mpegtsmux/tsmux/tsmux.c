@@ -105,8 +105,11 @@
  * 1/8 second atm */
 #define TSMUX_PCR_OFFSET (TSMUX_CLOCK_FREQ / 8)
 
-/* Times per second to write PCR */
-#define TSMUX_DEFAULT_PCR_FREQ (25)
+/* Offset in a packet of the byte holding the last bit of the PCR base,
+ * which is the one the PCR value refers to */
+#define TSMUX_PCR_BYTE_OFFSET 10
+
+#define TSMUX_NULL_PID 0x1FFF
 
 /* Base for all written PCR and DTS/PTS,
  * so we have some slack to go backwards */
@@ -114,6 +117,8 @@
 
 static gboolean tsmux_write_pat (TsMux * mux);
 static gboolean tsmux_write_pmt (TsMux * mux, TsMuxProgram * program);
+static gboolean tsmux_write_ts_header (guint8 * buf, TsMuxPacketInfo * pi,
+    guint * payload_len_out, guint * payload_offset_out);
 
 /**
  * tsmux_new:
@@ -139,6 +144,9 @@ tsmux_new (void)
   mux->last_pat_ts = -1;
   mux->pat_interval = TSMUX_DEFAULT_PAT_INTERVAL;
 
+  mux->pcr_interval = TSMUX_DEFAULT_PCR_INTERVAL;
+  mux->first_pcr = -1;
+
   return mux;
 }
 
@@ -214,6 +222,75 @@ tsmux_get_pat_interval (TsMux * mux)
   return mux->pat_interval;
 }
 
+/**
+ * tsmux_set_pcr_interval:
+ * @mux: a #TsMux
+ * @interval: a new PCR interval
+ *
+ * Set the interval (in cycles of the 90kHz clock) for writing out the PCR of
+ * each program.
+ */
+void
+tsmux_set_pcr_interval (TsMux * mux, guint interval)
+{
+  g_return_if_fail (mux != NULL);
+
+  mux->pcr_interval = interval;
+}
+
+/**
+ * tsmux_get_pcr_interval:
+ * @mux: a #TsMux
+ *
+ * Get the configured PCR interval. See also tsmux_set_pcr_interval().
+ *
+ * Returns: the configured PCR interval
+ */
+guint
+tsmux_get_pcr_interval (TsMux * mux)
+{
+  g_return_val_if_fail (mux != NULL, 0);
+
+  return mux->pcr_interval;
+}
+
+/**
+ * tsmux_set_bitrate:
+ * @mux: a #TsMux
+ * @bitrate: the output bitrate in bits per second, or 0
+ *
+ * Set a constant output bitrate for @mux. Packets are then scheduled against
+ * a virtual transmit clock running at @bitrate: null packets are inserted
+ * whenever no stream may send data, each stream being limited by its T-STD
+ * buffer model, and the PCR of each program is sent in packets of its own
+ * exactly every PCR interval.
+ *
+ * A @bitrate of 0 (the default) gives variable bitrate output.
+ */
+void
+tsmux_set_bitrate (TsMux * mux, guint64 bitrate)
+{
+  g_return_if_fail (mux != NULL);
+
+  mux->bitrate = bitrate;
+}
+
+/**
+ * tsmux_get_bitrate:
+ * @mux: a #TsMux
+ *
+ * Get the configured output bitrate. See also tsmux_set_bitrate().
+ *
+ * Returns: the configured bitrate
+ */
+guint64
+tsmux_get_bitrate (TsMux * mux)
+{
+  g_return_val_if_fail (mux != NULL, 0);
+
+  return mux->bitrate;
+}
+
 /**
  * tsmux_free:
  * @mux: a #TsMux
@@ -495,9 +572,20 @@ tsmux_get_buffer (TsMux * mux, GstBuffer ** buf)
   return TRUE;
 }
 
+/* Time on the CBR transmit clock at which the byte at @offset of the next
+ * packet is output */
+static inline gint64
+tsmux_cbr_get_time (TsMux * mux, guint offset)
+{
+  return mux->first_pcr + gst_util_uint64_scale (mux->n_bytes + offset,
+      8 * TSMUX_SYS_CLOCK_FREQ, mux->bitrate);
+}
+
 static gboolean
-tsmux_packet_out (TsMux * mux, GstBuffer * buf, gint64 pcr)
+tsmux_packet_out_unscheduled (TsMux * mux, GstBuffer * buf, gint64 pcr)
 {
+  mux->n_bytes += TSMUX_PACKET_LENGTH;
+
   if (G_UNLIKELY (mux->write_func == NULL)) {
     if (buf)
       gst_buffer_unref (buf);
@@ -507,6 +595,139 @@ tsmux_packet_out (TsMux * mux, GstBuffer * buf, gint64 pcr)
   return mux->write_func (buf, mux->write_func_data, pcr);
 }
 
+/* Outputs a packet carrying nothing but the PCR of @stream */
+static gboolean
+tsmux_write_pcr_packet (TsMux * mux, TsMuxStream * stream, gint64 pcr)
+{
+  TsMuxPacketInfo pi = { 0, };
+  guint payload_len, payload_offs;
+  GstBuffer *buf = NULL;
+  GstMapInfo map;
+
+  pi.pid = stream->pi.pid;
+  /* no payload, so repeat the continuity counter of the last packet */
+  pi.packet_count = stream->pi.packet_count - 1;
+  pi.flags = TSMUX_PACKET_FLAG_ADAPTATION | TSMUX_PACKET_FLAG_WRITE_PCR;
+  pi.pcr = pcr;
+
+  if (!tsmux_get_buffer (mux, &buf))
+    return FALSE;
+
+  gst_buffer_map (buf, &map, GST_MAP_WRITE);
+  tsmux_write_ts_header (map.data, &pi, &payload_len, &payload_offs);
+  gst_buffer_unmap (buf, &map);
+
+  TS_DEBUG ("PCR packet on PID 0x%04x, PCR %" G_GINT64_FORMAT, pi.pid, pcr);
+  stream->last_pcr = pcr;
+
+  return tsmux_packet_out_unscheduled (mux, buf, pcr);
+}
+
+static gboolean
+tsmux_packet_out (TsMux * mux, GstBuffer * buf, gint64 pcr)
+{
+  GList *cur;
+
+  /* In CBR mode, PCR go out in packets of their own as soon as they're
+   * due, so they're exactly spaced */
+  if (mux->bitrate && mux->first_pcr != -1) {
+    for (cur = mux->programs; cur; cur = cur->next) {
+      TsMuxProgram *program = (TsMuxProgram *) cur->data;
+      TsMuxStream *stream = program->pcr_stream;
+      gint64 now;
+
+      if (stream == NULL)
+        continue;
+
+      now = tsmux_cbr_get_time (mux, TSMUX_PCR_BYTE_OFFSET);
+      if (stream->last_pcr != -1 && now - stream->last_pcr <
+          mux->pcr_interval * (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ))
+        continue;
+
+      if (!tsmux_write_pcr_packet (mux, stream, now)) {
+        if (buf)
+          gst_buffer_unref (buf);
+        return FALSE;
+      }
+    }
+  }
+
+  return tsmux_packet_out_unscheduled (mux, buf, pcr);
+}
+
+static gboolean
+tsmux_write_null_packet (TsMux * mux)
+{
+  GstBuffer *buf = NULL;
+  GstMapInfo map;
+
+  if (!tsmux_get_buffer (mux, &buf))
+    return FALSE;
+
+  gst_buffer_map (buf, &map, GST_MAP_WRITE);
+  map.data[0] = TSMUX_SYNC_BYTE;
+  map.data[1] = TSMUX_NULL_PID >> 8;
+  map.data[2] = TSMUX_NULL_PID & 0xff;
+  /* payload only, continuity counter undefined */
+  map.data[3] = 0x10;
+  memset (map.data + TSMUX_HEADER_LENGTH, 0xff, TSMUX_PAYLOAD_LENGTH);
+  gst_buffer_unmap (buf, &map);
+
+  return tsmux_packet_out (mux, buf, -1);
+}
+
+/* In CBR mode, holds back the next packet of @stream until it may be sent:
+ * data is sent the same fixed delay ahead of its decoding time as the PCR
+ * is in VBR mode, unless the T-STD buffer of @stream has no room for it
+ * yet. Null packets fill the gap. Sets @removal_time to the time the
+ * packet will leave the T-STD buffer, or -1 if unknown */
+static gboolean
+tsmux_cbr_schedule_stream (TsMux * mux, TsMuxStream * stream,
+    gint64 * removal_time)
+{
+  gint64 dts, target, room, now;
+
+  *removal_time = -1;
+
+  dts = tsmux_stream_get_next_dts (stream);
+  if (dts == -1)
+    return TRUE;
+
+  /* CLOCK_BASE >= TSMUX_PCR_OFFSET */
+  dts = (dts + CLOCK_BASE) * (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ);
+  target = dts - TSMUX_PCR_OFFSET * (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ);
+
+  if (G_UNLIKELY (mux->first_pcr == -1)) {
+    /* Start the transmit clock so that this packet goes out right now */
+    mux->first_pcr = target - gst_util_uint64_scale (mux->n_bytes,
+        8 * TSMUX_SYS_CLOCK_FREQ, mux->bitrate);
+    TS_DEBUG ("Starting transmit clock at %" G_GINT64_FORMAT,
+        mux->first_pcr);
+  }
+
+  now = tsmux_cbr_get_time (mux, 0);
+  tsmux_stream_tstd_update (stream, now);
+  room = tsmux_stream_tstd_time_for (stream, TSMUX_PAYLOAD_LENGTH);
+  target = MAX (target, room);
+
+  while (now < target) {
+    if (!tsmux_write_null_packet (mux))
+      return FALSE;
+    now = tsmux_cbr_get_time (mux, 0);
+  }
+  tsmux_stream_tstd_update (stream, now);
+
+  if (G_UNLIKELY (now > dts) && tsmux_stream_at_pes_start (stream)) {
+    GST_WARNING ("PID 0x%04x is late by %" G_GINT64_FORMAT " us, bitrate "
+        "too low", stream->pi.pid, (now - dts) / (TSMUX_SYS_CLOCK_FREQ /
+            G_USEC_PER_SEC));
+  }
+
+  *removal_time = dts;
+
+  return TRUE;
+}
+
 /*
  * adaptation_field() {
  *   adaptation_field_length                              8 uimsbf
@@ -770,12 +991,16 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
   TsMuxPacketInfo *pi = &stream->pi;
   gboolean res;
   gint64 cur_pcr = -1;
+  gint64 removal_time = -1;
   GstBuffer *buf = NULL;
   GstMapInfo map;
 
   g_return_val_if_fail (mux != NULL, FALSE);
   g_return_val_if_fail (stream != NULL, FALSE);
 
+  if (mux->bitrate && !tsmux_cbr_schedule_stream (mux, stream, &removal_time))
+    return FALSE;
+
   if (tsmux_stream_is_pcr (stream)) {
     gint64 cur_pts = tsmux_stream_get_pts (stream);
     gboolean write_pat;
@@ -795,10 +1020,13 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
           (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ);
     }
 
-    /* Need to decide whether to write a new PCR in this packet */
-    if (stream->last_pcr == -1 ||
+    /* Need to decide whether to write a new PCR in this packet. In CBR
+     * mode, they are written on their own by tsmux_packet_out() */
+    if (mux->bitrate) {
+      cur_pcr = -1;
+    } else if (stream->last_pcr == -1 ||
         (cur_pcr - stream->last_pcr >
-            (TSMUX_SYS_CLOCK_FREQ / TSMUX_DEFAULT_PCR_FREQ))) {
+            mux->pcr_interval * (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ))) {
 
       stream->pi.flags |=
           TSMUX_PACKET_FLAG_ADAPTATION | TSMUX_PACKET_FLAG_WRITE_PCR;
@@ -867,6 +1095,9 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
 
   gst_buffer_unmap (buf, &map);
 
+  if (removal_time != -1)
+    tsmux_stream_tstd_add (stream, removal_time, payload_len);
+
   res = tsmux_packet_out (mux, buf, cur_pcr);
 
   /* Reset all dynamic flags */
@@ -160,6 +160,16 @@ struct TsMux {
   /* last time PAT written in MPEG PTS clock time */
   gint64   last_pat_ts;
 
+  /* interval between PCR in MPEG PTS clock time */
+  guint    pcr_interval;
+
+  /* constant output bitrate in bits per second, 0 for variable bitrate */
+  guint64  bitrate;
+  /* number of bytes output so far */
+  guint64  n_bytes;
+  /* CBR: system clock time of the first byte output, -1 if not started */
+  gint64   first_pcr;
+
   /* callback to write finished packet */
   TsMuxWriteFunc write_func;
   void *write_func_data;
@@ -180,6 +190,10 @@ void 		tsmux_set_write_func 		(TsMux *mux, TsMuxWriteFunc func, void *user_data)
 void 		tsmux_set_alloc_func 		(TsMux *mux, TsMuxAllocFunc func, void *user_data);
 void 		tsmux_set_pat_interval          (TsMux *mux, guint interval);
 guint 		tsmux_get_pat_interval          (TsMux *mux);
+void 		tsmux_set_pcr_interval          (TsMux *mux, guint interval);
+guint 		tsmux_get_pcr_interval          (TsMux *mux);
+void 		tsmux_set_bitrate               (TsMux *mux, guint64 bitrate);
+guint64 	tsmux_get_bitrate               (TsMux *mux);
 guint16		tsmux_get_new_pid 		(TsMux *mux);
 
 /* pid/program management */
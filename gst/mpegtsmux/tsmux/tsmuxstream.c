@@ -109,6 +109,20 @@ struct TsMuxStreamBuffer
   void *user_data;
 };
 
+/* T-STD buffer sizes. The actual sizes depend on the profile and level of
+ * each stream, so use the MPEG-2 MP@ML ones for video (1835008 bits of
+ * VBV buffer plus some multiplex buffer) and the common audio one
+ * (BSn = 3584 bytes) for everything else */
+#define TSMUX_TSTD_VIDEO_BUFFER_SIZE (1835008 / 8 + 4096)
+#define TSMUX_TSTD_BUFFER_SIZE 3584
+
+typedef struct
+{
+  /* system clock time at which the bytes leave the buffer */
+  gint64 time;
+  guint32 len;
+} TsMuxTStdRemoval;
+
 /**
  * tsmux_stream_new:
  * @pid: a PID
@@ -199,6 +213,9 @@ tsmux_stream_new (guint16 pid, TsMuxStreamType stream_type)
   stream->pcr_ref = 0;
   stream->last_pcr = -1;
 
+  stream->tstd_size = stream->is_video_stream ?
+      TSMUX_TSTD_VIDEO_BUFFER_SIZE : TSMUX_TSTD_BUFFER_SIZE;
+
   return stream;
 }
 
@@ -241,6 +258,8 @@ tsmux_stream_free (TsMuxStream * stream)
   }
   g_list_free (stream->buffers);
 
+  tsmux_stream_tstd_update (stream, G_MAXINT64);
+
   g_slice_free (TsMuxStream, stream);
 }
 
@@ -971,3 +990,118 @@ tsmux_stream_get_pts (TsMuxStream * stream)
 
   return stream->last_pts;
 }
+
+/**
+ * tsmux_stream_get_next_dts:
+ * @stream: a #TsMuxStream
+ *
+ * Return the decoding time of the next bytes to be written in @stream, or
+ * of the last ones written if that isn't known.
+ *
+ * Returns: the DTS of the next bytes of @stream, or -1 if unknown.
+ */
+gint64
+tsmux_stream_get_next_dts (TsMuxStream * stream)
+{
+  TsMuxStreamBuffer *buf;
+
+  g_return_val_if_fail (stream != NULL, -1);
+
+  buf = stream->cur_buffer;
+  if (buf == NULL && stream->buffers)
+    buf = (TsMuxStreamBuffer *) stream->buffers->data;
+
+  if (buf) {
+    if (buf->dts != -1)
+      return buf->dts;
+    if (buf->pts != -1)
+      return buf->pts;
+  }
+
+  return stream->last_dts != -1 ? stream->last_dts : stream->last_pts;
+}
+
+/**
+ * tsmux_stream_tstd_add:
+ * @stream: a #TsMuxStream
+ * @removal_time: the system clock time at which the bytes are decoded
+ * @len: the number of bytes
+ *
+ * Account for @len bytes of @stream entering the T-STD buffer, to be removed
+ * at @removal_time.
+ */
+void
+tsmux_stream_tstd_add (TsMuxStream * stream, gint64 removal_time, guint len)
+{
+  TsMuxTStdRemoval *removal;
+
+  g_return_if_fail (stream != NULL);
+
+  removal = g_queue_peek_tail (&stream->tstd_removals);
+  if (removal == NULL || removal->time != removal_time) {
+    removal = g_slice_new (TsMuxTStdRemoval);
+    removal->time = removal_time;
+    removal->len = 0;
+    g_queue_push_tail (&stream->tstd_removals, removal);
+  }
+
+  removal->len += len;
+  stream->tstd_level += len;
+}
+
+/**
+ * tsmux_stream_tstd_update:
+ * @stream: a #TsMuxStream
+ * @time: the current system clock time
+ *
+ * Remove from the T-STD buffer of @stream all the bytes decoded by @time.
+ */
+void
+tsmux_stream_tstd_update (TsMuxStream * stream, gint64 time)
+{
+  TsMuxTStdRemoval *removal;
+
+  g_return_if_fail (stream != NULL);
+
+  while ((removal = g_queue_peek_head (&stream->tstd_removals))) {
+    if (removal->time > time)
+      break;
+
+    stream->tstd_level -= removal->len;
+    g_slice_free (TsMuxTStdRemoval, g_queue_pop_head (&stream->tstd_removals));
+  }
+}
+
+/**
+ * tsmux_stream_tstd_time_for:
+ * @stream: a #TsMuxStream
+ * @len: a number of bytes
+ *
+ * Find when @len more bytes fit in the T-STD buffer of @stream.
+ *
+ * Returns: the system clock time at which there is room for @len bytes, or
+ * -1 if there already is.
+ */
+gint64
+tsmux_stream_tstd_time_for (TsMuxStream * stream, guint len)
+{
+  TsMuxTStdRemoval *removal;
+  guint32 level;
+  GList *cur;
+
+  g_return_val_if_fail (stream != NULL, -1);
+
+  level = stream->tstd_level;
+  if (level + len <= stream->tstd_size)
+    return -1;
+
+  for (cur = stream->tstd_removals.head; cur; cur = cur->next) {
+    removal = (TsMuxTStdRemoval *) cur->data;
+    level -= removal->len;
+    if (level + len <= stream->tstd_size)
+      return removal->time;
+  }
+
+  /* Can only happen if @len is bigger than the whole buffer */
+  return -1;
+}
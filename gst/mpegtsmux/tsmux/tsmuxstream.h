@@ -198,6 +198,12 @@ struct TsMuxStream {
   /* last time PCR written */
   gint64 last_pcr;
 
+  /* T-STD buffer model, used in CBR mode: size and fullness in bytes, and
+   * the pending removals (TsMuxTStdRemoval) in system clock time */
+  guint32 tstd_size;
+  guint32 tstd_level;
+  GQueue tstd_removals;
+
   /* audio parameters for stream
    * (used in stream descriptor) */
   gint audio_sampling;
@@ -236,6 +242,11 @@ gboolean 	tsmux_stream_initialize_pes_packet (TsMuxStream *stream);
 gboolean 	tsmux_stream_get_data 		(TsMuxStream *stream, guint8 *buf, guint len);
 
 guint64 	tsmux_stream_get_pts 		(TsMuxStream *stream);
+gint64 		tsmux_stream_get_next_dts 	(TsMuxStream *stream);
+
+void 		tsmux_stream_tstd_add 		(TsMuxStream *stream, gint64 removal_time, guint len);
+void 		tsmux_stream_tstd_update 	(TsMuxStream *stream, gint64 time);
+gint64 		tsmux_stream_tstd_time_for 	(TsMuxStream *stream, guint len);
 
 G_END_DECLS
 
@@ -31,7 +31,7 @@
  */
 
 /* TODO:
- *   - Seeking support: Use IndexTableSegments
+ *   - Use IndexTableSegments for seeking in push mode too
  *   - Handle timecode tracks correctly (where is this documented?)
  *   - Handle drop-frame field of timecode tracks
  *   - Handle Generic container system items
@@ -112,9 +112,15 @@ enum
   PROP_0,
   PROP_PACKAGE,
   PROP_MAX_DRIFT,
-  PROP_STRUCTURE
+  PROP_STRUCTURE,
+  PROP_GROWING_FILE
 };
 
+/* How often to check if a growing file has more data */
+#define GROWING_FILE_POLL_INTERVAL (500 * G_TIME_SPAN_MILLISECOND)
+/* Maximum number of unknown edit units between known ones in the index */
+#define MAX_INDEX_GAP (64 * 1024)
+
 static gboolean gst_mxf_demux_sink_event (GstPad * pad, GstObject * parent,
     GstEvent * event);
 static gboolean gst_mxf_demux_src_event (GstPad * pad, GstObject * parent,
@@ -178,6 +184,15 @@ gst_mxf_demux_reset_mxf_state (GstMXFDemux * demux)
       gst_caps_unref (t->caps);
   }
   g_array_set_size (demux->essence_tracks, 0);
+
+  for (i = 0; i < demux->index_tables->len; i++) {
+    GstMXFDemuxIndexTable *t =
+        &g_array_index (demux->index_tables, GstMXFDemuxIndexTable, i);
+
+    if (t->entries)
+      g_array_free (t->entries, TRUE);
+  }
+  g_array_set_size (demux->index_tables, 0);
 }
 
 static void
@@ -242,6 +257,9 @@ gst_mxf_demux_reset (GstMXFDemux * demux)
   demux->offset = 0;
 
   demux->pull_footer_metadata = TRUE;
+  demux->pull_index_tables = TRUE;
+
+  demux->growing_file_duration = 0;
 
   demux->run_in = -1;
 
@@ -255,6 +273,7 @@ gst_mxf_demux_reset (GstMXFDemux * demux)
   }
 
   gst_adapter_clear (demux->adapter);
+  gst_buffer_replace (&demux->pull_cache, NULL);
 
   gst_mxf_demux_remove_pads (demux);
 
@@ -267,8 +286,8 @@ gst_mxf_demux_reset (GstMXFDemux * demux)
     GList *l;
 
     for (l = demux->pending_index_table_segments; l; l = l->next) {
-      MXFIndexTableSegment *s = l->data;
-      mxf_index_table_segment_reset (s);
+      GstMXFDemuxPendingIndexTableSegment *s = l->data;
+      mxf_index_table_segment_reset (&s->segment);
       g_free (s);
     }
     g_list_free (demux->pending_index_table_segments);
@@ -315,12 +334,79 @@ done:
   return ret;
 }
 
+/* A file that is still being written ends with its footer partition */
+static gboolean
+gst_mxf_demux_is_growing (GstMXFDemux * demux)
+{
+  return demux->growing_file && (!demux->current_partition ||
+      demux->current_partition->partition.type != MXF_PARTITION_PACK_FOOTER);
+}
+
+static void
+gst_mxf_demux_wait_for_growing_file (GstMXFDemux * demux)
+{
+  gint64 end_time = g_get_monotonic_time () + GROWING_FILE_POLL_INTERVAL;
+
+  GST_OBJECT_LOCK (demux);
+  while (!demux->growing_file_wakeup &&
+      g_cond_wait_until (&demux->growing_file_cond,
+          GST_OBJECT_GET_LOCK (demux), end_time));
+  demux->growing_file_wakeup = FALSE;
+  GST_OBJECT_UNLOCK (demux);
+}
+
+/* Seeks and deactivation must not wait for the next poll */
+static void
+gst_mxf_demux_wake_up_growing_file (GstMXFDemux * demux)
+{
+  GST_OBJECT_LOCK (demux);
+  demux->growing_file_wakeup = TRUE;
+  g_cond_signal (&demux->growing_file_cond);
+  GST_OBJECT_UNLOCK (demux);
+}
+
+/* Size of the read-ahead buffer for small KLV packets */
+#define PULL_CACHE_SIZE (64 * 1024)
+
+static gboolean
+gst_mxf_demux_pull_cache_has_range (GstMXFDemux * demux, guint64 offset,
+    guint size)
+{
+  return demux->pull_cache && offset >= demux->pull_cache_offset &&
+      offset + size <= demux->pull_cache_offset +
+      gst_buffer_get_size (demux->pull_cache);
+}
+
+/* Reads the next PULL_CACHE_SIZE bytes from @offset into the read-ahead
+ * buffer. This is only done for KLV packets that fit into it so that
+ * the packet and the small ones after it are pulled together */
+static void
+gst_mxf_demux_fill_pull_cache (GstMXFDemux * demux, guint64 offset)
+{
+  GstBuffer *cache = NULL;
+
+  if (gst_pad_pull_range (demux->sinkpad, offset, PULL_CACHE_SIZE,
+          &cache) == GST_FLOW_OK) {
+    gst_buffer_replace (&demux->pull_cache, cache);
+    gst_buffer_unref (cache);
+    demux->pull_cache_offset = offset;
+  }
+}
+
 static GstFlowReturn
 gst_mxf_demux_pull_range (GstMXFDemux * demux, guint64 offset,
     guint size, GstBuffer ** buffer)
 {
   GstFlowReturn ret;
 
+  /* Ranges in the read-ahead buffer are handed out as sub-buffers of it,
+   * sharing its memory instead of copying it */
+  if (gst_mxf_demux_pull_cache_has_range (demux, offset, size)) {
+    *buffer = gst_buffer_copy_region (demux->pull_cache, GST_BUFFER_COPY_ALL,
+        offset - demux->pull_cache_offset, size);
+    return GST_FLOW_OK;
+  }
+
   ret = gst_pad_pull_range (demux->sinkpad, offset, size, buffer);
   if (G_UNLIKELY (ret != GST_FLOW_OK)) {
     GST_WARNING_OBJECT (demux,
@@ -1603,6 +1689,28 @@ gst_mxf_demux_pad_set_component (GstMXFDemux * demux, GstMXFDemuxPad * pad,
   return ret;
 }
 
+static void
+gst_mxf_demux_essence_track_set_offset (GstMXFDemuxEssenceTrack * etrack,
+    gint64 position, guint64 offset, gboolean keyframe)
+{
+  GstMXFDemuxIndex *index;
+
+  if (!etrack->offsets)
+    etrack->offsets = g_array_new (FALSE, TRUE, sizeof (GstMXFDemuxIndex));
+
+  /* Offsets found in the index tables can be after the ones we have
+   * seen so far, the ones in between stay unknown. Don't remember
+   * offsets that are too far away, they can be looked up again */
+  if (position < 0 || position >= (gint64) etrack->offsets->len + MAX_INDEX_GAP)
+    return;
+  if (etrack->offsets->len <= position)
+    g_array_set_size (etrack->offsets, position + 1);
+
+  index = &g_array_index (etrack->offsets, GstMXFDemuxIndex, position);
+  index->offset = offset;
+  index->keyframe = keyframe;
+}
+
 static GstFlowReturn
 gst_mxf_demux_handle_generic_container_essence_element (GstMXFDemux * demux,
     const MXFUL * key, GstBuffer * buffer, gboolean peek)
@@ -1722,24 +1830,8 @@ gst_mxf_demux_handle_generic_container_essence_element (GstMXFDemux * demux,
   if (outbuf)
     keyframe = !GST_BUFFER_FLAG_IS_SET (outbuf, GST_BUFFER_FLAG_DELTA_UNIT);
 
-  if (!etrack->offsets)
-    etrack->offsets = g_array_new (FALSE, TRUE, sizeof (GstMXFDemuxIndex));
-
-  {
-    if (etrack->offsets->len > etrack->position) {
-      GstMXFDemuxIndex *index =
-          &g_array_index (etrack->offsets, GstMXFDemuxIndex, etrack->position);
-
-      index->offset = demux->offset - demux->run_in;
-      index->keyframe = keyframe;
-    } else {
-      GstMXFDemuxIndex index;
-
-      index.offset = demux->offset - demux->run_in;
-      index.keyframe = keyframe;
-      g_array_insert_val (etrack->offsets, etrack->position, index);
-    }
-  }
+  gst_mxf_demux_essence_track_set_offset (etrack, etrack->position,
+      demux->offset - demux->run_in, keyframe);
 
   if (peek)
     goto out;
@@ -1974,11 +2066,23 @@ gst_mxf_demux_handle_random_index_pack (GstMXFDemux * demux, const MXFUL * key,
   return GST_FLOW_OK;
 }
 
+static gint
+gst_mxf_demux_pending_index_table_segment_compare (const
+    GstMXFDemuxPendingIndexTableSegment * a,
+    const GstMXFDemuxPendingIndexTableSegment * b)
+{
+  if (a->offset < b->offset)
+    return -1;
+  else if (a->offset > b->offset)
+    return 1;
+  return 0;
+}
+
 static GstFlowReturn
 gst_mxf_demux_handle_index_table_segment (GstMXFDemux * demux,
     const MXFUL * key, GstBuffer * buffer)
 {
-  MXFIndexTableSegment *segment;
+  GstMXFDemuxPendingIndexTableSegment *segment;
   GstMapInfo map;
   gboolean ret;
 
@@ -1990,33 +2094,37 @@ gst_mxf_demux_handle_index_table_segment (GstMXFDemux * demux,
     GST_WARNING_OBJECT (demux, "Invalid primer pack");
   }
 
-  segment = g_new0 (MXFIndexTableSegment, 1);
+  segment = g_new0 (GstMXFDemuxPendingIndexTableSegment, 1);
+  segment->offset = demux->offset;
 
   gst_buffer_map (buffer, &map, GST_MAP_READ);
-  ret = mxf_index_table_segment_parse (key, segment,
+  ret = mxf_index_table_segment_parse (key, &segment->segment,
       &demux->current_partition->primer, map.data, map.size);
   gst_buffer_unmap (buffer, &map);
 
   if (!ret) {
     GST_ERROR_OBJECT (demux, "Parsing index table segment failed");
+    mxf_index_table_segment_reset (&segment->segment);
+    g_free (segment);
     return GST_FLOW_ERROR;
   }
 
+  /* Partitions are walked backwards in pull mode, keep the segments
+   * in file order */
   demux->pending_index_table_segments =
-      g_list_prepend (demux->pending_index_table_segments, segment);
-
+      g_list_insert_sorted (demux->pending_index_table_segments, segment,
+      (GCompareFunc) gst_mxf_demux_pending_index_table_segment_compare);
 
   return GST_FLOW_OK;
 }
 
+/* Only pulls the key and length of a KLV packet */
 static GstFlowReturn
-gst_mxf_demux_pull_klv_packet (GstMXFDemux * demux, guint64 offset, MXFUL * key,
-    GstBuffer ** outbuf, guint * read)
+gst_mxf_demux_peek_klv_packet (GstMXFDemux * demux, guint64 offset,
+    MXFUL * key, guint64 * data_offset, guint64 * length)
 {
   GstBuffer *buffer = NULL;
   const guint8 *data;
-  guint64 data_offset = 0;
-  guint64 length;
   GstFlowReturn ret = GST_FLOW_OK;
   GstMapInfo map;
 #ifndef GST_DISABLE_GST_DEBUG
@@ -2039,12 +2147,12 @@ gst_mxf_demux_pull_klv_packet (GstMXFDemux * demux, guint64 offset, MXFUL * key,
 
   /* Decode BER encoded packet length */
   if ((map.data[16] & 0x80) == 0) {
-    length = map.data[16];
-    data_offset = 17;
+    *length = map.data[16];
+    *data_offset = 17;
   } else {
     guint slen = map.data[16] & 0x7f;
 
-    data_offset = 16 + 1 + slen;
+    *data_offset = 16 + 1 + slen;
 
     gst_buffer_unmap (buffer, &map);
     gst_buffer_unref (buffer);
@@ -2065,44 +2173,63 @@ gst_mxf_demux_pull_klv_packet (GstMXFDemux * demux, guint64 offset, MXFUL * key,
     gst_buffer_map (buffer, &map, GST_MAP_READ);
 
     data = map.data;
-    length = 0;
+    *length = 0;
     while (slen) {
-      length = (length << 8) | *data;
+      *length = (*length << 8) | *data;
       data++;
       slen--;
     }
   }
 
   gst_buffer_unmap (buffer, &map);
-  gst_buffer_unref (buffer);
-  buffer = NULL;
+
+  GST_DEBUG_OBJECT (demux, "KLV packet with key %s has length "
+      "%" G_GUINT64_FORMAT, mxf_ul_to_string (key, str), *length);
+
+beach:
+  if (buffer)
+    gst_buffer_unref (buffer);
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_mxf_demux_pull_klv_packet (GstMXFDemux * demux, guint64 offset, MXFUL * key,
+    GstBuffer ** outbuf, guint * read)
+{
+  GstBuffer *buffer = NULL;
+  guint64 data_offset = 0;
+  guint64 length;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if ((ret = gst_mxf_demux_peek_klv_packet (demux, offset, key, &data_offset,
+              &length)) != GST_FLOW_OK)
+    return ret;
 
   /* GStreamer's buffer sizes are stored in a guint so we
    * limit ourself to G_MAXUINT large buffers */
   if (length > G_MAXUINT) {
     GST_ERROR_OBJECT (demux,
         "Unsupported KLV packet length: %" G_GUINT64_FORMAT, length);
-    ret = GST_FLOW_ERROR;
-    goto beach;
+    return GST_FLOW_ERROR;
   }
 
-  GST_DEBUG_OBJECT (demux, "KLV packet with key %s has length "
-      "%" G_GUINT64_FORMAT, mxf_ul_to_string (key, str), length);
+  /* Small packets are pulled together with the ones after them, bigger
+   * ones directly into their own buffer */
+  if (data_offset + length <= PULL_CACHE_SIZE &&
+      !gst_mxf_demux_pull_cache_has_range (demux, offset,
+          data_offset + length))
+    gst_mxf_demux_fill_pull_cache (demux, offset);
 
   /* Pull the complete KLV packet */
   if ((ret = gst_mxf_demux_pull_range (demux, offset + data_offset, length,
               &buffer)) != GST_FLOW_OK)
-    goto beach;
+    return ret;
 
   *outbuf = buffer;
-  buffer = NULL;
   if (read)
     *read = data_offset + length;
 
-beach:
-  if (buffer)
-    gst_buffer_unref (buffer);
-
   return ret;
 }
 
@@ -2476,6 +2603,452 @@ gst_mxf_demux_set_partition_for_offset (GstMXFDemux * demux, guint64 offset)
   }
 }
 
+/* Returns the number of edit units of the essence container with @body_sid
+ * that the file can hold at most, or -1 if that is unknown */
+static gint64
+gst_mxf_demux_get_max_edit_units (GstMXFDemux * demux, guint32 body_sid)
+{
+  gint64 max_edit_units = -1, filesize = -1;
+  guint i;
+
+  for (i = 0; i < demux->essence_tracks->len; i++) {
+    GstMXFDemuxEssenceTrack *t =
+        &g_array_index (demux->essence_tracks, GstMXFDemuxEssenceTrack, i);
+
+    if (t->body_sid == body_sid && t->duration > 0)
+      max_edit_units = MAX (max_edit_units, t->duration);
+  }
+
+  /* Every edit unit takes at least the key and length of a KLV packet */
+  if (gst_pad_peer_query_duration (demux->sinkpad, GST_FORMAT_BYTES,
+          &filesize) && filesize > 0) {
+    if (max_edit_units == -1 || filesize / 17 < max_edit_units)
+      max_edit_units = filesize / 17;
+  }
+
+  return max_edit_units;
+}
+
+static void
+gst_mxf_demux_update_index_tables (GstMXFDemux * demux)
+{
+  GList *l;
+  guint i, j;
+
+  /* Segments are sorted by their offset, handle them in file order so
+   * that the last segment for an edit unit wins */
+  for (l = demux->pending_index_table_segments; l; l = l->next) {
+    MXFIndexTableSegment *segment =
+        &((GstMXFDemuxPendingIndexTableSegment *) l->data)->segment;
+    GstMXFDemuxIndexTable *table = NULL;
+    gint64 max_edit_units;
+
+    if (segment->body_sid == 0 || segment->index_start_position < 0 ||
+        segment->index_start_position + segment->n_index_entries >
+        G_MAXUINT) {
+      GST_WARNING_OBJECT (demux, "Ignoring invalid index table segment");
+      goto next;
+    }
+
+    for (i = 0; i < demux->index_tables->len; i++) {
+      GstMXFDemuxIndexTable *tmp =
+          &g_array_index (demux->index_tables, GstMXFDemuxIndexTable, i);
+
+      if (tmp->body_sid == segment->body_sid &&
+          tmp->index_sid == segment->index_sid) {
+        table = tmp;
+        break;
+      }
+    }
+
+    /* Don't let a broken start position allocate a huge table, segments
+     * can only be a bit after the end of the essence or of the entries
+     * we already have */
+    if (segment->n_index_entries > 0) {
+      max_edit_units = gst_mxf_demux_get_max_edit_units (demux,
+          segment->body_sid);
+      if (max_edit_units == -1)
+        max_edit_units = (table && table->entries) ? table->entries->len : 0;
+
+      if (segment->index_start_position > max_edit_units + MAX_INDEX_GAP) {
+        GST_WARNING_OBJECT (demux, "Ignoring index table segment starting at "
+            "edit unit %" G_GINT64_FORMAT ", only %" G_GINT64_FORMAT
+            " expected", segment->index_start_position, max_edit_units);
+        goto next;
+      }
+    }
+
+    if (!table) {
+      GstMXFDemuxIndexTable new_table;
+
+      memset (&new_table, 0, sizeof (GstMXFDemuxIndexTable));
+      new_table.body_sid = segment->body_sid;
+      new_table.index_sid = segment->index_sid;
+      new_table.edit_rate = segment->index_edit_rate;
+      g_array_append_val (demux->index_tables, new_table);
+      table =
+          &g_array_index (demux->index_tables, GstMXFDemuxIndexTable,
+          demux->index_tables->len - 1);
+    }
+
+    if (segment->n_index_entries > 0) {
+      guint start = segment->index_start_position;
+
+      if (!table->entries)
+        table->entries =
+            g_array_new (FALSE, TRUE, sizeof (GstMXFDemuxIndexTableEntry));
+      if (table->entries->len < start + segment->n_index_entries)
+        g_array_set_size (table->entries, start + segment->n_index_entries);
+
+      for (j = 0; j < segment->n_index_entries; j++) {
+        GstMXFDemuxIndexTableEntry *entry =
+            &g_array_index (table->entries, GstMXFDemuxIndexTableEntry,
+            start + j);
+
+        entry->stream_offset = segment->index_entries[j].stream_offset;
+        entry->keyframe = (segment->index_entries[j].flags & 0x80) != 0;
+        entry->initialized = TRUE;
+      }
+    } else if (segment->edit_unit_byte_count != 0) {
+      table->edit_unit_byte_count = segment->edit_unit_byte_count;
+    }
+
+  next:
+    mxf_index_table_segment_reset (segment);
+    g_free (l->data);
+  }
+
+  g_list_free (demux->pending_index_table_segments);
+  demux->pending_index_table_segments = NULL;
+}
+
+static GstMXFDemuxIndexTable *
+gst_mxf_demux_get_index_table (GstMXFDemux * demux,
+    GstMXFDemuxEssenceTrack * etrack)
+{
+  MXFFraction *edit_rate;
+  guint i;
+
+  if (demux->pending_index_table_segments)
+    gst_mxf_demux_update_index_tables (demux);
+
+  if (!etrack->source_track)
+    return NULL;
+  edit_rate = &etrack->source_track->edit_rate;
+
+  for (i = 0; i < demux->index_tables->len; i++) {
+    GstMXFDemuxIndexTable *t =
+        &g_array_index (demux->index_tables, GstMXFDemuxIndexTable, i);
+
+    /* Positions in tables with another edit rate are not track positions */
+    if (t->body_sid == etrack->body_sid &&
+        (gint64) t->edit_rate.n * edit_rate->d ==
+        (gint64) edit_rate->n * t->edit_rate.d)
+      return t;
+  }
+
+  return NULL;
+}
+
+/* Maps an offset in the essence container with @body_sid to an offset in
+ * the file, without the run-in */
+static guint64
+gst_mxf_demux_get_essence_container_offset (GstMXFDemux * demux,
+    guint32 body_sid, guint64 stream_offset)
+{
+  GList *l;
+  GstMXFDemuxPartition *p = NULL;
+
+  for (l = demux->partitions; l; l = l->next) {
+    GstMXFDemuxPartition *tmp = l->data;
+
+    if (tmp->partition.body_sid != body_sid)
+      continue;
+
+    /* Only known from the random index pack, we don't know which part
+     * of the essence container it holds */
+    if (tmp->partition.major_version == 0)
+      return -1;
+
+    if (tmp->partition.body_offset > stream_offset)
+      break;
+    p = tmp;
+  }
+
+  if (!p || p->essence_container_offset == 0)
+    return -1;
+
+  return p->partition.this_partition + p->essence_container_offset +
+      stream_offset - p->partition.body_offset;
+}
+
+/* Finds the essence element of @etrack in the @size bytes of the content
+ * package starting at @offset */
+static guint64
+gst_mxf_demux_find_essence_element_in_content_package (GstMXFDemux * demux,
+    GstMXFDemuxEssenceTrack * etrack, guint64 offset, guint64 size)
+{
+  guint64 end = (size == G_MAXUINT64) ? G_MAXUINT64 : offset + size;
+  guint64 data_offset, length;
+  MXFUL key;
+
+  while (offset < end &&
+      gst_mxf_demux_peek_klv_packet (demux, offset + demux->run_in, &key,
+          &data_offset, &length) == GST_FLOW_OK) {
+    if (mxf_is_generic_container_essence_element (&key) ||
+        mxf_is_avid_essence_container_essence_element (&key)) {
+      guint32 track_number = GST_READ_UINT32_BE (&key.u[12]);
+
+      if (etrack->track_number == 0 || etrack->track_number == track_number)
+        return offset;
+    } else if (!mxf_is_generic_container_system_item (&key) &&
+        !mxf_is_fill (&key)) {
+      break;
+    }
+
+    offset += data_offset + length;
+  }
+
+  return -1;
+}
+
+/* Remembers the index table segments of the partition that starts after
+ * the partition pack at @offset and where its essence container data
+ * starts */
+static void
+gst_mxf_demux_pull_partition_index_table_segments (GstMXFDemux * demux,
+    guint64 offset)
+{
+  GstMXFDemuxPartition *p = demux->current_partition;
+  guint64 data_offset, length;
+  GstBuffer *buffer;
+  guint read;
+  MXFUL key;
+
+  while (gst_mxf_demux_peek_klv_packet (demux, offset, &key, &data_offset,
+          &length) == GST_FLOW_OK) {
+    if (mxf_is_fill (&key)) {
+      offset += data_offset + length;
+    } else if (mxf_is_primer_pack (&key)
+        && p->partition.header_byte_count != 0) {
+      /* Skip all header metadata, starting with the primer pack */
+      offset += p->partition.header_byte_count;
+    } else if (mxf_is_index_table_segment (&key)) {
+      buffer = NULL;
+      if (gst_mxf_demux_pull_klv_packet (demux, offset, &key, &buffer,
+              &read) != GST_FLOW_OK)
+        break;
+
+      demux->offset = offset;
+      gst_mxf_demux_handle_index_table_segment (demux, &key, buffer);
+      gst_buffer_unref (buffer);
+      offset += read;
+    } else {
+      if (p->partition.body_sid != 0 && p->essence_container_offset == 0 &&
+          (mxf_is_generic_container_system_item (&key) ||
+              mxf_is_generic_container_essence_element (&key) ||
+              mxf_is_avid_essence_container_essence_element (&key)))
+        p->essence_container_offset =
+            offset - p->partition.this_partition - demux->run_in;
+      break;
+    }
+  }
+}
+
+/* Walks backwards from the footer partition over all partitions to
+ * collect the index table segments of the file */
+static void
+gst_mxf_demux_pull_index_tables (GstMXFDemux * demux)
+{
+  guint64 old_offset = demux->offset;
+  GstMXFDemuxPartition *old_partition = demux->current_partition;
+  MXFPartitionPack partition;
+  guint64 offset, prev_partition;
+  GstBuffer *buffer;
+  GstMapInfo map;
+  gboolean res;
+  guint read;
+  MXFUL key;
+
+  if (demux->footer_partition_pack_offset != 0) {
+    offset = demux->run_in + demux->footer_partition_pack_offset;
+  } else if (demux->random_index_pack && demux->random_index_pack->len > 0) {
+    offset =
+        g_array_index (demux->random_index_pack, MXFRandomIndexPackEntry,
+        demux->random_index_pack->len - 1).offset;
+  } else {
+    GST_DEBUG_OBJECT (demux, "No footer partition, not pulling index tables");
+    return;
+  }
+
+  while (TRUE) {
+    buffer = NULL;
+    if (gst_mxf_demux_pull_klv_packet (demux, offset, &key, &buffer,
+            &read) != GST_FLOW_OK)
+      break;
+
+    if (!mxf_is_partition_pack (&key)) {
+      gst_buffer_unref (buffer);
+      break;
+    }
+
+    /* Handling the partition pack replaces the previous partition by the
+     * previous one we know about, keep the one from the file */
+    gst_buffer_map (buffer, &map, GST_MAP_READ);
+    res = mxf_partition_pack_parse (&key, &partition, map.data, map.size);
+    gst_buffer_unmap (buffer, &map);
+    if (!res) {
+      gst_buffer_unref (buffer);
+      break;
+    }
+    prev_partition = partition.prev_partition;
+    mxf_partition_pack_reset (&partition);
+
+    demux->offset = offset;
+    if (gst_mxf_demux_handle_partition_pack (demux, &key,
+            buffer) != GST_FLOW_OK) {
+      gst_buffer_unref (buffer);
+      break;
+    }
+    gst_buffer_unref (buffer);
+
+    gst_mxf_demux_pull_partition_index_table_segments (demux, offset + read);
+
+    if (offset == demux->run_in || prev_partition >= offset - demux->run_in)
+      break;
+    offset = demux->run_in + prev_partition;
+  }
+
+  demux->offset = old_offset;
+  demux->current_partition = old_partition;
+}
+
+/* Extends the duration of a file that is still being written to the
+ * essence that was seen or indexed so far */
+static void
+gst_mxf_demux_update_growing_file_duration (GstMXFDemux * demux)
+{
+  GstClockTime duration = 0;
+  gboolean changed = FALSE;
+  guint i;
+
+  for (i = 0; i < demux->essence_tracks->len; i++) {
+    GstMXFDemuxEssenceTrack *t =
+        &g_array_index (demux->essence_tracks, GstMXFDemuxEssenceTrack, i);
+    GstMXFDemuxIndexTable *table;
+    gint64 edit_units = MAX (t->position, 0);
+
+    if (!t->source_track || t->source_track->edit_rate.n <= 0 ||
+        t->source_track->edit_rate.d <= 0)
+      continue;
+
+    if (t->offsets)
+      edit_units = MAX (edit_units, t->offsets->len);
+
+    table = gst_mxf_demux_get_index_table (demux, t);
+    if (table && table->entries)
+      edit_units = MAX (edit_units, table->entries->len);
+
+    duration = MAX (duration, gst_util_uint64_scale (edit_units,
+            GST_SECOND * t->source_track->edit_rate.d,
+            t->source_track->edit_rate.n));
+  }
+
+  GST_OBJECT_LOCK (demux);
+  if (duration > demux->growing_file_duration) {
+    demux->growing_file_duration = duration;
+    changed = TRUE;
+  }
+  GST_OBJECT_UNLOCK (demux);
+
+  if (changed) {
+    GST_DEBUG_OBJECT (demux, "Growing file duration is now %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (duration));
+    gst_element_post_message (GST_ELEMENT_CAST (demux),
+        gst_message_new_duration_changed (GST_OBJECT_CAST (demux)));
+  }
+}
+
+/* Looks up the offset of the essence element at @position of @etrack in
+ * the index tables and adds it to the track's index */
+static guint64
+gst_mxf_demux_find_essence_element_in_index_tables (GstMXFDemux * demux,
+    GstMXFDemuxEssenceTrack * etrack, gint64 * position, gboolean keyframe)
+{
+  GstMXFDemuxIndexTable *table;
+  gint64 current_position = *position;
+  guint64 stream_offset, size = G_MAXUINT64;
+  gboolean is_keyframe = TRUE;
+  guint64 offset;
+
+  if (demux->pull_index_tables) {
+    gst_mxf_demux_pull_index_tables (demux);
+    demux->pull_index_tables = FALSE;
+  }
+
+  table = gst_mxf_demux_get_index_table (demux, etrack);
+  if (!table)
+    return -1;
+
+  if (table->entries && table->entries->len > 0) {
+    GstMXFDemuxIndexTableEntry *entry, *next;
+
+    if (current_position >= table->entries->len)
+      return -1;
+
+    entry =
+        &g_array_index (table->entries, GstMXFDemuxIndexTableEntry,
+        current_position);
+    while (keyframe && entry->initialized && !entry->keyframe
+        && current_position > 0) {
+      current_position--;
+      entry =
+          &g_array_index (table->entries, GstMXFDemuxIndexTableEntry,
+          current_position);
+    }
+
+    if (!entry->initialized || (keyframe && !entry->keyframe))
+      return -1;
+
+    stream_offset = entry->stream_offset;
+    is_keyframe = entry->keyframe;
+
+    if (current_position + 1 < table->entries->len) {
+      next =
+          &g_array_index (table->entries, GstMXFDemuxIndexTableEntry,
+          current_position + 1);
+      if (next->initialized && next->stream_offset > stream_offset)
+        size = next->stream_offset - stream_offset;
+    }
+  } else if (table->edit_unit_byte_count != 0) {
+    stream_offset = current_position * table->edit_unit_byte_count;
+    size = table->edit_unit_byte_count;
+  } else {
+    return -1;
+  }
+
+  offset =
+      gst_mxf_demux_get_essence_container_offset (demux, etrack->body_sid,
+      stream_offset);
+  if (offset == -1)
+    return -1;
+
+  offset =
+      gst_mxf_demux_find_essence_element_in_content_package (demux, etrack,
+      offset, size);
+  if (offset == -1)
+    return -1;
+
+  GST_DEBUG_OBJECT (demux, "Found in index table at offset %" G_GUINT64_FORMAT,
+      offset);
+
+  gst_mxf_demux_essence_track_set_offset (etrack, current_position, offset,
+      is_keyframe);
+  *position = current_position;
+
+  return offset;
+}
+
 static guint64
 gst_mxf_demux_find_essence_element (GstMXFDemux * demux,
     GstMXFDemuxEssenceTrack * etrack, gint64 * position, gboolean keyframe)
@@ -2554,6 +3127,14 @@ from_index:
       return new_offset;
     }
   } else if (demux->random_access) {
+    guint64 new_offset;
+
+    new_offset =
+        gst_mxf_demux_find_essence_element_in_index_tables (demux, etrack,
+        position, keyframe);
+    if (new_offset != -1)
+      return new_offset;
+
     demux->offset = demux->run_in;
     if (etrack->offsets && etrack->offsets->len) {
       for (i = etrack->offsets->len - 1; i >= 0; i--) {
@@ -2587,7 +3168,8 @@ from_index:
           gst_mxf_demux_pull_klv_packet (demux, demux->offset, &key, &buffer,
           &read);
 
-      if (ret == GST_FLOW_EOS) {
+      /* The end of a growing file is not the end of its essence */
+      if (ret == GST_FLOW_EOS && !gst_mxf_demux_is_growing (demux)) {
         for (i = 0; i < demux->essence_tracks->len; i++) {
           GstMXFDemuxEssenceTrack *t =
               &g_array_index (demux->essence_tracks, GstMXFDemuxEssenceTrack,
@@ -2667,6 +3249,16 @@ gst_mxf_demux_pull_and_handle_klv_packet (GstMXFDemux * demux)
       gst_mxf_demux_pull_klv_packet (demux, demux->offset, &key, &buffer,
       &read);
 
+  /* Try again from the same offset once more data was written */
+  if (ret == GST_FLOW_EOS && gst_mxf_demux_is_growing (demux)) {
+    GST_LOG_OBJECT (demux, "Waiting for more data at offset %"
+        G_GUINT64_FORMAT, demux->offset);
+    gst_mxf_demux_update_growing_file_duration (demux);
+    gst_mxf_demux_wait_for_growing_file (demux);
+    ret = GST_FLOW_OK;
+    goto beach;
+  }
+
   if (ret == GST_FLOW_EOS && demux->src->len > 0) {
     guint i;
     GstMXFDemuxPad *p = NULL;
@@ -2730,6 +3322,10 @@ gst_mxf_demux_pull_and_handle_klv_packet (GstMXFDemux * demux)
   ret = gst_mxf_demux_handle_klv_packet (demux, &key, buffer, FALSE);
   demux->offset += read;
 
+  if (ret == GST_FLOW_OK && demux->growing_file
+      && mxf_is_body_partition_pack (&key))
+    gst_mxf_demux_update_growing_file_duration (demux);
+
   if (ret == GST_FLOW_OK && demux->src->len > 0
       && demux->essence_tracks->len > 0) {
     GstMXFDemuxPad *earliest = NULL;
@@ -2796,6 +3392,9 @@ gst_mxf_demux_loop (GstPad * pad)
     while (demux->offset < 64 * 1024) {
       GstBuffer *buffer = NULL;
 
+      if (!gst_mxf_demux_pull_cache_has_range (demux, demux->offset, 16))
+        gst_mxf_demux_fill_pull_cache (demux, demux->offset);
+
       if ((ret =
               gst_mxf_demux_pull_range (demux, demux->offset, 16,
                   &buffer)) != GST_FLOW_OK)
@@ -2827,8 +3426,10 @@ gst_mxf_demux_loop (GstPad * pad)
       goto pause;
     }
 
-    /* First of all pull&parse the random index pack at EOF */
-    gst_mxf_demux_pull_random_index_pack (demux);
+    /* First of all pull&parse the random index pack at EOF, a file that
+     * is still being written has none yet */
+    if (!demux->growing_file)
+      gst_mxf_demux_pull_random_index_pack (demux);
   }
 
   /* Now actually do something */
@@ -3082,7 +3683,9 @@ gst_mxf_demux_chain (GstPad * pad, GstObject * parent, GstBuffer * inbuf)
     gst_adapter_flush (demux->adapter, offset);
 
     if (length > 0) {
-      buffer = gst_adapter_take_buffer (demux->adapter, length);
+      /* Takes the memory of the queued buffers instead of copying it
+       * into a new buffer, mapping it is free when it is contiguous */
+      buffer = gst_adapter_take_buffer_fast (demux->adapter, length);
 
       ret = gst_mxf_demux_handle_klv_packet (demux, &key, buffer, FALSE);
       gst_buffer_unref (buffer);
@@ -3340,6 +3943,8 @@ gst_mxf_demux_seek_pull (GstMXFDemux * demux, GstEvent * event)
   flush = ! !(flags & GST_SEEK_FLAG_FLUSH);
   keyframe = ! !(flags & GST_SEEK_FLAG_KEY_UNIT);
 
+  gst_mxf_demux_wake_up_growing_file (demux);
+
   if (flush) {
     GstEvent *e;
 
@@ -3608,6 +4213,13 @@ gst_mxf_demux_src_query (GstPad * pad, GstObject * parent, GstQuery * query)
       }
       g_rw_lock_reader_unlock (&demux->metadata_lock);
 
+      if (format == GST_FORMAT_TIME && demux->growing_file) {
+        GST_OBJECT_LOCK (demux);
+        if (demux->growing_file_duration > 0)
+          duration = MAX (duration, (gint64) demux->growing_file_duration);
+        GST_OBJECT_UNLOCK (demux);
+      }
+
       GST_DEBUG_OBJECT (pad,
           "Returning duration %" G_GINT64_FORMAT " in format %s", duration,
           gst_format_get_name (format));
@@ -3626,7 +4238,16 @@ gst_mxf_demux_src_query (GstPad * pad, GstObject * parent, GstQuery * query)
         goto done;
       }
 
-      if (demux->random_access) {
+      if (demux->random_access && demux->growing_file) {
+        gint64 end = -1;
+
+        /* Only what was written so far can be seeked to */
+        GST_OBJECT_LOCK (demux);
+        if (demux->growing_file_duration > 0)
+          end = demux->growing_file_duration;
+        GST_OBJECT_UNLOCK (demux);
+        gst_query_set_seeking (query, GST_FORMAT_TIME, TRUE, 0, end);
+      } else if (demux->random_access) {
         gst_query_set_seeking (query, GST_FORMAT_TIME, TRUE, 0, -1);
       } else {
         GstQuery *peerquery = gst_query_new_seeking (GST_FORMAT_BYTES);
@@ -3712,6 +4333,7 @@ gst_mxf_demux_sink_activate_mode (GstPad * sinkpad, GstObject * parent,
           sinkpad, NULL);
     } else {
       demux->random_access = FALSE;
+      gst_mxf_demux_wake_up_growing_file (demux);
       return gst_pad_stop_task (sinkpad);
     }
   }
@@ -3894,6 +4516,13 @@ gst_mxf_demux_query (GstElement * element, GstQuery * query)
       }
       g_rw_lock_reader_unlock (&demux->metadata_lock);
 
+      if (demux->growing_file) {
+        GST_OBJECT_LOCK (demux);
+        if (demux->growing_file_duration > 0)
+          duration = MAX (duration, (gint64) demux->growing_file_duration);
+        GST_OBJECT_UNLOCK (demux);
+      }
+
       if (duration == -1) {
         GST_DEBUG_OBJECT (demux, "No duration known (yet)");
         goto done;
@@ -3917,7 +4546,16 @@ gst_mxf_demux_query (GstElement * element, GstQuery * query)
         goto done;
       }
 
-      if (demux->random_access) {
+      if (demux->random_access && demux->growing_file) {
+        gint64 end = -1;
+
+        /* Only what was written so far can be seeked to */
+        GST_OBJECT_LOCK (demux);
+        if (demux->growing_file_duration > 0)
+          end = demux->growing_file_duration;
+        GST_OBJECT_UNLOCK (demux);
+        gst_query_set_seeking (query, GST_FORMAT_TIME, TRUE, 0, end);
+      } else if (demux->random_access) {
         gst_query_set_seeking (query, GST_FORMAT_TIME, TRUE, 0, -1);
       } else {
         GstQuery *peerquery = gst_query_new_seeking (GST_FORMAT_BYTES);
@@ -4012,6 +4650,9 @@ gst_mxf_demux_set_property (GObject * object, guint prop_id,
     case PROP_MAX_DRIFT:
       demux->max_drift = g_value_get_uint64 (value);
       break;
+    case PROP_GROWING_FILE:
+      demux->growing_file = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -4031,6 +4672,9 @@ gst_mxf_demux_get_property (GObject * object, guint prop_id,
     case PROP_MAX_DRIFT:
       g_value_set_uint64 (value, demux->max_drift);
       break;
+    case PROP_GROWING_FILE:
+      g_value_set_boolean (value, demux->growing_file);
+      break;
     case PROP_STRUCTURE:{
       GstStructure *s;
 
@@ -4080,10 +4724,13 @@ gst_mxf_demux_finalize (GObject * object)
   demux->src = NULL;
   g_array_free (demux->essence_tracks, TRUE);
   demux->essence_tracks = NULL;
+  g_array_free (demux->index_tables, TRUE);
+  demux->index_tables = NULL;
 
   g_hash_table_destroy (demux->metadata);
 
   g_rw_lock_clear (&demux->metadata_lock);
+  g_cond_clear (&demux->growing_file_cond);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -4118,6 +4765,12 @@ gst_mxf_demux_class_init (GstMXFDemuxClass * klass)
           "Structural metadata of the MXF file",
           GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_GROWING_FILE,
+      g_param_spec_boolean ("growing-file", "Growing file",
+          "The file is still being written, wait for more data at its end "
+          "until the footer partition is found (pull mode only)", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_mxf_demux_change_state);
   gstelement_class->query = GST_DEBUG_FUNCPTR (gst_mxf_demux_query);
@@ -4152,10 +4805,13 @@ gst_mxf_demux_init (GstMXFDemux * demux)
 
   demux->adapter = gst_adapter_new ();
   g_rw_lock_init (&demux->metadata_lock);
+  g_cond_init (&demux->growing_file_cond);
 
   demux->src = g_ptr_array_new ();
   demux->essence_tracks =
       g_array_new (FALSE, FALSE, sizeof (GstMXFDemuxEssenceTrack));
+  demux->index_tables =
+      g_array_new (FALSE, FALSE, sizeof (GstMXFDemuxIndexTable));
 
   gst_segment_init (&demux->segment, GST_FORMAT_TIME);
 
@@ -61,6 +61,36 @@ typedef struct
   gboolean keyframe;
 } GstMXFDemuxIndex;
 
+/* Edit unit of an index table, stream_offset is relative to the start of
+ * the essence container with the table's body_sid */
+typedef struct
+{
+  guint64 stream_offset;
+  gboolean keyframe;
+  gboolean initialized;
+} GstMXFDemuxIndexTableEntry;
+
+/* Index table segment waiting to be merged into the index tables */
+typedef struct
+{
+  /* Offset of the segment in the file, segments are merged in this order */
+  guint64 offset;
+  MXFIndexTableSegment segment;
+} GstMXFDemuxPendingIndexTableSegment;
+
+/* All index table segments of one essence container merged together */
+typedef struct
+{
+  guint32 body_sid;
+  guint32 index_sid;
+  MXFFraction edit_rate;
+
+  /* Non-zero for constant size edit units */
+  guint32 edit_unit_byte_count;
+  /* GstMXFDemuxIndexTableEntry, one per edit unit */
+  GArray *entries;
+} GstMXFDemuxIndexTable;
+
 typedef struct
 {
   guint32 body_sid;
@@ -131,6 +161,10 @@ struct _GstMXFDemux
 
   GstAdapter *adapter;
 
+  /* Read-ahead buffer in pull mode */
+  GstBuffer *pull_cache;
+  guint64 pull_cache_offset;
+
   GstSegment segment;
   guint32 seqnum;
 
@@ -152,6 +186,8 @@ struct _GstMXFDemux
 
   GArray *essence_tracks;
   GList *pending_index_table_segments;
+  GArray *index_tables;
+  gboolean pull_index_tables;
 
   GArray *random_index_pack;
 
@@ -173,6 +209,12 @@ struct _GstMXFDemux
   /* Properties */
   gchar *requested_package_string;
   GstClockTime max_drift;
+  gboolean growing_file;
+
+  /* Growing file state, protected by the object lock */
+  GCond growing_file_cond;
+  gboolean growing_file_wakeup;
+  GstClockTime growing_file_duration;
 };
 
 struct _GstMXFDemuxClass
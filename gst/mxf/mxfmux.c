@@ -54,9 +54,18 @@ static GstStaticPadTemplate src_templ = GST_STATIC_PAD_TEMPLATE ("src",
 
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_BODY_PARTITION_INTERVAL
 };
 
+#define DEFAULT_BODY_PARTITION_INTERVAL 0
+
+/* All partitions reference the same index table */
+#define INDEX_SID 2
+
+/* The index entry array of a segment is a local tag with a 16 bit length */
+#define MAX_INDEX_ENTRIES_PER_SEGMENT ((G_MAXUINT16 - 8) / 11)
+
 #define gst_mxf_mux_parent_class parent_class
 G_DEFINE_TYPE (GstMXFMux, gst_mxf_mux, GST_TYPE_ELEMENT);
 
@@ -110,6 +119,15 @@ gst_mxf_mux_class_init (GstMXFMuxClass * klass)
   gobject_class->set_property = gst_mxf_mux_set_property;
   gobject_class->get_property = gst_mxf_mux_get_property;
 
+  g_object_class_install_property (gobject_class, PROP_BODY_PARTITION_INTERVAL,
+      g_param_spec_uint64 ("body-partition-interval",
+          "Body partition interval",
+          "Start a new body partition with the index table segments of the "
+          "previous one every that many nanoseconds of essence (0 = a single "
+          "body partition, index table only in the footer)", 0, G_MAXUINT64,
+          DEFAULT_BODY_PARTITION_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gstelement_class->change_state = GST_DEBUG_FUNCPTR (gst_mxf_mux_change_state);
   gstelement_class->request_new_pad =
       GST_DEBUG_FUNCPTR (gst_mxf_mux_request_new_pad);
@@ -149,6 +167,11 @@ gst_mxf_mux_init (GstMXFMux * mux)
   gst_collect_pads_set_function (mux->collect,
       GST_DEBUG_FUNCPTR (gst_mxf_mux_collected), mux);
 
+  mux->index_table = g_array_new (FALSE, TRUE, sizeof (MXFIndexEntry));
+  mux->partitions =
+      g_array_new (FALSE, FALSE, sizeof (MXFRandomIndexPackEntry));
+  mux->body_partition_interval = DEFAULT_BODY_PARTITION_INTERVAL;
+
   gst_mxf_mux_reset (mux);
 }
 
@@ -166,6 +189,9 @@ gst_mxf_mux_finalize (GObject * object)
     mux->metadata_list = NULL;
   }
 
+  g_array_free (mux->index_table, TRUE);
+  g_array_free (mux->partitions, TRUE);
+
   gst_object_unref (mux->collect);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -175,9 +201,12 @@ static void
 gst_mxf_mux_set_property (GObject * object,
     guint prop_id, const GValue * value, GParamSpec * pspec)
 {
-  //GstMXFMux *mux = GST_MXF_MUX (object);
+  GstMXFMux *mux = GST_MXF_MUX (object);
 
   switch (prop_id) {
+    case PROP_BODY_PARTITION_INTERVAL:
+      mux->body_partition_interval = g_value_get_uint64 (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -188,9 +217,12 @@ static void
 gst_mxf_mux_get_property (GObject * object,
     guint prop_id, GValue * value, GParamSpec * pspec)
 {
-  //GstMXFMux *mux = GST_MXF_MUX (object);
+  GstMXFMux *mux = GST_MXF_MUX (object);
 
   switch (prop_id) {
+    case PROP_BODY_PARTITION_INTERVAL:
+      g_value_set_uint64 (value, mux->body_partition_interval);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -228,6 +260,13 @@ gst_mxf_mux_reset (GstMXFMux * mux)
   mux->last_gc_timestamp = 0;
   mux->last_gc_position = 0;
   mux->offset = 0;
+
+  g_array_set_size (mux->index_table, 0);
+  mux->n_indexed_entries = 0;
+  mux->last_keyframe_position = 0;
+  mux->body_offset = 0;
+  g_array_set_size (mux->partitions, 0);
+  mux->last_partition_timestamp = 0;
 }
 
 static gboolean
@@ -946,7 +985,7 @@ gst_mxf_mux_create_metadata (GstMXFMux * mux)
 
     cstorage->essence_container_data[0]->linked_package =
         MXF_METADATA_SOURCE_PACKAGE (cstorage->packages[1]);
-    cstorage->essence_container_data[0]->index_sid = 0;
+    cstorage->essence_container_data[0]->index_sid = INDEX_SID;
     cstorage->essence_container_data[0]->body_sid = 1;
   }
 
@@ -1092,6 +1131,155 @@ gst_mxf_mux_write_header_metadata (GstMXFMux * mux)
   return ret;
 }
 
+static void
+gst_mxf_mux_add_index_entry (GstMXFMux * mux, gboolean keyframe)
+{
+  MXFIndexEntry entry;
+
+  memset (&entry, 0, sizeof (entry));
+  entry.stream_offset = mux->body_offset;
+
+  /* Content packages without any element have no size */
+  while (mux->n_indexed_entries + mux->index_table->len <
+      mux->last_gc_position)
+    g_array_append_val (mux->index_table, entry);
+
+  if (keyframe) {
+    entry.flags = 0x80;
+    mux->last_keyframe_position = mux->last_gc_position;
+  }
+  entry.key_frame_offset =
+      MAX (-128, -(gint64) (mux->last_gc_position -
+          mux->last_keyframe_position));
+
+  g_array_append_val (mux->index_table, entry);
+}
+
+/* Creates VBE index table segments for the index entries that are not in any
+ * segment yet, or a single CBE segment without entries if
+ * @edit_unit_byte_count is not 0. The entries are dropped afterwards.
+ * Returns the size of all segments */
+static guint64
+gst_mxf_mux_create_index_table_segments (GstMXFMux * mux,
+    guint32 edit_unit_byte_count, GList ** buffers)
+{
+  MXFIndexTableSegment segment;
+  guint64 index_byte_count = 0;
+  GstBuffer *buf;
+  guint i, n;
+
+  memset (&segment, 0, sizeof (segment));
+  memcpy (&segment.index_edit_rate, &mux->min_edit_rate, sizeof (MXFFraction));
+  segment.index_sid = INDEX_SID;
+  segment.body_sid =
+      mux->preface->content_storage->essence_container_data[0]->body_sid;
+
+  if (edit_unit_byte_count != 0) {
+    mxf_uuid_init (&segment.instance_id, NULL);
+    segment.index_start_position = 0;
+    segment.index_duration = mux->index_table->len;
+    segment.edit_unit_byte_count = edit_unit_byte_count;
+
+    buf = mxf_index_table_segment_to_buffer (&segment);
+    index_byte_count += gst_buffer_get_size (buf);
+    *buffers = g_list_append (*buffers, buf);
+    mux->n_indexed_entries += mux->index_table->len;
+    g_array_set_size (mux->index_table, 0);
+
+    return index_byte_count;
+  }
+
+  for (i = 0; i < mux->index_table->len; i += n) {
+    n = MIN (mux->index_table->len - i, MAX_INDEX_ENTRIES_PER_SEGMENT);
+
+    mxf_uuid_init (&segment.instance_id, NULL);
+    segment.index_start_position = mux->n_indexed_entries + i;
+    segment.index_duration = n;
+    segment.n_index_entries = n;
+    segment.index_entries = &g_array_index (mux->index_table, MXFIndexEntry, i);
+
+    buf = mxf_index_table_segment_to_buffer (&segment);
+    index_byte_count += gst_buffer_get_size (buf);
+    *buffers = g_list_append (*buffers, buf);
+  }
+
+  mux->n_indexed_entries += mux->index_table->len;
+  g_array_set_size (mux->index_table, 0);
+
+  return index_byte_count;
+}
+
+/* Returns the size of every edit unit if all of them have the same size and
+ * are keyframes, 0 otherwise */
+static guint32
+gst_mxf_mux_get_edit_unit_byte_count (GstMXFMux * mux)
+{
+  MXFIndexEntry *entries = (MXFIndexEntry *) mux->index_table->data;
+  guint64 size;
+  guint i;
+
+  if (mux->index_table->len == 0 || mux->n_indexed_entries > 0)
+    return 0;
+
+  size = (mux->index_table->len > 1) ? entries[1].stream_offset :
+      mux->body_offset;
+  if (size == 0 || size > G_MAXUINT32)
+    return 0;
+
+  for (i = 0; i < mux->index_table->len; i++) {
+    guint64 next = (i + 1 < mux->index_table->len) ?
+        entries[i + 1].stream_offset : mux->body_offset;
+
+    if (!(entries[i].flags & 0x80) || next - entries[i].stream_offset != size)
+      return 0;
+  }
+
+  return size;
+}
+
+static GstFlowReturn
+gst_mxf_mux_push_index_table_segments (GstMXFMux * mux, GList * buffers)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GList *l;
+
+  for (l = buffers; l; l = l->next) {
+    GstBuffer *buf = l->data;
+
+    l->data = NULL;
+    if ((ret = gst_mxf_mux_push (mux, buf)) != GST_FLOW_OK) {
+      GST_ERROR_OBJECT (mux, "Failed pushing index table segment: %s",
+          gst_flow_get_name (ret));
+      g_list_foreach (l, (GFunc) gst_mini_object_unref, NULL);
+      break;
+    }
+  }
+
+  g_list_free (buffers);
+
+  return ret;
+}
+
+static void
+gst_mxf_mux_add_random_index_pack_entry (GstMXFMux * mux)
+{
+  MXFRandomIndexPackEntry entry;
+
+  entry.offset = mux->partition.this_partition;
+  entry.body_sid = mux->partition.body_sid;
+  g_array_append_val (mux->partitions, entry);
+}
+
+static guint64
+gst_mxf_mux_get_last_partition (GstMXFMux * mux)
+{
+  if (mux->partitions->len == 0)
+    return 0;
+
+  return g_array_index (mux->partitions, MXFRandomIndexPackEntry,
+      mux->partitions->len - 1).offset;
+}
+
 static const guint8 _gc_essence_element_ul[] = {
   0x06, 0x0e, 0x2b, 0x34, 0x01, 0x02, 0x01, 0x00,
   0x0d, 0x01, 0x03, 0x01, 0x00, 0x00, 0x00, 0x00
@@ -1124,6 +1312,7 @@ gst_mxf_mux_handle_buffer (GstMXFMux * mux, GstMXFMuxPad * cpad)
         "Handling buffer of size %" G_GSIZE_FORMAT " for track %u at position %"
         G_GINT64_FORMAT, gst_buffer_get_size (buf),
         cpad->source_track->parent.track_id, cpad->pos);
+    cpad->keyframe = !GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
   } else {
     flush = TRUE;
     GST_DEBUG_OBJECT (cpad->collect.pad,
@@ -1169,6 +1358,11 @@ gst_mxf_mux_handle_buffer (GstMXFMux * mux, GstMXFMuxPad * cpad)
       cpad->source_track->parent.track_id);
   gst_buffer_unmap (packet, &map);
 
+  /* The first element of a content package starts its edit unit */
+  if (mux->n_indexed_entries + mux->index_table->len <= mux->last_gc_position)
+    gst_mxf_mux_add_index_entry (mux, cpad->keyframe);
+  mux->body_offset += gst_buffer_get_size (packet);
+
   if ((ret = gst_mxf_mux_push (mux, packet)) != GST_FLOW_OK) {
     GST_ERROR_OBJECT (cpad->collect.pad,
         "Failed pushing buffer for track %u, reason %s",
@@ -1184,24 +1378,44 @@ gst_mxf_mux_handle_buffer (GstMXFMux * mux, GstMXFMuxPad * cpad)
   return ret;
 }
 
+/* Index table segments for the essence written since the previous body
+ * partition are put before the essence of the new one */
 static GstFlowReturn
 gst_mxf_mux_write_body_partition (GstMXFMux * mux)
 {
   GstBuffer *buf;
+  GstFlowReturn ret;
+  GList *buffers = NULL;
+  guint64 index_byte_count;
+
+  index_byte_count =
+      gst_mxf_mux_create_index_table_segments (mux, 0, &buffers);
 
   mux->partition.type = MXF_PARTITION_PACK_BODY;
+  mux->partition.prev_partition = gst_mxf_mux_get_last_partition (mux);
   mux->partition.this_partition = mux->offset;
-  mux->partition.prev_partition = 0;
   mux->partition.footer_partition = 0;
   mux->partition.header_byte_count = 0;
-  mux->partition.index_byte_count = 0;
-  mux->partition.index_sid = 0;
-  mux->partition.body_offset = 0;
+  mux->partition.index_byte_count = index_byte_count;
+  mux->partition.index_sid = (index_byte_count > 0) ? INDEX_SID : 0;
+  mux->partition.body_offset = mux->body_offset;
   mux->partition.body_sid =
       mux->preface->content_storage->essence_container_data[0]->body_sid;
+  gst_mxf_mux_add_random_index_pack_entry (mux);
+  mux->last_partition_timestamp = mux->last_gc_timestamp;
+
+  GST_DEBUG_OBJECT (mux, "Writing body partition at offset %" G_GUINT64_FORMAT
+      " with %" G_GUINT64_FORMAT " bytes of index table segments",
+      mux->offset, index_byte_count);
 
   buf = mxf_partition_pack_to_buffer (&mux->partition);
-  return gst_mxf_mux_push (mux, buf);
+  if ((ret = gst_mxf_mux_push (mux, buf)) != GST_FLOW_OK) {
+    g_list_foreach (buffers, (GFunc) gst_mini_object_unref, NULL);
+    g_list_free (buffers);
+    return ret;
+  }
+
+  return gst_mxf_mux_push_index_table_segments (mux, buffers);
 }
 
 static GstFlowReturn
@@ -1296,44 +1510,37 @@ gst_mxf_mux_handle_eos (GstMXFMux * mux)
   }
 
   {
-    guint64 body_partition = mux->partition.this_partition;
-    guint32 body_sid = mux->partition.body_sid;
     guint64 footer_partition = mux->offset;
-    GArray *rip;
     GstFlowReturn ret;
     GstSegment segment;
-    MXFRandomIndexPackEntry entry;
+    GList *buffers = NULL;
+    guint64 index_byte_count;
+
+    /* Without any index table segments in body partitions and with a
+     * constant edit unit size a single CBE segment indexes everything */
+    index_byte_count = gst_mxf_mux_create_index_table_segments (mux,
+        gst_mxf_mux_get_edit_unit_byte_count (mux), &buffers);
 
     mux->partition.type = MXF_PARTITION_PACK_FOOTER;
     mux->partition.closed = TRUE;
     mux->partition.complete = TRUE;
+    mux->partition.prev_partition = gst_mxf_mux_get_last_partition (mux);
     mux->partition.this_partition = mux->offset;
-    mux->partition.prev_partition = body_partition;
     mux->partition.footer_partition = mux->offset;
     mux->partition.header_byte_count = 0;
-    mux->partition.index_byte_count = 0;
-    mux->partition.index_sid = 0;
+    mux->partition.index_byte_count = index_byte_count;
+    mux->partition.index_sid = (index_byte_count > 0) ? INDEX_SID : 0;
     mux->partition.body_offset = 0;
     mux->partition.body_sid = 0;
+    gst_mxf_mux_add_random_index_pack_entry (mux);
 
     gst_mxf_mux_write_header_metadata (mux);
+    gst_mxf_mux_push_index_table_segments (mux, buffers);
 
-    rip = g_array_sized_new (FALSE, FALSE, sizeof (MXFRandomIndexPackEntry), 3);
-    entry.offset = 0;
-    entry.body_sid = 0;
-    g_array_append_val (rip, entry);
-    entry.offset = body_partition;
-    entry.body_sid = body_sid;
-    g_array_append_val (rip, entry);
-    entry.offset = footer_partition;
-    entry.body_sid = 0;
-    g_array_append_val (rip, entry);
-
-    packet = mxf_random_index_pack_to_buffer (rip);
+    packet = mxf_random_index_pack_to_buffer (mux->partitions);
     if ((ret = gst_mxf_mux_push (mux, packet)) != GST_FLOW_OK) {
       GST_ERROR_OBJECT (mux, "Failed pushing random index pack");
     }
-    g_array_free (rip, TRUE);
 
     /* Rewrite header partition with updated values */
     gst_segment_init (&segment, GST_FORMAT_BYTES);
@@ -1421,6 +1628,7 @@ gst_mxf_mux_collected (GstCollectPads * pads, gpointer user_data)
 
     if (ret != GST_FLOW_OK)
       goto error;
+    gst_mxf_mux_add_random_index_pack_entry (mux);
 
     /* Sort pads, we will always write in that order */
     mux->collect->data = g_slist_sort (mux->collect->data, _sort_mux_pads);
@@ -1462,6 +1670,17 @@ gst_mxf_mux_collected (GstCollectPads * pads, gpointer user_data)
   } while (!eos && best == NULL);
 
   if (!eos && best) {
+    /* Only start new body partitions at content package boundaries */
+    if (mux->body_partition_interval > 0
+        && mux->n_indexed_entries + mux->index_table->len <=
+        mux->last_gc_position
+        && mux->last_gc_timestamp - mux->last_partition_timestamp >=
+        mux->body_partition_interval) {
+      ret = gst_mxf_mux_write_body_partition (mux);
+      if (ret != GST_FLOW_OK)
+        goto error;
+    }
+
     ret = gst_mxf_mux_handle_buffer (mux, best);
     if (ret != GST_FLOW_OK)
       goto error;
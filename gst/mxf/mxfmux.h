@@ -57,6 +57,9 @@ typedef struct
 
   MXFMetadataSourcePackage *source_package;
   MXFMetadataTimelineTrack *source_track;
+
+  /* last input buffer was a keyframe */
+  gboolean keyframe;
 } GstMXFMuxPad;
 
 typedef enum
@@ -92,7 +95,21 @@ typedef struct _GstMXFMux {
   guint64 last_gc_position;
   GstClockTime last_gc_timestamp;
 
+  /* one MXFIndexEntry per content package that is not in an index table
+   * segment yet, the n_indexed_entries before them were written already */
+  GArray *index_table;
+  guint n_indexed_entries;
+  guint64 last_keyframe_position;
+  guint64 body_offset;
+
+  /* MXFRandomIndexPackEntry for every written partition */
+  GArray *partitions;
+  GstClockTime last_partition_timestamp;
+
   gchar *application;
+
+  /* properties */
+  GstClockTime body_partition_interval;
 } GstMXFMux;
 
 typedef struct _GstMXFMuxClass {
@@ -1307,6 +1307,121 @@ mxf_index_table_segment_reset (MXFIndexTableSegment * segment)
   memset (segment, 0, sizeof (MXFIndexTableSegment));
 }
 
+/* SMPTE 377M 10.2.3, slices and position tables are not written */
+GstBuffer *
+mxf_index_table_segment_to_buffer (const MXFIndexTableSegment * segment)
+{
+  GstBuffer *ret;
+  GstMapInfo map;
+  guint8 slen, ber[9];
+  guint size, i;
+  guint8 *data;
+
+  g_return_val_if_fail (segment != NULL, NULL);
+  g_return_val_if_fail (segment->slice_count == 0, NULL);
+  g_return_val_if_fail (segment->pos_table_count == 0, NULL);
+  g_return_val_if_fail (8 + 6 * segment->n_delta_entries <= G_MAXUINT16,
+      NULL);
+  g_return_val_if_fail (8 + 11 * segment->n_index_entries <= G_MAXUINT16,
+      NULL);
+
+  size = (4 + 16) + (4 + 8) + (4 + 8) + (4 + 8) + (4 + 4) + (4 + 4) +
+      (4 + 4) + (4 + 1);
+  if (segment->n_delta_entries > 0)
+    size += 4 + 8 + 6 * segment->n_delta_entries;
+  if (segment->n_index_entries > 0)
+    size += 4 + 8 + 11 * segment->n_index_entries;
+
+  slen = mxf_ber_encode_size (size, ber);
+  ret = gst_buffer_new_and_alloc (16 + slen + size);
+  gst_buffer_map (ret, &map, GST_MAP_WRITE);
+
+  memcpy (map.data, MXF_UL (INDEX_TABLE_SEGMENT), 16);
+  memcpy (map.data + 16, ber, slen);
+
+  data = map.data + 16 + slen;
+
+  GST_WRITE_UINT16_BE (data, 0x3c0a);
+  GST_WRITE_UINT16_BE (data + 2, 16);
+  memcpy (data + 4, &segment->instance_id, 16);
+  data += 4 + 16;
+
+  GST_WRITE_UINT16_BE (data, 0x3f0b);
+  GST_WRITE_UINT16_BE (data + 2, 8);
+  GST_WRITE_UINT32_BE (data + 4, segment->index_edit_rate.n);
+  GST_WRITE_UINT32_BE (data + 8, segment->index_edit_rate.d);
+  data += 4 + 8;
+
+  GST_WRITE_UINT16_BE (data, 0x3f0c);
+  GST_WRITE_UINT16_BE (data + 2, 8);
+  GST_WRITE_UINT64_BE (data + 4, segment->index_start_position);
+  data += 4 + 8;
+
+  GST_WRITE_UINT16_BE (data, 0x3f0d);
+  GST_WRITE_UINT16_BE (data + 2, 8);
+  GST_WRITE_UINT64_BE (data + 4, segment->index_duration);
+  data += 4 + 8;
+
+  GST_WRITE_UINT16_BE (data, 0x3f05);
+  GST_WRITE_UINT16_BE (data + 2, 4);
+  GST_WRITE_UINT32_BE (data + 4, segment->edit_unit_byte_count);
+  data += 4 + 4;
+
+  GST_WRITE_UINT16_BE (data, 0x3f06);
+  GST_WRITE_UINT16_BE (data + 2, 4);
+  GST_WRITE_UINT32_BE (data + 4, segment->index_sid);
+  data += 4 + 4;
+
+  GST_WRITE_UINT16_BE (data, 0x3f07);
+  GST_WRITE_UINT16_BE (data + 2, 4);
+  GST_WRITE_UINT32_BE (data + 4, segment->body_sid);
+  data += 4 + 4;
+
+  GST_WRITE_UINT16_BE (data, 0x3f08);
+  GST_WRITE_UINT16_BE (data + 2, 1);
+  GST_WRITE_UINT8 (data + 4, segment->slice_count);
+  data += 4 + 1;
+
+  if (segment->n_delta_entries > 0) {
+    GST_WRITE_UINT16_BE (data, 0x3f09);
+    GST_WRITE_UINT16_BE (data + 2, 8 + 6 * segment->n_delta_entries);
+    GST_WRITE_UINT32_BE (data + 4, segment->n_delta_entries);
+    GST_WRITE_UINT32_BE (data + 8, 6);
+    data += 4 + 8;
+
+    for (i = 0; i < segment->n_delta_entries; i++) {
+      const MXFDeltaEntry *entry = &segment->delta_entries[i];
+
+      GST_WRITE_UINT8 (data, entry->pos_table_index);
+      GST_WRITE_UINT8 (data + 1, entry->slice);
+      GST_WRITE_UINT32_BE (data + 2, entry->element_delta);
+      data += 6;
+    }
+  }
+
+  if (segment->n_index_entries > 0) {
+    GST_WRITE_UINT16_BE (data, 0x3f0a);
+    GST_WRITE_UINT16_BE (data + 2, 8 + 11 * segment->n_index_entries);
+    GST_WRITE_UINT32_BE (data + 4, segment->n_index_entries);
+    GST_WRITE_UINT32_BE (data + 8, 11);
+    data += 4 + 8;
+
+    for (i = 0; i < segment->n_index_entries; i++) {
+      const MXFIndexEntry *entry = &segment->index_entries[i];
+
+      GST_WRITE_UINT8 (data, entry->temporal_offset);
+      GST_WRITE_UINT8 (data + 1, entry->key_frame_offset);
+      GST_WRITE_UINT8 (data + 2, entry->flags);
+      GST_WRITE_UINT64_BE (data + 3, entry->stream_offset);
+      data += 11;
+    }
+  }
+
+  gst_buffer_unmap (ret, &map);
+
+  return ret;
+}
+
 /* SMPTE 377M 8.2 Table 1 and 2 */
 
 static void
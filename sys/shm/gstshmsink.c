@@ -37,6 +37,7 @@
 #include "gstshmsink.h"
 
 #include <gst/gst.h>
+#include <gst/video/video.h>
 
 #include <string.h>
 
@@ -56,7 +57,8 @@ enum
   PROP_PERMS,
   PROP_SHM_SIZE,
   PROP_WAIT_FOR_CONNECTION,
-  PROP_BUFFER_TIME
+  PROP_BUFFER_TIME,
+  PROP_RING
 };
 
 struct GstShmClient
@@ -67,6 +69,7 @@ struct GstShmClient
 
 #define DEFAULT_SIZE ( 256 * 1024 )
 #define DEFAULT_WAIT_FOR_CONNECTION (TRUE)
+#define DEFAULT_RING (FALSE)
 /* Default is user read/write, group read */
 #define DEFAULT_PERMS ( S_IRUSR | S_IWUSR | S_IRGRP )
 
@@ -99,6 +102,7 @@ static gboolean gst_shm_sink_propose_allocation (GstBaseSink * sink,
     GstQuery * query);
 
 static gpointer pollthread_func (gpointer data);
+static gpointer ringthread_func (gpointer data);
 
 static guint signals[LAST_SIGNAL] = { 0 };
 
@@ -244,21 +248,28 @@ gst_shm_sink_allocator_init (GstShmSinkAllocator * self)
 }
 
 
+/* Bytes of the shm area taken by a memory of @size bytes with @params */
+static gsize
+gst_shm_sink_get_block_size (gsize size, const GstAllocationParams * params)
+{
+  /* allocate more to compensate for alignment */
+  return size + params->prefix + params->padding +
+      (params->align | gst_memory_alignment);
+}
+
 static GstMemory *
 gst_shm_sink_allocator_alloc_locked (GstShmSinkAllocator * self, gsize size,
     GstAllocationParams * params)
 {
   GstMemory *memory = NULL;
   ShmBlock *block = NULL;
-  gsize maxsize = size + params->prefix + params->padding;
+  gsize maxsize = gst_shm_sink_get_block_size (size, params);
   gsize align = params->align;
 
   /* ensure configured alignment */
   align |= gst_memory_alignment;
-  /* allocate more to compensate for alignment */
-  maxsize += align;
 
-  block = sp_writer_alloc_block (self->sink->pipe, size);
+  block = sp_writer_alloc_block (self->sink->pipe, maxsize);
   if (block) {
     GstShmSinkMemory *mymem;
     gsize aoffset, padding;
@@ -349,6 +360,7 @@ gst_shm_sink_init (GstShmSink * self)
   self->size = DEFAULT_SIZE;
   self->wait_for_connection = DEFAULT_WAIT_FOR_CONNECTION;
   self->perms = DEFAULT_PERMS;
+  self->ring = DEFAULT_RING;
 
   gst_allocation_params_init (&self->params);
 }
@@ -410,6 +422,13 @@ gst_shm_sink_class_init (GstShmSinkClass * klass)
           -1, G_MAXINT64, -1,
           G_PARAM_CONSTRUCT | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_RING,
+      g_param_spec_boolean ("ring",
+          "Ring",
+          "Pass buffers to the clients through a ring in shared memory"
+          " instead of the socket (only on Linux)",
+          DEFAULT_RING, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   signals[SIGNAL_CLIENT_CONNECTED] = g_signal_new ("client-connected",
       GST_TYPE_SHM_SINK, G_SIGNAL_RUN_LAST, 0, NULL, NULL,
       g_cclosure_marshal_VOID__INT, G_TYPE_NONE, 1, G_TYPE_INT);
@@ -499,6 +518,11 @@ gst_shm_sink_set_property (GObject * object, guint prop_id,
       GST_OBJECT_UNLOCK (object);
       g_cond_broadcast (&self->cond);
       break;
+    case PROP_RING:
+      GST_OBJECT_LOCK (object);
+      self->ring = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (object);
+      break;
     default:
       break;
   }
@@ -528,6 +552,9 @@ gst_shm_sink_get_property (GObject * object, guint prop_id,
     case PROP_BUFFER_TIME:
       g_value_set_int64 (value, self->buffer_time);
       break;
+    case PROP_RING:
+      g_value_set_boolean (value, self->ring);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -543,6 +570,7 @@ gst_shm_sink_start (GstBaseSink * bsink)
 {
   GstShmSink *self = GST_SHM_SINK (bsink);
   GError *err = NULL;
+  gboolean has_ring = FALSE;
 
   self->stop = FALSE;
 
@@ -563,6 +591,14 @@ gst_shm_sink_start (GstBaseSink * bsink)
     return FALSE;
   }
 
+  if (self->ring) {
+    if (sp_writer_enable_ring (self->pipe) < 0)
+      GST_WARNING_OBJECT (self, "Could not create the ring, passing buffers"
+          " through the socket");
+    else
+      has_ring = TRUE;
+  }
+
   sp_set_data (self->pipe, self);
   g_free (self->socket_path);
   self->socket_path = g_strdup (sp_writer_get_path (self->pipe));
@@ -581,6 +617,20 @@ gst_shm_sink_start (GstBaseSink * bsink)
   if (!self->pollthread)
     goto thread_error;
 
+  /* Nothing to wait for without a ring */
+  if (has_ring) {
+    self->ringthread = g_thread_try_new ("gst-shmsink-ring-thread",
+        ringthread_func, self, &err);
+
+    if (!self->ringthread) {
+      self->stop = TRUE;
+      gst_poll_set_flushing (self->poll, TRUE);
+      g_thread_join (self->pollthread);
+      self->pollthread = NULL;
+      goto thread_error;
+    }
+  }
+
   self->allocator = gst_shm_sink_allocator_new (self);
 
   return TRUE;
@@ -610,9 +660,22 @@ gst_shm_sink_stop (GstBaseSink * bsink)
     gst_object_unref (self->allocator);
   self->allocator = NULL;
 
+  /* Free the idle buffers while their blocks can still be freed */
+  if (self->pool) {
+    gst_buffer_pool_set_active (self->pool, FALSE);
+    gst_object_unref (self->pool);
+    self->pool = NULL;
+  }
+
   g_thread_join (self->pollthread);
   self->pollthread = NULL;
 
+  if (self->ringthread) {
+    sp_ring_wakeup (self->pipe);
+    g_thread_join (self->ringthread);
+    self->ringthread = NULL;
+  }
+
   GST_DEBUG_OBJECT (self, "Stopping");
 
   while (self->clients) {
@@ -737,7 +800,16 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
    * reading
    */
 
-  rv = sp_writer_send_buf (self->pipe, (char *) map.data, map.size, sendbuf);
+  /* -2 means the ring is full, wait for the readers to release buffers */
+  while ((rv = sp_writer_send_buf (self->pipe, (char *) map.data, map.size,
+              sendbuf)) == -2) {
+    g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
+    if (self->unlock) {
+      gst_buffer_unmap (sendbuf, &map);
+      gst_buffer_unref (sendbuf);
+      goto flushing;
+    }
+  }
 
   gst_buffer_unmap (sendbuf, &map);
 
@@ -892,6 +964,36 @@ pollthread_func (gpointer data)
   return NULL;
 }
 
+/* Frees the buffers released through the ring, it sleeps on the ring
+ * futex so that the readers don't need to write to the socket */
+static gpointer
+ringthread_func (gpointer data)
+{
+  GstShmSink *self = GST_SHM_SINK (data);
+  guint release_seq = 0;
+
+  while (!self->stop) {
+    GSList *list = NULL;
+    int ret;
+
+    ret = sp_writer_ring_wait (self->pipe, &release_seq, 100);
+    if (ret < 0)
+      break;
+    if (ret == 0)
+      continue;
+
+    GST_OBJECT_LOCK (self);
+    sp_writer_ring_reclaim (self->pipe,
+        (sp_buffer_free_callback) free_buffer_locked, (void **) &list);
+    GST_OBJECT_UNLOCK (self);
+    g_slist_free_full (list, (GDestroyNotify) gst_buffer_unref);
+
+    g_cond_broadcast (&self->cond);
+  }
+
+  return NULL;
+}
+
 static gboolean
 gst_shm_sink_event (GstBaseSink * bsink, GstEvent * event)
 {
@@ -942,10 +1044,77 @@ static gboolean
 gst_shm_sink_propose_allocation (GstBaseSink * sink, GstQuery * query)
 {
   GstShmSink *self = GST_SHM_SINK (sink);
+  GstBufferPool *pool = NULL;
+  GstStructure *config;
+  GstVideoInfo info;
+  GstCaps *caps;
+  gboolean need_pool;
+  guint max_buffers = 0;
+
+  if (!self->allocator)
+    return TRUE;
 
-  if (self->allocator)
-    gst_query_add_allocation_param (query, GST_ALLOCATOR (self->allocator),
-        NULL);
+  gst_query_add_allocation_param (query, GST_ALLOCATOR (self->allocator),
+      NULL);
+
+  gst_query_parse_allocation (query, &caps, &need_pool);
+
+  /* For raw video, the frames all have the same size, so upstream can
+   * recycle the same shm blocks from a pool */
+  if (!need_pool || !caps || !gst_video_info_from_caps (&info, caps))
+    return TRUE;
+
+  GST_OBJECT_LOCK (self);
+  if (self->pipe)
+    max_buffers = sp_writer_get_max_buf_size (self->pipe) /
+        gst_shm_sink_get_block_size (info.size, &self->params);
+
+  if (max_buffers < 2) {
+    GST_OBJECT_UNLOCK (self);
+    GST_DEBUG_OBJECT (self, "Shared memory area too small for a pool of"
+        " %" G_GSIZE_FORMAT " bytes buffers", info.size);
+    return TRUE;
+  }
+
+  if (self->pool) {
+    GstCaps *pcaps;
+    guint size;
+
+    config = gst_buffer_pool_get_config (self->pool);
+    gst_buffer_pool_config_get_params (config, &pcaps, &size, NULL, NULL);
+    if (size == info.size && gst_caps_is_equal (caps, pcaps))
+      pool = gst_object_ref (self->pool);
+    gst_structure_free (config);
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  if (!pool) {
+    GST_DEBUG_OBJECT (self, "Creating pool of %u buffers of %" G_GSIZE_FORMAT
+        " bytes", max_buffers, info.size);
+
+    pool = gst_buffer_pool_new ();
+    config = gst_buffer_pool_get_config (pool);
+    /* Limited to what fits in the area, so upstream waits for buffers to
+     * come back instead of getting system memory */
+    gst_buffer_pool_config_set_params (config, caps, info.size, 0,
+        max_buffers);
+    gst_buffer_pool_config_set_allocator (config,
+        GST_ALLOCATOR (self->allocator), &self->params);
+    if (!gst_buffer_pool_set_config (pool, config)) {
+      gst_object_unref (pool);
+      GST_WARNING_OBJECT (self, "Could not configure the pool");
+      return TRUE;
+    }
+
+    GST_OBJECT_LOCK (self);
+    if (self->pool)
+      gst_object_unref (self->pool);
+    self->pool = gst_object_ref (pool);
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  gst_query_add_allocation_pool (query, pool, info.size, 0, max_buffers);
+  gst_object_unref (pool);
 
   return TRUE;
 }
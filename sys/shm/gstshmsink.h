@@ -59,6 +59,9 @@ struct _GstShmSink
   GstPoll *poll;
   GstPollFD serverpollfd;
 
+  gboolean ring;
+  GThread *ringthread;
+
   gboolean wait_for_connection;
   gboolean stop;
   gboolean unlock;
@@ -67,6 +70,7 @@ struct _GstShmSink
   GCond cond;
 
   GstShmSinkAllocator *allocator;
+  GstBufferPool *pool;
 
   GstAllocationParams params;
 };
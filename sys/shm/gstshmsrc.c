@@ -313,7 +313,27 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
   struct GstShmBuffer *gsb;
 
   do {
-    if (gst_poll_wait (self->poll, GST_CLOCK_TIME_NONE) < 0) {
+    GstClockTime timeout = GST_CLOCK_TIME_NONE;
+
+    /* With a ring, buffers don't come through the socket, it only has to be
+     * checked for new areas and for the sink going away */
+    if (sp_client_has_ring (self->pipe->pipe)) {
+      GST_OBJECT_LOCK (self);
+      rv = sp_client_ring_recv (self->pipe->pipe, &buf);
+      GST_OBJECT_UNLOCK (self);
+
+      if (buf)
+        break;
+
+      if (rv == 0) {
+        sp_client_ring_wait (self->pipe->pipe, 100);
+        if (self->unlocked)
+          return GST_FLOW_FLUSHING;
+        timeout = 0;
+      }
+    }
+
+    if (gst_poll_wait (self->poll, timeout) < 0) {
       if (errno == EBUSY)
         return GST_FLOW_FLUSHING;
       GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
@@ -401,6 +421,11 @@ gst_shm_src_unlock (GstBaseSrc * bsrc)
   self->unlocked = TRUE;
   gst_poll_set_flushing (self->poll, TRUE);
 
+  GST_OBJECT_LOCK (self);
+  if (self->pipe)
+    sp_ring_wakeup (self->pipe->pipe);
+  GST_OBJECT_UNLOCK (self);
+
   return TRUE;
 }
 
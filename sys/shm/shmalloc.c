@@ -33,6 +33,11 @@
 #include <string.h>
 #include <assert.h>
 
+/* Freed blocks are kept in free lists by size class, class n holding the
+ * blocks of 2^n to 2^(n+1) - 1 bytes, so that allocating a block of a size
+ * that was recently freed doesn't need to go through the whole space */
+#define SIZE_CLASSES (sizeof (unsigned long) * 8)
+
 /* This is the allocated space to hold multiple blocks */
 struct _ShmAllocSpace
 {
@@ -41,6 +46,10 @@ struct _ShmAllocSpace
 
   /* chained list of the blocks contained in this space */
   ShmAllocBlock *blocks;
+
+  /* free lists of the unused blocks still in the chain, by size class */
+  ShmAllocBlock *free_blocks[SIZE_CLASSES];
+  unsigned int n_free_blocks;
 };
 
 /* A single block of data */
@@ -58,8 +67,48 @@ struct _ShmAllocBlock
 
   /* Pointer to the next block in the chain */
   ShmAllocBlock *next;
+
+  /* Pointer to the next block in the same free list */
+  ShmAllocBlock *next_free;
 };
 
+static void shm_alloc_space_free_block (ShmAllocBlock * block);
+
+static unsigned int
+size_class (unsigned long size)
+{
+  unsigned int class = 0;
+
+  while (size >>= 1)
+    class++;
+
+  return class;
+}
+
+static ShmAllocBlock *
+shm_alloc_space_pop_free_block (ShmAllocSpace * self, unsigned int class)
+{
+  ShmAllocBlock *block = self->free_blocks[class];
+
+  self->free_blocks[class] = block->next_free;
+  block->next_free = NULL;
+  self->n_free_blocks--;
+
+  return block;
+}
+
+/* Really frees all the unused blocks */
+static void
+shm_alloc_space_flush (ShmAllocSpace * self)
+{
+  unsigned int class;
+
+  for (class = 0; class < SIZE_CLASSES; class++)
+    while (self->free_blocks[class])
+      shm_alloc_space_free_block (shm_alloc_space_pop_free_block (self,
+              class));
+}
+
 
 ShmAllocSpace *
 shm_alloc_space_new (size_t size)
@@ -76,7 +125,9 @@ shm_alloc_space_new (size_t size)
 void
 shm_alloc_space_free (ShmAllocSpace * self)
 {
-  assert (self && self->blocks == NULL);
+  assert (self);
+  shm_alloc_space_flush (self);
+  assert (self->blocks == NULL);
   spalloc_free (ShmAllocSpace, self);
 }
 
@@ -89,6 +140,28 @@ shm_alloc_space_alloc_block (ShmAllocSpace * self, unsigned long size)
   ShmAllocBlock *prev_item = NULL;
   unsigned long prev_end_offset = 0;
 
+  if (size > 0 && self->n_free_blocks) {
+    unsigned int class = size_class (size);
+
+    /* Only the first block of the request's class is checked, it's big
+     * enough when the same sizes keep being allocated. Any block of the
+     * next class is big enough. */
+    if (self->free_blocks[class] && self->free_blocks[class]->size >= size)
+      block = shm_alloc_space_pop_free_block (self, class);
+    else if (class + 1 < SIZE_CLASSES && self->free_blocks[class + 1])
+      block = shm_alloc_space_pop_free_block (self, class + 1);
+    else
+      block = NULL;
+
+    if (block) {
+      block->use_count = 1;
+      return block;
+    }
+  }
+
+again:
+  prev_item = NULL;
+  prev_end_offset = 0;
 
   for (item = self->blocks; item; item = item->next) {
     unsigned long max_size = 0;
@@ -105,8 +178,14 @@ shm_alloc_space_alloc_block (ShmAllocSpace * self, unsigned long size)
   /* Return NULL if there is no big enough space, otherwise, there is space
    * at the end */
   assert (prev_end_offset <= self->size);
-  if (!item && self->size - prev_end_offset < size)
+  if (!item && self->size - prev_end_offset < size) {
+    /* The unused blocks may be in the way */
+    if (self->n_free_blocks) {
+      shm_alloc_space_flush (self);
+      goto again;
+    }
     return NULL;
+  }
 
   block = spalloc_new (ShmAllocBlock);
   memset (block, 0, sizeof (ShmAllocBlock));
@@ -158,7 +237,8 @@ shm_alloc_space_block_get (ShmAllocSpace * self, unsigned long offset)
   ShmAllocBlock *block = NULL;
 
   for (block = self->blocks; block; block = block->next) {
-    if (block->offset <= offset && (block->offset + block->size) > offset)
+    if (block->use_count > 0 && block->offset <= offset &&
+        (block->offset + block->size) > offset)
       return block;
   }
 
@@ -175,8 +255,22 @@ shm_alloc_space_block_inc (ShmAllocBlock * block)
 void
 shm_alloc_space_block_dec (ShmAllocBlock * block)
 {
+  ShmAllocSpace *self = block->space;
+  unsigned int class;
+
   block->use_count--;
 
-  if (block->use_count <= 0)
+  if (block->use_count > 0)
+    return;
+
+  if (block->size == 0) {
     shm_alloc_space_free_block (block);
+    return;
+  }
+
+  /* Keep it around for the next allocation of the same size */
+  class = size_class (block->size);
+  block->next_free = self->free_blocks[class];
+  self->free_blocks[class] = block;
+  self->n_free_blocks++;
 }
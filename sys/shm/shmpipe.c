@@ -47,6 +47,13 @@
 #include <sys/mman.h>
 #include <assert.h>
 
+#ifdef HAVE_LINUX_FUTEX_H
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#define SHM_PIPE_HAVE_RING
+#endif
+
 #include "shmalloc.h"
 
 /*
@@ -67,9 +74,23 @@
  * type 4: ack buffer
  * offset
  *
+ * type 5: new ring
+ * Ring length
+ * Size of path (followed by path)
+ * Reader index
+ * Sequence number of the first buffer for this reader
+ *
  * Type 4 goes from the client to the server
  * The rest are from the server to the client
- * The client should never write in the SHM
+ * The client should never write in the SHM, except in the ring
+ *
+ * When the writer has a ring, types 3 and 4 are replaced for the clients
+ * it was announced to by writing to the ring: the writer fills the next
+ * slot with the buffer and the readers which receive it, then bumps the
+ * write sequence number. Each reader clears its bit in the slot when it
+ * releases the buffer and bumps the release sequence number. Both
+ * sequence numbers are futexes, so the other side only needs to be woken
+ * up if it's waiting.
  */
 
 
@@ -80,10 +101,18 @@ enum
   COMMAND_NEW_SHM_AREA = 1,
   COMMAND_CLOSE_SHM_AREA = 2,
   COMMAND_NEW_BUFFER = 3,
-  COMMAND_ACK_BUFFER = 4
+  COMMAND_ACK_BUFFER = 4,
+  COMMAND_NEW_RING = 5
 };
 
+#define RING_SLOTS 256
+#define RING_MAX_READERS 32
+/* Stands for all the ring readers in the clients of a ShmBuffer */
+#define RING_CLIENT_FD -2
+
 typedef struct _ShmArea ShmArea;
+typedef struct _ShmRing ShmRing;
+typedef struct _ShmRingSlot ShmRingSlot;
 
 struct _ShmArea
 {
@@ -123,6 +152,31 @@ struct _ShmBuffer
 };
 
 
+struct _ShmRingSlot
+{
+  int area_id;
+  /* Bitmask of the readers which still have to release the buffer */
+  uint32_t readers;
+  unsigned long offset;
+  unsigned long size;
+};
+
+/* Lives in its own shm area, mapped read-write by all sides */
+struct _ShmRing
+{
+  /* Number of buffers published, futex for the readers */
+  uint32_t write_seq;
+  uint32_t readers_waiting;
+  /* Number of buffers released, futex for the writer */
+  uint32_t release_seq;
+  uint32_t writer_waiting;
+
+  /* Sequence number of the next buffer each reader will read */
+  uint32_t read_seq[RING_MAX_READERS];
+
+  ShmRingSlot slots[RING_SLOTS];
+};
+
 struct _ShmPipe
 {
   int main_socket;
@@ -140,11 +194,25 @@ struct _ShmPipe
   ShmClient *clients;
 
   mode_t perms;
+
+  ShmRing *ring;
+  int ring_fd;
+  char *ring_name;
+  /* writer: bitmask of the clients using the ring */
+  uint32_t ring_readers;
+  /* writer: sequence number of the oldest slot not reclaimed yet, and the
+   * buffer in each slot */
+  uint32_t ring_reclaim_seq;
+  ShmBuffer *ring_buffers[RING_SLOTS];
+  /* client: our reader index */
+  int ring_index;
 };
 
 struct _ShmClient
 {
   int fd;
+  /* reader index in the ring, -1 if using the socket */
+  int ring_index;
 
   ShmClient *next;
 };
@@ -178,14 +246,46 @@ struct CommandBuffer
     {
       unsigned long offset;
     } ack_buffer;
+    struct
+    {
+      size_t size;
+      unsigned int path_size;
+      int index;
+      unsigned int start_seq;
+      /* Followed by path */
+    } new_ring;
   } payload;
 };
 
 static ShmArea *sp_open_shm (char *path, int id, mode_t perms, size_t size);
 static void sp_close_shm (ShmArea * area);
 static int sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf,
-    ShmBuffer * prev_buf, ShmClient * client, void **tag);
+    ShmBuffer * prev_buf, int client_fd, void **tag);
 static void sp_shm_area_dec (ShmPipe * self, ShmArea * area);
+static void sp_close_ring (ShmPipe * self);
+
+#ifdef SHM_PIPE_HAVE_RING
+/* Reads atomically with a full barrier */
+#define RING_LOAD(p) __sync_fetch_and_add ((p), 0)
+
+static void
+sp_futex_wait (uint32_t * addr, uint32_t val, int timeout_ms)
+{
+  struct timespec ts;
+
+  ts.tv_sec = timeout_ms / 1000;
+  ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+
+  syscall (SYS_futex, addr, FUTEX_WAIT, val, timeout_ms < 0 ? NULL : &ts,
+      NULL, 0);
+}
+
+static void
+sp_futex_wake (uint32_t * addr)
+{
+  syscall (SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+#endif
 
 
 
@@ -207,6 +307,7 @@ sp_writer_create (const char *path, size_t size, mode_t perms)
 
   self->main_socket = socket (PF_UNIX, SOCK_STREAM, 0);
   self->use_count = 1;
+  self->ring_fd = -1;
 
   if (self->main_socket < 0)
     RETURN_ERROR ("Could not create socket (%d): %s\n", errno,
@@ -439,6 +540,8 @@ sp_writer_close (ShmPipe * self, sp_buffer_free_callback callback,
   while (self->clients)
     sp_writer_close_client (self, self->clients, callback, user_data);
 
+  sp_close_ring (self);
+
   sp_dec (self);
 }
 
@@ -461,9 +564,82 @@ sp_writer_setperms_shm (ShmPipe * self, mode_t perms)
 
   ret |= chmod (self->socket_path, perms);
 
+  if (self->ring_fd >= 0)
+    ret |= fchmod (self->ring_fd, perms);
+
   return ret;
 }
 
+/**
+ * sp_writer_enable_ring:
+ *
+ * Creates the ring through which buffers are passed to the clients
+ * connecting from now on.
+ *
+ * Returns: 0 on success, -1 if the ring could not be created or isn't
+ * supported on this platform
+ */
+int
+sp_writer_enable_ring (ShmPipe * self)
+{
+#ifdef SHM_PIPE_HAVE_RING
+  char tmppath[32];
+  void *ring;
+  int i = 0;
+
+  if (self->ring)
+    return 0;
+
+  do {
+    snprintf (tmppath, sizeof (tmppath), "/shmpipe.%5d.ring.%d", getpid (),
+        i++);
+    self->ring_fd = shm_open (tmppath, O_RDWR | O_CREAT | O_TRUNC | O_EXCL,
+        self->perms);
+  } while (self->ring_fd < 0 && errno == EEXIST);
+
+  if (self->ring_fd < 0)
+    return -1;
+
+  self->ring_name = strdup (tmppath);
+
+  /* ftruncate() zeroes the ring */
+  if (ftruncate (self->ring_fd, sizeof (ShmRing)))
+    goto error;
+
+  ring = mmap (NULL, sizeof (ShmRing), PROT_READ | PROT_WRITE, MAP_SHARED,
+      self->ring_fd, 0);
+  if (ring == MAP_FAILED)
+    goto error;
+
+  self->ring = ring;
+  self->ring_reclaim_seq = 0;
+
+  return 0;
+
+error:
+  sp_close_ring (self);
+#endif
+  return -1;
+}
+
+static void
+sp_close_ring (ShmPipe * self)
+{
+  if (self->ring)
+    munmap (self->ring, sizeof (ShmRing));
+  self->ring = NULL;
+
+  if (self->ring_fd >= 0)
+    close (self->ring_fd);
+  self->ring_fd = -1;
+
+  if (self->ring_name) {
+    shm_unlink (self->ring_name);
+    free (self->ring_name);
+    self->ring_name = NULL;
+  }
+}
+
 static int
 send_command (int fd, struct CommandBuffer *cb, unsigned short int type,
     int area_id)
@@ -577,6 +753,7 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
   ShmBuffer *sb;
   ShmClient *client = NULL;
   ShmAllocBlock *ablock = NULL;
+  uint32_t seq = 0;
   int i = 0;
   int c = 0;
 
@@ -596,6 +773,13 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
   if (!ablock)
     return -1;
 
+  if (self->ring_readers) {
+    seq = self->ring->write_seq;
+    /* The oldest slot must have been released by all readers */
+    if (seq - self->ring_reclaim_seq >= RING_SLOTS)
+      return -2;
+  }
+
   sb = spalloc_alloc (sizeof (ShmBuffer) + sizeof (int) * self->num_clients);
   memset (sb, 0, sizeof (ShmBuffer));
   memset (sb->clients, -1, sizeof (int) * self->num_clients);
@@ -608,6 +792,10 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
 
   for (client = self->clients; client; client = client->next) {
     struct CommandBuffer cb = { 0 };
+
+    if (client->ring_index >= 0)
+      continue;
+
     cb.payload.buffer.offset = offset;
     cb.payload.buffer.size = bsize;
     if (!send_command (client->fd, &cb, COMMAND_NEW_BUFFER, self->shm_area->id))
@@ -616,6 +804,26 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
     c++;
   }
 
+#ifdef SHM_PIPE_HAVE_RING
+  if (self->ring_readers) {
+    ShmRingSlot *slot = &self->ring->slots[seq % RING_SLOTS];
+
+    slot->area_id = area->id;
+    slot->offset = offset;
+    slot->size = bsize;
+    slot->readers = self->ring_readers;
+    self->ring_buffers[seq % RING_SLOTS] = sb;
+    sb->clients[i++] = RING_CLIENT_FD;
+    c += __builtin_popcount (self->ring_readers);
+
+    /* Publish the slot */
+    __sync_synchronize ();
+    self->ring->write_seq = seq + 1;
+    if (RING_LOAD (&self->ring->readers_waiting))
+      sp_futex_wake (&self->ring->write_seq);
+  }
+#endif
+
   if (c == 0) {
     spalloc_free1 (sizeof (ShmBuffer) + sizeof (int) * sb->num_clients, sb);
     return 0;
@@ -624,7 +832,7 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
   sp_shm_area_inc (area);
   shm_alloc_space_block_inc (ablock);
 
-  sb->use_count = c;
+  sb->use_count = i;
 
   sb->next = self->buffers;
   self->buffers = sb;
@@ -689,6 +897,48 @@ sp_client_recv (ShmPipe * self, char **buf)
       }
       break;
 
+    case COMMAND_NEW_RING:
+#ifdef SHM_PIPE_HAVE_RING
+    {
+      void *ring;
+
+      assert (cb.payload.new_ring.path_size > 0);
+
+      /* Both sides must agree on the layout */
+      if (cb.payload.new_ring.size != sizeof (ShmRing) ||
+          cb.payload.new_ring.index < 0 ||
+          cb.payload.new_ring.index >= RING_MAX_READERS || self->ring)
+        return -5;
+
+      area_name = malloc (cb.payload.new_ring.path_size);
+      retval = recv (self->main_socket, area_name,
+          cb.payload.new_ring.path_size, 0);
+      if (retval != cb.payload.new_ring.path_size) {
+        free (area_name);
+        return -3;
+      }
+
+      self->ring_fd = shm_open (area_name, O_RDWR, 0);
+      free (area_name);
+      if (self->ring_fd < 0)
+        return -4;
+
+      ring = mmap (NULL, sizeof (ShmRing), PROT_READ | PROT_WRITE, MAP_SHARED,
+          self->ring_fd, 0);
+      if (ring == MAP_FAILED) {
+        sp_close_ring (self);
+        return -4;
+      }
+
+      self->ring = ring;
+      self->ring_index = cb.payload.new_ring.index;
+      self->ring->read_seq[self->ring_index] = cb.payload.new_ring.start_seq;
+      break;
+    }
+#else
+      return -5;
+#endif
+
     case COMMAND_NEW_BUFFER:
       assert (buf);
       for (area = self->shm_area; area; area = area->next) {
@@ -722,7 +972,7 @@ sp_writer_recv (ShmPipe * self, ShmClient * client, void **tag)
       for (buf = self->buffers; buf; buf = buf->next) {
         if (buf->shm_area->id == cb.area_id &&
             buf->offset == cb.payload.ack_buffer.offset) {
-          return sp_shmbuf_dec (self, buf, prev_buf, client, tag);
+          return sp_shmbuf_dec (self, buf, prev_buf, client->fd, tag);
           break;
         }
         prev_buf = buf;
@@ -756,6 +1006,31 @@ sp_client_recv_finish (ShmPipe * self, char *buf)
 
   offset = buf - shm_area->shm_area_buf;
 
+#ifdef SHM_PIPE_HAVE_RING
+  if (self->ring) {
+    ShmRing *ring = self->ring;
+    uint32_t bit = 1U << self->ring_index;
+    uint32_t end = ring->read_seq[self->ring_index];
+    uint32_t seq;
+
+    for (seq = end - RING_SLOTS; seq != end; seq++) {
+      ShmRingSlot *slot = &ring->slots[seq % RING_SLOTS];
+
+      if ((RING_LOAD (&slot->readers) & bit) &&
+          slot->area_id == shm_area->id && slot->offset == offset) {
+        sp_shm_area_dec (self, shm_area);
+        __sync_fetch_and_and (&slot->readers, ~bit);
+        __sync_fetch_and_add (&ring->release_seq, 1);
+        if (RING_LOAD (&ring->writer_waiting))
+          sp_futex_wake (&ring->release_seq);
+        return 1;
+      }
+    }
+
+    return 0;
+  }
+#endif
+
   sp_shm_area_dec (self, shm_area);
 
   cb.payload.ack_buffer.offset = offset;
@@ -774,6 +1049,7 @@ sp_client_open (const char *path)
 
   self->main_socket = socket (PF_UNIX, SOCK_STREAM, 0);
   self->use_count = 1;
+  self->ring_fd = -1;
 
   if (self->main_socket < 0)
     goto error;
@@ -831,6 +1107,39 @@ sp_writer_accept_client (ShmPipe * self)
 
   client = spalloc_new (ShmClient);
   client->fd = fd;
+  client->ring_index = -1;
+
+#ifdef SHM_PIPE_HAVE_RING
+  if (self->ring) {
+    int index;
+
+    for (index = 0; index < RING_MAX_READERS; index++)
+      if (!(self->ring_readers & (1U << index)))
+        break;
+
+    /* Past the maximum number of readers, fall back to the socket */
+    if (index < RING_MAX_READERS) {
+      struct CommandBuffer rcb = { 0 };
+      int ringpathlen = strlen (self->ring_name) + 1;
+
+      rcb.payload.new_ring.size = sizeof (ShmRing);
+      rcb.payload.new_ring.path_size = ringpathlen;
+      rcb.payload.new_ring.index = index;
+      rcb.payload.new_ring.start_seq = self->ring->write_seq;
+      if (!send_command (fd, &rcb, COMMAND_NEW_RING, 0) ||
+          send (fd, self->ring_name, ringpathlen, MSG_NOSIGNAL) !=
+          ringpathlen) {
+        fprintf (stderr, "Sending new ring failed: %s", strerror (errno));
+        spalloc_free (ShmClient, client);
+        goto error;
+      }
+
+      self->ring->read_seq[index] = self->ring->write_seq;
+      self->ring_readers |= 1U << index;
+      client->ring_index = index;
+    }
+  }
+#endif
 
   /* Prepend ot linked list */
   client->next = self->clients;
@@ -846,7 +1155,7 @@ error:
 
 static int
 sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf, ShmBuffer * prev_buf,
-    ShmClient * client, void **tag)
+    int client_fd, void **tag)
 {
   int i;
   int had_client = 0;
@@ -858,7 +1167,7 @@ sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf, ShmBuffer * prev_buf,
    * buffer will not be freed too early in sp_writer_close_client.
    */
   for (i = 0; i < buf->num_clients; i++) {
-    if (buf->clients[i] == client->fd) {
+    if (buf->clients[i] == client_fd) {
       buf->clients[i] = -1;
       had_client = 1;
       break;
@@ -894,6 +1203,20 @@ sp_writer_close_client (ShmPipe * self, ShmClient * client,
 
   close (client->fd);
 
+#ifdef SHM_PIPE_HAVE_RING
+  if (client->ring_index >= 0) {
+    uint32_t bit = 1U << client->ring_index;
+    uint32_t seq;
+
+    /* Release everything the client still had */
+    self->ring_readers &= ~bit;
+    for (seq = self->ring_reclaim_seq; seq != self->ring->write_seq; seq++)
+      __sync_fetch_and_and (&self->ring->slots[seq % RING_SLOTS].readers,
+          ~bit);
+    sp_writer_ring_reclaim (self, callback, user_data);
+  }
+#endif
+
 again:
   for (buffer = self->buffers; buffer; buffer = buffer->next) {
     int i;
@@ -901,7 +1224,7 @@ again:
 
     for (i = 0; i < buffer->num_clients; i++) {
       if (buffer->clients[i] == client->fd) {
-        if (!sp_shmbuf_dec (self, buffer, prev_buf, client, &tag)) {
+        if (!sp_shmbuf_dec (self, buffer, prev_buf, client->fd, &tag)) {
           if (callback)
             callback (tag, user_data);
           goto again;
@@ -979,3 +1302,198 @@ sp_writer_get_max_buf_size (ShmPipe * self)
 
   return self->shm_area->shm_area_len;
 }
+
+/**
+ * sp_writer_ring_reclaim:
+ *
+ * Frees the buffers released by all the ring readers, calling @callback
+ * with their tag.
+ *
+ * Returns: the number of buffers freed
+ */
+int
+sp_writer_ring_reclaim (ShmPipe * self, sp_buffer_free_callback callback,
+    void *user_data)
+{
+  int n = 0;
+
+#ifdef SHM_PIPE_HAVE_RING
+  if (!self->ring)
+    return 0;
+
+  /* Slots are reclaimed in order, so the ring stays contiguous */
+  while (self->ring_reclaim_seq != self->ring->write_seq) {
+    unsigned int index = self->ring_reclaim_seq % RING_SLOTS;
+    ShmBuffer *sb = self->ring_buffers[index];
+    ShmBuffer *buf, *prev_buf = NULL;
+    void *tag = NULL;
+
+    if (RING_LOAD (&self->ring->slots[index].readers) != 0)
+      break;
+
+    self->ring_buffers[index] = NULL;
+    self->ring_reclaim_seq++;
+
+    for (buf = self->buffers; buf != sb; buf = buf->next)
+      prev_buf = buf;
+    assert (buf);
+
+    if (sp_shmbuf_dec (self, sb, prev_buf, RING_CLIENT_FD, &tag) == 0) {
+      if (callback)
+        callback (tag, user_data);
+      n++;
+    }
+  }
+#endif
+
+  return n;
+}
+
+/**
+ * sp_writer_ring_wait:
+ * @release_seq: the release sequence number last seen, updated
+ * @timeout_ms: the maximum time to wait, -1 for no limit
+ *
+ * Waits until ring readers release buffers.
+ *
+ * Returns: 1 if buffers were released, 0 if not, -1 if there is no ring
+ */
+int
+sp_writer_ring_wait (ShmPipe * self, unsigned int *release_seq, int timeout_ms)
+{
+#ifdef SHM_PIPE_HAVE_RING
+  ShmRing *ring = self->ring;
+  uint32_t seq;
+  int changed;
+
+  if (!ring)
+    return -1;
+
+  seq = RING_LOAD (&ring->release_seq);
+  if (seq == *release_seq) {
+    __sync_fetch_and_add (&ring->writer_waiting, 1);
+    sp_futex_wait (&ring->release_seq, seq, timeout_ms);
+    __sync_fetch_and_sub (&ring->writer_waiting, 1);
+    seq = RING_LOAD (&ring->release_seq);
+  }
+
+  changed = (seq != *release_seq);
+  *release_seq = seq;
+
+  return changed;
+#else
+  return -1;
+#endif
+}
+
+int
+sp_client_has_ring (ShmPipe * self)
+{
+  return self->ring != NULL;
+}
+
+/**
+ * sp_client_ring_recv:
+ *
+ * Takes the next buffer from the ring, without blocking. It must be
+ * released with sp_client_recv_finish().
+ *
+ * Returns: the size of the buffer if there was one (then @buf is set), 0
+ * if there is none, or -1 if the buffer is in an area that was not
+ * received yet (then the control messages should be read with
+ * sp_client_recv() first)
+ */
+long int
+sp_client_ring_recv (ShmPipe * self, char **buf)
+{
+#ifdef SHM_PIPE_HAVE_RING
+  ShmRing *ring = self->ring;
+  uint32_t bit, seq;
+
+  *buf = NULL;
+
+  if (!ring)
+    return 0;
+
+  bit = 1U << self->ring_index;
+  seq = ring->read_seq[self->ring_index];
+
+  while (seq != RING_LOAD (&ring->write_seq)) {
+    ShmRingSlot *slot = &ring->slots[seq % RING_SLOTS];
+    ShmArea *area;
+
+    /* Not for us, we are being disconnected */
+    if (!(RING_LOAD (&slot->readers) & bit)) {
+      seq++;
+      continue;
+    }
+
+    for (area = self->shm_area; area; area = area->next) {
+      if (area->id == slot->area_id) {
+        *buf = area->shm_area_buf + slot->offset;
+        sp_shm_area_inc (area);
+        ring->read_seq[self->ring_index] = seq + 1;
+        return slot->size;
+      }
+    }
+
+    ring->read_seq[self->ring_index] = seq;
+    return -1;
+  }
+
+  ring->read_seq[self->ring_index] = seq;
+#else
+  *buf = NULL;
+#endif
+
+  return 0;
+}
+
+/**
+ * sp_client_ring_wait:
+ * @timeout_ms: the maximum time to wait, -1 for no limit
+ *
+ * Waits until a new buffer is available in the ring.
+ *
+ * Returns: 1 if there is a new buffer, 0 if not, -1 if there is no ring
+ */
+int
+sp_client_ring_wait (ShmPipe * self, int timeout_ms)
+{
+#ifdef SHM_PIPE_HAVE_RING
+  ShmRing *ring = self->ring;
+  uint32_t seq;
+
+  if (!ring)
+    return -1;
+
+  seq = ring->read_seq[self->ring_index];
+  if (RING_LOAD (&ring->write_seq) != seq)
+    return 1;
+
+  __sync_fetch_and_add (&ring->readers_waiting, 1);
+  sp_futex_wait (&ring->write_seq, seq, timeout_ms);
+  __sync_fetch_and_sub (&ring->readers_waiting, 1);
+
+  return RING_LOAD (&ring->write_seq) != seq;
+#else
+  return -1;
+#endif
+}
+
+/**
+ * sp_ring_wakeup:
+ *
+ * Wakes up everyone waiting in sp_writer_ring_wait() or
+ * sp_client_ring_wait() on the ring of @self.
+ */
+void
+sp_ring_wakeup (ShmPipe * self)
+{
+#ifdef SHM_PIPE_HAVE_RING
+  if (self->ring) {
+    sp_futex_wake (&self->ring->write_seq);
+    sp_futex_wake (&self->ring->release_seq);
+  }
+#endif
+}
@@ -56,6 +56,17 @@
  * buffers are no longer valid. If was valid buffer was received, the
  * client must release it with sp_client_recv_finish() when it is done
  * reading from it.
+ *
+ * Optionally, the writer can call sp_writer_enable_ring() before
+ * clients connect. The buffers are then passed to the clients through
+ * a ring in shared memory instead of the socket, which is only used
+ * for connecting, disconnecting and announcing new shm areas. Once
+ * sp_client_has_ring() returns true, the client gets its buffers with
+ * sp_client_ring_recv() and waits for them with sp_client_ring_wait()
+ * (it must still read the control messages from the socket with
+ * sp_client_recv()). The writer waits for buffers to be released with
+ * sp_writer_ring_wait() and frees them with sp_writer_ring_reclaim().
+ * Any waiter can be woken up with sp_ring_wakeup().
  */
 
 
@@ -107,6 +118,12 @@ int sp_writer_recv (ShmPipe * self, ShmClient * client, void ** tag);
 
 int sp_writer_pending_writes (ShmPipe * self);
 
+int sp_writer_enable_ring (ShmPipe * self);
+int sp_writer_ring_reclaim (ShmPipe * self, sp_buffer_free_callback callback,
+    void * user_data);
+int sp_writer_ring_wait (ShmPipe * self, unsigned int * release_seq,
+    int timeout_ms);
+
 ShmBuffer *sp_writer_get_pending_buffers (ShmPipe * self);
 ShmBuffer *sp_writer_get_next_buffer (ShmBuffer * buffer);
 void *sp_writer_buf_get_tag (ShmBuffer * buffer);
@@ -116,6 +133,12 @@ long int sp_client_recv (ShmPipe * self, char **buf);
 int sp_client_recv_finish (ShmPipe * self, char *buf);
 void sp_client_close (ShmPipe * self);
 
+int sp_client_has_ring (ShmPipe * self);
+long int sp_client_ring_recv (ShmPipe * self, char **buf);
+int sp_client_ring_wait (ShmPipe * self, int timeout_ms);
+
+void sp_ring_wakeup (ShmPipe * self);
+
 #ifdef __cplusplus
 }
 #endif
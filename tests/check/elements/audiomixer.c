@@ -1725,6 +1725,410 @@ GST_START_TEST (test_sync_unaligned)
 
 GST_END_TEST;
 
+static GstPadProbeReturn
+set_volume_on_second_buffer (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  guint *count = user_data;
+
+  if (++(*count) == 2)
+    g_object_set (pad, "volume", 0.5, NULL);
+
+  return GST_PAD_PROBE_OK;
+}
+
+GST_START_TEST (test_volume_ramp)
+{
+  GstSegment segment;
+  GstElement *bin, *audiomixer, *queue, *sink;
+  GstBus *bus;
+  GstPad *sinkpad, *queue_sinkpad, *pad;
+  GstStateChangeReturn state_res;
+  GstBuffer *buffer;
+  GstMapInfo map;
+  GstCaps *caps;
+  GList *received_buffers = NULL, *l;
+  guint count = 0;
+  gfloat *samples;
+  gint i, j;
+
+  main_loop = g_main_loop_new (NULL, FALSE);
+
+  bin = gst_pipeline_new ("pipeline");
+  bus = gst_element_get_bus (bin);
+  gst_bus_add_signal_watch_full (bus, G_PRIORITY_HIGH);
+
+  g_signal_connect (bus, "message::error", (GCallback) message_received, bin);
+  g_signal_connect (bus, "message::warning", (GCallback) message_received, bin);
+  g_signal_connect (bus, "message::eos", (GCallback) message_received, bin);
+
+  queue = gst_element_factory_make ("queue", "queue");
+  audiomixer = gst_element_factory_make ("audiomixer", "audiomixer");
+  g_object_set (audiomixer, "blocksize", 100, NULL);
+  sink = gst_element_factory_make ("fakesink", "sink");
+  g_object_set (sink, "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", (GCallback) handoff_buffer_collect_cb,
+      &received_buffers);
+  gst_bin_add_many (GST_BIN (bin), queue, audiomixer, sink, NULL);
+  fail_unless (gst_element_link (audiomixer, sink));
+
+  state_res = gst_element_set_state (bin, GST_STATE_PAUSED);
+  ck_assert_int_ne (state_res, GST_STATE_CHANGE_FAILURE);
+
+  sinkpad = gst_element_get_request_pad (audiomixer, "sink_%u");
+  fail_if (sinkpad == NULL, NULL);
+  gst_pad_add_probe (sinkpad, GST_PAD_PROBE_TYPE_BUFFER,
+      set_volume_on_second_buffer, &count, NULL);
+
+  queue_sinkpad = gst_element_get_static_pad (queue, "sink");
+  pad = gst_element_get_static_pad (queue, "src");
+  fail_unless (gst_pad_link (pad, sinkpad) == GST_PAD_LINK_OK);
+  gst_object_unref (pad);
+
+  gst_pad_send_event (queue_sinkpad, gst_event_new_stream_start ("test"));
+
+  caps = gst_caps_new_simple ("audio/x-raw",
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+      "format", G_TYPE_STRING, "F32BE",
+#else
+      "format", G_TYPE_STRING, "F32LE",
+#endif
+      "layout", G_TYPE_STRING, "interleaved",
+      "rate", G_TYPE_INT, 1000, "channels", G_TYPE_INT, 1, NULL);
+  gst_pad_set_caps (queue_sinkpad, caps);
+  gst_caps_unref (caps);
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_send_event (queue_sinkpad, gst_event_new_segment (&segment));
+
+  /* 3 buffers of 100 samples at 1.0, the volume drops to 0.5 when the
+   * second one arrives */
+  for (i = 0; i < 3; i++) {
+    buffer = gst_buffer_new_and_alloc (100 * sizeof (gfloat));
+    gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+    samples = (gfloat *) map.data;
+    for (j = 0; j < 100; j++)
+      samples[j] = 1.0;
+    gst_buffer_unmap (buffer, &map);
+    GST_BUFFER_TIMESTAMP (buffer) = i * 100 * GST_MSECOND;
+    GST_BUFFER_DURATION (buffer) = 100 * GST_MSECOND;
+    ck_assert_int_eq (gst_pad_chain (queue_sinkpad, buffer), GST_FLOW_OK);
+  }
+  gst_pad_send_event (queue_sinkpad, gst_event_new_eos ());
+
+  g_idle_add ((GSourceFunc) set_playing, bin);
+  g_main_loop_run (main_loop);
+
+  fail_unless_equals_int (g_list_length (received_buffers), 3);
+  for (i = 0, l = received_buffers; l; l = l->next, i++) {
+    gst_buffer_map (l->data, &map, GST_MAP_READ);
+    samples = (gfloat *) map.data;
+    if (i == 0) {
+      fail_unless_equals_float (samples[0], 1.0);
+      fail_unless_equals_float (samples[99], 1.0);
+    } else if (i == 1) {
+      /* ramps down instead of jumping */
+      fail_unless_equals_float (samples[0], 1.0);
+      fail_unless_equals_float (samples[50], 0.75);
+      fail_unless_equals_float (samples[99], 0.505);
+    } else {
+      fail_unless_equals_float (samples[0], 0.5);
+      fail_unless_equals_float (samples[99], 0.5);
+    }
+    gst_buffer_unmap (l->data, &map);
+  }
+
+  g_list_free_full (received_buffers, (GDestroyNotify) gst_buffer_unref);
+  gst_element_release_request_pad (audiomixer, sinkpad);
+  gst_object_unref (sinkpad);
+  gst_object_unref (queue_sinkpad);
+  gst_element_set_state (bin, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  gst_object_unref (bus);
+  gst_object_unref (bin);
+  g_main_loop_unref (main_loop);
+}
+
+GST_END_TEST;
+
+#define SPEED_FRAMES 1024
+
+typedef struct
+{
+  guint n_buffers;
+  guint32 hash;
+} MixOutput;
+
+static void
+hash_buffer_cb (GstElement * fakesink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  MixOutput *output = user_data;
+  GstMapInfo map;
+  gsize i;
+
+  output->n_buffers++;
+
+  /* FNV-1a */
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  for (i = 0; i < map.size; i++)
+    output->hash = (output->hash ^ map.data[i]) * 16777619;
+  gst_buffer_unmap (buffer, &map);
+}
+
+/* Mixes @n_pads inputs of @n_buffers buffers each with @threads threads,
+ * @format has to have 32 bit samples. Returns the number of input samples
+ * mixed per second */
+static gdouble
+run_mix (const gchar * format, gint channels, gint rate, gint n_pads,
+    gint n_buffers, guint threads, guint32 * hash)
+{
+  GstSegment segment;
+  GstElement *bin, *audiomixer, *sink, *queue;
+  GstPad **sinkpads, **queue_sinkpads;
+  GstBus *bus;
+  GstPad *pad;
+  GstStateChangeReturn state_res;
+  GstBuffer *buffer, *copy;
+  GstMapInfo map;
+  GstCaps *caps;
+  MixOutput output = { 0, 2166136261u };
+  gint64 start, elapsed;
+  GRand *rand;
+  gint i, j;
+
+  main_loop = g_main_loop_new (NULL, FALSE);
+
+  bin = gst_pipeline_new ("pipeline");
+  bus = gst_element_get_bus (bin);
+  gst_bus_add_signal_watch_full (bus, G_PRIORITY_HIGH);
+
+  g_signal_connect (bus, "message::error", (GCallback) message_received, bin);
+  g_signal_connect (bus, "message::warning", (GCallback) message_received, bin);
+  g_signal_connect (bus, "message::eos", (GCallback) message_received, bin);
+
+  audiomixer = gst_element_factory_make ("audiomixer", "audiomixer");
+  g_object_set (audiomixer, "blocksize", SPEED_FRAMES, "threads", threads,
+      NULL);
+  sink = gst_element_factory_make ("fakesink", "sink");
+  g_object_set (sink, "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", (GCallback) hash_buffer_cb, &output);
+  gst_bin_add_many (GST_BIN (bin), audiomixer, sink, NULL);
+  fail_unless (gst_element_link (audiomixer, sink));
+
+  state_res = gst_element_set_state (bin, GST_STATE_PAUSED);
+  ck_assert_int_ne (state_res, GST_STATE_CHANGE_FAILURE);
+
+  caps = gst_caps_new_simple ("audio/x-raw",
+      "format", G_TYPE_STRING, format,
+      "layout", G_TYPE_STRING, "interleaved",
+      "rate", G_TYPE_INT, rate, "channels", G_TYPE_INT, channels, NULL);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+
+  sinkpads = g_new (GstPad *, n_pads);
+  queue_sinkpads = g_new (GstPad *, n_pads);
+  rand = g_rand_new_with_seed (0);
+
+  for (i = 0; i < n_pads; i++) {
+    queue = gst_element_factory_make ("queue", NULL);
+    g_object_set (queue, "max-size-buffers", 0, "max-size-bytes", 0,
+        "max-size-time", (guint64) 0, NULL);
+    gst_bin_add (GST_BIN (bin), queue);
+    gst_element_sync_state_with_parent (queue);
+
+    sinkpads[i] = gst_element_get_request_pad (audiomixer, "sink_%u");
+    fail_if (sinkpads[i] == NULL, NULL);
+    queue_sinkpads[i] = gst_element_get_static_pad (queue, "sink");
+    pad = gst_element_get_static_pad (queue, "src");
+    fail_unless (gst_pad_link (pad, sinkpads[i]) == GST_PAD_LINK_OK);
+    gst_object_unref (pad);
+
+    gst_pad_send_event (queue_sinkpads[i], gst_event_new_stream_start ("test"));
+    gst_pad_set_caps (queue_sinkpads[i], caps);
+    gst_pad_send_event (queue_sinkpads[i], gst_event_new_segment (&segment));
+
+    /* one buffer per pad, shared by all of its timestamps */
+    buffer = gst_buffer_new_and_alloc (SPEED_FRAMES * channels * 4);
+    gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+    if (g_str_has_prefix (format, "F32")) {
+      for (j = 0; j < SPEED_FRAMES * channels; j++)
+        ((gfloat *) map.data)[j] = g_rand_double_range (rand, -1.0, 1.0);
+    } else {
+      for (j = 0; j < SPEED_FRAMES * channels; j++)
+        ((guint32 *) map.data)[j] = g_rand_int (rand);
+    }
+    gst_buffer_unmap (buffer, &map);
+
+    for (j = 0; j < n_buffers; j++) {
+      copy = gst_buffer_copy (buffer);
+      GST_BUFFER_TIMESTAMP (copy) =
+          gst_util_uint64_scale (j * SPEED_FRAMES, GST_SECOND, rate);
+      GST_BUFFER_DURATION (copy) =
+          gst_util_uint64_scale ((j + 1) * SPEED_FRAMES, GST_SECOND, rate) -
+          GST_BUFFER_TIMESTAMP (copy);
+      ck_assert_int_eq (gst_pad_chain (queue_sinkpads[i], copy), GST_FLOW_OK);
+    }
+    gst_pad_send_event (queue_sinkpads[i], gst_event_new_eos ());
+    gst_buffer_unref (buffer);
+  }
+  g_rand_free (rand);
+  gst_caps_unref (caps);
+
+  start = g_get_monotonic_time ();
+  g_idle_add ((GSourceFunc) set_playing, bin);
+  g_main_loop_run (main_loop);
+  elapsed = g_get_monotonic_time () - start;
+
+  fail_unless_equals_int (output.n_buffers, n_buffers);
+  if (hash)
+    *hash = output.hash;
+
+  for (i = 0; i < n_pads; i++) {
+    gst_element_release_request_pad (audiomixer, sinkpads[i]);
+    gst_object_unref (sinkpads[i]);
+    gst_object_unref (queue_sinkpads[i]);
+  }
+  g_free (sinkpads);
+  g_free (queue_sinkpads);
+  gst_element_set_state (bin, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  gst_object_unref (bus);
+  gst_object_unref (bin);
+  g_main_loop_unref (main_loop);
+
+  return (gdouble) n_pads * n_buffers * SPEED_FRAMES * channels *
+      G_USEC_PER_SEC / MAX (elapsed, 1);
+}
+
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+#define NE(format) format "BE"
+#else
+#define NE(format) format "LE"
+#endif
+
+/* Benchmark, mixes many stereo float pads */
+GST_START_TEST (test_mix_speed)
+{
+  GST_INFO ("mixed 64 float stereo pads: %.0f samples/s",
+      run_mix (NE ("F32"), 2, 48000, 64, 200, 1, NULL));
+}
+
+GST_END_TEST;
+
+/* Benchmark of how mixing scales with the threads */
+GST_START_TEST (test_mix_threads_speed)
+{
+  guint threads;
+
+  for (threads = 1; threads <= 8; threads *= 2)
+    GST_INFO ("mixed 128 float 8 channel pads with %u threads: %.0f "
+        "samples/s", threads,
+        run_mix (NE ("F32"), 8, 96000, 128, 50, threads, NULL));
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_mix_threads_exact)
+{
+  guint32 hash1, hash4;
+
+  /* saturating integers, with blocks several tiles long */
+  run_mix (NE ("S32"), 2, 48000, 16, 20, 1, &hash1);
+  run_mix (NE ("S32"), 2, 48000, 16, 20, 4, &hash4);
+  fail_unless_equals_int (hash1, hash4);
+
+  run_mix (NE ("F32"), 2, 48000, 16, 20, 1, &hash1);
+  run_mix (NE ("F32"), 2, 48000, 16, 20, 4, &hash4);
+  fail_unless_equals_int (hash1, hash4);
+}
+
+GST_END_TEST;
+
+static GstPadProbeReturn
+drop_buffer_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  return GST_PAD_PROBE_DROP;
+}
+
+static void
+quit_after_buffers_cb (GstElement * fakesink, GstBuffer * buffer,
+    GstPad * pad, gpointer user_data)
+{
+  guint *n_buffers = user_data;
+
+  if (++(*n_buffers) == 10)
+    g_main_loop_quit (main_loop);
+}
+
+static gboolean
+quit_main_loop (gpointer user_data)
+{
+  guint *timeout = user_data;
+
+  *timeout = 0;
+  g_main_loop_quit (main_loop);
+
+  return FALSE;
+}
+
+/* a live input that stalls must not stall the mix */
+GST_START_TEST (test_live_timeout)
+{
+  GstElement *bin, *src1, *src2, *audiomixer, *sink;
+  GstBus *bus;
+  GstPad *srcpad;
+  GstStateChangeReturn state_res;
+  guint n_buffers = 0, timeout;
+
+  main_loop = g_main_loop_new (NULL, FALSE);
+
+  bin = gst_pipeline_new ("pipeline");
+  bus = gst_element_get_bus (bin);
+  gst_bus_add_signal_watch_full (bus, G_PRIORITY_HIGH);
+  g_signal_connect (bus, "message::error", (GCallback) message_received, bin);
+  g_signal_connect (bus, "message::warning", (GCallback) message_received, bin);
+
+  src1 = gst_element_factory_make ("audiotestsrc", "src1");
+  g_object_set (src1, "wave", 4, "is-live", TRUE, NULL);        /* silence */
+  src2 = gst_element_factory_make ("audiotestsrc", "src2");
+  g_object_set (src2, "wave", 4, "is-live", TRUE, NULL);        /* silence */
+  audiomixer = gst_element_factory_make ("audiomixer", "audiomixer");
+  sink = gst_element_factory_make ("fakesink", "sink");
+  g_object_set (sink, "sync", TRUE, "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", (GCallback) quit_after_buffers_cb,
+      &n_buffers);
+  gst_bin_add_many (GST_BIN (bin), src1, src2, audiomixer, sink, NULL);
+
+  fail_unless (gst_element_link (src1, audiomixer));
+  fail_unless (gst_element_link (src2, audiomixer));
+  fail_unless (gst_element_link (audiomixer, sink));
+
+  /* src2 never delivers any data */
+  srcpad = gst_element_get_static_pad (src2, "src");
+  gst_pad_add_probe (srcpad, GST_PAD_PROBE_TYPE_BUFFER, drop_buffer_probe,
+      NULL, NULL);
+  gst_object_unref (srcpad);
+
+  timeout = g_timeout_add_seconds (5, quit_main_loop, &timeout);
+
+  state_res = gst_element_set_state (bin, GST_STATE_PLAYING);
+  ck_assert_int_ne (state_res, GST_STATE_CHANGE_FAILURE);
+
+  g_main_loop_run (main_loop);
+  if (timeout)
+    g_source_remove (timeout);
+
+  fail_unless (n_buffers >= 10, "got only %u buffers", n_buffers);
+
+  gst_element_set_state (bin, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  gst_object_unref (bus);
+  gst_object_unref (bin);
+  g_main_loop_unref (main_loop);
+}
+
+GST_END_TEST;
+
 static Suite *
 audiomixer_suite (void)
 {
@@ -1748,6 +2152,15 @@ audiomixer_suite (void)
   tcase_add_test (tc_chain, test_sync);
   tcase_add_test (tc_chain, test_sync_discont);
   tcase_add_test (tc_chain, test_sync_unaligned);
+  tcase_add_test (tc_chain, test_volume_ramp);
+  tcase_add_test (tc_chain, test_live_timeout);
+  tcase_add_test (tc_chain, test_mix_threads_exact);
+
+  /* the benchmarks take a while, only run them on request */
+  if (g_getenv ("GST_CHECK_BENCHMARKS")) {
+    tcase_add_test (tc_chain, test_mix_speed);
+    tcase_add_test (tc_chain, test_mix_threads_speed);
+  }
 
   /* Use a longer timeout */
 #ifdef HAVE_VALGRIND
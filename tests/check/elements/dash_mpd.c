@@ -0,0 +1,278 @@
+/* GStreamer
+ *
+ * unit test for the DASH manifest updates
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include "../../ext/dash/gstmpdparser.c"
+
+GST_DEBUG_CATEGORY (gst_dash_demux_debug);
+
+#define MPD_HEAD \
+  "<?xml version=\"1.0\"?>" \
+  "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" type=\"dynamic\"" \
+  "     availabilityStartTime=\"2015-01-01T00:00:00Z\"" \
+  "     minimumUpdatePeriod=\"PT2S\"" \
+  "     profiles=\"urn:mpeg:dash:profile:isoff-live:2011\">" \
+  "  <BaseURL>http://example.com/</BaseURL>"
+
+#define MPD_PERIOD(id, start, number, timeline) \
+  "  <Period id=\"" id "\" start=\"" start "\">" \
+  "    <AdaptationSet id=\"1\" mimeType=\"video/mp2t\">" \
+  "      <SegmentTemplate timescale=\"1\" media=\"" id "-$Number$.ts\"" \
+  "                       startNumber=\"" number "\">" \
+  "        <SegmentTimeline>" timeline "</SegmentTimeline>" \
+  "      </SegmentTemplate>" \
+  "      <Representation id=\"v\" bandwidth=\"250000\"/>" \
+  "    </AdaptationSet>" \
+  "  </Period>"
+
+#define MPD_TAIL "</MPD>"
+
+static GstMpdClient *
+setup_client (const gchar * xml)
+{
+  GstMpdClient *client = gst_mpd_client_new ();
+
+  fail_unless (gst_mpd_parse (client, xml, strlen (xml)));
+  fail_unless (gst_mpd_client_setup_media_presentation (client));
+  fail_unless (gst_mpd_client_setup_streaming (client, GST_STREAM_VIDEO, ""));
+
+  return client;
+}
+
+static void
+set_period (GstMpdClient * client, guint period_idx)
+{
+  gst_active_streams_free (client);
+  fail_unless (gst_mpd_client_set_period_index (client, period_idx));
+  fail_unless (gst_mpd_client_setup_streaming (client, GST_STREAM_VIDEO, ""));
+}
+
+/* moves the stream of @client to its @idx segment and returns its start */
+static GstClockTime
+move_to_segment (GstMpdClient * client, guint idx)
+{
+  GstClockTime ts = GST_CLOCK_TIME_NONE;
+
+  gst_mpd_client_set_segment_index (client->active_streams->data, idx);
+  fail_unless (gst_mpd_client_get_next_fragment_timestamp (client, 0, &ts));
+
+  return ts;
+}
+
+/* checks that the merged @client lists the segments of @expected, which was
+ * parsed from the full update */
+static void
+check_segments (GstMpdClient * client, GstMpdClient * expected)
+{
+  GstActiveStream *stream = client->active_streams->data;
+  GstActiveStream *expected_stream = expected->active_streams->data;
+  GstMediaFragmentInfo fragment, expected_fragment;
+  guint idx, expected_idx, i;
+  gboolean ret, expected_ret;
+
+  fail_unless_equals_int (gst_mpd_client_get_segments_counts (stream),
+      gst_mpd_client_get_segments_counts (expected_stream));
+
+  idx = gst_mpd_client_get_segment_index (stream);
+  expected_idx = gst_mpd_client_get_segment_index (expected_stream);
+  for (i = 0;; i++) {
+    gst_mpd_client_set_segment_index (stream, i);
+    gst_mpd_client_set_segment_index (expected_stream, i);
+    ret = gst_mpd_client_get_next_fragment (client, 0, &fragment);
+    expected_ret =
+        gst_mpd_client_get_next_fragment (expected, 0, &expected_fragment);
+    fail_unless_equals_int (ret, expected_ret);
+    if (!ret)
+      break;
+
+    fail_unless_equals_string (fragment.uri, expected_fragment.uri);
+    fail_unless_equals_uint64 (fragment.timestamp, expected_fragment.timestamp);
+    fail_unless_equals_uint64 (fragment.duration, expected_fragment.duration);
+    gst_media_fragment_info_clear (&fragment);
+    gst_media_fragment_info_clear (&expected_fragment);
+  }
+  gst_mpd_client_set_segment_index (stream, idx);
+  gst_mpd_client_set_segment_index (expected_stream, expected_idx);
+}
+
+/* merges @xml into @client and checks it against a full parse of @xml,
+ * @client has to stay on the segment starting at @ts */
+static void
+check_update (GstMpdClient * client, const gchar * xml, GstClockTime ts)
+{
+  GstMpdClient *update, *expected;
+  GstActiveStream *expected_stream;
+  GstClockTime next_ts = GST_CLOCK_TIME_NONE;
+
+  update = gst_mpd_client_new ();
+  fail_unless (gst_mpd_parse (update, xml, strlen (xml)));
+  fail_unless (gst_mpd_client_merge_update (client, update));
+  gst_mpd_client_free (update);
+
+  expected = setup_client (xml);
+  expected_stream = expected->active_streams->data;
+  gst_mpd_client_set_segment_index (expected_stream,
+      gst_mpd_client_get_segment_index_for_position (expected,
+          expected_stream, ts));
+
+  check_segments (client, expected);
+  fail_unless (gst_mpd_client_get_next_fragment_timestamp (client, 0,
+          &next_ts));
+  fail_unless_equals_uint64 (next_ts, ts);
+  fail_unless_equals_int (gst_mpd_client_get_segment_index (client->
+          active_streams->data),
+      gst_mpd_client_get_segment_index (expected_stream));
+
+  gst_mpd_client_free (expected);
+}
+
+GST_START_TEST (test_merge_append)
+{
+  GstMpdClient *client;
+  GstClockTime ts;
+
+  client = setup_client (MPD_HEAD
+      MPD_PERIOD ("p0", "PT0S", "1", "<S t=\"0\" d=\"2\" r=\"2\"/>")
+      MPD_TAIL);
+  ts = move_to_segment (client, 2);
+  fail_unless_equals_uint64 (ts, 4 * GST_SECOND);
+
+  /* the known segments are listed again, followed by new ones */
+  check_update (client, MPD_HEAD
+      MPD_PERIOD ("p0", "PT0S", "1",
+          "<S t=\"0\" d=\"2\" r=\"3\"/><S d=\"3\" r=\"1\"/>")
+      MPD_TAIL, ts);
+  fail_unless_equals_int (gst_mpd_client_get_segments_counts (client->
+          active_streams->data), 6);
+
+  gst_mpd_client_free (client);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_merge_drop)
+{
+  GstMpdClient *client;
+  GstClockTime ts;
+
+  client = setup_client (MPD_HEAD
+      MPD_PERIOD ("p0", "PT0S", "1", "<S d=\"2\" r=\"4\"/>")
+      MPD_TAIL);
+  ts = move_to_segment (client, 3);
+  fail_unless_equals_uint64 (ts, 6 * GST_SECOND);
+
+  /* the first two segments went out of the window, the update starts in the
+   * middle of the known S node */
+  check_update (client, MPD_HEAD
+      MPD_PERIOD ("p0", "PT0S", "3",
+          "<S t=\"4\" d=\"2\" r=\"3\"/><S d=\"4\"/>")
+      MPD_TAIL, ts);
+  fail_unless_equals_int (gst_mpd_client_get_segment_index (client->
+          active_streams->data), 1);
+
+  /* only the last known segment is still in the window */
+  ts = move_to_segment (client, 4);
+  fail_unless_equals_uint64 (ts, 12 * GST_SECOND);
+  check_update (client, MPD_HEAD
+      MPD_PERIOD ("p0", "PT0S", "7",
+          "<S t=\"12\" d=\"4\"/><S d=\"2\" r=\"1\"/>")
+      MPD_TAIL, ts);
+  fail_unless_equals_int (gst_mpd_client_get_segment_index (client->
+          active_streams->data), 0);
+
+  gst_mpd_client_free (client);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_merge_period)
+{
+  GstMpdClient *client, *update, *expected;
+  GstClockTime ts;
+  const gchar *xml;
+  GList *list, *expected_list;
+
+  client = setup_client (MPD_HEAD
+      MPD_PERIOD ("p0", "PT0S", "1", "<S t=\"0\" d=\"2\" r=\"2\"/>")
+      MPD_TAIL);
+  ts = move_to_segment (client, 1);
+
+  /* a new Period starts after the current one */
+  xml = MPD_HEAD
+      MPD_PERIOD ("p0", "PT0S", "1", "<S t=\"0\" d=\"2\" r=\"2\"/>")
+      MPD_PERIOD ("p1", "PT6S", "1", "<S t=\"0\" d=\"2\" r=\"1\"/>")
+      MPD_TAIL;
+  check_update (client, xml, ts);
+
+  expected = setup_client (xml);
+  fail_unless_equals_int (g_list_length (client->periods),
+      g_list_length (expected->periods));
+  for (list = client->periods, expected_list = expected->periods; list;
+      list = g_list_next (list), expected_list = g_list_next (expected_list)) {
+    GstStreamPeriod *period = list->data;
+    GstStreamPeriod *expected_period = expected_list->data;
+
+    fail_unless_equals_uint64 (period->start, expected_period->start);
+    fail_unless_equals_uint64 (period->duration, expected_period->duration);
+  }
+
+  set_period (client, 1);
+  set_period (expected, 1);
+  check_segments (client, expected);
+  gst_mpd_client_free (expected);
+
+  /* the Periods changed, the update can't be merged and has to replace the
+   * client */
+  expected = setup_client (xml);
+  set_period (expected, 1);
+  update = gst_mpd_client_new ();
+  xml = MPD_HEAD
+      MPD_PERIOD ("p2", "PT0S", "1", "<S t=\"0\" d=\"2\" r=\"5\"/>")
+      MPD_TAIL;
+  fail_unless (gst_mpd_parse (update, xml, strlen (xml)));
+  fail_if (gst_mpd_client_merge_update (client, update));
+  check_segments (client, expected);
+  gst_mpd_client_free (update);
+  gst_mpd_client_free (expected);
+
+  gst_mpd_client_free (client);
+}
+
+GST_END_TEST;
+
+static Suite *
+dash_mpd_suite (void)
+{
+  Suite *s = suite_create ("dash_mpd");
+  TCase *tc_chain = tcase_create ("general");
+
+  GST_DEBUG_CATEGORY_INIT (gst_dash_demux_debug, "dashdemux", 0,
+      "dashdemux tests");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_merge_append);
+  tcase_add_test (tc_chain, test_merge_drop);
+  tcase_add_test (tc_chain, test_merge_period);
+
+  return s;
+}
+
+GST_CHECK_MAIN (dash_mpd);
@@ -0,0 +1,592 @@
+/* GStreamer
+ *
+ * unit test for hlsdemux
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/base/gstbasesrc.h>
+#include <string.h>
+
+#define TS_PACKET_SIZE 188
+#define N_FRAGMENTS 6
+#define LOW_PACKETS 50
+#define HIGH_PACKETS 100
+/* The source serves the fragments in several buffers */
+#define CHUNK_SIZE (10 * TS_PACKET_SIZE)
+
+#define URI_PREFIX "hlstest://localhost/"
+
+/* Files served by the hlstest:// source, and the files requested so far */
+static GHashTable *files = NULL;
+static GMutex requests_lock;
+static GPtrArray *requests = NULL;
+
+/* The files whose URI ends with @fail_suffix fail from @fail_offset on */
+static const gchar *fail_suffix = NULL;
+static guint64 fail_offset = 0;
+
+/* What the sink received, in progressive mode */
+typedef struct
+{
+  GstClockTime pts;
+  GstClockTime duration;
+  gboolean discont;
+  gsize size;
+} PushedBuffer;
+
+static GMutex pushed_lock;
+static GArray *pushed = NULL;
+
+/* A source serving the files from memory, for the playlists and for the
+ * fragments the demuxer downloads */
+typedef struct
+{
+  GstBaseSrc parent;
+
+  gchar *uri;
+} GstHlsTestSrc;
+
+typedef struct
+{
+  GstBaseSrcClass parent_class;
+} GstHlsTestSrcClass;
+
+static GType gst_hls_test_src_get_type (void);
+static void gst_hls_test_src_uri_handler_init (gpointer g_iface,
+    gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (GstHlsTestSrc, gst_hls_test_src, GST_TYPE_BASE_SRC,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER,
+        gst_hls_test_src_uri_handler_init));
+
+static GstStaticPadTemplate hls_test_src_template =
+GST_STATIC_PAD_TEMPLATE ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GBytes *
+gst_hls_test_src_get_file (GstHlsTestSrc * src)
+{
+  GBytes *file = NULL;
+
+  GST_OBJECT_LOCK (src);
+  if (src->uri)
+    file = g_hash_table_lookup (files, src->uri);
+  GST_OBJECT_UNLOCK (src);
+
+  return file;
+}
+
+static gboolean
+gst_hls_test_src_start (GstBaseSrc * basesrc)
+{
+  return gst_hls_test_src_get_file ((GstHlsTestSrc *) basesrc) != NULL;
+}
+
+static gboolean
+gst_hls_test_src_get_size (GstBaseSrc * basesrc, guint64 * size)
+{
+  GBytes *file = gst_hls_test_src_get_file ((GstHlsTestSrc *) basesrc);
+
+  if (file == NULL)
+    return FALSE;
+
+  *size = g_bytes_get_size (file);
+  return TRUE;
+}
+
+static gboolean
+gst_hls_test_src_is_seekable (GstBaseSrc * basesrc)
+{
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_hls_test_src_create (GstBaseSrc * basesrc, guint64 offset, guint length,
+    GstBuffer ** buf)
+{
+  GstHlsTestSrc *src = (GstHlsTestSrc *) basesrc;
+  GBytes *file = gst_hls_test_src_get_file (src);
+  gsize size;
+
+  if (file == NULL) {
+    GST_ELEMENT_ERROR (src, RESOURCE, NOT_FOUND, (NULL), (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  size = g_bytes_get_size (file);
+  if (offset >= size)
+    return GST_FLOW_EOS;
+
+  if (fail_suffix && offset >= fail_offset) {
+    gboolean fail;
+
+    GST_OBJECT_LOCK (src);
+    fail = g_str_has_suffix (src->uri, fail_suffix);
+    GST_OBJECT_UNLOCK (src);
+    if (fail) {
+      GST_ELEMENT_ERROR (src, RESOURCE, READ, (NULL), (NULL));
+      return GST_FLOW_ERROR;
+    }
+  }
+
+  if (offset == 0) {
+    g_mutex_lock (&requests_lock);
+    GST_OBJECT_LOCK (src);
+    g_ptr_array_add (requests, g_strdup (src->uri));
+    GST_OBJECT_UNLOCK (src);
+    g_mutex_unlock (&requests_lock);
+  }
+
+  length = MIN (length, size - offset);
+  *buf = gst_buffer_new_allocate (NULL, length, NULL);
+  gst_buffer_fill (*buf, 0, (const guint8 *) g_bytes_get_data (file,
+          NULL) + offset, length);
+  GST_BUFFER_OFFSET (*buf) = offset;
+
+  return GST_FLOW_OK;
+}
+
+static void
+gst_hls_test_src_finalize (GObject * object)
+{
+  g_free (((GstHlsTestSrc *) object)->uri);
+
+  G_OBJECT_CLASS (gst_hls_test_src_parent_class)->finalize (object);
+}
+
+static void
+gst_hls_test_src_class_init (GstHlsTestSrcClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+
+  gobject_class->finalize = gst_hls_test_src_finalize;
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&hls_test_src_template));
+  gst_element_class_set_static_metadata (element_class,
+      "HLS test source", "Source/Network", "Serves files from memory",
+      "GStreamer maintainers <gstreamer-devel@lists.freedesktop.org>");
+
+  basesrc_class->start = gst_hls_test_src_start;
+  basesrc_class->get_size = gst_hls_test_src_get_size;
+  basesrc_class->is_seekable = gst_hls_test_src_is_seekable;
+  basesrc_class->create = gst_hls_test_src_create;
+}
+
+static void
+gst_hls_test_src_init (GstHlsTestSrc * src)
+{
+  gst_base_src_set_format (GST_BASE_SRC (src), GST_FORMAT_BYTES);
+  gst_base_src_set_blocksize (GST_BASE_SRC (src), CHUNK_SIZE);
+}
+
+static GstURIType
+gst_hls_test_src_uri_get_type (GType type)
+{
+  return GST_URI_SRC;
+}
+
+static const gchar *const *
+gst_hls_test_src_uri_get_protocols (GType type)
+{
+  static const gchar *protocols[] = { "hlstest", NULL };
+
+  return protocols;
+}
+
+static gchar *
+gst_hls_test_src_uri_get_uri (GstURIHandler * handler)
+{
+  GstHlsTestSrc *src = (GstHlsTestSrc *) handler;
+  gchar *uri;
+
+  GST_OBJECT_LOCK (src);
+  uri = g_strdup (src->uri);
+  GST_OBJECT_UNLOCK (src);
+
+  return uri;
+}
+
+static gboolean
+gst_hls_test_src_uri_set_uri (GstURIHandler * handler, const gchar * uri,
+    GError ** error)
+{
+  GstHlsTestSrc *src = (GstHlsTestSrc *) handler;
+
+  GST_OBJECT_LOCK (src);
+  g_free (src->uri);
+  src->uri = g_strdup (uri);
+  GST_OBJECT_UNLOCK (src);
+
+  return TRUE;
+}
+
+static void
+gst_hls_test_src_uri_handler_init (gpointer g_iface, gpointer iface_data)
+{
+  GstURIHandlerInterface *iface = (GstURIHandlerInterface *) g_iface;
+
+  iface->get_type = gst_hls_test_src_uri_get_type;
+  iface->get_protocols = gst_hls_test_src_uri_get_protocols;
+  iface->get_uri = gst_hls_test_src_uri_get_uri;
+  iface->set_uri = gst_hls_test_src_uri_set_uri;
+}
+
+/* MPEG-TS null packets, enough for the fragments to be typefound */
+static GBytes *
+make_fragment (guint n_packets)
+{
+  guint8 *data = g_malloc (n_packets * TS_PACKET_SIZE);
+  guint i;
+
+  memset (data, 0xff, n_packets * TS_PACKET_SIZE);
+  for (i = 0; i < n_packets; i++) {
+    data[i * TS_PACKET_SIZE] = 0x47;
+    data[i * TS_PACKET_SIZE + 1] = 0x1f;
+    data[i * TS_PACKET_SIZE + 2] = 0xff;
+    data[i * TS_PACKET_SIZE + 3] = 0x10;
+  }
+
+  return g_bytes_new_take (data, n_packets * TS_PACKET_SIZE);
+}
+
+static void
+add_file (const gchar * uri, GBytes * data)
+{
+  g_hash_table_insert (files, g_strdup (uri), data);
+}
+
+static void
+add_text_file (const gchar * uri, const gchar * text)
+{
+  add_file (uri, g_bytes_new (text, strlen (text)));
+}
+
+/* Adds a media playlist named @name and its fragments */
+static void
+add_media_playlist (const gchar * name, guint n_packets)
+{
+  GString *playlist;
+  gchar *uri;
+  guint i;
+
+  playlist = g_string_new ("#EXTM3U\n#EXT-X-TARGETDURATION:1\n"
+      "#EXT-X-MEDIA-SEQUENCE:0\n");
+  for (i = 0; i < N_FRAGMENTS; i++) {
+    uri = g_strdup_printf (URI_PREFIX "%s/%u.ts", name, i);
+    g_string_append_printf (playlist, "#EXTINF:1,\n%s\n", uri);
+    add_file (uri, make_fragment (n_packets));
+    g_free (uri);
+  }
+  g_string_append (playlist, "#EXT-X-ENDLIST\n");
+
+  uri = g_strdup_printf (URI_PREFIX "%s.m3u8", name);
+  add_text_file (uri, playlist->str);
+  g_free (uri);
+  g_string_free (playlist, TRUE);
+}
+
+static void
+setup_hls (void)
+{
+  files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) g_bytes_unref);
+  requests = g_ptr_array_new_with_free_func (g_free);
+  pushed = g_array_new (FALSE, FALSE, sizeof (PushedBuffer));
+  fail_suffix = NULL;
+  fail_offset = 0;
+
+  gst_element_register (NULL, "hlstestsrc", GST_RANK_PRIMARY,
+      gst_hls_test_src_get_type ());
+
+  add_text_file (URI_PREFIX "master.m3u8", "#EXTM3U\n"
+      "#EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=100000\n"
+      URI_PREFIX "low.m3u8\n"
+      "#EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=1000000\n"
+      URI_PREFIX "high.m3u8\n");
+  add_media_playlist ("low", LOW_PACKETS);
+  add_media_playlist ("high", HIGH_PACKETS);
+}
+
+static void
+teardown_hls (void)
+{
+  g_hash_table_unref (files);
+  files = NULL;
+  g_ptr_array_unref (requests);
+  requests = NULL;
+  g_array_unref (pushed);
+  pushed = NULL;
+}
+
+static void
+pad_added_cb (GstElement * demux, GstPad * pad, GstElement * sink)
+{
+  GstPad *sinkpad = gst_element_get_static_pad (sink, "sink");
+
+  /* Pads are replaced when the caps change */
+  if (gst_pad_is_linked (sinkpad)) {
+    GstPad *peer = gst_pad_get_peer (sinkpad);
+
+    gst_pad_unlink (peer, sinkpad);
+    gst_object_unref (peer);
+  }
+  fail_unless (gst_pad_link (pad, sinkpad) == GST_PAD_LINK_OK);
+  gst_object_unref (sinkpad);
+}
+
+static GstElement *
+create_pipeline (GstElement ** demux)
+{
+  GstElement *pipeline, *src, *sink;
+
+  pipeline = gst_pipeline_new (NULL);
+  src = gst_element_make_from_uri (GST_URI_SRC, URI_PREFIX "master.m3u8",
+      NULL, NULL);
+  fail_unless (src != NULL);
+  *demux = gst_element_factory_make ("hlsdemux", NULL);
+  fail_unless (*demux != NULL);
+  sink = gst_element_factory_make ("fakesink", "sink");
+  g_object_set (sink, "sync", FALSE, NULL);
+
+  gst_bin_add_many (GST_BIN (pipeline), src, *demux, sink, NULL);
+  fail_unless (gst_element_link (src, *demux));
+  g_signal_connect (*demux, "pad-added", G_CALLBACK (pad_added_cb), sink);
+
+  return pipeline;
+}
+
+GST_START_TEST (test_fetch_accounting)
+{
+  GstElement *pipeline, *demux;
+  GstBus *bus;
+  GstMessage *msg;
+  guint64 n_fetched, bytes_fetched, fetch_time, expected_bytes = 0;
+  gint switched_bitrate = 0;
+  guint i, n_fragments = 0, n_high = 0;
+
+  pipeline = create_pipeline (&demux);
+  g_object_set (demux, "fragments-cache", 2, NULL);
+
+  bus = gst_element_get_bus (pipeline);
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  do {
+    msg = gst_bus_timed_pop_filtered (bus, 20 * GST_SECOND,
+        GST_MESSAGE_EOS | GST_MESSAGE_ERROR | GST_MESSAGE_ELEMENT);
+    fail_unless (msg != NULL, "timed out");
+    fail_if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR);
+
+    if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ELEMENT &&
+        gst_message_has_name (msg, "playlist"))
+      gst_structure_get_int (gst_message_get_structure (msg), "bitrate",
+          &switched_bitrate);
+    if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS) {
+      gst_message_unref (msg);
+      break;
+    }
+    gst_message_unref (msg);
+  } while (TRUE);
+
+  g_object_get (demux, "fragments-fetched", &n_fetched, "bytes-fetched",
+      &bytes_fetched, "average-fetch-time", &fetch_time, NULL);
+
+  /* Only the fragments count, not the playlists */
+  g_mutex_lock (&requests_lock);
+  for (i = 0; i < requests->len; i++) {
+    const gchar *uri = g_ptr_array_index (requests, i);
+
+    if (!g_str_has_suffix (uri, ".ts"))
+      continue;
+    n_fragments++;
+    if (g_str_has_prefix (uri, URI_PREFIX "high/"))
+      n_high++;
+    expected_bytes += g_bytes_get_size (g_hash_table_lookup (files, uri));
+  }
+  g_mutex_unlock (&requests_lock);
+
+  fail_unless_equals_int (n_fragments, N_FRAGMENTS);
+  fail_unless_equals_uint64 (n_fetched, N_FRAGMENTS);
+  fail_unless_equals_uint64 (bytes_fetched, expected_bytes);
+  fail_unless (fetch_time > 0);
+
+  /* The local downloads are faster than both variants, so the demuxer
+   * switches to the high one once it knows how fast they are */
+  fail_unless_equals_int (switched_bitrate, 1000000);
+  fail_unless (n_high > 0);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (bus);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+static void
+handoff_cb (GstElement * sink, GstBuffer * buf, GstPad * pad, gpointer data)
+{
+  PushedBuffer pushed_buf;
+
+  pushed_buf.pts = GST_BUFFER_PTS (buf);
+  pushed_buf.duration = GST_BUFFER_DURATION (buf);
+  pushed_buf.discont = GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DISCONT);
+  pushed_buf.size = gst_buffer_get_size (buf);
+
+  g_mutex_lock (&pushed_lock);
+  g_array_append_val (pushed, pushed_buf);
+  g_mutex_unlock (&pushed_lock);
+}
+
+/* Runs @pipeline in progressive mode until EOS or an error, which is
+ * returned */
+static GstMessageType
+run_progressive (GstElement * pipeline, GstElement * demux)
+{
+  GstElement *sink;
+  GstBus *bus;
+  GstMessage *msg;
+  GstMessageType type;
+
+  g_object_set (demux, "progressive", TRUE, NULL);
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_object_set (sink, "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (handoff_cb), NULL);
+  gst_object_unref (sink);
+
+  bus = gst_element_get_bus (pipeline);
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+  msg = gst_bus_timed_pop_filtered (bus, 20 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL, "timed out");
+  type = GST_MESSAGE_TYPE (msg);
+  gst_message_unref (msg);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (bus);
+
+  return type;
+}
+
+/* Checks that the buffers of each fragment were pushed in order, the first
+ * one carrying the timestamp and duration of the fragment and the others
+ * continuing it, and returns the number of fragments pushed. The last one
+ * is expected to stop after @last_size bytes, or to be complete if 0 */
+static guint
+check_progressive_buffers (gsize last_size)
+{
+  GPtrArray *fragments;
+  gsize size = 0;
+  guint i, n = 0;
+
+  /* The fragments the source served, in order */
+  fragments = g_ptr_array_new ();
+  g_mutex_lock (&requests_lock);
+  for (i = 0; i < requests->len; i++) {
+    gchar *uri = g_ptr_array_index (requests, i);
+
+    if (g_str_has_suffix (uri, ".ts"))
+      g_ptr_array_add (fragments, uri);
+  }
+  g_mutex_unlock (&requests_lock);
+
+  g_mutex_lock (&pushed_lock);
+  fail_unless (pushed->len > 0);
+  for (i = 0; i < pushed->len; i++) {
+    PushedBuffer *buf = &g_array_index (pushed, PushedBuffer, i);
+
+    if (GST_CLOCK_TIME_IS_VALID (buf->pts)) {
+      /* A new fragment, the previous one was pushed completely */
+      if (n > 0)
+        fail_unless_equals_uint64 (size,
+            g_bytes_get_size (g_hash_table_lookup (files,
+                    g_ptr_array_index (fragments, n - 1))));
+      fail_unless_equals_uint64 (buf->pts, n * GST_SECOND);
+      fail_unless_equals_uint64 (buf->duration, GST_SECOND);
+      /* Only the start of the stream can be discontinuous */
+      fail_unless (n == 0 || !buf->discont);
+      n++;
+      size = 0;
+    } else {
+      fail_unless (i > 0, "the first buffer has no timestamp");
+      fail_unless (!GST_CLOCK_TIME_IS_VALID (buf->duration));
+      fail_unless (!buf->discont);
+    }
+    size += buf->size;
+  }
+  g_mutex_unlock (&pushed_lock);
+
+  fail_unless_equals_int (n, fragments->len);
+  if (last_size == 0)
+    last_size = g_bytes_get_size (g_hash_table_lookup (files,
+            g_ptr_array_index (fragments, n - 1)));
+  fail_unless_equals_uint64 (size, last_size);
+
+  g_ptr_array_unref (fragments);
+  return n;
+}
+
+GST_START_TEST (test_progressive)
+{
+  GstElement *pipeline, *demux;
+
+  pipeline = create_pipeline (&demux);
+  fail_unless_equals_int (run_progressive (pipeline, demux), GST_MESSAGE_EOS);
+  fail_unless_equals_int (check_progressive_buffers (0), N_FRAGMENTS);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_progressive_error)
+{
+  GstElement *pipeline, *demux;
+
+  /* The third fragment fails after two buffers were pushed, which can't be
+   * taken back by fetching it again */
+  fail_suffix = "/2.ts";
+  fail_offset = 2 * CHUNK_SIZE;
+
+  pipeline = create_pipeline (&demux);
+  fail_unless_equals_int (run_progressive (pipeline, demux),
+      GST_MESSAGE_ERROR);
+  fail_unless_equals_int (check_progressive_buffers (2 * CHUNK_SIZE), 3);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+static Suite *
+hlsdemux_suite (void)
+{
+  Suite *s = suite_create ("hlsdemux");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_checked_fixture (tc_chain, setup_hls, teardown_hls);
+  tcase_add_test (tc_chain, test_fetch_accounting);
+  tcase_add_test (tc_chain, test_progressive);
+  tcase_add_test (tc_chain, test_progressive_error);
+
+  return s;
+}
+
+GST_CHECK_MAIN (hlsdemux);
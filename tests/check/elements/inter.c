@@ -0,0 +1,381 @@
+/* GStreamer
+ *
+ * unit test for the inter elements
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+#include <gst/check/gsttestclock.h>
+
+#define VIDEO_CAPS_STRING "video/x-raw, format=(string)I420, " \
+  "width=(int)320, height=(int)240, framerate=(fraction)30/1"
+#define FRAME_SIZE (320 * 240 * 3 / 2)
+
+/* the name of the structure of the channels query */
+#define CHANNELS_QUERY "GstInterChannels"
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VIDEO_CAPS_STRING));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VIDEO_CAPS_STRING));
+
+static GstElement *src, *sink;
+static GstPad *srcpad, *sinkpad;
+static GstClock *test_clock;
+static guint n_produced;
+
+static void
+setup_video (const gchar * channel, guint queue_size)
+{
+  GstCaps *caps;
+
+  sink = gst_check_setup_element ("intervideosink");
+  src = gst_check_setup_element ("intervideosrc");
+  g_object_set (sink, "channel", channel, "sync", FALSE, NULL);
+  g_object_set (src, "channel", channel, "queue-size", queue_size, NULL);
+
+  srcpad = gst_check_setup_src_pad (sink, &src_template);
+  sinkpad = gst_check_setup_sink_pad (src, &sink_template);
+  gst_pad_set_active (srcpad, TRUE);
+  gst_pad_set_active (sinkpad, TRUE);
+
+  /* the consumer runs at the pace of the test */
+  test_clock = gst_test_clock_new ();
+  gst_element_set_clock (src, test_clock);
+  gst_element_set_base_time (src, 0);
+
+  fail_unless (gst_element_set_state (sink, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_ASYNC);
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_check_setup_events (srcpad, sink, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+  n_produced = 0;
+
+  fail_unless (gst_element_set_state (src, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_NO_PREROLL);
+}
+
+static void
+cleanup_video (void)
+{
+  fail_unless (gst_element_set_state (src, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  fail_unless (gst_element_set_state (sink, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  gst_check_drop_buffers ();
+  gst_pad_set_active (srcpad, FALSE);
+  gst_pad_set_active (sinkpad, FALSE);
+  gst_check_teardown_src_pad (sink);
+  gst_check_teardown_sink_pad (src);
+  gst_check_teardown_element (sink);
+  gst_check_teardown_element (src);
+  gst_object_unref (test_clock);
+}
+
+/* pushes a frame filled with @value to the producer */
+static void
+produce (guint8 value)
+{
+  GstBuffer *buffer;
+  GstMapInfo map;
+
+  buffer = gst_buffer_new_and_alloc (FRAME_SIZE);
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  memset (map.data, value, map.size);
+  gst_buffer_unmap (buffer, &map);
+  GST_BUFFER_PTS (buffer) =
+      gst_util_uint64_scale_int (n_produced, GST_SECOND, 30);
+  n_produced++;
+
+  fail_unless_equals_int (gst_pad_push (srcpad, buffer), GST_FLOW_OK);
+}
+
+/* Lets the consumer output the frame it is waiting to sync on, and waits
+ * for it. The consumer created its next frame once it waits again. */
+static void
+step_consumer (void)
+{
+  GstClockID pending, processed;
+  guint n_buffers;
+
+  gst_test_clock_wait_for_next_pending_id (GST_TEST_CLOCK (test_clock),
+      &pending);
+
+  g_mutex_lock (&check_mutex);
+  n_buffers = g_list_length (buffers);
+  g_mutex_unlock (&check_mutex);
+
+  gst_test_clock_set_time (GST_TEST_CLOCK (test_clock),
+      gst_clock_id_get_time (pending));
+  processed =
+      gst_test_clock_process_next_clock_id (GST_TEST_CLOCK (test_clock));
+  fail_unless (processed == pending);
+  gst_clock_id_unref (processed);
+  gst_clock_id_unref (pending);
+
+  g_mutex_lock (&check_mutex);
+  while (g_list_length (buffers) <= n_buffers)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+}
+
+static guint8
+get_value (guint idx)
+{
+  GstBuffer *buffer = g_list_nth_data (buffers, idx);
+  guint8 value;
+
+  fail_unless (buffer != NULL);
+  fail_unless_equals_int (gst_buffer_extract (buffer, 0, &value, 1), 1);
+
+  return value;
+}
+
+static guint64
+get_uint64 (GstElement * element, const gchar * property)
+{
+  guint64 value;
+
+  g_object_get (element, property, &value, NULL);
+
+  return value;
+}
+
+/* returns the structure of @channel in the reply to the channels query
+ * sent to @element */
+static GstStructure *
+query_channel (GstElement * element, const gchar * channel)
+{
+  GstQuery *query;
+  const GstStructure *s;
+  const GValue *channels;
+  GstStructure *result = NULL;
+  guint i;
+
+  query = gst_query_new_custom (GST_QUERY_CUSTOM,
+      gst_structure_new_empty (CHANNELS_QUERY));
+  fail_unless (gst_element_query (element, query));
+
+  s = gst_query_get_structure (query);
+  channels = gst_structure_get_value (s, "channels");
+  fail_unless (channels != NULL);
+  fail_unless (GST_VALUE_HOLDS_ARRAY (channels));
+  for (i = 0; i < gst_value_array_get_size (channels); i++) {
+    const GstStructure *c =
+        gst_value_get_structure (gst_value_array_get_value (channels, i));
+
+    if (g_strcmp0 (gst_structure_get_string (c, "name"), channel) == 0) {
+      fail_unless (result == NULL);
+      result = gst_structure_copy (c);
+    }
+  }
+  gst_query_unref (query);
+
+  return result;
+}
+
+static void
+check_channel (GstElement * element, const gchar * channel,
+    guint producers, guint consumers, guint64 n_buffers)
+{
+  GstStructure *s;
+  guint value;
+  guint64 value64;
+
+  s = query_channel (element, channel);
+  fail_unless (s != NULL, "no channel %s", channel);
+
+  fail_unless (gst_structure_get_uint (s, "producers", &value));
+  fail_unless_equals_int (value, producers);
+  fail_unless (gst_structure_get_uint (s, "consumers", &value));
+  fail_unless_equals_int (value, consumers);
+  fail_unless (gst_structure_get_uint64 (s, "buffers", &value64));
+  fail_unless_equals_uint64 (value64, n_buffers);
+  fail_unless (gst_structure_get_uint64 (s, "bytes", &value64));
+  fail_unless_equals_uint64 (value64, n_buffers * FRAME_SIZE);
+  fail_unless (gst_structure_has_field_typed (s, "byte-rate", G_TYPE_UINT64));
+
+  gst_structure_free (s);
+}
+
+GST_START_TEST (test_video_queue)
+{
+  static const guint8 expected[] = { 1, 2, 3, 4, 4, 4, 4, 7 };
+  guint i;
+
+  setup_video ("queue", 4);
+
+  /* the consumer made its first frame before anything was produced */
+  gst_test_clock_wait_for_next_pending_id (GST_TEST_CLOCK (test_clock), NULL);
+
+  /* faster producer: the queue keeps the first 4 frames */
+  for (i = 1; i <= 6; i++)
+    produce (i);
+  fail_unless_equals_uint64 (get_uint64 (src, "dropped"), 2);
+  g_usleep (20 * G_USEC_PER_SEC / 1000);
+
+  /* faster consumer: the last frame is repeated once the queue is empty */
+  for (i = 0; i < 7; i++)
+    step_consumer ();
+  fail_unless_equals_uint64 (get_uint64 (src, "duplicated"), 3);
+
+  produce (7);
+  step_consumer ();
+  step_consumer ();
+
+  fail_unless_equals_int (g_list_length (buffers), 1 + G_N_ELEMENTS (expected));
+  /* the first frame was made up */
+  fail_unless_equals_int (get_value (0), 16);
+  for (i = 0; i < G_N_ELEMENTS (expected); i++)
+    fail_unless_equals_int (get_value (i + 1), expected[i]);
+
+  fail_unless_equals_uint64 (get_uint64 (src, "dropped"), 2);
+  fail_unless_equals_uint64 (get_uint64 (src, "duplicated"), 3);
+
+  /* the first 4 frames waited in the queue while the test slept */
+  fail_unless (get_uint64 (src, "max-latency") >= 20 * GST_MSECOND);
+  fail_unless (get_uint64 (src, "average-latency") > 0);
+  fail_unless (get_uint64 (src, "average-latency") <=
+      get_uint64 (src, "max-latency"));
+
+  check_channel (src, "queue", 1, 1, 7);
+
+  cleanup_video ();
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_video_latest)
+{
+  guint i;
+
+  /* without a queue, only the latest frame is used */
+  setup_video ("latest", 0);
+  gst_test_clock_wait_for_next_pending_id (GST_TEST_CLOCK (test_clock), NULL);
+
+  for (i = 1; i <= 3; i++)
+    produce (i);
+  step_consumer ();
+  step_consumer ();
+  step_consumer ();
+
+  fail_unless_equals_int (get_value (0), 16);
+  fail_unless_equals_int (get_value (1), 3);
+  fail_unless_equals_int (get_value (2), 3);
+
+  /* the queue statistics stay at 0 */
+  fail_unless_equals_uint64 (get_uint64 (src, "dropped"), 0);
+  fail_unless_equals_uint64 (get_uint64 (src, "duplicated"), 0);
+  fail_unless_equals_uint64 (get_uint64 (src, "average-latency"), 0);
+  fail_unless_equals_uint64 (get_uint64 (src, "max-latency"), 0);
+
+  cleanup_video ();
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_queue_size_property)
+{
+  GstElement *element;
+  guint queue_size;
+
+  element = gst_check_setup_element ("intervideosrc");
+
+  g_object_get (element, "queue-size", &queue_size, NULL);
+  fail_unless_equals_int (queue_size, 0);
+  g_object_set (element, "queue-size", 8, NULL);
+  g_object_get (element, "queue-size", &queue_size, NULL);
+  fail_unless_equals_int (queue_size, 8);
+
+  /* nothing to report before starting */
+  fail_unless_equals_uint64 (get_uint64 (element, "dropped"), 0);
+  fail_unless_equals_uint64 (get_uint64 (element, "duplicated"), 0);
+  fail_unless_equals_uint64 (get_uint64 (element, "average-latency"), 0);
+  fail_unless_equals_uint64 (get_uint64 (element, "max-latency"), 0);
+
+  gst_check_teardown_element (element);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_channels_query)
+{
+  GstElement *audiosrc;
+  GstStructure *s;
+  GstQuery *query;
+  guint i;
+
+  setup_video ("video", 0);
+  audiosrc = gst_check_setup_element ("interaudiosrc");
+  g_object_set (audiosrc, "channel", "audio", NULL);
+  gst_element_set_state (audiosrc, GST_STATE_PAUSED);
+
+  for (i = 1; i <= 3; i++)
+    produce (i);
+
+  /* every inter element lists all the channels */
+  check_channel (src, "video", 1, 1, 3);
+  check_channel (src, "audio", 0, 1, 0);
+  check_channel (audiosrc, "video", 1, 1, 3);
+  check_channel (audiosrc, "audio", 0, 1, 0);
+
+  /* other custom queries are left alone */
+  query = gst_query_new_custom (GST_QUERY_CUSTOM,
+      gst_structure_new_empty ("SomethingElse"));
+  gst_element_query (src, query);
+  fail_if (gst_structure_has_field (gst_query_get_structure (query),
+          "channels"));
+  gst_query_unref (query);
+
+  /* the channels go away with their elements */
+  gst_element_set_state (audiosrc, GST_STATE_NULL);
+  s = query_channel (src, "audio");
+  fail_unless (s == NULL);
+  gst_check_teardown_element (audiosrc);
+
+  cleanup_video ();
+}
+
+GST_END_TEST;
+
+static Suite *
+inter_suite (void)
+{
+  Suite *s = suite_create ("inter");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_video_queue);
+  tcase_add_test (tc_chain, test_video_latest);
+  tcase_add_test (tc_chain, test_queue_size_property);
+  tcase_add_test (tc_chain, test_channels_query);
+
+  return s;
+}
+
+GST_CHECK_MAIN (inter);
@@ -329,6 +329,100 @@ GST_START_TEST (test_audio)
 
 GST_END_TEST;
 
+/* With a bitrate of 2Mbit/s, one second of stream should be about 1330
+ * packets, mostly null ones */
+GST_START_TEST (test_cbr)
+{
+  GstElement *mux;
+  GstBuffer *inbuffer;
+  GstCaps *caps;
+  GList *l;
+  gchar *padname;
+  guint i, n_packets = 0, n_null = 0;
+
+  mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
+  g_object_set (mux, "bitrate", (guint64) 2000000, NULL);
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  for (i = 0; i < 2; i++) {
+    inbuffer = gst_buffer_new_and_alloc (1000);
+    gst_buffer_memset (inbuffer, 0, 0, 1000);
+    GST_BUFFER_PTS (inbuffer) = GST_BUFFER_DTS (inbuffer) = i * GST_SECOND;
+    fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+  }
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+
+  for (l = buffers; l; l = l->next) {
+    GstMapInfo map;
+    gsize offset;
+
+    gst_buffer_map (GST_BUFFER (l->data), &map, GST_MAP_READ);
+    fail_unless (map.size % 188 == 0);
+    for (offset = 0; offset < map.size; offset += 188) {
+      fail_unless (map.data[offset] == 0x47);
+      if ((GST_READ_UINT16_BE (map.data + offset + 1) & 0x1fff) == 0x1fff)
+        n_null++;
+      n_packets++;
+    }
+    gst_buffer_unmap (GST_BUFFER (l->data), &map);
+  }
+
+  GST_DEBUG ("%u packets, %u null", n_packets, n_null);
+  fail_unless (n_packets >= 1300 && n_packets <= 1360);
+  fail_unless (n_null > n_packets / 2);
+
+  gst_check_drop_buffers ();
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_aligned_output)
+{
+  GstElement *mux;
+  GstBuffer *inbuffer, *outbuffer;
+  GstCaps *caps;
+  GList *l;
+  gchar *padname;
+
+  mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
+  g_object_set (mux, "alignment", 7, NULL);
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  /* enough data for several chunks of 7 packets */
+  inbuffer = gst_buffer_new_and_alloc (16 * 1024);
+  gst_buffer_memset (inbuffer, 0, 0, 16 * 1024);
+  GST_BUFFER_TIMESTAMP (inbuffer) = 0;
+  fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+
+  fail_unless (g_list_length (buffers) > 1);
+  for (l = buffers; l; l = l->next) {
+    outbuffer = GST_BUFFER (l->data);
+    fail_unless_equals_int (gst_buffer_get_size (outbuffer), 7 * 188);
+    fail_unless (gst_buffer_memcmp (outbuffer, 0, "\x47", 1) == 0);
+  }
+
+  gst_check_drop_buffers ();
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+}
+
+GST_END_TEST;
+
 
 typedef struct _TestData
 {
@@ -722,6 +816,8 @@ mpegtsmux_suite (void)
 
   tcase_add_test (tc_chain, test_audio);
   tcase_add_test (tc_chain, test_video);
+  tcase_add_test (tc_chain, test_aligned_output);
+  tcase_add_test (tc_chain, test_cbr);
   tcase_add_test (tc_chain, test_force_key_unit_event_downstream);
   tcase_add_test (tc_chain, test_force_key_unit_event_upstream);
   tcase_add_test (tc_chain, test_propagate_flow_status);
@@ -21,6 +21,8 @@
  */
 
 #include <gst/check/gstcheck.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
 #include <string.h>
 #include "mxfdemux.h"
 
@@ -29,6 +31,16 @@ static GMainLoop *loop = NULL;
 static gboolean have_eos = FALSE;
 static gboolean have_data = FALSE;
 
+/* File served by the pull mode source pad */
+static const guint8 *src_data = mxf_file;
+static gsize src_size = sizeof (mxf_file);
+
+/* Reads from this offset block until the source pad is flushed */
+static GMutex block_lock;
+static GCond block_cond;
+static guint64 block_offset = -1;
+static gboolean blocked = FALSE;
+
 static GstStaticPadTemplate mysrctemplate =
 GST_STATIC_PAD_TEMPLATE ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
     GST_STATIC_CAPS ("application/mxf"));
@@ -134,11 +146,22 @@ static GstFlowReturn
 _src_getrange (GstPad * pad, GstObject * parent, guint64 offset, guint length,
     GstBuffer ** buffer)
 {
-  if (offset + length > sizeof (mxf_file))
+  g_mutex_lock (&block_lock);
+  if (offset == block_offset) {
+    blocked = TRUE;
+    g_cond_broadcast (&block_cond);
+    while (block_offset != -1)
+      g_cond_wait (&block_cond, &block_lock);
+    g_mutex_unlock (&block_lock);
+    return GST_FLOW_FLUSHING;
+  }
+  g_mutex_unlock (&block_lock);
+
+  if (offset + length > src_size)
     return GST_FLOW_EOS;
 
   *buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
-      (guint8 *) (mxf_file + offset), length, 0, length, NULL, NULL);
+      (guint8 *) (src_data + offset), length, 0, length, NULL, NULL);
 
   return GST_FLOW_OK;
 }
@@ -156,7 +179,7 @@ _src_query (GstPad * pad, GstObject * parent, GstQuery * query)
       if (fmt != GST_FORMAT_BYTES)
         break;
 
-      gst_query_set_duration (query, fmt, sizeof (mxf_file));
+      gst_query_set_duration (query, fmt, src_size);
       res = TRUE;
       break;
     }
@@ -174,12 +197,28 @@ _src_query (GstPad * pad, GstObject * parent, GstQuery * query)
   return res;
 }
 
+static gboolean
+_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_START) {
+    g_mutex_lock (&block_lock);
+    block_offset = -1;
+    g_cond_broadcast (&block_cond);
+    g_mutex_unlock (&block_lock);
+  }
+
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
 static GstPad *
 _create_src_pad_pull (void)
 {
   mysrcpad = gst_pad_new_from_static_template (&mysrctemplate, "src");
   gst_pad_set_getrange_function (mysrcpad, _src_getrange);
   gst_pad_set_query_function (mysrcpad, _src_query);
+  gst_pad_set_event_function (mysrcpad, _src_event);
 
   return mysrcpad;
 }
@@ -287,6 +326,217 @@ GST_START_TEST (test_push)
 
 GST_END_TEST;
 
+/* Offset of the essence element and of the footer index table segment */
+#define ESSENCE_OFFSET 19995
+#define INDEX_SEGMENT_OFFSET 20171
+
+/* Variable edit unit size index table segment with one entry that
+ * starts at edit unit 0xf0000000, as big as the segment it replaces */
+static const guint8 huge_index_segment[] = {
+  0x3f, 0x0b, 0x00, 0x08, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x01,
+  0x3f, 0x0c, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0xf0, 0x00, 0x00, 0x00,
+  0x3f, 0x0d, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+  0x3f, 0x06, 0x00, 0x04, 0x00, 0x00, 0x00, 0x81,
+  0x3f, 0x07, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01,
+  0x3f, 0x08, 0x00, 0x01, 0x00,
+  0x3f, 0x0a, 0x00, 0x13, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0b,
+  0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+GST_START_TEST (test_pull_seek_huge_index_start)
+{
+  GstStateChangeReturn sret;
+  GstElement *mxfdemux;
+  GstPad *sinkpad;
+  guint8 *data;
+
+  /* The index table segment in the footer is replaced so that seeking
+   * makes the demuxer read it, the file must still play */
+  data = g_memdup (mxf_file, sizeof (mxf_file));
+  fail_unless_equals_int (data[INDEX_SEGMENT_OFFSET + 16], 0x83);
+  fail_unless_equals_int (GST_READ_UINT24_BE (data + INDEX_SEGMENT_OFFSET +
+          17), sizeof (huge_index_segment));
+  memcpy (data + INDEX_SEGMENT_OFFSET + 20, huge_index_segment,
+      sizeof (huge_index_segment));
+  src_data = data;
+
+  have_eos = FALSE;
+  have_data = FALSE;
+  loop = g_main_loop_new (NULL, FALSE);
+
+  mxfdemux = gst_element_factory_make ("mxfdemux", NULL);
+  fail_unless (mxfdemux != NULL);
+  g_signal_connect (mxfdemux, "pad-added", G_CALLBACK (_pad_added), NULL);
+  sinkpad = gst_element_get_static_pad (mxfdemux, "sink");
+  fail_unless (sinkpad != NULL);
+
+  mysinkpad = _create_sink_pad ();
+  fail_unless (mysinkpad != NULL);
+  mysrcpad = _create_src_pad_pull ();
+  fail_unless (mysrcpad != NULL);
+
+  fail_unless (gst_pad_link (mysrcpad, sinkpad) == GST_PAD_LINK_OK);
+  gst_object_unref (sinkpad);
+
+  gst_pad_set_active (mysinkpad, TRUE);
+  gst_pad_set_active (mysrcpad, TRUE);
+
+  /* Hold the demuxer before it finds the essence so that the seek has
+   * to look it up in the index tables */
+  g_mutex_lock (&block_lock);
+  block_offset = ESSENCE_OFFSET;
+  blocked = FALSE;
+  g_mutex_unlock (&block_lock);
+
+  sret = gst_element_set_state (mxfdemux, GST_STATE_PLAYING);
+  fail_unless_equals_int (sret, GST_STATE_CHANGE_SUCCESS);
+
+  g_mutex_lock (&block_lock);
+  while (!blocked)
+    g_cond_wait (&block_cond, &block_lock);
+  g_mutex_unlock (&block_lock);
+
+  fail_unless (gst_element_send_event (mxfdemux,
+          gst_event_new_seek (1.0, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH,
+              GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE, -1)));
+
+  g_main_loop_run (loop);
+  fail_unless (have_eos == TRUE);
+  fail_unless (have_data == TRUE);
+
+  gst_element_set_state (mxfdemux, GST_STATE_NULL);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_pad_set_active (mysrcpad, FALSE);
+
+  gst_object_unref (mxfdemux);
+  gst_object_unref (mysinkpad);
+  gst_object_unref (mysrcpad);
+  g_main_loop_unref (loop);
+  loop = NULL;
+
+  src_data = mxf_file;
+  g_free (data);
+}
+
+GST_END_TEST;
+
+/* Offset of the footer partition pack */
+#define FOOTER_OFFSET 20031
+
+/* Offsets of the durations of all sequences and components */
+static const guint duration_offsets[] = {
+  2246, 2369, 2607, 2707, 3281, 3404, 3642, 3742
+};
+
+static void
+_link_to_sink (GstElement * element, GstPad * pad, gpointer user_data)
+{
+  GstPad *sinkpad = gst_element_get_static_pad (GST_ELEMENT (user_data),
+      "sink");
+
+  fail_unless (gst_pad_link (pad, sinkpad) == GST_PAD_LINK_OK);
+  gst_object_unref (sinkpad);
+}
+
+static void
+_count_buffer (GstElement * fakesink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  g_atomic_int_inc ((gint *) user_data);
+}
+
+GST_START_TEST (test_growing_file)
+{
+  GstElement *pipeline, *filesrc, *mxfdemux, *fakesink;
+  GstMessage *msg;
+  GstBus *bus;
+  gint64 duration;
+  gint n_buffers = 0;
+  gchar *path;
+  guint8 *data;
+  FILE *f;
+  gint fd;
+  guint i;
+
+  /* A file that is still being written doesn't know its duration yet */
+  data = g_memdup (mxf_file, sizeof (mxf_file));
+  for (i = 0; i < G_N_ELEMENTS (duration_offsets); i++) {
+    fail_unless_equals_uint64 (GST_READ_UINT64_BE (data +
+            duration_offsets[i]), 1);
+    GST_WRITE_UINT64_BE (data + duration_offsets[i], G_MAXUINT64);
+  }
+
+  /* Write everything up to the footer partition */
+  fd = g_file_open_tmp ("mxfdemux-XXXXXX.mxf", &path, NULL);
+  fail_unless (fd != -1);
+  f = fdopen (fd, "wb");
+  fail_unless (f != NULL);
+  fail_unless_equals_int (fwrite (data, 1, FOOTER_OFFSET, f), FOOTER_OFFSET);
+  fail_unless_equals_int (fflush (f), 0);
+
+  pipeline = gst_pipeline_new (NULL);
+  filesrc = gst_element_factory_make ("filesrc", NULL);
+  fail_unless (filesrc != NULL);
+  mxfdemux = gst_element_factory_make ("mxfdemux", NULL);
+  fail_unless (mxfdemux != NULL);
+  fakesink = gst_element_factory_make ("fakesink", NULL);
+  fail_unless (fakesink != NULL);
+
+  g_object_set (filesrc, "location", path, NULL);
+  g_object_set (mxfdemux, "growing-file", TRUE, NULL);
+  g_object_set (fakesink, "signal-handoffs", TRUE, "sync", FALSE, NULL);
+  g_signal_connect (fakesink, "handoff", G_CALLBACK (_count_buffer),
+      &n_buffers);
+  g_signal_connect (mxfdemux, "pad-added", G_CALLBACK (_link_to_sink),
+      fakesink);
+
+  gst_bin_add_many (GST_BIN (pipeline), filesrc, mxfdemux, fakesink, NULL);
+  fail_unless (gst_element_link (filesrc, mxfdemux));
+
+  bus = gst_element_get_bus (pipeline);
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  /* At the end of the data the demuxer extends the duration to the
+   * essence it has seen and waits instead of sending EOS */
+  msg = gst_bus_timed_pop_filtered (bus, 10 * GST_SECOND,
+      GST_MESSAGE_DURATION_CHANGED | GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg),
+      GST_MESSAGE_DURATION_CHANGED);
+  gst_message_unref (msg);
+
+  fail_unless (gst_element_query_duration (pipeline, GST_FORMAT_TIME,
+          &duration));
+  fail_unless_equals_uint64 (duration, 200 * GST_MSECOND);
+  fail_unless_equals_int (g_atomic_int_get (&n_buffers), 1);
+
+  /* Once the footer is written the demuxer retries, finds it and
+   * finishes */
+  fail_unless_equals_int (fwrite (data + FOOTER_OFFSET, 1,
+          sizeof (mxf_file) - FOOTER_OFFSET, f),
+      sizeof (mxf_file) - FOOTER_OFFSET);
+  fail_unless_equals_int (fflush (f), 0);
+
+  msg = gst_bus_timed_pop_filtered (bus, 10 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  fail_unless_equals_int (g_atomic_int_get (&n_buffers), 1);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (bus);
+  gst_object_unref (pipeline);
+
+  fclose (f);
+  g_unlink (path);
+  g_free (path);
+  g_free (data);
+}
+
+GST_END_TEST;
+
 static Suite *
 mxfdemux_suite (void)
 {
@@ -302,6 +552,8 @@ mxfdemux_suite (void)
   tcase_set_timeout (tc_chain, 180);
   tcase_add_test (tc_chain, test_pull);
   tcase_add_test (tc_chain, test_push);
+  tcase_add_test (tc_chain, test_pull_seek_huge_index_start);
+  tcase_add_test (tc_chain, test_growing_file);
 
   return s;
 }
@@ -21,7 +21,9 @@
  */
 
 #include <gst/check/gstcheck.h>
+#include <glib/gstdio.h>
 #include <string.h>
+#include <unistd.h>
 
 static const gchar *
 get_mpeg2enc_element_name (void)
@@ -239,6 +241,270 @@ GST_START_TEST (test_multiple_av_streams)
 
 GST_END_TEST;
 
+#define N_INDEX_TEST_FRAMES 50
+
+static const guint8 partition_pack_key[] = {
+  0x06, 0x0e, 0x2b, 0x34, 0x02, 0x05, 0x01, 0x01,
+  0x0d, 0x01, 0x02, 0x01, 0x01
+};
+
+static const guint8 index_table_segment_key[] = {
+  0x06, 0x0e, 0x2b, 0x34, 0x02, 0x53, 0x01, 0x01,
+  0x0d, 0x01, 0x02, 0x01, 0x01, 0x10, 0x01, 0x00
+};
+
+static const guint8 random_index_pack_key[] = {
+  0x06, 0x0e, 0x2b, 0x34, 0x02, 0x05, 0x01, 0x01,
+  0x0d, 0x01, 0x02, 0x01, 0x01, 0x11, 0x01, 0x00
+};
+
+static gboolean
+is_essence_element (const guint8 * key)
+{
+  return memcmp (key, partition_pack_key, 4) == 0 && key[4] == 0x01
+      && key[5] == 0x02 && key[6] == 0x01 && key[8] == 0x0d
+      && key[9] == 0x01 && key[10] == 0x03 && key[11] == 0x01;
+}
+
+/* Walks all KLV packets of the file at @path and checks that the
+ * partitions link to each other and are all in the random index pack,
+ * and that the index table segments index every edit unit once */
+static void
+check_partitions_and_index (const gchar * path, gboolean body_partitions)
+{
+  GArray *partitions = g_array_new (FALSE, FALSE, sizeof (guint64));
+  GArray *body_sids = g_array_new (FALSE, FALSE, sizeof (guint32));
+  guint64 offset = 0, element_size = 0, n_elements = 0;
+  gint64 next_position = 0;
+  guint n_cbe = 0, n_vbe = 0, n_body_segments = 0;
+  gboolean have_rip = FALSE;
+  guint8 partition_type = 0;
+  const guint8 *data;
+  gchar *contents;
+  gsize size;
+  guint i;
+
+  fail_unless (g_file_get_contents (path, &contents, &size, NULL));
+  data = (const guint8 *) contents;
+
+  while (offset < size) {
+    const guint8 *key = data + offset, *value;
+    guint64 length = 0;
+    guint header_size = 17;
+
+    fail_if (have_rip, "Data after the random index pack");
+    fail_unless (offset + 17 <= size);
+    if (key[16] & 0x80) {
+      guint slen = key[16] & 0x7f;
+
+      fail_unless (slen <= 8 && offset + 17 + slen <= size);
+      for (i = 0; i < slen; i++)
+        length = (length << 8) | key[17 + i];
+      header_size += slen;
+    } else {
+      length = key[16];
+    }
+    value = key + header_size;
+    fail_unless (offset + header_size + length <= size);
+
+    if (memcmp (key, partition_pack_key, 13) == 0 && key[13] >= 0x02
+        && key[13] <= 0x04) {
+      guint32 body_sid = GST_READ_UINT32_BE (value + 60);
+
+      fail_unless (length >= 64);
+      partition_type = key[13];
+      fail_unless_equals_uint64 (GST_READ_UINT64_BE (value + 8), offset);
+      /* The header partition is rewritten at the end and links to the
+       * footer, all others to the one before them */
+      if (partition_type != 0x02) {
+        fail_unless (partitions->len > 0);
+        fail_unless_equals_uint64 (GST_READ_UINT64_BE (value + 16),
+            g_array_index (partitions, guint64, partitions->len - 1));
+      }
+      if (partition_type == 0x03)
+        fail_unless_equals_uint64 (GST_READ_UINT64_BE (value + 52),
+            n_elements * element_size);
+      g_array_append_val (partitions, offset);
+      g_array_append_val (body_sids, body_sid);
+    } else if (memcmp (key, index_table_segment_key, 16) == 0) {
+      gint64 start = -1, duration = -1;
+      guint32 edit_unit_byte_count = 0, n_entries = 0;
+      const guint8 *entries = NULL;
+      guint entry_size = 0;
+      guint64 pos = 0;
+
+      fail_unless (element_size > 0);
+      while (pos + 4 <= length) {
+        guint16 tag = GST_READ_UINT16_BE (value + pos);
+        guint16 tag_size = GST_READ_UINT16_BE (value + pos + 2);
+        const guint8 *tag_data = value + pos + 4;
+
+        fail_unless (pos + 4 + tag_size <= length);
+        if (tag == 0x3f0c)
+          start = GST_READ_UINT64_BE (tag_data);
+        else if (tag == 0x3f0d)
+          duration = GST_READ_UINT64_BE (tag_data);
+        else if (tag == 0x3f05)
+          edit_unit_byte_count = GST_READ_UINT32_BE (tag_data);
+        else if (tag == 0x3f0a) {
+          n_entries = GST_READ_UINT32_BE (tag_data);
+          entry_size = GST_READ_UINT32_BE (tag_data + 4);
+          entries = tag_data + 8;
+          fail_unless (entry_size >= 11);
+          fail_unless (8 + (guint64) n_entries * entry_size <= tag_size);
+        }
+        pos += 4 + tag_size;
+      }
+
+      /* Every segment continues where the previous one stopped */
+      fail_unless_equals_int64 (start, next_position);
+      fail_unless (duration > 0);
+      if (edit_unit_byte_count != 0) {
+        fail_unless_equals_int (n_entries, 0);
+        fail_unless_equals_uint64 (edit_unit_byte_count, element_size);
+        n_cbe++;
+      } else {
+        fail_unless_equals_int64 (n_entries, duration);
+        for (i = 0; i < n_entries; i++) {
+          const guint8 *entry = entries + i * entry_size;
+
+          fail_unless (entry[2] & 0x80);
+          fail_unless_equals_uint64 (GST_READ_UINT64_BE (entry + 3),
+              (start + i) * element_size);
+        }
+        n_vbe++;
+      }
+      next_position += duration;
+
+      /* Segments in a body partition index the essence before it */
+      if (partition_type == 0x03) {
+        fail_unless (next_position <= n_elements);
+        n_body_segments++;
+      }
+    } else if (memcmp (key, random_index_pack_key, 16) == 0) {
+      fail_unless_equals_uint64 (length, partitions->len * 12 + 4);
+      for (i = 0; i < partitions->len; i++) {
+        fail_unless_equals_int (GST_READ_UINT32_BE (value + i * 12),
+            g_array_index (body_sids, guint32, i));
+        fail_unless_equals_uint64 (GST_READ_UINT64_BE (value + i * 12 + 4),
+            g_array_index (partitions, guint64, i));
+      }
+      fail_unless_equals_uint64 (GST_READ_UINT32_BE (value + length - 4),
+          header_size + length);
+      have_rip = TRUE;
+    } else if (is_essence_element (key)) {
+      if (element_size == 0)
+        element_size = header_size + length;
+      fail_unless_equals_uint64 (header_size + length, element_size);
+      n_elements++;
+    }
+
+    offset += header_size + length;
+  }
+
+  fail_unless (have_rip);
+  fail_unless_equals_int (partition_type, 0x04);
+  fail_unless_equals_int (n_elements, N_INDEX_TEST_FRAMES);
+  fail_unless_equals_int64 (next_position, N_INDEX_TEST_FRAMES);
+
+  if (body_partitions) {
+    /* Raw video has a constant edit unit size but only the footer can
+     * use a single CBE segment for everything */
+    fail_unless (partitions->len > 3);
+    fail_unless_equals_int (n_cbe, 0);
+    fail_unless (n_body_segments > 0);
+  } else {
+    fail_unless_equals_int (partitions->len, 3);
+    fail_unless_equals_int (n_cbe, 1);
+    fail_unless_equals_int (n_vbe, 0);
+  }
+
+  g_array_free (partitions, TRUE);
+  g_array_free (body_sids, TRUE);
+  g_free (contents);
+}
+
+/* Seeks in the file at @path with mxfdemux, which uses the index table
+ * segments for positions it didn't see yet */
+static void
+check_seek (const gchar * path)
+{
+  GstElement *pipeline, *sink;
+  GstSample *sample;
+  GstBuffer *buffer;
+  gchar *pipeline_string;
+
+  pipeline_string = g_strdup_printf ("filesrc location=\"%s\" ! mxfdemux ! "
+      "fakesink name=sink", path);
+  pipeline = gst_parse_launch (pipeline_string, NULL);
+  fail_unless (pipeline != NULL);
+  g_free (pipeline_string);
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  fail_unless (sink != NULL);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PAUSED) != GST_STATE_CHANGE_FAILURE);
+  fail_unless_equals_int (gst_element_get_state (pipeline, NULL, NULL,
+          GST_CLOCK_TIME_NONE), GST_STATE_CHANGE_SUCCESS);
+
+  fail_unless (gst_element_seek_simple (pipeline, GST_FORMAT_TIME,
+          GST_SEEK_FLAG_FLUSH, GST_SECOND));
+  fail_unless_equals_int (gst_element_get_state (pipeline, NULL, NULL,
+          GST_CLOCK_TIME_NONE), GST_STATE_CHANGE_SUCCESS);
+
+  g_object_get (sink, "last-sample", &sample, NULL);
+  fail_unless (sample != NULL);
+  buffer = gst_sample_get_buffer (sample);
+  fail_unless (buffer != NULL);
+  fail_unless_equals_uint64 (GST_BUFFER_PTS (buffer), GST_SECOND);
+  gst_sample_unref (sample);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_NULL) == GST_STATE_CHANGE_SUCCESS);
+  gst_object_unref (sink);
+  gst_object_unref (pipeline);
+}
+
+static void
+run_index_test (GstClockTime body_partition_interval)
+{
+  gchar *pipeline;
+  gchar *path;
+  gint fd;
+
+  fd = g_file_open_tmp ("mxfmux-XXXXXX.mxf", &path, NULL);
+  fail_unless (fd != -1);
+  close (fd);
+
+  pipeline = g_strdup_printf ("videotestsrc num-buffers=%d ! "
+      "video/x-raw,format=(string)v308,width=64,height=48,framerate=25/1 ! "
+      "mxfmux body-partition-interval=%" G_GUINT64_FORMAT " ! "
+      "filesink location=\"%s\"", N_INDEX_TEST_FRAMES,
+      body_partition_interval, path);
+  run_test (pipeline);
+  g_free (pipeline);
+
+  check_partitions_and_index (path, body_partition_interval > 0);
+  check_seek (path);
+
+  g_unlink (path);
+  g_free (path);
+}
+
+GST_START_TEST (test_index_footer)
+{
+  run_index_test (0);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_index_body_partitions)
+{
+  run_index_test (400 * GST_MSECOND);
+}
+
+GST_END_TEST;
+
 static Suite *
 mxfmux_suite (void)
 {
@@ -259,6 +525,8 @@ mxfmux_suite (void)
   tcase_add_test (tc_chain, test_jpeg2000_alaw);
   tcase_add_test (tc_chain, test_dnxhd_mp3);
   tcase_add_test (tc_chain, test_multiple_av_streams);
+  tcase_add_test (tc_chain, test_index_footer);
+  tcase_add_test (tc_chain, test_index_body_partitions);
 
   return s;
 }
@@ -42,7 +42,7 @@ GstElement *src, *sink;
 GstPad *sinkpad, *srcpad;
 
 static void
-setup_shm (void)
+setup_shm_full (gboolean ring)
 {
   gchar *socket_path = NULL;
 
@@ -52,7 +52,7 @@ setup_shm (void)
   srcpad = gst_check_setup_src_pad (sink, &src_template);
   sinkpad = gst_check_setup_sink_pad (src, &sink_template);
 
-  g_object_set (sink, "socket-path", "shm-unit-test", NULL);
+  g_object_set (sink, "socket-path", "shm-unit-test", "ring", ring, NULL);
 
   fail_unless (gst_element_set_state (sink, GST_STATE_PLAYING) ==
       GST_STATE_CHANGE_ASYNC);
@@ -69,6 +69,18 @@ setup_shm (void)
       GST_STATE_CHANGE_SUCCESS);
 }
 
+static void
+setup_shm (void)
+{
+  setup_shm_full (FALSE);
+}
+
+static void
+setup_shm_ring (void)
+{
+  setup_shm_full (TRUE);
+}
+
 static void
 teardown_shm (void)
 {
@@ -165,6 +177,107 @@ GST_START_TEST (test_shm_alloc)
 
 GST_END_TEST;
 
+GST_START_TEST (test_shm_pool)
+{
+  GstBuffer *buf;
+  GstQuery *query;
+  GstCaps *caps;
+  GstBufferPool *pool;
+  GstSegment segment;
+  guint size, min, max, i;
+  guint8 val;
+
+  caps = gst_caps_from_string ("video/x-raw, format=(string)RGB, "
+      "width=(int)160, height=(int)120, framerate=(fraction)30/1");
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_pad_push_event (srcpad, gst_event_new_caps (caps));
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  query = gst_query_new_allocation (caps, TRUE);
+  gst_caps_unref (caps);
+
+  fail_unless (gst_pad_peer_query (srcpad, query));
+  fail_unless (gst_query_get_n_allocation_pools (query) == 1);
+
+  gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+  gst_query_unref (query);
+  fail_unless (pool != NULL);
+  fail_unless_equals_int (size, 160 * 120 * 3);
+  /* as many frames as fit in the default 256k area */
+  fail_unless_equals_int (max, 4);
+
+  fail_unless (gst_buffer_pool_set_active (pool, TRUE));
+
+  for (i = 0; i < 3; i++) {
+    fail_unless (gst_buffer_pool_acquire_buffer (pool, &buf,
+            NULL) == GST_FLOW_OK);
+    gst_buffer_memset (buf, 0, i, size);
+    fail_unless (gst_pad_push (srcpad, buf) == GST_FLOW_OK);
+  }
+
+  g_mutex_lock (&check_mutex);
+  while (g_list_length (buffers) < 3)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+
+  for (i = 0; i < 3; i++) {
+    buf = g_list_nth_data (buffers, i);
+    fail_unless (gst_buffer_get_size (buf) == size);
+    val = i;
+    fail_unless (gst_buffer_memcmp (buf, size - 1, &val, 1) == 0);
+  }
+
+  gst_check_drop_buffers ();
+  gst_buffer_pool_set_active (pool, FALSE);
+  gst_object_unref (pool);
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+/* Benchmark of the time buffers take to go from shmsink to shmsrc, one
+ * at a time */
+GST_START_TEST (test_shm_latency)
+{
+  GstBuffer *buf;
+  GstSegment segment;
+  gboolean ring;
+  gint64 start, elapsed = 0;
+  guint i, n_buffers = 2000;
+
+  g_object_get (sink, "ring", &ring, NULL);
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  for (i = 0; i < n_buffers; i++) {
+    buf = gst_buffer_new_allocate (NULL, 1000, NULL);
+
+    start = g_get_monotonic_time ();
+    fail_unless (gst_pad_push (srcpad, buf) == GST_FLOW_OK);
+
+    g_mutex_lock (&check_mutex);
+    while (buffers == NULL)
+      g_cond_wait (&check_cond, &check_mutex);
+    g_mutex_unlock (&check_mutex);
+    elapsed += g_get_monotonic_time () - start;
+
+    gst_check_drop_buffers ();
+  }
+
+  elapsed = MAX (elapsed, 1);
+  GST_INFO ("shm %s: %u buffers, %.1f us per buffer, %.0f buffers/s",
+      ring ? "ring" : "socket", n_buffers, (gdouble) elapsed / n_buffers,
+      (gdouble) n_buffers * G_USEC_PER_SEC / elapsed);
+
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
 static Suite *
 shm_suite (void)
 {
@@ -175,6 +288,16 @@ shm_suite (void)
   tcase_add_checked_fixture (tc, setup_shm, NULL);
   tcase_add_test (tc, test_shm_sysmem_alloc);
   tcase_add_test (tc, test_shm_alloc);
+  tcase_add_test (tc, test_shm_pool);
+  if (g_getenv ("GST_CHECK_BENCHMARKS"))
+    tcase_add_test (tc, test_shm_latency);
+  suite_add_tcase (s, tc);
+
+  tc = tcase_create ("shm-ring");
+  tcase_add_checked_fixture (tc, setup_shm_ring, NULL);
+  tcase_add_test (tc, test_shm_sysmem_alloc);
+  if (g_getenv ("GST_CHECK_BENCHMARKS"))
+    tcase_add_test (tc, test_shm_latency);
   suite_add_tcase (s, tc);
 
   return s;
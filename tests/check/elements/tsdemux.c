@@ -0,0 +1,373 @@
+/* GStreamer
+ *
+ * unit test for the tsdemux keyframe index
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "../../gst/mpegtsdemux/tsdemux.c"
+
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <gst/check/gstcheck.h>
+
+#define UPSTREAM_SIZE (188 * 1000)
+#define INDEX_PID 0x100
+
+static const TSDemuxIndexEntry entries[] = {
+  {1 * GST_SECOND, 188 * 10},
+  {3 * GST_SECOND, 188 * 50},
+  {5 * GST_SECOND, 188 * 90},
+  {20 * GST_SECOND, 188 * 400}
+};
+
+static gchar *location;
+static gint64 upstream_size;
+static GstPad *srcpad;
+
+static gboolean
+src_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  GstFormat format;
+
+  if (GST_QUERY_TYPE (query) == GST_QUERY_DURATION) {
+    gst_query_parse_duration (query, &format, NULL);
+    if (format != GST_FORMAT_BYTES)
+      return FALSE;
+    gst_query_set_duration (query, format, upstream_size);
+    return TRUE;
+  }
+
+  return gst_pad_query_default (pad, parent, query);
+}
+
+static GstTSDemux *
+setup_demux (void)
+{
+  GstTSDemux *demux;
+
+  demux = g_object_new (GST_TYPE_TS_DEMUX, "index-location", location, NULL);
+  gst_object_ref_sink (demux);
+  srcpad = gst_pad_new ("src", GST_PAD_SRC);
+  gst_pad_set_query_function (srcpad, src_query);
+  fail_unless (gst_pad_link (srcpad,
+          ((MpegTSBase *) demux)->sinkpad) == GST_PAD_LINK_OK);
+  upstream_size = UPSTREAM_SIZE;
+
+  return demux;
+}
+
+static void
+cleanup_demux (GstTSDemux * demux)
+{
+  gst_pad_unlink (srcpad, ((MpegTSBase *) demux)->sinkpad);
+  gst_object_unref (srcpad);
+  gst_object_unref (demux);
+}
+
+static void
+setup (void)
+{
+  gint fd;
+
+  fd = g_file_open_tmp ("tsdemux-index-XXXXXX", &location, NULL);
+  fail_unless (fd >= 0);
+  close (fd);
+}
+
+static void
+teardown (void)
+{
+  g_unlink (location);
+  g_free (location);
+  location = NULL;
+}
+
+/* writes an index file with the first @n_valid of the entries, announcing
+ * @n_entries of them */
+static guint8 *
+make_index_data (guint32 n_entries, guint n_valid, gsize * size)
+{
+  guint8 *data, *p;
+  guint i;
+
+  *size = INDEX_FILE_HEADER_SIZE + n_valid * INDEX_FILE_ENTRY_SIZE;
+  data = p = g_malloc0 (*size);
+  memcpy (p, INDEX_FILE_MAGIC, 8);
+  GST_WRITE_UINT32_BE (p + 8, INDEX_FILE_VERSION);
+  GST_WRITE_UINT16_BE (p + 12, INDEX_PID);
+  GST_WRITE_UINT64_BE (p + 16, UPSTREAM_SIZE);
+  GST_WRITE_UINT32_BE (p + 24, n_entries);
+  p += INDEX_FILE_HEADER_SIZE;
+  for (i = 0; i < n_valid; i++, p += INDEX_FILE_ENTRY_SIZE) {
+    GST_WRITE_UINT64_BE (p, entries[i].ts);
+    GST_WRITE_UINT64_BE (p + 8, entries[i].offset);
+  }
+
+  return data;
+}
+
+static void
+write_index (const guint8 * data, gsize size)
+{
+  fail_unless (g_file_set_contents (location, (const gchar *) data, size,
+          NULL));
+}
+
+static void
+check_entries (GstTSDemux * demux)
+{
+  TSDemuxIndexEntry *entry;
+  guint i;
+
+  fail_unless_equals_int (demux->index->len, G_N_ELEMENTS (entries));
+  for (i = 0; i < demux->index->len; i++) {
+    entry = &g_array_index (demux->index, TSDemuxIndexEntry, i);
+    fail_unless_equals_uint64 (entry->ts, entries[i].ts);
+    fail_unless_equals_uint64 (entry->offset, entries[i].offset);
+  }
+}
+
+static void
+check_lookup (GstTSDemux * demux, GstClockTime ts, GstSeekFlags flags,
+    GstClockTime expected)
+{
+  const TSDemuxIndexEntry *entry;
+
+  entry = gst_ts_demux_index_lookup (demux, ts, flags);
+  if (!GST_CLOCK_TIME_IS_VALID (expected)) {
+    if (entry != NULL)
+      fail ("found %" GST_TIME_FORMAT " for %" GST_TIME_FORMAT
+          " with flags 0x%x", GST_TIME_ARGS (entry->ts), GST_TIME_ARGS (ts),
+          flags);
+    return;
+  }
+  if (entry == NULL)
+    fail ("nothing found for %" GST_TIME_FORMAT " with flags 0x%x",
+        GST_TIME_ARGS (ts), flags);
+  fail_unless_equals_uint64 (entry->ts, expected);
+}
+
+/* loads the index file and checks that it was rejected */
+static void
+check_rejected (GstTSDemux * demux)
+{
+  gst_ts_demux_load_index (demux);
+  fail_unless (demux->index_loaded);
+  fail_unless_equals_int (demux->index->len, 0);
+}
+
+GST_START_TEST (test_index_round_trip)
+{
+  GstTSDemux *demux;
+  guint i;
+
+  demux = setup_demux ();
+  demux->index_pid = INDEX_PID;
+  demux->index_upstream_size = UPSTREAM_SIZE;
+  /* out of order, and twice */
+  for (i = G_N_ELEMENTS (entries); i > 0; i--)
+    gst_ts_demux_index_insert (demux, entries[i - 1].ts, entries[i - 1].offset);
+  for (i = 0; i < G_N_ELEMENTS (entries); i++)
+    gst_ts_demux_index_insert (demux, entries[i].ts, entries[i].offset);
+  check_entries (demux);
+  fail_unless (demux->index_dirty);
+
+  gst_ts_demux_save_index (demux);
+  fail_if (demux->index_dirty);
+  cleanup_demux (demux);
+
+  demux = setup_demux ();
+  gst_ts_demux_load_index (demux);
+  fail_unless (demux->index_loaded);
+  fail_if (demux->index_dirty);
+  fail_unless_equals_int (demux->index_pid, INDEX_PID);
+  fail_unless_equals_uint64 (demux->index_upstream_size, UPSTREAM_SIZE);
+  check_entries (demux);
+  cleanup_demux (demux);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_index_lookup)
+{
+  GstTSDemux *demux;
+  gsize size;
+  guint8 *data;
+
+  data = make_index_data (G_N_ELEMENTS (entries), G_N_ELEMENTS (entries),
+      &size);
+  write_index (data, size);
+  g_free (data);
+
+  demux = setup_demux ();
+  gst_ts_demux_load_index (demux);
+  check_entries (demux);
+
+  /* between two keyframes */
+  check_lookup (demux, 4 * GST_SECOND, 0, 3 * GST_SECOND);
+  check_lookup (demux, 4 * GST_SECOND, GST_SEEK_FLAG_KEY_UNIT, 3 * GST_SECOND);
+  check_lookup (demux, 4 * GST_SECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE, 3 * GST_SECOND);
+  check_lookup (demux, 4 * GST_SECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_AFTER, 5 * GST_SECOND);
+  check_lookup (demux, 3500 * GST_MSECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_NEAREST, 3 * GST_SECOND);
+  check_lookup (demux, 4500 * GST_MSECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_NEAREST, 5 * GST_SECOND);
+  /* SNAP flags are only honored with KEY_UNIT */
+  check_lookup (demux, 4 * GST_SECOND, GST_SEEK_FLAG_SNAP_AFTER,
+      3 * GST_SECOND);
+
+  /* exactly on a keyframe */
+  check_lookup (demux, 5 * GST_SECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE, 5 * GST_SECOND);
+  check_lookup (demux, 5 * GST_SECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_AFTER, 5 * GST_SECOND);
+
+  /* before the first keyframe */
+  check_lookup (demux, 500 * GST_MSECOND, 0, GST_CLOCK_TIME_NONE);
+  check_lookup (demux, 500 * GST_MSECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE, GST_CLOCK_TIME_NONE);
+  check_lookup (demux, 500 * GST_MSECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_AFTER, 1 * GST_SECOND);
+  check_lookup (demux, 500 * GST_MSECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_NEAREST, 1 * GST_SECOND);
+
+  /* keyframes further than INDEX_MAX_DISTANCE away aren't used */
+  check_lookup (demux, 12 * GST_SECOND, 0, 5 * GST_SECOND);
+  check_lookup (demux, 12 * GST_SECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_NEAREST, 5 * GST_SECOND);
+  check_lookup (demux, 16 * GST_SECOND, 0, GST_CLOCK_TIME_NONE);
+  check_lookup (demux, 16 * GST_SECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE, GST_CLOCK_TIME_NONE);
+  check_lookup (demux, 16 * GST_SECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_AFTER, 20 * GST_SECOND);
+  check_lookup (demux, 16 * GST_SECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_NEAREST, 20 * GST_SECOND);
+  check_lookup (demux, 40 * GST_SECOND,
+      GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_NEAREST, GST_CLOCK_TIME_NONE);
+
+  cleanup_demux (demux);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_index_invalid)
+{
+  GstTSDemux *demux;
+  gsize size;
+  guint8 *data;
+
+  data = make_index_data (G_N_ELEMENTS (entries), G_N_ELEMENTS (entries),
+      &size);
+
+  /* no file */
+  g_unlink (location);
+  demux = setup_demux ();
+  check_rejected (demux);
+  cleanup_demux (demux);
+
+  /* truncated in the header */
+  write_index (data, INDEX_FILE_HEADER_SIZE - 4);
+  demux = setup_demux ();
+  check_rejected (demux);
+  cleanup_demux (demux);
+
+  /* truncated in the entries */
+  write_index (data, size - INDEX_FILE_ENTRY_SIZE / 2);
+  demux = setup_demux ();
+  check_rejected (demux);
+  cleanup_demux (demux);
+
+  /* bad magic */
+  data[0] = 'X';
+  write_index (data, size);
+  demux = setup_demux ();
+  check_rejected (demux);
+  cleanup_demux (demux);
+  data[0] = INDEX_FILE_MAGIC[0];
+
+  /* unknown version */
+  GST_WRITE_UINT32_BE (data + 8, INDEX_FILE_VERSION + 1);
+  write_index (data, size);
+  demux = setup_demux ();
+  check_rejected (demux);
+  cleanup_demux (demux);
+  g_free (data);
+
+  /* more entries announced than present, or overflowing the size check */
+  data = make_index_data (G_N_ELEMENTS (entries) + 1, G_N_ELEMENTS (entries),
+      &size);
+  write_index (data, size);
+  demux = setup_demux ();
+  check_rejected (demux);
+  cleanup_demux (demux);
+  g_free (data);
+
+  data = make_index_data (G_MAXUINT32, G_N_ELEMENTS (entries), &size);
+  write_index (data, size);
+  demux = setup_demux ();
+  check_rejected (demux);
+  cleanup_demux (demux);
+  g_free (data);
+
+  data = make_index_data (G_N_ELEMENTS (entries), G_N_ELEMENTS (entries),
+      &size);
+  write_index (data, size);
+  g_free (data);
+
+  /* stale: the file changed size since the index was created */
+  demux = setup_demux ();
+  upstream_size = UPSTREAM_SIZE + 188;
+  check_rejected (demux);
+  cleanup_demux (demux);
+
+  /* another PID is being indexed already */
+  demux = setup_demux ();
+  demux->index_pid = INDEX_PID + 1;
+  check_rejected (demux);
+  cleanup_demux (demux);
+
+  /* and the valid file is still accepted */
+  demux = setup_demux ();
+  gst_ts_demux_load_index (demux);
+  check_entries (demux);
+  cleanup_demux (demux);
+}
+
+GST_END_TEST;
+
+static Suite *
+tsdemux_suite (void)
+{
+  Suite *s = suite_create ("tsdemux");
+  TCase *tc_chain = tcase_create ("index");
+
+  gst_mpegts_initialize ();
+  gst_mpegtsbase_plugin_init (NULL);
+  gst_ts_demux_plugin_init (NULL);
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_checked_fixture (tc_chain, setup, teardown);
+  tcase_add_test (tc_chain, test_index_round_trip);
+  tcase_add_test (tc_chain, test_index_lookup);
+  tcase_add_test (tc_chain, test_index_invalid);
+
+  return s;
+}
+
+GST_CHECK_MAIN (tsdemux);
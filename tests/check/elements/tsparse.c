@@ -0,0 +1,376 @@
+/* GStreamer
+ *
+ * unit test for tsparse
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/check/gstcheck.h>
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/mpegts"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/mpegts, systemstream = (boolean) true"));
+
+static GstPad *mysrcpad, *mysinkpad;
+
+/* Size of the chunks pushed into tsparse, deliberately not a multiple
+ * of any packet size */
+#define CHUNK_SIZE 4096
+
+static GstElement *
+setup_tsparse (void)
+{
+  GstElement *tsparse;
+
+  tsparse = gst_check_setup_element ("tsparse");
+  mysrcpad = gst_check_setup_src_pad (tsparse, &src_template);
+  mysinkpad = gst_check_setup_sink_pad (tsparse, &sink_template);
+  gst_pad_set_active (mysrcpad, TRUE);
+  gst_pad_set_active (mysinkpad, TRUE);
+
+  fail_unless (gst_element_set_state (tsparse, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  gst_check_setup_events (mysrcpad, tsparse, NULL, GST_FORMAT_BYTES);
+
+  return tsparse;
+}
+
+static void
+cleanup_tsparse (GstElement * tsparse)
+{
+  gst_check_drop_buffers ();
+  gst_element_set_state (tsparse, GST_STATE_NULL);
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_check_teardown_src_pad (tsparse);
+  gst_check_teardown_sink_pad (tsparse);
+  gst_check_teardown_element (tsparse);
+}
+
+/* Creates @n_packets null packets of @packet_size bytes, preceded by
+ * @garbage bytes of junk. Every @corrupt_interval packets (if non-zero),
+ * a packet loses its sync byte and gets some junk inserted after it, to
+ * force the packetizer to resync. */
+static guint8 *
+create_ts_data (guint packet_size, guint n_packets, guint garbage,
+    guint corrupt_interval, gsize * size)
+{
+  guint8 *data, *p;
+  guint sync_offset, i;
+
+  /* M2TS packets have a 4 byte timecode in front of the sync byte */
+  sync_offset = packet_size == 192 ? 4 : 0;
+
+  data = p = g_malloc (garbage + n_packets * (packet_size + 7));
+  memset (p, 0x00, garbage);
+  p += garbage;
+
+  for (i = 0; i < n_packets; i++) {
+    memset (p, 0xff, packet_size);
+    p[sync_offset] = 0x47;
+    p[sync_offset + 1] = 0x1f;
+    p[sync_offset + 2] = 0xff;
+    p[sync_offset + 3] = 0x10 | (i & 0x0f);
+    if (corrupt_interval && i % corrupt_interval == corrupt_interval - 1) {
+      p[sync_offset] = 0x46;
+      p += packet_size;
+      memset (p, 0x00, 7);
+      p += 7;
+    } else {
+      p += packet_size;
+    }
+  }
+
+  *size = p - data;
+
+  return data;
+}
+
+static void
+push_ts_data (GstBuffer * buffer)
+{
+  gsize offset, chunk, size;
+
+  size = gst_buffer_get_size (buffer);
+  for (offset = 0; offset < size; offset += chunk) {
+    chunk = MIN (CHUNK_SIZE, size - offset);
+    fail_unless_equals_int (gst_pad_push (mysrcpad,
+            gst_buffer_copy_region (buffer, GST_BUFFER_COPY_ALL, offset,
+                chunk)), GST_FLOW_OK);
+  }
+}
+
+static void
+check_packet_size (guint packet_size, guint garbage)
+{
+  GstElement *tsparse;
+  GstStructure *s;
+  GstBuffer *buffer;
+  GstCaps *caps;
+  guint8 *data;
+  gsize size;
+  gint val;
+
+  tsparse = setup_tsparse ();
+
+  data = create_ts_data (packet_size, 64, garbage, 0, &size);
+  buffer = gst_buffer_new_wrapped (data, size);
+  push_ts_data (buffer);
+  gst_buffer_unref (buffer);
+
+  caps = gst_pad_get_current_caps (mysinkpad);
+  fail_unless (caps != NULL);
+  s = gst_caps_get_structure (caps, 0);
+  fail_unless (gst_structure_get_int (s, "packetsize", &val));
+  fail_unless_equals_int (val, packet_size);
+  gst_caps_unref (caps);
+
+  cleanup_tsparse (tsparse);
+}
+
+GST_START_TEST (test_discover_packet_size)
+{
+  check_packet_size (188, 0);
+  check_packet_size (192, 0);
+  check_packet_size (204, 0);
+  check_packet_size (208, 0);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_discover_packet_size_after_garbage)
+{
+  check_packet_size (188, 1001);
+  check_packet_size (192, 37);
+  check_packet_size (204, 2050);
+  check_packet_size (208, 15);
+}
+
+GST_END_TEST;
+
+/* Benchmark: how fast tsparse gets through a stream that needs to be
+ * resynced every few packets */
+GST_START_TEST (test_resync_speed)
+{
+  GstElement *tsparse;
+  GstBuffer *buffer;
+  guint8 *data;
+  gsize size, total = 0;
+  gint64 start, elapsed;
+  guint i;
+
+  tsparse = setup_tsparse ();
+
+  data = create_ts_data (188, 8192, 0, 5, &size);
+  buffer = gst_buffer_new_wrapped (data, size);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < 16; i++) {
+    push_ts_data (buffer);
+    total += size;
+    gst_check_drop_buffers ();
+  }
+  elapsed = MAX (g_get_monotonic_time () - start, 1);
+  gst_buffer_unref (buffer);
+
+  GST_INFO ("tsparse resync: %" G_GSIZE_FORMAT " bytes in %" G_GINT64_FORMAT
+      " us, %.1f MB/s", total, elapsed, (gdouble) total / elapsed);
+
+  cleanup_tsparse (tsparse);
+}
+
+GST_END_TEST;
+
+#define N_SERVICES 40
+#define PMT_PID(i) (0x100 + (i))
+#define ES_PID(i, j) (0x200 + 2 * (i) + (j))
+
+static guint32
+calc_crc32 (const guint8 * data, guint len)
+{
+  guint32 crc = 0xffffffff;
+  guint i, j;
+
+  for (i = 0; i < len; i++) {
+    crc ^= (guint32) data[i] << 24;
+    for (j = 0; j < 8; j++)
+      crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+  }
+
+  return crc;
+}
+
+static guint8 *
+write_packet_header (guint8 * p, guint16 pid, gboolean pusi, guint8 cc)
+{
+  memset (p, 0xff, 188);
+  p[0] = 0x47;
+  p[1] = (pusi ? 0x40 : 0x00) | (pid >> 8);
+  p[2] = pid & 0xff;
+  p[3] = 0x10 | (cc & 0x0f);
+
+  return p + 4;
+}
+
+/* Writes the header of a packet carrying a single section and returns
+ * where the section starts */
+static guint8 *
+write_section_packet_header (guint8 * p, guint16 pid)
+{
+  guint8 *section;
+
+  section = write_packet_header (p, pid, TRUE, 0);
+  /* pointer_field */
+  *section++ = 0x00;
+
+  return section;
+}
+
+/* Fills in the header and CRC of a section whose body (following the
+ * 8 bytes of header) was already written */
+static void
+finish_section (guint8 * section, guint8 table_id, guint16 extension,
+    guint body_len)
+{
+  guint32 crc;
+
+  section[0] = table_id;
+  GST_WRITE_UINT16_BE (section + 1, 0xb000 | (5 + body_len + 4));
+  GST_WRITE_UINT16_BE (section + 3, extension);
+  section[5] = 0xc1;
+  section[6] = 0x00;
+  section[7] = 0x00;
+  crc = calc_crc32 (section, 8 + body_len);
+  GST_WRITE_UINT32_BE (section + 8 + body_len, crc);
+}
+
+/* Creates a stream carrying N_SERVICES programs with one video and one
+ * audio stream each, starting with a PAT and all PMTs */
+static guint8 *
+create_multi_service_data (guint n_rounds, gsize * size)
+{
+  guint8 *data, *p, *section, *body;
+  guint i, j, round;
+
+  *size = (1 + N_SERVICES + n_rounds * N_SERVICES * 2) * 188;
+  data = p = g_malloc (*size);
+
+  /* PAT */
+  section = write_section_packet_header (p, 0x0000);
+  body = section + 8;
+  for (i = 0; i < N_SERVICES; i++) {
+    GST_WRITE_UINT16_BE (body + 4 * i, i + 1);
+    GST_WRITE_UINT16_BE (body + 4 * i + 2, 0xe000 | PMT_PID (i));
+  }
+  finish_section (section, 0x00, 1, 4 * N_SERVICES);
+  p += 188;
+
+  /* PMTs */
+  for (i = 0; i < N_SERVICES; i++) {
+    section = write_section_packet_header (p, PMT_PID (i));
+    body = section + 8;
+    GST_WRITE_UINT16_BE (body, 0xe000 | ES_PID (i, 0));
+    GST_WRITE_UINT16_BE (body + 2, 0xf000);
+    for (j = 0; j < 2; j++) {
+      body[4 + 5 * j] = j == 0 ? 0x1b : 0x0f;
+      GST_WRITE_UINT16_BE (body + 5 + 5 * j, 0xe000 | ES_PID (i, j));
+      GST_WRITE_UINT16_BE (body + 7 + 5 * j, 0xf000);
+    }
+    finish_section (section, 0x02, i + 1, 4 + 2 * 5);
+    p += 188;
+  }
+
+  /* Elementary stream packets, interleaved */
+  for (round = 0; round < n_rounds; round++) {
+    for (i = 0; i < N_SERVICES; i++) {
+      for (j = 0; j < 2; j++) {
+        write_packet_header (p, ES_PID (i, j), FALSE, round);
+        p += 188;
+      }
+    }
+  }
+
+  return data;
+}
+
+/* Benchmark: packets per second tsparse dispatches on a stream with many
+ * services */
+GST_START_TEST (test_multi_service_speed)
+{
+  GstElement *tsparse;
+  GstBuffer *buffer;
+  guint8 *data;
+  gsize size;
+  guint64 n_packets = 0;
+  gint64 start, elapsed;
+  guint i;
+
+  tsparse = setup_tsparse ();
+
+  data = create_multi_service_data (1024, &size);
+  buffer = gst_buffer_new_wrapped (data, size);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < 8; i++) {
+    push_ts_data (buffer);
+    n_packets += size / 188;
+    gst_check_drop_buffers ();
+  }
+  elapsed = MAX (g_get_monotonic_time () - start, 1);
+  gst_buffer_unref (buffer);
+
+  GST_INFO ("tsparse, %d services: %" G_GUINT64_FORMAT " packets in %"
+      G_GINT64_FORMAT " us, %.0f packets/s", N_SERVICES, n_packets, elapsed,
+      (gdouble) n_packets * G_USEC_PER_SEC / elapsed);
+
+  cleanup_tsparse (tsparse);
+}
+
+GST_END_TEST;
+
+static Suite *
+tsparse_suite (void)
+{
+  Suite *s = suite_create ("tsparse");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_discover_packet_size);
+  tcase_add_test (tc_chain, test_discover_packet_size_after_garbage);
+
+  /* the benchmarks only run on request */
+  if (g_getenv ("GST_CHECK_BENCHMARKS")) {
+    tcase_add_test (tc_chain, test_resync_speed);
+    tcase_add_test (tc_chain, test_multi_service_speed);
+  }
+
+  return s;
+}
+
+GST_CHECK_MAIN (tsparse);
@@ -0,0 +1,302 @@
+/* GStreamer
+ *
+ * unit test for the download rate estimation and bitrate selection
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/check/gstcheck.h>
+#include <gst/uridownloader/gstdownloadrate.h>
+
+#define FRAGMENT_DURATION (2 * GST_SECOND)
+#define BUFFER_MAX (30 * GST_SECOND)
+#define SAFETY 0.8
+#define N_FRAGMENTS 300
+
+static const guint64 bitrates[] = { 500000, 1000000, 2000000, 4000000 };
+
+#define N_BITRATES G_N_ELEMENTS (bitrates)
+
+/* Adds a download of @bitrate bits per second lasting @seconds */
+static void
+add_rate (GstDownloadRate * rate, guint bitrate, guint seconds)
+{
+  gst_download_rate_add_rate (rate, bitrate / 8 * seconds,
+      seconds * GST_SECOND);
+}
+
+#define assert_rate_near(rate, expected) \
+  fail_unless (ABS ((gint64) (rate) - (gint64) (expected)) <= (expected) / 100, \
+      "rate %u, expected %u", (guint) (rate), (guint) (expected))
+
+GST_START_TEST (test_rate_estimates)
+{
+  GstDownloadRate rate;
+
+  gst_download_rate_init (&rate);
+  gst_download_rate_set_max_length (&rate, 5);
+
+  /* Nothing downloaded yet */
+  fail_unless_equals_int (gst_download_rate_get_estimate (&rate), G_MAXUINT);
+
+  /* With a constant rate, all the estimates agree */
+  add_rate (&rate, 1000000, 1);
+  add_rate (&rate, 1000000, 1);
+  add_rate (&rate, 1000000, 1);
+  assert_rate_near (gst_download_rate_get_current_rate (&rate), 1000000);
+  assert_rate_near (gst_download_rate_get_harmonic_rate (&rate), 1000000);
+  assert_rate_near (gst_download_rate_get_ewma_rate (&rate), 1000000);
+  assert_rate_near (gst_download_rate_get_estimate (&rate), 1000000);
+
+  /* The harmonic mean is less sensitive to fast downloads */
+  gst_download_rate_clear (&rate);
+  add_rate (&rate, 1000000, 1);
+  add_rate (&rate, 4000000, 1);
+  assert_rate_near (gst_download_rate_get_current_rate (&rate), 2500000);
+  assert_rate_near (gst_download_rate_get_harmonic_rate (&rate), 1600000);
+  fail_unless (gst_download_rate_get_estimate (&rate) <= 1600000);
+
+  gst_download_rate_deinit (&rate);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_ewma_follows_drops)
+{
+  GstDownloadRate rate;
+  guint i;
+
+  gst_download_rate_init (&rate);
+  gst_download_rate_set_max_length (&rate, 5);
+
+  for (i = 0; i < 10; i++)
+    add_rate (&rate, 4000000, 2);
+  assert_rate_near (gst_download_rate_get_ewma_rate (&rate), 4000000);
+
+  /* The fast average reacts to a drop before the mean of the history */
+  add_rate (&rate, 500000, 2);
+  fail_unless (gst_download_rate_get_ewma_rate (&rate) <
+      gst_download_rate_get_current_rate (&rate));
+  fail_unless (gst_download_rate_get_ewma_rate (&rate) < 2500000);
+
+  /* A short peak is not trusted right away */
+  gst_download_rate_clear (&rate);
+  for (i = 0; i < 10; i++)
+    add_rate (&rate, 1000000, 2);
+  add_rate (&rate, 8000000, 1);
+  fail_unless (gst_download_rate_get_ewma_rate (&rate) < 3000000);
+
+  gst_download_rate_deinit (&rate);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_choose_bitrate)
+{
+  GstDownloadRate rate;
+
+  gst_download_rate_init (&rate);
+  gst_download_rate_set_max_length (&rate, 5);
+
+  /* Nothing known yet, keep the current bitrate */
+  fail_unless_equals_uint64 (gst_download_rate_choose_bitrate (&rate,
+          bitrates, N_BITRATES, 1000000, 0, BUFFER_MAX, FRAGMENT_DURATION,
+          SAFETY), 1000000);
+
+  add_rate (&rate, 4500000, 2);
+  add_rate (&rate, 4500000, 2);
+
+  /* No buffer information, use the throughput with the safety margin */
+  fail_unless_equals_uint64 (gst_download_rate_choose_bitrate (&rate,
+          bitrates, N_BITRATES, 500000, GST_CLOCK_TIME_NONE, 0, 0, SAFETY),
+      2000000);
+
+  /* Low buffer, keep the safety margin */
+  fail_unless_equals_uint64 (gst_download_rate_choose_bitrate (&rate,
+          bitrates, N_BITRATES, 2000000, 4 * GST_SECOND, BUFFER_MAX,
+          FRAGMENT_DURATION, SAFETY), 2000000);
+
+  /* Almost full buffer, go one step higher into the margin */
+  fail_unless_equals_uint64 (gst_download_rate_choose_bitrate (&rate,
+          bitrates, N_BITRATES, 2000000, 28 * GST_SECOND, BUFFER_MAX,
+          FRAGMENT_DURATION, SAFETY), 4000000);
+
+  /* The throughput drops, the buffer allows keeping the bitrate for a
+   * while but not once it is low */
+  add_rate (&rate, 1500000, 2);
+  add_rate (&rate, 1500000, 2);
+  add_rate (&rate, 1500000, 2);
+  fail_unless_equals_uint64 (gst_download_rate_choose_bitrate (&rate,
+          bitrates, N_BITRATES, 4000000, 28 * GST_SECOND, BUFFER_MAX,
+          FRAGMENT_DURATION, SAFETY), 4000000);
+  fail_unless_equals_uint64 (gst_download_rate_choose_bitrate (&rate,
+          bitrates, N_BITRATES, 4000000, 4 * GST_SECOND, BUFFER_MAX,
+          FRAGMENT_DURATION, SAFETY), 1000000);
+
+  gst_download_rate_deinit (&rate);
+}
+
+GST_END_TEST;
+
+typedef struct
+{
+  guint switches;
+  GstClockTime rebuffering;
+  guint64 bitrate_sum;
+} TraceResult;
+
+/* Bandwidth available for each fragment: a random walk around @mean with
+ * short drops, from a fixed seed so that results are reproducible */
+static void
+make_trace (guint64 * trace, guint n, guint64 mean, guint32 seed)
+{
+  guint i;
+
+  for (i = 0; i < n; i++) {
+    seed = seed * 1103515245 + 12345;
+    trace[i] = mean / 2 + (guint64) mean * ((seed >> 16) % 1000) / 1000;
+    if (i % 40 >= 35)
+      trace[i] /= 4;
+  }
+}
+
+typedef enum
+{
+  SELECT_ENGINE,
+  /* what hlsdemux used to do */
+  SELECT_LAST_RATE,
+  /* what dashdemux and mssdemux used to do */
+  SELECT_MEAN_RATE
+} SelectMode;
+
+/* Simulates a player downloading fragments one after the other while
+ * playing them back, choosing the bitrate of each fragment with @mode */
+static void
+replay_trace (const guint64 * trace, guint n, SelectMode mode,
+    TraceResult * res)
+{
+  GstDownloadRate rate;
+  GstClockTime buffer = 0;
+  guint64 bitrate = bitrates[0], next;
+  guint i, j;
+
+  memset (res, 0, sizeof (TraceResult));
+  gst_download_rate_init (&rate);
+  gst_download_rate_set_max_length (&rate, 5);
+
+  for (i = 0; i < n; i++) {
+    guint bytes = bitrate / 8 * (FRAGMENT_DURATION / GST_SECOND);
+    GstClockTime time = gst_util_uint64_scale (bytes * 8, GST_SECOND,
+        trace[i]);
+
+    /* Playback goes on while downloading, stalls if the buffer runs out */
+    if (time > buffer) {
+      if (i > 0)
+        res->rebuffering += time - buffer;
+      buffer = 0;
+    } else {
+      buffer -= time;
+    }
+    buffer = MIN (buffer + FRAGMENT_DURATION, BUFFER_MAX);
+    res->bitrate_sum += bitrate;
+
+    gst_download_rate_add_rate (&rate, bytes, time);
+    if (mode == SELECT_ENGINE) {
+      next = gst_download_rate_choose_bitrate (&rate, bitrates, N_BITRATES,
+          bitrate, buffer, BUFFER_MAX, FRAGMENT_DURATION, SAFETY);
+    } else {
+      guint64 rate_limit;
+
+      if (mode == SELECT_LAST_RATE)
+        rate_limit = trace[i];
+      else
+        rate_limit = gst_download_rate_get_current_rate (&rate);
+
+      next = bitrates[0];
+      for (j = 0; j < N_BITRATES; j++) {
+        if (bitrates[j] <= rate_limit * SAFETY)
+          next = bitrates[j];
+      }
+    }
+
+    if (next != bitrate)
+      res->switches++;
+    bitrate = next;
+  }
+
+  gst_download_rate_deinit (&rate);
+}
+
+static void
+check_trace (guint64 mean, guint32 seed)
+{
+  guint64 trace[N_FRAGMENTS];
+  TraceResult engine, last_rate, mean_rate;
+
+  make_trace (trace, N_FRAGMENTS, mean, seed);
+  replay_trace (trace, N_FRAGMENTS, SELECT_ENGINE, &engine);
+  replay_trace (trace, N_FRAGMENTS, SELECT_LAST_RATE, &last_rate);
+  replay_trace (trace, N_FRAGMENTS, SELECT_MEAN_RATE, &mean_rate);
+
+  GST_INFO ("mean %" G_GUINT64_FORMAT ": switches %u / %u / %u, "
+      "rebuffering %" GST_TIME_FORMAT " / %" GST_TIME_FORMAT " / %"
+      GST_TIME_FORMAT ", average bitrate %" G_GUINT64_FORMAT " / %"
+      G_GUINT64_FORMAT " / %" G_GUINT64_FORMAT, mean, engine.switches,
+      last_rate.switches, mean_rate.switches,
+      GST_TIME_ARGS (engine.rebuffering), GST_TIME_ARGS (last_rate.rebuffering),
+      GST_TIME_ARGS (mean_rate.rebuffering), engine.bitrate_sum / N_FRAGMENTS,
+      last_rate.bitrate_sum / N_FRAGMENTS, mean_rate.bitrate_sum / N_FRAGMENTS);
+
+  /* Fewer switches and no more stalls than either of the old selections,
+   * without giving up much quality for it */
+  fail_unless (engine.switches < last_rate.switches / 2);
+  fail_unless (engine.switches <= mean_rate.switches);
+  fail_unless (engine.rebuffering <= last_rate.rebuffering);
+  fail_unless (engine.rebuffering <= mean_rate.rebuffering);
+  fail_unless (engine.bitrate_sum >= mean_rate.bitrate_sum * 85 / 100);
+}
+
+GST_START_TEST (test_trace_replay)
+{
+  check_trace (1500000, 1);
+  check_trace (3000000, 2);
+  check_trace (6000000, 3);
+}
+
+GST_END_TEST;
+
+static Suite *
+downloadrate_suite (void)
+{
+  Suite *s = suite_create ("downloadrate");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_rate_estimates);
+  tcase_add_test (tc_chain, test_ewma_follows_drops);
+  tcase_add_test (tc_chain, test_choose_bitrate);
+  tcase_add_test (tc_chain, test_trace_replay);
+
+  return s;
+}
+
+GST_CHECK_MAIN (downloadrate);
@@ -0,0 +1,435 @@
+/* GStreamer
+ *
+ * unit test for the start code scanner of the codec parsers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include <gst/check/gstcheck.h>
+#include <gst/base/gstbytereader.h>
+#include <gst/codecparsers/gstmpeg4parser.h>
+#include <gst/codecparsers/gstmpegvideoparser.h>
+#include <gst/codecparsers/gstvc1parser.h>
+#include <string.h>
+
+/* The scanner isn't exported by the library */
+#include "../../../gst-libs/gst/codecparsers/scanutils.c"
+
+#define MAX_SIZE 100
+
+/* How the parsers used to look for start codes */
+static gint
+masked_scan (const guint8 * data, guint size)
+{
+  GstByteReader br;
+
+  gst_byte_reader_init (&br, data, size);
+
+  return gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00, 0x00000100,
+      0, size);
+}
+
+/* Random data with many zeros and ones, so it is full of start codes,
+ * prefixes and near misses */
+static void
+fill_random (GRand * rand, guint8 * data, guint size)
+{
+  guint i;
+
+  for (i = 0; i < size; i++) {
+    switch (g_rand_int_range (rand, 0, 8)) {
+      case 0:
+      case 1:
+      case 2:
+      case 3:
+        data[i] = 0x00;
+        break;
+      case 4:
+        data[i] = 0x01;
+        break;
+      default:
+        data[i] = g_rand_int_range (rand, 0x02, 0x100);
+        break;
+    }
+  }
+}
+
+static void
+check_scan (const guint8 * data, guint size)
+{
+  gint expected = masked_scan (data, size);
+  gint found = scan_for_start_codes (data, size);
+
+  fail_unless (found == expected, "found %d instead of %d in %u bytes",
+      found, expected, size);
+}
+
+/* A start code at every position of buffers of every size up to a few
+ * SIMD blocks, including codes straddling 16 byte boundaries and codes
+ * followed by no byte or by a single one */
+GST_START_TEST (test_scan_positions)
+{
+  guint8 data[MAX_SIZE];
+  guint size, pos, filler;
+  static const guint8 fillers[] = { 0x00, 0x01, 0x02, 0x80, 0xff };
+
+  for (filler = 0; filler < G_N_ELEMENTS (fillers); filler++) {
+    for (size = 0; size < MAX_SIZE; size++) {
+      memset (data, fillers[filler], size);
+      check_scan (data, size);
+
+      for (pos = 0; pos + 3 <= size; pos++) {
+        memset (data, fillers[filler], size);
+        data[pos] = 0x00;
+        data[pos + 1] = 0x00;
+        data[pos + 2] = 0x01;
+        check_scan (data, size);
+        /* start code with the extra zero byte of 4 byte start codes */
+        if (pos > 0) {
+          data[pos - 1] = 0x00;
+          check_scan (data, size);
+        }
+      }
+    }
+  }
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_scan_four_byte_code)
+{
+  guint8 data[MAX_SIZE];
+  guint size, pos;
+
+  for (size = 4; size < MAX_SIZE; size++) {
+    for (pos = 0; pos + 4 <= size; pos++) {
+      memset (data, 0xff, size);
+      data[pos] = 0x00;
+      data[pos + 1] = 0x00;
+      data[pos + 2] = 0x00;
+      data[pos + 3] = 0x01;
+      check_scan (data, size);
+      if (pos + 5 <= size)
+        fail_unless_equals_int (scan_for_start_codes (data, size), pos + 1);
+    }
+  }
+}
+
+GST_END_TEST;
+
+/* Scans random data the way the parsers walk through a buffer, from every
+ * offset on, so unaligned starts are covered as well */
+GST_START_TEST (test_scan_random)
+{
+  GRand *rand = g_rand_new_with_seed (0x5ca9);
+  guint8 data[MAX_SIZE];
+  guint n, size, offset;
+
+  for (n = 0; n < 2000; n++) {
+    size = g_rand_int_range (rand, 0, MAX_SIZE);
+    fill_random (rand, data, size);
+    for (offset = 0; offset <= size; offset++)
+      check_scan (data + offset, size - offset);
+  }
+
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+/* gst_mpeg4_parse() without resync markers before the scanner was shared,
+ * returns the parse result and fills @packet */
+static GstMpeg4ParseResult
+old_mpeg4_parse (GstMpeg4Packet * packet, gboolean skip_user_data,
+    const guint8 * data, guint offset, gsize size)
+{
+  GstByteReader br;
+  gint off1, off2;
+
+  gst_byte_reader_init (&br, data, size);
+
+  if (size - offset <= 4)
+    return GST_MPEG4_PARSER_ERROR;
+
+  off1 = gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00, 0x00000100,
+      offset, size - offset);
+  if (off1 == -1)
+    return GST_MPEG4_PARSER_NO_PACKET;
+
+  if (skip_user_data && data[off1 + 3] == GST_MPEG4_USER_DATA)
+    return old_mpeg4_parse (packet, skip_user_data, data, off1 + 3, size);
+
+  packet->offset = off1 + 3;
+  packet->type = (GstMpeg4StartCode) (data[off1 + 3]);
+
+  off2 = -1;
+  if (off1 + 4 <= size)
+    off2 = gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00, 0x00000100,
+        off1 + 4, size - off1 - 4);
+  if (off2 == -1) {
+    packet->size = G_MAXUINT;
+    return GST_MPEG4_PARSER_NO_PACKET_END;
+  }
+
+  if (packet->type == GST_MPEG4_RESYNC)
+    packet->size = (gsize) off2 - off1;
+  else
+    packet->size = (gsize) off2 - off1 - 3;
+
+  return GST_MPEG4_PARSER_OK;
+}
+
+GST_START_TEST (test_scan_mpeg4)
+{
+  GRand *rand = g_rand_new_with_seed (0x4d34);
+  GstMpeg4Packet packet, expected;
+  GstMpeg4ParseResult res, expected_res;
+  guint8 data[MAX_SIZE];
+  guint n, size, offset, skip;
+
+  for (n = 0; n < 2000; n++) {
+    size = g_rand_int_range (rand, 5, MAX_SIZE);
+    fill_random (rand, data, size);
+    /* user data start codes, to go through the recursion */
+    if (size > 8 && g_rand_boolean (rand))
+      data[g_rand_int_range (rand, 3, size)] = GST_MPEG4_USER_DATA;
+
+    for (offset = 0; offset + 4 < size; offset++) {
+      for (skip = 0; skip < 2; skip++) {
+        memset (&packet, 0, sizeof (packet));
+        memset (&expected, 0, sizeof (expected));
+        expected_res = old_mpeg4_parse (&expected, skip, data, offset, size);
+        res = gst_mpeg4_parse (&packet, skip, NULL, data, offset, size);
+
+        fail_unless_equals_int (res, expected_res);
+        if (res == GST_MPEG4_PARSER_OK
+            || res == GST_MPEG4_PARSER_NO_PACKET_END) {
+          fail_unless_equals_int (packet.offset, expected.offset);
+          fail_unless_equals_int (packet.type, expected.type);
+          fail_unless_equals_uint64 (packet.size, expected.size);
+        }
+      }
+    }
+  }
+
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+/* The skipping loop the MPEG video parser had before the scanner was
+ * shared */
+static gint
+old_mpeg_video_scan (const guint8 * data, guint size)
+{
+  guint i = 0;
+
+  if (size < 4)
+    return -1;
+
+  while (i <= (size - 4)) {
+    if (data[i + 2] > 1) {
+      i += 3;
+    } else if (data[i + 1]) {
+      i += 2;
+    } else if (data[i] || data[i + 2] != 1) {
+      i++;
+    } else {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+GST_START_TEST (test_scan_mpeg_video)
+{
+  GRand *rand = g_rand_new_with_seed (0x3256);
+  GstMpegVideoPacket packet;
+  guint8 data[MAX_SIZE];
+  guint n, size, offset;
+  gint off, end;
+  gboolean res;
+
+  for (n = 0; n < 2000; n++) {
+    size = g_rand_int_range (rand, 1, MAX_SIZE);
+    fill_random (rand, data, size);
+
+    for (offset = 0; offset < size; offset++) {
+      memset (&packet, 0, sizeof (packet));
+      res = gst_mpeg_video_parse (&packet, data, size, offset);
+
+      off = old_mpeg_video_scan (data + offset, size - offset);
+      fail_unless_equals_int (res, off >= 0);
+      if (off < 0)
+        continue;
+
+      fail_unless_equals_int (packet.offset, offset + off + 4);
+      fail_unless_equals_int (packet.type, data[offset + off + 3]);
+      end = old_mpeg_video_scan (data + packet.offset, size - packet.offset);
+      fail_unless_equals_int (packet.size, end > 0 ? end : -1);
+    }
+  }
+
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_scan_vc1)
+{
+  GRand *rand = g_rand_new_with_seed (0x5643);
+  GstVC1BDU bdu;
+  GstVC1ParserResult res;
+  guint8 data[MAX_SIZE];
+  guint n, size, offset;
+  gint off1, off2;
+
+  for (n = 0; n < 2000; n++) {
+    size = g_rand_int_range (rand, 4, MAX_SIZE);
+    fill_random (rand, data, size);
+
+    for (offset = 0; offset + 4 <= size; offset++) {
+      const guint8 *d = data + offset;
+      guint s = size - offset;
+
+      memset (&bdu, 0, sizeof (bdu));
+      res = gst_vc1_identify_next_bdu (d, s, &bdu);
+
+      off1 = masked_scan (d, s);
+      if (off1 < 0) {
+        fail_unless_equals_int (res, GST_VC1_PARSER_NO_BDU);
+        continue;
+      }
+      fail_unless_equals_int (bdu.sc_offset, off1);
+      fail_unless_equals_int (bdu.offset, off1 + 4);
+      fail_unless_equals_int (bdu.type, d[off1 + 3]);
+      if (bdu.type == GST_VC1_END_OF_SEQ) {
+        fail_unless_equals_int (res, GST_VC1_PARSER_OK);
+        continue;
+      }
+
+      off2 = masked_scan (d + off1 + 4, s - off1 - 4);
+      if (off2 < 0) {
+        fail_unless_equals_int (res, GST_VC1_PARSER_NO_BDU_END);
+        continue;
+      }
+      if (off2 > 0 && d[off1 + 4 + off2 - 1] == 0x00)
+        off2--;
+      fail_unless_equals_int (res, GST_VC1_PARSER_OK);
+      fail_unless_equals_int (bdu.size, off2);
+    }
+  }
+
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+#define SCAN_STREAM_SIZE (64 * 1024 * 1024)
+
+/* Start codes every @distance bytes, the rest is the most expensive
+ * filler for the skipping loop */
+static guint8 *
+create_stream (guint distance, guint * n_codes)
+{
+  guint8 *data;
+  guint i;
+
+  data = g_malloc (SCAN_STREAM_SIZE);
+  for (i = 0; i < SCAN_STREAM_SIZE; i++)
+    data[i] = (i % 3) ? 0x00 : 0x80;
+
+  *n_codes = 0;
+  for (i = 0; i + distance <= SCAN_STREAM_SIZE; i += distance) {
+    data[i] = 0x00;
+    data[i + 1] = 0x00;
+    data[i + 2] = 0x01;
+    data[i + 3] = 0x65;
+    (*n_codes)++;
+  }
+
+  return data;
+}
+
+static void
+check_scan_speed (guint distance)
+{
+  guint8 *data;
+  guint n_codes, found;
+  gint offset, off;
+  gint64 start, masked_scan_time, scan_time;
+
+  data = create_stream (distance, &n_codes);
+
+  found = 0;
+  offset = 0;
+  start = g_get_monotonic_time ();
+  while ((off = masked_scan (data + offset, SCAN_STREAM_SIZE - offset)) >= 0) {
+    offset += off + 3;
+    found++;
+  }
+  masked_scan_time = MAX (g_get_monotonic_time () - start, 1);
+  fail_unless_equals_int (found, n_codes);
+
+  found = 0;
+  offset = 0;
+  start = g_get_monotonic_time ();
+  while ((off = scan_for_start_codes (data + offset,
+              SCAN_STREAM_SIZE - offset)) >= 0) {
+    offset += off + 3;
+    found++;
+  }
+  scan_time = MAX (g_get_monotonic_time () - start, 1);
+  fail_unless_equals_int (found, n_codes);
+
+  GST_INFO ("start codes every %u bytes: %.2f GB/s with the byte reader, "
+      "%.2f GB/s with the scanner", distance,
+      SCAN_STREAM_SIZE / (masked_scan_time * 1000.0),
+      SCAN_STREAM_SIZE / (scan_time * 1000.0));
+
+  g_free (data);
+}
+
+/* Benchmark, only run when GST_CHECK_BENCHMARKS is set */
+GST_START_TEST (test_scan_speed)
+{
+  check_scan_speed (64);
+  check_scan_speed (4096);
+  check_scan_speed (256 * 1024);
+}
+
+GST_END_TEST;
+
+static Suite *
+scanutils_suite (void)
+{
+  Suite *s = suite_create ("codecparsers start code scanner");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_scan_positions);
+  tcase_add_test (tc_chain, test_scan_four_byte_code);
+  tcase_add_test (tc_chain, test_scan_random);
+  tcase_add_test (tc_chain, test_scan_mpeg4);
+  tcase_add_test (tc_chain, test_scan_mpeg_video);
+  tcase_add_test (tc_chain, test_scan_vc1);
+  if (g_getenv ("GST_CHECK_BENCHMARKS"))
+    tcase_add_test (tc_chain, test_scan_speed);
+
+  return s;
+}
+
+GST_CHECK_MAIN (scanutils);
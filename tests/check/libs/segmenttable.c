@@ -0,0 +1,160 @@
+/* GStreamer
+ *
+ * unit test for the segment lookup table
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/uridownloader/gstsegmenttable.h>
+
+#define SEGMENT_DURATION (2 * GST_SECOND)
+
+GST_START_TEST (test_lookup)
+{
+  GstSegmentTable table;
+
+  gst_segment_table_init (&table);
+
+  /* Empty table */
+  fail_unless_equals_int (gst_segment_table_get_length (&table), 0);
+  fail_unless_equals_int (gst_segment_table_lookup (&table, 0), -1);
+
+  gst_segment_table_append (&table, 10);
+  gst_segment_table_append (&table, 20);
+  gst_segment_table_append (&table, 20);
+  gst_segment_table_append (&table, 35);
+  fail_unless_equals_int (gst_segment_table_get_length (&table), 4);
+
+  /* Before the first segment */
+  fail_unless_equals_int (gst_segment_table_lookup (&table, 9), -1);
+
+  /* Exact starts and positions inside segments */
+  fail_unless_equals_int (gst_segment_table_lookup (&table, 10), 0);
+  fail_unless_equals_int (gst_segment_table_lookup (&table, 19), 0);
+  fail_unless_equals_int (gst_segment_table_lookup (&table, 34), 2);
+  fail_unless_equals_int (gst_segment_table_lookup (&table, 35), 3);
+  fail_unless_equals_int (gst_segment_table_lookup (&table, G_MAXUINT64), 3);
+
+  /* Starts going backwards are raised, the table still has one entry per
+   * segment */
+  gst_segment_table_append (&table, 30);
+  fail_unless_equals_int (gst_segment_table_get_length (&table), 5);
+  fail_unless_equals_uint64 (gst_segment_table_get_start (&table, 4), 35);
+  fail_unless_equals_int (gst_segment_table_lookup (&table, 35), 4);
+
+  gst_segment_table_clear (&table);
+  fail_unless_equals_int (gst_segment_table_get_length (&table), 0);
+  fail_unless_equals_int (gst_segment_table_lookup (&table, 35), -1);
+
+  gst_segment_table_deinit (&table);
+}
+
+GST_END_TEST;
+
+/* What the demuxers used to do: walk the list until the next segment
+ * starts after the position */
+static gint
+linear_lookup (GList * segments, guint64 position)
+{
+  GList *iter;
+  gint idx = -1;
+
+  for (iter = segments; iter; iter = g_list_next (iter)) {
+    guint64 *start = iter->data;
+
+    if (*start > position)
+      break;
+    idx++;
+  }
+
+  return idx;
+}
+
+static void
+check_lookup_speed (guint n_segments)
+{
+  GstSegmentTable table;
+  GList *segments = NULL;
+  guint64 *starts;
+  gint64 start, linear_time, table_time;
+  guint i, n_seeks = 1000;
+  GstClockTime position;
+
+  gst_segment_table_init (&table);
+  starts = g_new (guint64, n_segments);
+  for (i = 0; i < n_segments; i++) {
+    starts[i] = i * SEGMENT_DURATION;
+    gst_segment_table_append (&table, starts[i]);
+    segments = g_list_prepend (segments, &starts[i]);
+  }
+  segments = g_list_reverse (segments);
+
+  /* seek to positions spread over the whole manifest */
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n_seeks; i++) {
+    position = (guint64) (i * 7919 % n_segments) * SEGMENT_DURATION + 1;
+    fail_unless_equals_int (linear_lookup (segments, position),
+        i * 7919 % n_segments);
+  }
+  linear_time = g_get_monotonic_time () - start;
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n_seeks; i++) {
+    position = (guint64) (i * 7919 % n_segments) * SEGMENT_DURATION + 1;
+    fail_unless_equals_int (gst_segment_table_lookup (&table, position),
+        i * 7919 % n_segments);
+  }
+  table_time = g_get_monotonic_time () - start;
+
+  GST_INFO ("%u segments: %u seeks in %" G_GINT64_FORMAT " us walking the "
+      "list, %" G_GINT64_FORMAT " us with the table", n_segments, n_seeks,
+      linear_time, table_time);
+
+  g_list_free (segments);
+  g_free (starts);
+  gst_segment_table_deinit (&table);
+}
+
+/* Benchmark of how the seek time grows with the manifest size */
+GST_START_TEST (test_lookup_speed)
+{
+  check_lookup_speed (1000);
+  check_lookup_speed (10000);
+  check_lookup_speed (100000);
+}
+
+GST_END_TEST;
+
+static Suite *
+segmenttable_suite (void)
+{
+  Suite *s = suite_create ("segmenttable");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_lookup);
+  if (g_getenv ("GST_CHECK_BENCHMARKS"))
+    tcase_add_test (tc_chain, test_lookup_speed);
+
+  return s;
+}
+
+GST_CHECK_MAIN (segmenttable);
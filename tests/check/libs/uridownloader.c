@@ -0,0 +1,231 @@
+/* GStreamer
+ *
+ * unit test for the URI downloader
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <gio/gio.h>
+#include <gst/check/gstcheck.h>
+#include <gst/uridownloader/gsturidownloader.h>
+
+#define FILE_A "the first file"
+#define FILE_B "the second file, with more data"
+
+/* A minimal HTTP/1.1 server keeping its connections alive, which counts
+ * the connections it accepted */
+static GSocketListener *listener;
+static GCancellable *cancellable;
+static GThread *accept_thread;
+static GMutex threads_lock;
+static GList *threads;
+static gint n_connections;
+static guint16 port;
+
+static const gchar *
+get_file (const gchar * path)
+{
+  if (strcmp (path, "/a") == 0)
+    return FILE_A;
+  if (strcmp (path, "/b") == 0)
+    return FILE_B;
+  return NULL;
+}
+
+static gchar *
+make_response (const gchar * header)
+{
+  gchar path[256];
+  const gchar *file, *range;
+  guint size, start, stop;
+
+  if (sscanf (header, "GET %255s ", path) != 1
+      || (file = get_file (path)) == NULL)
+    return g_strdup ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+
+  size = strlen (file);
+  range = strstr (header, "\r\nRange: bytes=");
+  if (range == NULL)
+    return g_strdup_printf ("HTTP/1.1 200 OK\r\nContent-Length: %u\r\n"
+        "Accept-Ranges: bytes\r\n\r\n%s", size, file);
+
+  stop = size - 1;
+  if (sscanf (range, "\r\nRange: bytes=%u-%u", &start, &stop) < 1
+      || start >= size)
+    return g_strdup ("HTTP/1.1 416 Requested Range Not Satisfiable\r\n"
+        "Content-Length: 0\r\n\r\n");
+  stop = MIN (stop, size - 1);
+
+  return g_strdup_printf ("HTTP/1.1 206 Partial Content\r\n"
+      "Content-Length: %u\r\nContent-Range: bytes %u-%u/%u\r\n"
+      "Accept-Ranges: bytes\r\n\r\n%.*s", stop - start + 1, start, stop,
+      size, (gint) (stop - start + 1), file + start);
+}
+
+static gpointer
+serve_connection (GSocketConnection * connection)
+{
+  GInputStream *in = g_io_stream_get_input_stream (G_IO_STREAM (connection));
+  GOutputStream *out =
+      g_io_stream_get_output_stream (G_IO_STREAM (connection));
+  GString *request = g_string_new (NULL);
+  gchar buf[1024];
+  gssize len;
+
+  while ((len = g_input_stream_read (in, buf, sizeof (buf), cancellable,
+              NULL)) > 0) {
+    gchar *end;
+
+    g_string_append_len (request, buf, len);
+    while ((end = strstr (request->str, "\r\n\r\n")) != NULL) {
+      gchar *header, *response;
+
+      header = g_strndup (request->str, end + 2 - request->str);
+      response = make_response (header);
+      g_output_stream_write_all (out, response, strlen (response), NULL,
+          cancellable, NULL);
+      g_free (response);
+      g_free (header);
+      g_string_erase (request, 0, end + 4 - request->str);
+    }
+  }
+
+  g_string_free (request, TRUE);
+  g_object_unref (connection);
+  return NULL;
+}
+
+static gpointer
+accept_connections (gpointer data)
+{
+  GSocketConnection *connection;
+
+  while ((connection = g_socket_listener_accept (listener, NULL,
+              cancellable, NULL)) != NULL) {
+    GThread *thread;
+
+    g_atomic_int_inc (&n_connections);
+    thread = g_thread_new ("connection", (GThreadFunc) serve_connection,
+        connection);
+    g_mutex_lock (&threads_lock);
+    threads = g_list_prepend (threads, thread);
+    g_mutex_unlock (&threads_lock);
+  }
+
+  return NULL;
+}
+
+static void
+start_server (void)
+{
+  GError *err = NULL;
+
+  listener = g_socket_listener_new ();
+  port = g_socket_listener_add_any_inet_port (listener, NULL, &err);
+  fail_unless (port != 0, "could not listen: %s", err ? err->message : "");
+  cancellable = g_cancellable_new ();
+  n_connections = 0;
+  accept_thread = g_thread_new ("accept", accept_connections, NULL);
+}
+
+static void
+stop_server (void)
+{
+  g_cancellable_cancel (cancellable);
+  g_thread_join (accept_thread);
+  g_list_free_full (threads, (GDestroyNotify) g_thread_join);
+  threads = NULL;
+  g_socket_listener_close (listener);
+  g_object_unref (listener);
+  g_object_unref (cancellable);
+}
+
+static void
+check_fetch (GstUriDownloader * downloader, const gchar * path,
+    gint64 range_start, const gchar * expected)
+{
+  GstFragment *fragment;
+  GstBuffer *buffer;
+  gchar *uri;
+
+  uri = g_strdup_printf ("http://127.0.0.1:%u%s", port, path);
+  fragment = gst_uri_downloader_fetch_uri_with_range (downloader, uri,
+      range_start, -1);
+  fail_unless (fragment != NULL, "could not fetch %s", uri);
+  g_free (uri);
+
+  buffer = gst_fragment_get_buffer (fragment);
+  fail_unless (buffer != NULL);
+  fail_unless_equals_int (gst_buffer_get_size (buffer), strlen (expected));
+  fail_unless (gst_buffer_memcmp (buffer, 0, expected, strlen (expected))
+      == 0);
+  gst_buffer_unref (buffer);
+  g_object_unref (fragment);
+}
+
+GST_START_TEST (test_connection_reuse)
+{
+  GstUriDownloader *downloader;
+
+  /* the server has to be reached directly */
+  g_unsetenv ("http_proxy");
+  g_setenv ("no_proxy", "127.0.0.1", TRUE);
+
+  start_server ();
+
+  downloader = gst_uri_downloader_new ();
+  check_fetch (downloader, "/a", 0, FILE_A);
+  check_fetch (downloader, "/b", 0, FILE_B);
+  /* a range of the same URI, then a different URI again */
+  check_fetch (downloader, "/b", 4, FILE_B + 4);
+  check_fetch (downloader, "/a", 0, FILE_A);
+  g_object_unref (downloader);
+
+  /* all the fetches went through the first connection */
+  fail_unless_equals_int (g_atomic_int_get (&n_connections), 1);
+
+  stop_server ();
+}
+
+GST_END_TEST;
+
+static Suite *
+uridownloader_suite (void)
+{
+  Suite *s = suite_create ("uridownloader");
+  TCase *tc_chain = tcase_create ("general");
+  GstElementFactory *factory;
+
+  suite_add_tcase (s, tc_chain);
+
+  /* the HTTP source is in gst-plugins-good */
+  factory = gst_element_factory_find ("souphttpsrc");
+  if (factory) {
+    tcase_add_test (tc_chain, test_connection_reuse);
+    gst_object_unref (factory);
+  }
+
+  return s;
+}
+
+GST_CHECK_MAIN (uridownloader);